@@ -2467,6 +2467,82 @@ JDWP "Java(tm) Debug Wire Protocol"
                                 "\"*.Foo\" or \"java.*\". "
                         )
                     )
+                    (Alt Prefetch=13
+                        "Asks for the state a debugger typically reads "
+                        "first when a thread stops to be sent along with "
+                        "the event. When a "
+                        "<a href=\"#JDWP_Event_Composite\">Composite</a> "
+                        "event command suspends threads and includes an "
+                        "event of a request with this modifier, a prefetch "
+                        "bundle for the event thread follows the last event "
+                        "of the command. The bundle holds: "
+                        "the thread object ID; "
+                        "the count of frames on the thread's stack (int); "
+                        "the number of frames that follow (int), each a "
+                        "frameID and its location, starting with the "
+                        "current frame; "
+                        "the tagged object ID of 'this' in the current "
+                        "frame, the null object if there is none; and the "
+                        "number of local variables that follow (int), each "
+                        "a slot (int) and its tagged value, for the "
+                        "variables visible at the location of the current "
+                        "frame whose values could be read. "
+                        "A debugger can thus detect the bundle from the "
+                        "length of the command. Where the state cannot be "
+                        "read the bundle is shortened, or left out, rather "
+                        "than the event being failed. "
+                        "This modifier does not filter events. It can be "
+                        "used with single step, breakpoint, exception, "
+                        "field access and modification, method entry and "
+                        "exit, and monitor events. "
+                        "This is a vendor extension."
+
+                        (int frames "Maximum number of frames in the "
+                                    "bundle. Must be positive.")
+                    )
+                    (Alt MethodOnly=14
+                        "Restricts reported events to those in the given "
+                        "method. Unlike a ClassMatch or ClassOnly "
+                        "modifier this lets the target VM avoid "
+                        "generating method entry and exit events for "
+                        "all other methods: entries are detected with a "
+                        "breakpoint at the start of the method, and exits "
+                        "by watching the frames so entered. As a "
+                        "consequence exits of activations which were "
+                        "already running when the request was made may "
+                        "not be reported. "
+                        "This modifier can be used with method entry and "
+                        "method exit event kinds only. "
+                        "This is a vendor extension."
+
+                        (referenceType declaring "Class or interface "
+                                                 "declaring the method.")
+                        (method methodID "The method.")
+                    )
+                    (Alt Snapshot=15
+                        "Turns a breakpoint request into a snapshot point. "
+                        "Instead of reporting an event, the thread which "
+                        "hits the breakpoint records the locations of its "
+                        "topmost frames and the values of the local "
+                        "variables visible in them, and continues. The "
+                        "snapshots are kept by the target VM until "
+                        "<a href=\"#JDWP_Vendor_SnapshotDrain\">SnapshotDrain</a> "
+                        "fetches them; when more than the given capacity "
+                        "accumulate, the oldest are dropped. "
+                        "Frames below the current one are only recorded "
+                        "while the encoded size of the snapshot stays "
+                        "within the given budget. "
+                        "This modifier can be used with breakpoint event "
+                        "kinds and suspend policy NONE only. "
+                        "This is a vendor extension."
+
+                        (int frames "Maximum number of frames in a "
+                                    "snapshot. Must be positive.")
+                        (int maxBytes "Size budget of a snapshot in bytes. "
+                                      "Must be positive.")
+                        (int capacity "Maximum number of snapshots kept. "
+                                      "Must be positive.")
+                    )
 
                 )
             )
@@ -3049,6 +3125,652 @@ JDWP "Java(tm) Debug Wire Protocol"
         )
     )
 )
+(CommandSet Vendor=-56
+    "Agent specific extension commands. These are not part of the JDWP "
+    "specification and are only understood by this back-end. Note that this "
+    "is equivalent to the uint8_t value '200'."
+    (Command MonitorContentionStart=1
+        "Starts aggregating monitor contention in the target VM. While active, "
+        "the back-end measures the time each thread spends blocked on monitor "
+        "entry (and optionally in Object.wait) and aggregates the durations "
+        "per monitor class and call site in per-thread buffers. "
+        "No events are reported and no threads are suspended. "
+        "Starting an already started profile only updates <code>includeWaits</code>. "
+        "Requires canRequestMonitorEvents capability - see "
+        "<a href=\"#JDWP_VirtualMachine_CapabilitiesNew\">CapabilitiesNew</a>."
+        (Out
+            (boolean includeWaits "Also record time spent in Object.wait.")
+        )
+        (Reply "none"
+        )
+        (ErrorSet
+            (Error NOT_IMPLEMENTED "The target VM cannot generate monitor events.")
+            (Error VM_DEAD)
+        )
+    )
+    (Command MonitorContentionStop=2
+        "Stops aggregating monitor contention. Data collected so far is kept "
+        "until it is cleared by "
+        "<a href=\"#JDWP_Vendor_MonitorContentionHistogram\">MonitorContentionHistogram</a> "
+        "or the debugger disconnects."
+        (Out
+        )
+        (Reply "none"
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command MonitorContentionHistogram=3
+        "Returns the aggregated monitor contention sites, ordered by total "
+        "blocked time, longest first."
+        (Out
+            (int maxSites "Maximum number of sites to return, or -1 for all sites.")
+            (boolean clear "Discard the aggregated data after it has been returned.")
+        )
+        (Reply
+            (long dropped "Number of samples which were not recorded because "
+                          "a per-thread buffer was full.")
+            (Repeat sites "Number of sites returned"
+                (Group Site
+                    (byte kind "1 for contended monitor entry, 2 for Object.wait.")
+                    (byte refTypeTag "Kind of the monitor's reference type. "
+                                     "See <a href=\"#JDWP_TypeTag\">JDWP.TypeTag</a>")
+                    (referenceTypeID monitorType "Class of the contended monitor object.")
+                    (location callSite "Location at which the thread blocked.")
+                    (long count "Number of times a thread blocked here.")
+                    (long totalNanos "Total time blocked, in nanoseconds.")
+                    (long maxNanos "Longest single time blocked, in nanoseconds.")
+                )
+            )
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command AllThreadInfo=4
+        "Returns the live threads in the target VM together with the "
+        "information a debugger needs to display them, equivalent to "
+        "<a href=\"#JDWP_VirtualMachine_AllThreads\">AllThreads</a> "
+        "followed by Name, Status, SuspendCount and ThreadGroup for every "
+        "thread. Names and groups are cached by the back-end when a thread "
+        "starts and only looked up again when the thread's name has changed. "
+        "Threads which have not yet started or have completed are not included."
+        (Out
+        )
+        (Reply
+            (Repeat threads "Number of threads that follow."
+                (Group ThreadInfo
+                    (threadObject thread "A running thread.")
+                    (string name "The thread name.")
+                    (int threadStatus "One of the thread status codes "
+                                      "See <a href=\"#JDWP_ThreadStatus\">JDWP.ThreadStatus</a>")
+                    (int suspendStatus "One of the suspend status codes "
+                                       "See <a href=\"#JDWP_SuspendStatus\">JDWP.SuspendStatus</a>")
+                    (int suspendCount "The number of outstanding debugger suspends.")
+                    (threadGroupObject group "The thread group of the thread.")
+                )
+            )
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command TransportStats=5
+        "Returns the traffic counters of the transport, accumulated over all "
+        "connections since the back-end was loaded."
+        (Out
+        )
+        (Reply
+            (long bytesSent "Bytes sent, including handshakes.")
+            (long bytesReceived "Bytes received, including handshakes.")
+            (long packetsSent "Packets sent.")
+            (long packetsReceived "Packets received.")
+            (long sendCalls "Send system calls made.")
+            (long recvCalls "Receive system calls made.")
+            (long flushes "Batches of packets sent with a single send.")
+            (long sendBufferSize "Send buffer size of the current "
+                                 "connection in bytes, as reported by the "
+                                 "system, or -1 if not known. Set with the "
+                                 "agent's socketbuffer option.")
+            (long receiveBufferSize "Receive buffer size of the current "
+                                    "connection in bytes, or -1 if not known.")
+        )
+        (ErrorSet
+            (Error NOT_IMPLEMENTED "The transport does not keep traffic counters.")
+            (Error VM_DEAD)
+        )
+    )
+    (Command LocationsOfLine=6
+        "Returns the locations in the methods of a reference type at which "
+        "code for the given source line begins, in the Java stratum. This "
+        "is the result of "
+        "<a href=\"#JDWP_Method_LineTable\">LineTable</a> for every "
+        "non-abstract, non-native method of the type, filtered by line number, "
+        "computed by the back-end in a single request. Where several "
+        "consecutive line table entries start at the same code index only the "
+        "last of them is considered."
+        (Out
+            (referenceType refType "The reference type.")
+            (int line "The source line number.")
+        )
+        (Reply
+            (Repeat locations "Number of locations that follow."
+                (Group LineLocation
+                    (method methodID "A method of the type.")
+                    (long lineCodeIndex "Initial code index of the line.")
+                )
+            )
+            (boolean absentInformation "True if none of the non-abstract, "
+                                       "non-native methods of the type has "
+                                       "line number information and at least "
+                                       "one of them lacks it.")
+        )
+        (ErrorSet
+            (Error INVALID_CLASS     "refType is not the ID of a reference "
+                                     "type.")
+            (Error INVALID_OBJECT    "refType is not a known ID.")
+            (Error CLASS_NOT_PREPARED)
+            (Error VM_DEAD)
+        )
+    )
+    (Command EventCredits=7
+        "Grants the back-end credits for sending "
+        "<a href=\"#JDWP_Event_Composite\">Composite</a> event commands. "
+        "Until this command is first sent, and again after the debugger "
+        "reconnects, the number of event commands is not limited. Once "
+        "credits have been granted, each event command sent uses up one "
+        "credit and, when none are left, further events are queued in the "
+        "back-end, as with "
+        "<a href=\"#JDWP_VirtualMachine_HoldEvents\">HoldEvents</a>, until "
+        "more credits are granted. Unlike HoldEvents this lets a debugger "
+        "bound the number of event commands in flight instead of switching "
+        "the flow on and off."
+        (Out
+            (int credits "Number of further event commands the back-end may "
+                         "send. A negative number removes the limit.")
+        )
+        (Reply "none"
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command ThreadSnapshot=8
+        "Returns the state of a suspended thread that is otherwise obtained "
+        "with the ThreadReference "
+        "<a href=\"#JDWP_ThreadReference_Status\">Status</a>, "
+        "<a href=\"#JDWP_ThreadReference_FrameCount\">FrameCount</a> and "
+        "<a href=\"#JDWP_ThreadReference_Frames\">Frames</a> commands, "
+        "in a single request. The frames returned are the topmost ones, "
+        "starting with the current frame. The thread must be suspended."
+        (Out
+            (threadObject thread "The thread object ID. ")
+            (int maxFrames "The maximum number of frames to retrieve, "
+                           "or -1 to retrieve all frames.")
+        )
+        (Reply
+            (int threadStatus "One of the thread status codes. "
+                              "See <a href=\"#JDWP_ThreadStatus\">JDWP.ThreadStatus</a>")
+            (int suspendStatus "One of the suspend status codes. "
+                               "See <a href=\"#JDWP_SuspendStatus\">JDWP.SuspendStatus</a>")
+            (int frameCount "The count of frames on this thread's stack. ")
+            (Repeat frames "The number of frames retrieved"
+                (Group Frame
+                    (frame frameID "The ID of this frame. ")
+                    (location location "The current location of this frame")
+                )
+            )
+        )
+        (ErrorSet
+            (Error INVALID_THREAD)
+            (Error INVALID_OBJECT    "thread is not a known ID.")
+            (Error THREAD_NOT_SUSPENDED)
+            (Error VM_DEAD)
+        )
+    )
+    (Command ClassesChangedSince=9
+        "Returns the changes to the set of loaded reference types since "
+        "an earlier reply to this command. The reply carries a class-set "
+        "generation number; passing it back in a later request returns "
+        "only the reference types prepared and the signatures of those "
+        "unloaded since. If the generation is 0, too old for the target "
+        "VM to still know which classes were unloaded since, or was not "
+        "issued by this target VM, delta is false and all loaded reference "
+        "types are returned as by "
+        "<a href=\"#JDWP_VirtualMachine_AllClassesWithGeneric\">AllClassesWithGeneric</a>. "
+        "Class unloads which the back-end has not processed yet are "
+        "processed first, so they are part of this reply; their "
+        "ClassUnload events are generated as usual. "
+        "<p>"
+        "This command is only provided for debuggers which talk JDWP "
+        "directly and keep their own class set; the JDI implementation "
+        "does not use it."
+        (Out
+            (long generation "A generation from an earlier reply, or 0.")
+        )
+        (Reply
+            (long generation "The current class-set generation.")
+            (boolean delta "True if the lists below are the changes since the "
+                           "requested generation, false if classes holds "
+                           "all loaded reference types.")
+            (Repeat classes "Number of reference types that follow."
+                (Group ClassInfo
+                    (byte refTypeTag  "<a href=\"#JDWP_TypeTag\">Kind</a> "
+                                      "of following reference type. ")
+                    (referenceTypeID typeID "Loaded reference type")
+                    (string signature
+                                "The JNI signature of the loaded reference type.")
+                    (string genericSignature
+                                "The generic signature of the loaded reference type "
+                                "or an empty string if there is none.")
+                    (int status "The current class "
+                                "<a href=\"#JDWP_ClassStatus\">status.</a> ")
+                )
+            )
+            (Repeat unloaded "Number of unloaded class signatures that follow."
+                (string signature "The JNI signature of an unloaded reference type.")
+            )
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command BytecodeRange=10
+        "Like the Method "
+        "<a href=\"#JDWP_Method_Bytecodes\">Bytecodes</a> command, but also "
+        "returns a hash of the method's bytecodes and their total length, "
+        "and only the requested range of bytes. A length of 0 returns just "
+        "the hash and total length. "
+        "The hash is the 64-bit FNV-1a hash of all the bytecodes, so a "
+        "debugger can keep bytecodes it has seen before and only fetch them "
+        "again when the hash changes. "
+        "Requires canGetBytecodes capability - see "
+        "<a href=\"#JDWP_VirtualMachine_CapabilitiesNew\">CapabilitiesNew</a>."
+        (Out
+            (referenceType refType "The class.")
+            (method methodID "The method.")
+            (int offset "Index of the first byte to return. "
+                        "Must be between 0 and the total length.")
+            (int length "The maximum number of bytes to return, "
+                        "or -1 to return all bytes from offset on.")
+        )
+        (Reply
+            (long hash "The content hash of all the bytecodes.")
+            (int totalLength "The total number of bytecodes.")
+            (Repeat bytes
+                (byte bytecode "A Java bytecode.")
+            )
+        )
+        (ErrorSet
+            (Error INVALID_CLASS     "refType is not the ID of a reference "
+                                     "type.")
+            (Error INVALID_OBJECT    "refType is not a known ID.")
+            (Error INVALID_METHODID  "methodID is not the ID of a method.")
+            (Error ILLEGAL_ARGUMENT  "offset is out of range.")
+            (Error NOT_IMPLEMENTED   "If the target virtual machine does not "
+                                     "support the retrieval of bytecodes.")
+            (Error VM_DEAD)
+        )
+    )
+    (Command ConstantPoolRange=11
+        "Like the ReferenceType "
+        "<a href=\"#JDWP_ReferenceType_ConstantPool\">ConstantPool</a> command, "
+        "but also returns a hash of the constant pool bytes and their total "
+        "length, and only the requested range of bytes, as for "
+        "<a href=\"#JDWP_Vendor_BytecodeRange\">BytecodeRange</a>. "
+        "Requires canGetConstantPool capability - see "
+        "<a href=\"#JDWP_VirtualMachine_CapabilitiesNew\">CapabilitiesNew</a>."
+        (Out
+            (referenceType refType "The class.")
+            (int offset "Index of the first byte to return. "
+                        "Must be between 0 and the total length.")
+            (int length "The maximum number of bytes to return, "
+                        "or -1 to return all bytes from offset on.")
+        )
+        (Reply
+            (int count "Total number of constant pool entries plus one.")
+            (long hash "The content hash of all the constant pool bytes.")
+            (int totalLength "The total number of constant pool bytes.")
+            (Repeat bytes
+                (byte cpbytes "Raw bytes of constant pool")
+            )
+        )
+        (ErrorSet
+            (Error INVALID_CLASS     "refType is not the ID of a reference "
+                                     "type.")
+            (Error INVALID_OBJECT    "refType is not a known ID.")
+            (Error ILLEGAL_ARGUMENT  "offset is out of range.")
+            (Error NOT_IMPLEMENTED   "If the target virtual machine does not "
+                                     "support the retrieval of constant pool information.")
+            (Error ABSENT_INFORMATION "The Constant Pool information is "
+                                      "absent for primitive and array types.")
+            (Error VM_DEAD)
+        )
+    )
+
+    (Command ClassMetadataKey=12
+        "Returns the content hash and length of the metadata blob of a "
+        "reference type, together with the IDs of the fields and methods "
+        "it describes. The blob, retrieved with "
+        "<a href=\"#JDWP_Vendor_ClassMetadata\">ClassMetadata</a>, holds "
+        "the source file name, source debug extension, fields, methods and "
+        "the line and variable tables of the methods, but no IDs. "
+        "A debugger can therefore keep blobs across sessions, keyed by their "
+        "hash, and pair a cached blob with the IDs returned here."
+        (Out
+            (referenceType refType "The reference type ID.")
+        )
+        (Reply
+            (long hash "The 64-bit FNV-1a hash of the metadata blob.")
+            (int totalLength "The length of the metadata blob.")
+            (Repeat fields "The fields in the order the blob describes them."
+                (field fieldID "Field ID.")
+            )
+            (Repeat methods "The methods in the order the blob describes them."
+                (method methodID "Method ID.")
+            )
+        )
+        (ErrorSet
+            (Error INVALID_CLASS     "refType is not the ID of a reference "
+                                     "type.")
+            (Error INVALID_OBJECT    "refType is not a known ID.")
+            (Error CLASS_NOT_PREPARED)
+            (Error VM_DEAD)
+        )
+    )
+    (Command ClassMetadata=13
+        "Returns a range of the metadata blob of a reference type, as for "
+        "<a href=\"#JDWP_Vendor_BytecodeRange\">BytecodeRange</a>. "
+        "All values in the blob are encoded as in JDWP packets. "
+        "It starts with an int format version, currently 1, followed by the "
+        "source file name and the source debug extension, each preceded by "
+        "a state byte. The fields follow as an int count and, for each field, "
+        "the name, signature, generic signature and modifier bits as in "
+        "<a href=\"#JDWP_ReferenceType_FieldsWithGeneric\">FieldsWithGeneric</a>. "
+        "The methods follow likewise as in "
+        "<a href=\"#JDWP_ReferenceType_MethodsWithGeneric\">MethodsWithGeneric</a>, "
+        "each followed by its line table as in "
+        "<a href=\"#JDWP_Method_LineTable\">LineTable</a> and its variable "
+        "table as in "
+        "<a href=\"#JDWP_Method_VariableTableWithGeneric\">VariableTableWithGeneric</a>, "
+        "again each preceded by a state byte. "
+        "A state byte of 1 means the item follows, 0 that the target VM "
+        "reports the information as absent and 2 that the item is not "
+        "included and must be retrieved with the regular command."
+        (Out
+            (referenceType refType "The reference type ID.")
+            (int offset "Index of the first byte to return. "
+                        "Must be between 0 and the total length.")
+            (int length "The maximum number of bytes to return, "
+                        "or -1 to return all bytes from offset on.")
+        )
+        (Reply
+            (long hash "The 64-bit FNV-1a hash of the metadata blob.")
+            (int totalLength "The length of the metadata blob.")
+            (Repeat bytes
+                (byte metadata "Metadata blob byte.")
+            )
+        )
+        (ErrorSet
+            (Error INVALID_CLASS     "refType is not the ID of a reference "
+                                     "type.")
+            (Error INVALID_OBJECT    "refType is not a known ID.")
+            (Error CLASS_NOT_PREPARED)
+            (Error ILLEGAL_ARGUMENT  "offset is out of range.")
+            (Error VM_DEAD)
+        )
+    )
+    (Command CpuSamplingStart=14
+        "Starts sampling the stacks of application threads, or changes the "
+        "sampling parameters if sampling is already active. An agent thread "
+        "takes the stacks of all threads every sampling interval without "
+        "suspending them, and merges those of runnable threads which are "
+        "neither suspended nor in native code into a call tree held by the "
+        "back-end. Sampling continues until "
+        "<a href=\"#JDWP_Vendor_CpuSamplingStop\">CpuSamplingStop</a> "
+        "or the debugger disconnects."
+        (Out
+            (int intervalMillis "Time between samples, in milliseconds. "
+                                "Must be positive.")
+            (int maxDepth "Maximum number of frames sampled per stack, "
+                          "from the current frame. Between 1 and 1024.")
+        )
+        (Reply "none"
+        )
+        (ErrorSet
+            (Error ILLEGAL_ARGUMENT  "intervalMillis or maxDepth is out "
+                                     "of range.")
+            (Error VM_DEAD)
+        )
+    )
+    (Command CpuSamplingStop=15
+        "Stops sampling. The samples taken so far are kept until they are "
+        "returned by <a href=\"#JDWP_Vendor_CpuSamplingStacks\">CpuSamplingStacks</a> "
+        "with clear set or the debugger disconnects."
+        (Out
+        )
+        (Reply "none"
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command CpuSamplingStacks=16
+        "Returns the samples taken so far as collapsed stacks: every "
+        "distinct sampled stack once, with the number of samples in which "
+        "it was found."
+        (Out
+            (boolean clear "Discard the samples after they have been returned.")
+        )
+        (Reply
+            (long samples "Number of samples recorded.")
+            (long dropped "Number of samples which were not recorded because "
+                          "the call tree was full or a class was unloaded.")
+            (Repeat stacks "Number of distinct stacks."
+                (Group Stack
+                    (long count "Number of samples of this stack.")
+                    (Repeat frames "Number of frames, the outermost first "
+                                   "and the current frame last."
+                        (location frame "The location executing in the frame.")
+                    )
+                )
+            )
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command CoverageStart=17
+        "Starts collecting line coverage of the classes whose names match "
+        "one of the given patterns. Every line of a matching class gets "
+        "a breakpoint which records that the line was reached and then "
+        "removes itself, so code which has run once is no longer slowed "
+        "down. Classes which are already prepared are instrumented right "
+        "away, others when they are prepared. In lazy mode only the first "
+        "line of each method gets its breakpoint up front; the other lines "
+        "of the method get theirs when the method is first entered. "
+        "Coverage breakpoints do not generate events, and breakpoint "
+        "requests at the same locations work as before. "
+        "<p>"
+        "Starting again replaces the patterns; coverage collected so far "
+        "is kept. Redefining a class ends the coverage of its lines which "
+        "have not been reached yet. Coverage stops when the debugger "
+        "disconnects."
+        (Out
+            (boolean lazy "Set the breakpoints of a method only when it "
+                          "is first entered.")
+            (Repeat classPatterns "Number of class patterns."
+                (string classPattern "A class name pattern as used by "
+                                     "the ClassMatch event modifier.")
+            )
+        )
+        (Reply "none"
+        )
+        (ErrorSet
+            (Error ILLEGAL_ARGUMENT)
+            (Error VM_DEAD)
+        )
+    )
+    (Command CoverageStop=18
+        "Removes the coverage breakpoints which are still set and stops "
+        "instrumenting classes. The bitmaps are kept until they are "
+        "returned by <a href=\"#JDWP_Vendor_CoverageBitmaps\">CoverageBitmaps</a> "
+        "with clear set or the debugger disconnects."
+        (Out
+        )
+        (Reply "none"
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command CoverageBitmaps=19
+        "Returns the lines of every instrumented class together with a "
+        "bitmap of the lines which were reached. Bit i, the bit "
+        "(i mod 8) of byte (i / 8) counting from the least significant "
+        "bit, is set if the i-th line was reached. "
+        "<p>"
+        "With clear set and coverage active, all lines of the returned "
+        "classes count as not reached again and get their breakpoints "
+        "back. With clear set and coverage stopped, the bitmaps are "
+        "discarded. "
+        "<p>"
+        "Coverage does not keep classes loaded. The coverage of a class "
+        "which has been unloaded is discarded and not returned."
+        (Out
+            (boolean clear "Start over after the bitmaps have been returned.")
+        )
+        (Reply
+            (Repeat classes "Number of instrumented classes."
+                (Group ClassCoverage
+                    (byte refTypeTag  "<a href=\"#JDWP_TypeTag\">Kind</a> "
+                                      "of following reference type. ")
+                    (referenceTypeID typeID "The instrumented class.")
+                    (Repeat lines "Number of distinct lines of the class."
+                        (int line "A line number, in ascending order.")
+                    )
+                    (Repeat bitmap "Number of bitmap bytes, (lines + 7) / 8."
+                        (byte bits "Eight bits of the bitmap.")
+                    )
+                )
+            )
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command SnapshotDrain=20
+        "Returns the oldest snapshots recorded by a breakpoint request "
+        "with the Snapshot modifier, and removes them from the target VM. "
+        "The object IDs in a snapshot count as sent by this reply."
+        (Out
+            (int requestID "ID of the breakpoint request.")
+            (int maxSnapshots "Maximum number of snapshots to return, "
+                              "all if not positive.")
+        )
+        (Reply
+            (long dropped "Number of snapshots dropped since the last drain, "
+                          "because the ring was full or they could not "
+                          "be recorded.")
+            (Repeat snapshots "Number of snapshots, the oldest first."
+                (Group Snapshot
+                    (threadObject thread "The thread which hit the breakpoint.")
+                    (long nanos "Time the snapshot was taken, in nanoseconds "
+                                "since an arbitrary origin.")
+                    (Repeat frames "Number of frames recorded, starting with "
+                                   "the current frame."
+                        (Group SnapshotFrame
+                            (location location "The location executing in "
+                                               "the frame.")
+                            (Repeat locals "Number of local variables which "
+                                           "were visible and could be read."
+                                (Group SnapshotLocal
+                                    (int slot "The local variable's index "
+                                              "in the frame.")
+                                    (value value "The variable's value.")
+                                )
+                            )
+                        )
+                    )
+                )
+            )
+        )
+        (ErrorSet
+            (Error ILLEGAL_ARGUMENT "There is no breakpoint request with "
+                                    "the Snapshot modifier with this ID.")
+            (Error VM_DEAD)
+        )
+    )
+    (Command AllocationTrackingStart=21
+        "Starts sampling object allocations, or changes the sampling "
+        "parameters if sampling is already active. The back-end is notified "
+        "of every allocation, counts them and samples every interval-th one: "
+        "the sample is added to the site of the allocated class and the "
+        "top frames of the allocating thread, which counts the samples and "
+        "their bytes. Allocations by the back-end's own threads are not "
+        "sampled. Sampling continues until "
+        "<a href=\"#JDWP_Vendor_AllocationTrackingStop\">AllocationTrackingStop</a> "
+        "or the debugger disconnects."
+        (Out
+            (int interval "Sample every interval-th allocation. Must be positive.")
+            (int maxDepth "Maximum number of frames of an allocation site, "
+                          "from the current frame. Between 1 and 16.")
+        )
+        (Reply "none"
+        )
+        (ErrorSet
+            (Error ILLEGAL_ARGUMENT  "interval or maxDepth is out of range.")
+            (Error NOT_IMPLEMENTED   "The target VM cannot report allocations.")
+            (Error VM_DEAD)
+        )
+    )
+    (Command AllocationTrackingStop=22
+        "Stops sampling allocations. The sites recorded so far are kept until "
+        "they are returned by "
+        "<a href=\"#JDWP_Vendor_AllocationSites\">AllocationSites</a> "
+        "with clear set or the debugger disconnects."
+        (Out
+        )
+        (Reply "none"
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+    (Command AllocationSites=23
+        "Returns the sampled allocation sites, ordered by sampled bytes, "
+        "most first. Multiplying the counts by the interval estimates the "
+        "allocations made."
+        (Out
+            (int maxSites "Maximum number of sites to return, or -1 for all sites.")
+            (boolean clear "Discard the sites and counts after they have been returned.")
+        )
+        (Reply
+            (int interval "The current sampling interval.")
+            (long allocations "Number of allocations seen.")
+            (long samples "Number of samples recorded.")
+            (long dropped "Number of samples which were not recorded because "
+                          "the site table was full or the stack could not be taken.")
+            (Repeat sites "Number of sites returned."
+                (Group Site
+                    (byte refTypeTag "Kind of the allocated reference type. "
+                                     "See <a href=\"#JDWP_TypeTag\">JDWP.TypeTag</a>")
+                    (referenceTypeID type "Class of the allocated objects.")
+                    (long count "Number of samples of this site.")
+                    (long bytes "Total size of the sampled objects, in bytes.")
+                    (Repeat frames "Number of frames, the current frame first."
+                        (location frame "The location executing in the frame.")
+                    )
+                )
+            )
+        )
+        (ErrorSet
+            (Error VM_DEAD)
+        )
+    )
+
+)
 (ConstantSet Error
     (Constant NONE                   =0   "No error has occurred.")
     (Constant INVALID_THREAD         =10  "Passed thread is null, is not a valid thread or has exited.")
@@ -207,6 +207,52 @@ readAndSetFilters(JNIEnv *env, PacketInputStream *in, HandlerNode *node,
                 break;
             }
 
+            /* ANDROID-CHANGED: See eventHelper.c writePrefetchBundle() */
+            case JDWP_REQUEST_MODIFIER(Prefetch): {
+                jint frames;
+                frames = inStream_readInt(in);
+                if ( (serror = inStream_error(in)) != JDWP_ERROR(NONE) )
+                    break;
+                serror = map2jdwpError(
+                        eventFilter_setPrefetchFilter(node, i, frames));
+                break;
+            }
+
+            /* ANDROID-CHANGED: See eventHandler.c method watches */
+            case JDWP_REQUEST_MODIFIER(MethodOnly): {
+                jclass clazz;
+                jmethodID method;
+                clazz = inStream_readClassRef(env, in);
+                if ( (serror = inStream_error(in)) != JDWP_ERROR(NONE) )
+                    break;
+                method = inStream_readMethodID(in);
+                if ( (serror = inStream_error(in)) != JDWP_ERROR(NONE) )
+                    break;
+                serror = map2jdwpError(
+                        eventFilter_setMethodOnlyFilter(node, i, clazz, method));
+                break;
+            }
+
+            /* ANDROID-CHANGED: See snapshotPoint.c */
+            case JDWP_REQUEST_MODIFIER(Snapshot): {
+                jint frames;
+                jint maxBytes;
+                jint capacity;
+                frames = inStream_readInt(in);
+                if ( (serror = inStream_error(in)) != JDWP_ERROR(NONE) )
+                    break;
+                maxBytes = inStream_readInt(in);
+                if ( (serror = inStream_error(in)) != JDWP_ERROR(NONE) )
+                    break;
+                capacity = inStream_readInt(in);
+                if ( (serror = inStream_error(in)) != JDWP_ERROR(NONE) )
+                    break;
+                serror = map2jdwpError(
+                        eventFilter_setSnapshotFilter(node, i, frames,
+                                                      maxBytes, capacity));
+                break;
+            }
+
             default:
                 serror = JDWP_ERROR(ILLEGAL_ARGUMENT);
                 break;
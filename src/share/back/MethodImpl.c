@@ -209,6 +209,56 @@ bytecodes(PacketInputStream *in, PacketOutputStream *out)
     return JNI_TRUE;
 }
 
+/*
+ * ANDROID-CHANGED: Handler for Vendor.BytecodeRange. Like Bytecodes but
+ * also returns a content hash and the total length, and only the requested
+ * range of bytes, so that the debugger can serve unchanged bytecodes from
+ * its own cache and fetch large methods in pieces.
+ */
+jboolean
+method_bytecodeRange(PacketInputStream *in, PacketOutputStream *out)
+{
+    jvmtiError error;
+    unsigned char * bcp;
+    jint bytecodeCount;
+    jmethodID method;
+    jint offset;
+    jint length;
+
+    (void)inStream_readClassRef(getEnv(), in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+    method = inStream_readMethodID(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+    offset = inStream_readInt(in);
+    length = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    error         = JVMTI_ERROR_NONE;
+    bytecodeCount = 0;
+    bcp           = NULL;
+
+    if ( !isMethodNative(method) ) {
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetBytecodes)
+                    (gdata->jvmti, method, &bytecodeCount, &bcp);
+    }
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+    } else {
+        writeContentRange(out, bcp, bytecodeCount, offset, length);
+        if (bcp != NULL) {
+            jvmtiDeallocate(bcp);
+        }
+    }
+
+    return JNI_TRUE;
+}
+
 static jboolean
 isObsolete(PacketInputStream *in, PacketOutputStream *out)
 {
@@ -231,6 +281,132 @@ isObsolete(PacketInputStream *in, PacketOutputStream *out)
     return JNI_TRUE;
 }
 
+/*
+ * ANDROID-CHANGED: Handler for Vendor.LocationsOfLine. Returns the code
+ * indices at which the given line begins in the methods of a class, so
+ * that the debugger does not need the LineTable of every method to
+ * resolve a line breakpoint. The matching rules mirror what JDI does with
+ * the line tables: abstract and native methods are skipped and, when
+ * several consecutive entries share a code index, only the last one
+ * counts.
+ */
+static jboolean
+isLineStart(jvmtiLineNumberEntry *table, jint count, jint index, jint line)
+{
+    return (jboolean)(table[index].line_number == line &&
+                      (index + 1 == count ||
+                       table[index].start_location !=
+                           table[index + 1].start_location));
+}
+
+jboolean
+method_locationsOfLine(PacketInputStream *in, PacketOutputStream *out)
+{
+    jvmtiError error;
+    jclass clazz;
+    jint line;
+    jint methodCount = 0;
+    jmethodID *methods = NULL;
+    jvmtiLineNumberEntry **tables = NULL;
+    jint *tableCounts = NULL;
+    jboolean somePresent = JNI_FALSE;
+    jboolean someAbsent = JNI_FALSE;
+    jint matchCount = 0;
+    jint i;
+    jint j;
+
+    clazz = inStream_readClassRef(getEnv(), in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+    line = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetClassMethods)
+                (gdata->jvmti, clazz, &methodCount, &methods);
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+        return JNI_TRUE;
+    }
+    if (methodCount > 0) {
+        tables = jvmtiAllocate(methodCount * (jint)sizeof(*tables));
+        tableCounts = jvmtiAllocate(methodCount * (jint)sizeof(*tableCounts));
+        if (tables == NULL || tableCounts == NULL) {
+            outStream_setError(out, JDWP_ERROR(OUT_OF_MEMORY));
+            goto done;
+        }
+        (void)memset(tables, 0, methodCount * sizeof(*tables));
+        (void)memset(tableCounts, 0, methodCount * sizeof(*tableCounts));
+    }
+
+    for (i = 0; i < methodCount; i++) {
+        jint modifiers;
+
+        error = methodModifiers(methods[i], &modifiers);
+        if (error != JVMTI_ERROR_NONE) {
+            outStream_setError(out, map2jdwpError(error));
+            goto done;
+        }
+        if ((modifiers & (MOD_ABSTRACT | MOD_NATIVE)) != 0) {
+            continue;
+        }
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLineNumberTable)
+                    (gdata->jvmti, methods[i], &tableCounts[i], &tables[i]);
+        if (error == JVMTI_ERROR_ABSENT_INFORMATION) {
+            tableCounts[i] = 0;
+            tables[i] = NULL;
+        } else if (error != JVMTI_ERROR_NONE) {
+            outStream_setError(out, map2jdwpError(error));
+            goto done;
+        }
+        if (tableCounts[i] == 0) {
+            someAbsent = JNI_TRUE;
+            continue;
+        }
+        somePresent = JNI_TRUE;
+        for (j = 0; j < tableCounts[i]; j++) {
+            if (isLineStart(tables[i], tableCounts[i], j, line)) {
+                matchCount++;
+            }
+        }
+    }
+
+    (void)outStream_writeInt(out, matchCount);
+    for (i = 0; (i < methodCount) && !outStream_error(out); i++) {
+        for (j = 0; j < tableCounts[i]; j++) {
+            if (isLineStart(tables[i], tableCounts[i], j, line)) {
+                (void)outStream_writeMethodID(out, methods[i]);
+                (void)outStream_writeLocation(out, tables[i][j].start_location);
+            }
+        }
+    }
+    (void)outStream_writeBoolean(out, (jboolean)(someAbsent && !somePresent));
+
+done:
+    for (i = 0; (tables != NULL) && (i < methodCount); i++) {
+        if (tables[i] != NULL) {
+            jvmtiDeallocate(tables[i]);
+        }
+    }
+    if (tables != NULL) {
+        jvmtiDeallocate(tables);
+    }
+    if (tableCounts != NULL) {
+        jvmtiDeallocate(tableCounts);
+    }
+    if (methods != NULL) {
+        jvmtiDeallocate(methods);
+    }
+    return JNI_TRUE;
+}
+
 void *Method_Cmds[] = { (void *)0x5
     ,(void *)lineTable
     ,(void *)variableTable
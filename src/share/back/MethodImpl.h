@@ -23,3 +23,13 @@
  * questions.
  */
 extern void *Method_Cmds[];
+
+/* ANDROID-CHANGED: Vendor.LocationsOfLine, see VendorImpl.c */
+struct PacketInputStream;
+struct PacketOutputStream;
+jboolean method_locationsOfLine(struct PacketInputStream *in,
+                                struct PacketOutputStream *out);
+
+/* ANDROID-CHANGED: Vendor.BytecodeRange, see VendorImpl.c */
+jboolean method_bytecodeRange(struct PacketInputStream *in,
+                              struct PacketOutputStream *out);
@@ -132,9 +132,13 @@ modifiers(PacketInputStream *in, PacketOutputStream *out)
     return JNI_TRUE;
 }
 
+/*
+ * ANDROID-CHANGED: Split out of writeMethodInfo so that Vendor.ClassMetadata
+ * can describe methods without their IDs.
+ */
 static void
-writeMethodInfo(PacketOutputStream *out, jclass clazz, jmethodID method,
-                int outputGenerics)
+writeMethodDescription(PacketOutputStream *out, jmethodID method,
+                       int outputGenerics)
 {
     char *name = NULL;
     char *signature = NULL;
@@ -164,7 +168,6 @@ writeMethodInfo(PacketOutputStream *out, jclass clazz, jmethodID method,
     if (isSynthetic) {
         modifiers |= MOD_SYNTHETIC;
     }
-    (void)outStream_writeMethodID(out, method);
     (void)outStream_writeString(out, name);
     (void)outStream_writeString(out, signature);
     if (outputGenerics == 1) {
@@ -178,6 +181,14 @@ writeMethodInfo(PacketOutputStream *out, jclass clazz, jmethodID method,
     }
 }
 
+static void
+writeMethodInfo(PacketOutputStream *out, jclass clazz, jmethodID method,
+                int outputGenerics)
+{
+    (void)outStream_writeMethodID(out, method);
+    writeMethodDescription(out, method, outputGenerics);
+}
+
 static jboolean
 methods1(PacketInputStream *in, PacketOutputStream *out,
          int outputGenerics)
@@ -342,9 +353,54 @@ getConstantPool(PacketInputStream *in, PacketOutputStream *out)
     return JNI_TRUE;
 }
 
+/*
+ * ANDROID-CHANGED: Handler for Vendor.ConstantPoolRange, the ConstantPool
+ * counterpart of Vendor.BytecodeRange.
+ */
+jboolean
+referenceType_constantPoolRange(PacketInputStream *in, PacketOutputStream *out)
+{
+    jclass clazz;
+    jvmtiError error;
+    jint cpCount;
+    jint cpByteCount;
+    unsigned char* cpBytesPtr;
+    jint offset;
+    jint length;
+
+    clazz = inStream_readClassRef(getEnv(), in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+    offset = inStream_readInt(in);
+    length = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    cpCount       = 0;
+    cpByteCount   = 0;
+    cpBytesPtr    = NULL;
+
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetConstantPool)
+                (gdata->jvmti, clazz, &cpCount, &cpByteCount, &cpBytesPtr);
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+    } else {
+        (void)outStream_writeInt(out, cpCount);
+        writeContentRange(out, cpBytesPtr, cpByteCount, offset, length);
+        jvmtiDeallocate(cpBytesPtr);
+    }
+
+    return JNI_TRUE;
+}
+
+/*
+ * ANDROID-CHANGED: Split out of writeFieldInfo, see writeMethodDescription.
+ */
 static void
-writeFieldInfo(PacketOutputStream *out, jclass clazz, jfieldID fieldID,
-               int outputGenerics)
+writeFieldDescription(PacketOutputStream *out, jclass clazz, jfieldID fieldID,
+                      int outputGenerics)
 {
     char *name;
     char *signature = NULL;
@@ -373,7 +429,6 @@ writeFieldInfo(PacketOutputStream *out, jclass clazz, jfieldID fieldID,
     if (isSynthetic) {
         modifiers |= MOD_SYNTHETIC;
     }
-    (void)outStream_writeFieldID(out, fieldID);
     (void)outStream_writeString(out, name);
     (void)outStream_writeString(out, signature);
     if (outputGenerics == 1) {
@@ -387,6 +442,14 @@ writeFieldInfo(PacketOutputStream *out, jclass clazz, jfieldID fieldID,
     }
 }
 
+static void
+writeFieldInfo(PacketOutputStream *out, jclass clazz, jfieldID fieldID,
+               int outputGenerics)
+{
+    (void)outStream_writeFieldID(out, fieldID);
+    writeFieldDescription(out, clazz, fieldID, outputGenerics);
+}
+
 static jboolean
 fields1(PacketInputStream *in, PacketOutputStream *out, int outputGenerics)
 {
@@ -434,6 +497,308 @@ fieldsWithGeneric(PacketInputStream *in, PacketOutputStream *out)
 
 }
 
+/*
+ * ANDROID-CHANGED: Class metadata blobs for Vendor.ClassMetadataKey and
+ * Vendor.ClassMetadata. The blob holds everything the debugger would get
+ * from the SourceFile, SourceDebugExtension, FieldsWithGeneric and
+ * MethodsWithGeneric commands and the LineTable and VariableTableWithGeneric
+ * commands of each method, minus the session specific field and method IDs.
+ * Its content hash thus identifies the class metadata across debugging
+ * sessions. Each optional part is preceded by a state byte.
+ */
+#define METADATA_VERSION 1
+
+#define METADATA_ABSENT  0  /* Target reports ABSENT_INFORMATION */
+#define METADATA_PRESENT 1  /* Data follows */
+#define METADATA_ASK     2  /* Not included, use the regular command */
+
+static void
+writeMetadataString(PacketOutputStream *out, jvmtiError error, char *string)
+{
+    if (error == JVMTI_ERROR_NONE) {
+        (void)outStream_writeByte(out, METADATA_PRESENT);
+        (void)outStream_writeString(out, string);
+        jvmtiDeallocate(string);
+    } else if (error == JVMTI_ERROR_ABSENT_INFORMATION) {
+        (void)outStream_writeByte(out, METADATA_ABSENT);
+    } else {
+        (void)outStream_writeByte(out, METADATA_ASK);
+    }
+}
+
+static void
+writeMetadataLines(PacketOutputStream *out, jmethodID method)
+{
+    jvmtiError error;
+    jint count = 0;
+    jvmtiLineNumberEntry *table = NULL;
+    jlocation firstCodeIndex;
+    jlocation lastCodeIndex;
+    jint i;
+
+    error = methodLocation(method, &firstCodeIndex, &lastCodeIndex);
+    if (error == JVMTI_ERROR_NONE) {
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLineNumberTable)
+                    (gdata->jvmti, method, &count, &table);
+        if (error == JVMTI_ERROR_ABSENT_INFORMATION) {
+            /* An empty table, as for LineTable */
+            error = JVMTI_ERROR_NONE;
+            count = 0;
+            table = NULL;
+        }
+    }
+    if (error != JVMTI_ERROR_NONE) {
+        (void)outStream_writeByte(out, METADATA_ASK);
+        return;
+    }
+
+    (void)outStream_writeByte(out, METADATA_PRESENT);
+    (void)outStream_writeLocation(out, firstCodeIndex);
+    (void)outStream_writeLocation(out, lastCodeIndex);
+    (void)outStream_writeInt(out, count);
+    for (i = 0; i < count; i++) {
+        (void)outStream_writeLocation(out, table[i].start_location);
+        (void)outStream_writeInt(out, table[i].line_number);
+    }
+    if (table != NULL) {
+        jvmtiDeallocate(table);
+    }
+}
+
+static void
+writeMetadataVariables(PacketOutputStream *out, jmethodID method)
+{
+    jvmtiError error;
+    jint count;
+    jvmtiLocalVariableEntry *table;
+    jint argsSize;
+    jint i;
+
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetArgumentsSize)
+                (gdata->jvmti, method, &argsSize);
+    if (error == JVMTI_ERROR_NONE) {
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalVariableTable)
+                    (gdata->jvmti, method, &count, &table);
+    }
+    if (error == JVMTI_ERROR_ABSENT_INFORMATION) {
+        (void)outStream_writeByte(out, METADATA_ABSENT);
+        return;
+    } else if (error != JVMTI_ERROR_NONE) {
+        (void)outStream_writeByte(out, METADATA_ASK);
+        return;
+    }
+
+    (void)outStream_writeByte(out, METADATA_PRESENT);
+    (void)outStream_writeInt(out, argsSize);
+    (void)outStream_writeInt(out, count);
+    for (i = 0; i < count; i++) {
+        jvmtiLocalVariableEntry *entry = &table[i];
+        (void)outStream_writeLocation(out, entry->start_location);
+        (void)outStream_writeString(out, entry->name);
+        (void)outStream_writeString(out, entry->signature);
+        writeGenericSignature(out, entry->generic_signature);
+        (void)outStream_writeInt(out, entry->length);
+        (void)outStream_writeInt(out, entry->slot);
+
+        jvmtiDeallocate(entry->name);
+        jvmtiDeallocate(entry->signature);
+        if (entry->generic_signature != NULL) {
+          jvmtiDeallocate(entry->generic_signature);
+        }
+    }
+    jvmtiDeallocate(table);
+}
+
+/*
+ * Encode the metadata of a class into 'meta'. The fields and methods are
+ * returned in the order they are described in.
+ */
+static jvmtiError
+writeClassMetadata(PacketOutputStream *meta, jclass clazz,
+                   jint *fieldCount, jfieldID **fields,
+                   jint *methodCount, jmethodID **methods)
+{
+    jvmtiError error;
+    char *string;
+    jint i;
+
+    *fields = NULL;
+    *methods = NULL;
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetClassFields)
+                (gdata->jvmti, clazz, fieldCount, fields);
+    if (error == JVMTI_ERROR_NONE) {
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetClassMethods)
+                    (gdata->jvmti, clazz, methodCount, methods);
+    }
+    if (error != JVMTI_ERROR_NONE) {
+        if (*fields != NULL) {
+            jvmtiDeallocate(*fields);
+            *fields = NULL;
+        }
+        return error;
+    }
+
+    (void)outStream_writeInt(meta, METADATA_VERSION);
+
+    string = NULL;
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetSourceFileName)
+                (gdata->jvmti, clazz, &string);
+    writeMetadataString(meta, error, string);
+
+    string = NULL;
+    error = getSourceDebugExtension(clazz, &string);
+    writeMetadataString(meta, error, string);
+
+    (void)outStream_writeInt(meta, *fieldCount);
+    for (i = 0; (i < *fieldCount) && !outStream_error(meta); i++) {
+        writeFieldDescription(meta, clazz, (*fields)[i], 1);
+    }
+
+    (void)outStream_writeInt(meta, *methodCount);
+    for (i = 0; (i < *methodCount) && !outStream_error(meta); i++) {
+        jmethodID method = (*methods)[i];
+        jint modifiers;
+
+        writeMethodDescription(meta, method, 1);
+        /* JVMTI behavior is unspecified for native methods. */
+        if (isMethodNative(method) ||
+                methodModifiers(method, &modifiers) != JVMTI_ERROR_NONE ||
+                (modifiers & MOD_ABSTRACT) != 0) {
+            (void)outStream_writeByte(meta, METADATA_ASK);
+            (void)outStream_writeByte(meta, METADATA_ASK);
+        } else {
+            writeMetadataLines(meta, method);
+            writeMetadataVariables(meta, method);
+        }
+    }
+    return JVMTI_ERROR_NONE;
+}
+
+/*
+ * Build the metadata blob of a class. The blob is allocated with
+ * jvmtiAllocate; the fields and methods too if requested.
+ */
+static jdwpError
+classMetadata(jclass clazz, jbyte **blob, jint *blobLength,
+              jint *fieldCount, jfieldID **fields,
+              jint *methodCount, jmethodID **methods)
+{
+    PacketOutputStream meta;
+    jfieldID *fieldArray;
+    jmethodID *methodArray;
+    jvmtiError error;
+    jdwpError serror;
+
+    *blob = NULL;
+    outStream_initReply(&meta, 0);
+    error = writeClassMetadata(&meta, clazz, fieldCount, &fieldArray,
+                               methodCount, &methodArray);
+    if (error != JVMTI_ERROR_NONE) {
+        serror = map2jdwpError(error);
+    } else {
+        serror = outStream_error(&meta);
+        if (serror == JDWP_ERROR(NONE)) {
+            *blob = outStream_copyData(&meta, blobLength);
+            if (*blob == NULL) {
+                serror = JDWP_ERROR(OUT_OF_MEMORY);
+            }
+        }
+        if (serror == JDWP_ERROR(NONE) && fields != NULL) {
+            *fields = fieldArray;
+            *methods = methodArray;
+        } else {
+            jvmtiDeallocate(fieldArray);
+            jvmtiDeallocate(methodArray);
+        }
+    }
+    outStream_destroy(&meta);
+    return serror;
+}
+
+/*
+ * ANDROID-CHANGED: Handler for Vendor.ClassMetadataKey. Returns the hash
+ * and length of the class metadata blob along with the field and method
+ * IDs it describes.
+ */
+jboolean
+referenceType_classMetadataKey(PacketInputStream *in, PacketOutputStream *out)
+{
+    jclass clazz;
+    jbyte *blob;
+    jint blobLength;
+    jint fieldCount;
+    jfieldID *fields;
+    jint methodCount;
+    jmethodID *methods;
+    jdwpError serror;
+    jint i;
+
+    clazz = inStream_readClassRef(getEnv(), in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    serror = classMetadata(clazz, &blob, &blobLength,
+                           &fieldCount, &fields, &methodCount, &methods);
+    if (serror != JDWP_ERROR(NONE)) {
+        outStream_setError(out, serror);
+        return JNI_TRUE;
+    }
+
+    (void)outStream_writeLong(out, contentHash((unsigned char *)blob, blobLength));
+    (void)outStream_writeInt(out, blobLength);
+    (void)outStream_writeInt(out, fieldCount);
+    for (i = 0; i < fieldCount; i++) {
+        (void)outStream_writeFieldID(out, fields[i]);
+    }
+    (void)outStream_writeInt(out, methodCount);
+    for (i = 0; i < methodCount; i++) {
+        (void)outStream_writeMethodID(out, methods[i]);
+    }
+    jvmtiDeallocate(fields);
+    jvmtiDeallocate(methods);
+    jvmtiDeallocate(blob);
+    return JNI_TRUE;
+}
+
+/*
+ * ANDROID-CHANGED: Handler for Vendor.ClassMetadata. Returns a range of
+ * the class metadata blob, see Vendor.BytecodeRange.
+ */
+jboolean
+referenceType_classMetadata(PacketInputStream *in, PacketOutputStream *out)
+{
+    jclass clazz;
+    jbyte *blob;
+    jint blobLength;
+    jint fieldCount;
+    jint methodCount;
+    jint offset;
+    jint length;
+    jdwpError serror;
+
+    clazz = inStream_readClassRef(getEnv(), in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+    offset = inStream_readInt(in);
+    length = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    serror = classMetadata(clazz, &blob, &blobLength,
+                           &fieldCount, NULL, &methodCount, NULL);
+    if (serror != JDWP_ERROR(NONE)) {
+        outStream_setError(out, serror);
+        return JNI_TRUE;
+    }
+
+    writeContentRange(out, (unsigned char *)blob, blobLength, offset, length);
+    jvmtiDeallocate(blob);
+    return JNI_TRUE;
+}
+
 static jboolean
 getValues(PacketInputStream *in, PacketOutputStream *out)
 {
@@ -23,3 +23,15 @@
  * questions.
  */
 extern void *ReferenceType_Cmds[];
+
+/* ANDROID-CHANGED: Vendor.ConstantPoolRange, see VendorImpl.c */
+struct PacketInputStream;
+struct PacketOutputStream;
+jboolean referenceType_constantPoolRange(struct PacketInputStream *in,
+                                         struct PacketOutputStream *out);
+
+/* ANDROID-CHANGED: Vendor.ClassMetadataKey and Vendor.ClassMetadata */
+jboolean referenceType_classMetadataKey(struct PacketInputStream *in,
+                                        struct PacketOutputStream *out);
+jboolean referenceType_classMetadata(struct PacketInputStream *in,
+                                     struct PacketOutputStream *out);
@@ -210,11 +210,56 @@ validateSuspendedThread(PacketOutputStream *out, jthread thread)
     return JNI_TRUE;
 }
 
+/*
+ * ANDROID-CHANGED: The frame loop of frames() is shared with
+ * threadReference_snapshot() below.
+ */
+static jvmtiError
+writeFrames(JNIEnv *env, PacketOutputStream *out, jthread thread,
+            jint startIndex, jint length)
+{
+    jvmtiError error;
+    FrameNumber fnum;
+
+    error = JVMTI_ERROR_NONE;
+    for(fnum = startIndex ; fnum < startIndex+length ; fnum++ ) {
+
+        WITH_LOCAL_REFS(env, 1) {
+
+            jclass clazz;
+            jmethodID method;
+            jlocation location;
+
+            /* Get location info */
+            error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
+                (gdata->jvmti, thread, fnum, &method, &location);
+            if (error == JVMTI_ERROR_OPAQUE_FRAME) {
+                clazz = NULL;
+                location = -1L;
+                error = JVMTI_ERROR_NONE;
+            } else if ( error == JVMTI_ERROR_NONE ) {
+                error = methodClass(method, &clazz);
+                if ( error == JVMTI_ERROR_NONE ) {
+                    FrameID frame;
+                    frame = createFrameID(thread, fnum);
+                    (void)outStream_writeFrameID(out, frame);
+                    writeCodeLocation(out, clazz, method, location);
+                }
+            }
+
+        } END_WITH_LOCAL_REFS(env);
+
+        if (error != JVMTI_ERROR_NONE)
+            break;
+
+    }
+    return error;
+}
+
 static jboolean
 frames(PacketInputStream *in, PacketOutputStream *out)
 {
     jvmtiError error;
-    FrameNumber fnum;
     jint count;
     JNIEnv *env;
     jthread thread;
@@ -273,38 +318,7 @@ frames(PacketInputStream *in, PacketOutputStream *out)
 
     (void)outStream_writeInt(out, length);
 
-    for(fnum = startIndex ; fnum < startIndex+length ; fnum++ ) {
-
-        WITH_LOCAL_REFS(env, 1) {
-
-            jclass clazz;
-            jmethodID method;
-            jlocation location;
-
-            /* Get location info */
-            error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
-                (gdata->jvmti, thread, fnum, &method, &location);
-            if (error == JVMTI_ERROR_OPAQUE_FRAME) {
-                clazz = NULL;
-                location = -1L;
-                error = JVMTI_ERROR_NONE;
-            } else if ( error == JVMTI_ERROR_NONE ) {
-                error = methodClass(method, &clazz);
-                if ( error == JVMTI_ERROR_NONE ) {
-                    FrameID frame;
-                    frame = createFrameID(thread, fnum);
-                    (void)outStream_writeFrameID(out, frame);
-                    writeCodeLocation(out, clazz, method, location);
-                }
-            }
-
-        } END_WITH_LOCAL_REFS(env);
-
-        if (error != JVMTI_ERROR_NONE)
-            break;
-
-    }
-
+    error = writeFrames(env, out, thread, startIndex, length);
     if (error != JVMTI_ERROR_NONE) {
         outStream_setError(out, map2jdwpError(error));
     }
@@ -664,6 +678,80 @@ forceEarlyReturn(PacketInputStream *in, PacketOutputStream *out)
 }
 
 
+/*
+ * ANDROID-CHANGED: Vendor.ThreadSnapshot. Answers the Status, FrameCount
+ * and Frames commands for a suspended thread in one reply, so that a
+ * debugger stopping at an event can fill its view of the thread with a
+ * single round trip.
+ */
+jboolean
+threadReference_snapshot(PacketInputStream *in, PacketOutputStream *out)
+{
+    jdwpThreadStatus threadStatus;
+    jint statusFlags;
+    jvmtiError error;
+    JNIEnv *env;
+    jthread thread;
+    jint maxFrames;
+    jint count;
+    jint length;
+
+    env = getEnv();
+
+    thread = inStream_readThreadRef(env, in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+    maxFrames = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    if (threadControl_isDebugThread(thread)) {
+        outStream_setError(out, JDWP_ERROR(INVALID_THREAD));
+        return JNI_TRUE;
+    }
+
+    if (!validateSuspendedThread(out, thread)) {
+        return JNI_TRUE;
+    }
+
+    error = threadControl_applicationThreadStatus(thread, &threadStatus,
+                                                          &statusFlags);
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+        return JNI_TRUE;
+    }
+
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameCount)
+                        (gdata->jvmti, thread, &count);
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+        return JNI_TRUE;
+    }
+
+    length = count;
+    if (maxFrames >= 0 && maxFrames < count) {
+        length = maxFrames;
+    }
+
+    (void)outStream_writeInt(out, threadStatus);
+    (void)outStream_writeInt(out, statusFlags);
+    (void)outStream_writeInt(out, count);
+    (void)outStream_writeInt(out, length);
+
+    error = writeFrames(env, out, thread, 0, length);
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+    }
+    return JNI_TRUE;
+}
+
 void *ThreadReference_Cmds[] = { (void *)14,
     (void *)name,
     (void *)suspend,
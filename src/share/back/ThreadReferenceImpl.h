@@ -23,3 +23,9 @@
  * questions.
  */
 extern void *ThreadReference_Cmds[];
+
+/* ANDROID-CHANGED: Vendor.ThreadSnapshot, see VendorImpl.c */
+struct PacketInputStream;
+struct PacketOutputStream;
+jboolean threadReference_snapshot(struct PacketInputStream *in,
+                                  struct PacketOutputStream *out);
@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+/*
+ * ANDROID-CHANGED: Handlers for the agent specific Vendor command set
+ * (-56). See the Vendor CommandSet in jdwp.spec.
+ */
+
+#include "util.h"
+#include "VendorImpl.h"
+#include "inStream.h"
+#include "outStream.h"
+#include "monitorProfile.h"
+#include "cpuProfile.h"
+#include "allocProfile.h"
+#include "lineCoverage.h"
+#include "snapshotPoint.h"
+#include "threadControl.h"
+#include "transport.h"
+#include "MethodImpl.h"
+#include "eventHelper.h"
+#include "ThreadReferenceImpl.h"
+#include "VirtualMachineImpl.h"
+#include "ReferenceTypeImpl.h"
+
+static jboolean
+monitorContentionStart(PacketInputStream *in, PacketOutputStream *out)
+{
+    jboolean includeWaits;
+    jvmtiError error;
+
+    includeWaits = inStream_readBoolean(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    error = monitorProfile_start(includeWaits);
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+    }
+    return JNI_TRUE;
+}
+
+static jboolean
+monitorContentionStop(PacketInputStream *in, PacketOutputStream *out)
+{
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    monitorProfile_stop();
+    return JNI_TRUE;
+}
+
+static jboolean
+monitorContentionHistogram(PacketInputStream *in, PacketOutputStream *out)
+{
+    jint maxSites;
+    jboolean clear;
+
+    maxSites = inStream_readInt(in);
+    clear = inStream_readBoolean(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    monitorProfile_writeHistogram(getEnv(), out, maxSites, clear);
+    return JNI_TRUE;
+}
+
+static jboolean
+cpuSamplingStart(PacketInputStream *in, PacketOutputStream *out)
+{
+    jint intervalMillis;
+    jint maxDepth;
+    jvmtiError error;
+
+    intervalMillis = inStream_readInt(in);
+    maxDepth = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    error = cpuProfile_start(intervalMillis, maxDepth);
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+    }
+    return JNI_TRUE;
+}
+
+static jboolean
+cpuSamplingStop(PacketInputStream *in, PacketOutputStream *out)
+{
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    cpuProfile_stop();
+    return JNI_TRUE;
+}
+
+static jboolean
+cpuSamplingStacks(PacketInputStream *in, PacketOutputStream *out)
+{
+    jboolean clear;
+
+    clear = inStream_readBoolean(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    cpuProfile_writeStacks(getEnv(), out, clear);
+    return JNI_TRUE;
+}
+
+static jboolean
+coverageStart(PacketInputStream *in, PacketOutputStream *out)
+{
+    jboolean lazy;
+    jint patternCount;
+    char **patterns;
+    jvmtiError error;
+    jint i;
+
+    lazy = inStream_readBoolean(in);
+    patternCount = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+    if (patternCount < 0) {
+        outStream_setError(out, JDWP_ERROR(ILLEGAL_ARGUMENT));
+        return JNI_TRUE;
+    }
+
+    patterns = jvmtiAllocate((patternCount + 1) * (jint)sizeof(char *));
+    if (patterns == NULL) {
+        outStream_setError(out, JDWP_ERROR(OUT_OF_MEMORY));
+        return JNI_TRUE;
+    }
+    for (i = 0; i < patternCount; i++) {
+        patterns[i] = inStream_readString(in);
+        if (inStream_error(in)) {
+            break;
+        }
+    }
+    if (inStream_error(in) || gdata->vmDead) {
+        jint j;
+
+        for (j = 0; j < i; j++) {
+            jvmtiDeallocate(patterns[j]);
+        }
+        jvmtiDeallocate(patterns);
+        if (!inStream_error(in)) {
+            outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        }
+        return JNI_TRUE;
+    }
+
+    /* The patterns now belong to lineCoverage */
+    error = lineCoverage_start(getEnv(), patterns, patternCount, lazy);
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+    }
+    return JNI_TRUE;
+}
+
+static jboolean
+coverageStop(PacketInputStream *in, PacketOutputStream *out)
+{
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    lineCoverage_stop();
+    return JNI_TRUE;
+}
+
+static jboolean
+coverageBitmaps(PacketInputStream *in, PacketOutputStream *out)
+{
+    jboolean clear;
+
+    clear = inStream_readBoolean(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    lineCoverage_writeBitmaps(getEnv(), out, clear);
+    return JNI_TRUE;
+}
+
+static jboolean
+snapshotDrain(PacketInputStream *in, PacketOutputStream *out)
+{
+    HandlerID requestID;
+    jint maxSnapshots;
+    jdwpError serror;
+
+    requestID = inStream_readInt(in);
+    maxSnapshots = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    serror = snapshotPoint_drain(getEnv(), out, requestID, maxSnapshots);
+    if (serror != JDWP_ERROR(NONE)) {
+        outStream_setError(out, serror);
+    }
+    return JNI_TRUE;
+}
+
+static jboolean
+allThreadInfo(PacketInputStream *in, PacketOutputStream *out)
+{
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    threadControl_writeAllThreadInfo(out);
+    return JNI_TRUE;
+}
+
+static jboolean
+transportStats(PacketInputStream *in, PacketOutputStream *out)
+{
+    jdwpTransportStats stats;
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    (void)memset(&stats, 0, sizeof(stats));
+    if (!transport_getStats(&stats)) {
+        outStream_setError(out, JDWP_ERROR(NOT_IMPLEMENTED));
+        return JNI_TRUE;
+    }
+    (void)outStream_writeLong(out, stats.bytesSent);
+    (void)outStream_writeLong(out, stats.bytesReceived);
+    (void)outStream_writeLong(out, stats.packetsSent);
+    (void)outStream_writeLong(out, stats.packetsReceived);
+    (void)outStream_writeLong(out, stats.sendCalls);
+    (void)outStream_writeLong(out, stats.recvCalls);
+    (void)outStream_writeLong(out, stats.flushes);
+    (void)outStream_writeLong(out, stats.sendBufferSize);
+    (void)outStream_writeLong(out, stats.receiveBufferSize);
+    return JNI_TRUE;
+}
+
+static jboolean
+eventCredits(PacketInputStream *in, PacketOutputStream *out)
+{
+    jint credits;
+
+    credits = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    eventHelper_grantEventCredits(credits);
+    return JNI_TRUE;
+}
+
+static jboolean
+allocationTrackingStart(PacketInputStream *in, PacketOutputStream *out)
+{
+    jint interval;
+    jint maxDepth;
+    jvmtiError error;
+
+    interval = inStream_readInt(in);
+    maxDepth = inStream_readInt(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    error = allocProfile_start(interval, maxDepth);
+    if (error != JVMTI_ERROR_NONE) {
+        outStream_setError(out, map2jdwpError(error));
+    }
+    return JNI_TRUE;
+}
+
+static jboolean
+allocationTrackingStop(PacketInputStream *in, PacketOutputStream *out)
+{
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    allocProfile_stop();
+    return JNI_TRUE;
+}
+
+static jboolean
+allocationSites(PacketInputStream *in, PacketOutputStream *out)
+{
+    jint maxSites;
+    jboolean clear;
+
+    maxSites = inStream_readInt(in);
+    clear = inStream_readBoolean(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    allocProfile_writeSites(getEnv(), out, maxSites, clear);
+    return JNI_TRUE;
+}
+
+void *Vendor_Cmds[] = { (void *)23
+    ,(void *)monitorContentionStart
+    ,(void *)monitorContentionStop
+    ,(void *)monitorContentionHistogram
+    ,(void *)allThreadInfo
+    ,(void *)transportStats
+    ,(void *)method_locationsOfLine
+    ,(void *)eventCredits
+    ,(void *)threadReference_snapshot
+    ,(void *)virtualMachine_classesChangedSince
+    ,(void *)method_bytecodeRange
+    ,(void *)referenceType_constantPoolRange
+    ,(void *)referenceType_classMetadataKey
+    ,(void *)referenceType_classMetadata
+    ,(void *)cpuSamplingStart
+    ,(void *)cpuSamplingStop
+    ,(void *)cpuSamplingStacks
+    ,(void *)coverageStart
+    ,(void *)coverageStop
+    ,(void *)coverageBitmaps
+    ,(void *)snapshotDrain
+    ,(void *)allocationTrackingStart
+    ,(void *)allocationTrackingStop
+    ,(void *)allocationSites
+};
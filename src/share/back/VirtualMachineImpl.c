@@ -33,6 +33,12 @@
 #include "threadControl.h"
 #include "SDE.h"
 #include "FrameID.h"
+#include "bag.h"
+#include "classTrack.h"
+#include "lineCoverage.h"
+#include "stepControl.h"
+// ANDROID-CHANGED: Needed for debugLoop_sync
+#include "debugLoop.h"
 
 static char *versionName = "Java Debug Wire Protocol (Reference Implementation)";
 static int majorVersion = 1;  /* JDWP major version */
@@ -296,6 +302,119 @@ allClassesWithGeneric(PacketInputStream *in, PacketOutputStream *out)
     return allClasses1(in, out, 1);
 }
 
+static jboolean
+writeSignature(void *item, void *arg)
+{
+    (void)outStream_writeString((PacketOutputStream *)arg, *(char **)item);
+    return JNI_TRUE;
+}
+
+static jboolean
+freeSignature(void *item, void *arg)
+{
+    jvmtiDeallocate(*(char **)item);
+    return JNI_TRUE;
+}
+
+/*
+ * ANDROID-CHANGED: Vendor.ClassesChangedSince. Like AllClassesWithGeneric but only
+ * reports the classes prepared and unloaded since a class-set generation the
+ * debugger saw before. Unloads which happened since the last event are processed
+ * first, so that they are part of the reply rather than left for a later one. The
+ * class list is snapshotted under the handlerLock (which guards classTrack) and
+ * written out after releasing it. The front-end does not use this command; it is
+ * vendor API for debuggers which keep their class set across requests.
+ */
+jboolean
+virtualMachine_classesChangedSince(PacketInputStream *in, PacketOutputStream *out)
+{
+    JNIEnv *env;
+    jlong since;
+    jlong generation;
+    jboolean isDelta;
+    jint tagCount;
+    jlong *tags;
+    struct bag *removed;
+
+    since = inStream_readLong(in);
+    if (inStream_error(in)) {
+        return JNI_TRUE;
+    }
+
+    if (gdata->vmDead) {
+        outStream_setError(out, JDWP_ERROR(VM_DEAD));
+        return JNI_TRUE;
+    }
+
+    env = getEnv();
+
+    removed = bagCreateBag(sizeof(char *), 10);
+    if (removed == NULL) {
+        outStream_setError(out, JDWP_ERROR(OUT_OF_MEMORY));
+        return JNI_TRUE;
+    }
+
+    eventHandler_processUnloads(env);
+
+    eventHandler_lock();
+    generation = classTrack_changesSince(since, &tagCount, &tags, removed, &isDelta);
+    eventHandler_unlock();
+
+    WITH_LOCAL_REFS(env, 1) {
+
+        jint classCount;
+        jclass *theClasses;
+        jvmtiError error;
+
+        error = classTrack_classesForTags(tagCount, tags, &classCount, &theClasses);
+        if (error != JVMTI_ERROR_NONE) {
+            outStream_setError(out, map2jdwpError(error));
+        } else {
+            int i;
+
+            (void)outStream_writeLong(out, generation);
+            (void)outStream_writeBoolean(out, isDelta);
+            (void)outStream_writeInt(out, classCount);
+            for (i = 0; i < classCount; i++) {
+                char *signature = NULL;
+                char *genericSignature = NULL;
+                jclass clazz = theClasses[i];
+
+                error = classSignature(clazz, &signature, &genericSignature);
+                if (error != JVMTI_ERROR_NONE) {
+                    outStream_setError(out, map2jdwpError(error));
+                    break;
+                }
+
+                (void)outStream_writeByte(out, referenceTypeTag(clazz));
+                (void)outStream_writeObjectRef(env, out, clazz);
+                (void)outStream_writeString(out, signature);
+                writeGenericSignature(out, genericSignature);
+                (void)outStream_writeInt(out, map2jdwpClassStatus(classStatus(clazz)));
+                jvmtiDeallocate(signature);
+                if (genericSignature != NULL) {
+                    jvmtiDeallocate(genericSignature);
+                }
+
+                if (outStream_error(out)) {
+                    break;
+                }
+            }
+            if (!outStream_error(out)) {
+                (void)outStream_writeInt(out, bagSize(removed));
+                (void)bagEnumerateOver(removed, writeSignature, out);
+            }
+            jvmtiDeallocate(theClasses);
+        }
+
+    } END_WITH_LOCAL_REFS(env);
+
+    jvmtiDeallocate(tags);
+    (void)bagEnumerateOver(removed, freeSignature, NULL);
+    bagDestroyBag(removed);
+    return JNI_TRUE;
+}
+
   /***********************************************************/
 
 
@@ -448,7 +567,11 @@ redefineClasses(PacketInputStream *in, PacketOutputStream *out)
             /* zap our BP info */
             for ( i = 0 ; i < classCount; i++ ) {
                 eventHandler_freeClassBreakpoints(classDefs[i].klass);
+                // ANDROID-CHANGED: Coverage breakpoints went away too.
+                lineCoverage_onRedefineClass(env, classDefs[i].klass);
             }
+            // ANDROID-CHANGED: So are cached step line tables.
+            stepControl_onRedefineClasses();
         }
     }
 
@@ -622,6 +745,11 @@ doExit(PacketInputStream *in, PacketOutputStream *out)
     }
 
     /* We send the reply from here because we are about to exit. */
+    /*
+     * ANDROID-CHANGED: Earlier replies may still be queued for the reply
+     * writer; send them first so that this one is not overtaken.
+     */
+    debugLoop_sync();
     if (inStream_error(in)) {
         outStream_setError(out, inStream_error(in));
     }
@@ -24,3 +24,9 @@
  */
 
 extern void *VirtualMachine_Cmds[];
+
+/* ANDROID-CHANGED: Vendor.ClassesChangedSince, see VendorImpl.c */
+struct PacketInputStream;
+struct PacketOutputStream;
+jboolean virtualMachine_classesChangedSince(struct PacketInputStream *in,
+                                            struct PacketOutputStream *out);
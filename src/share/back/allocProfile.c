@@ -0,0 +1,593 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+/*
+ * ANDROID-CHANGED: Sampling allocation profiler.
+ *
+ * InstanceCounts walks the whole heap and only tells what is live, not
+ * what churns. While this mode is active the agent enables VMObjectAlloc
+ * events, which ART posts for every allocation, and counts them. Every
+ * sampleInterval-th allocation is sampled: the top frames of the
+ * allocating thread are taken and the sample is added to the site keyed
+ * by allocated class and those frames, which counts its samples and
+ * their bytes.
+ *
+ * The callback runs on the allocating application thread, which the
+ * debugger may suspend at any JNI or JVMTI call. So siteLock, a
+ * lightweight lock, is only held for plain memory work: the stack, the
+ * class key and, for a new site, its global refs are all obtained
+ * outside of it, and the site is looked up again before it is inserted.
+ * Classes are told apart by a tag set in a JVMTI environment of our own
+ * (classTrack does not track array classes). Two threads racing to tag
+ * a class may leave a site recorded under both of their tags.
+ *
+ * Sites point to the allocated class and to the declaring classes of
+ * their frames in a class table, which holds one global ref per class
+ * tag, so the frames' jmethodIDs stay valid. Global refs are a scarce
+ * resource of the VM, so the class table is bounded well below its
+ * limit, as is the number of sites; samples which would need more are
+ * counted as dropped. Sites and class refs are only freed by the
+ * command loop thread (writing the sites with clear, and reset), so
+ * the sites command writes them out after dropping siteLock. Every
+ * time they are taken out of the tables the table epoch changes, and a
+ * sample which started before does not add to the new tables, as the
+ * class refs it holds may be gone.
+ */
+
+#include <stdatomic.h>
+
+#include "util.h"
+#include "threadControl.h"
+#include "allocProfile.h"
+
+#define MAX_DEPTH     16
+#define MAX_SITES     4096
+#define BUCKET_COUNT  1024
+#define MAX_CLASSES   2048
+#define CLASS_BUCKETS 256
+
+typedef struct ClassRef {
+    struct ClassRef *next;      /* hash chain */
+    jlong tag;                  /* see classKey */
+    jclass clazz;               /* global ref */
+} ClassRef;
+
+typedef struct SiteFrame {
+    jmethodID method;
+    jlocation location;
+    ClassRef *classRef;         /* declaring class */
+} SiteFrame;
+
+typedef struct AllocSite {
+    struct AllocSite *next;     /* hash chain */
+    jint hash;
+    jlong classTag;
+    ClassRef *classRef;         /* allocated class */
+    jlong count;
+    jlong bytes;
+    jint depth;
+    SiteFrame frames[MAX_DEPTH];
+} AllocSite;
+
+/* A site as written out, counters copied under siteLock */
+typedef struct SiteCounts {
+    AllocSite *site;
+    jlong count;
+    jlong bytes;
+} SiteCounts;
+
+static jvmtiEnv *tagEnv;
+static _Atomic(jlong) lastClassTag = ATOMIC_VAR_INIT(0);
+
+static _Atomic(jboolean) profileActive = ATOMIC_VAR_INIT(JNI_FALSE);
+static _Atomic(jint) sampleInterval = ATOMIC_VAR_INIT(1);
+static _Atomic(jint) sampleDepth = ATOMIC_VAR_INIT(1);
+static _Atomic(jlong) allocationCount = ATOMIC_VAR_INIT(0);
+
+static LightLock siteLock;
+/* Protected by siteLock */
+static AllocSite *buckets[BUCKET_COUNT];
+static jint siteCount;
+static jlong sampleCount;
+static jlong droppedCount;
+static ClassRef *classBuckets[CLASS_BUCKETS];
+static jint classCount;
+static jint tableEpoch;
+
+static jlong
+classKey(jclass clazz)
+{
+    jlong tag = 0;
+
+    if (JVMTI_FUNC_PTR(tagEnv,GetTag)(tagEnv, clazz, &tag) != JVMTI_ERROR_NONE) {
+        return 0;
+    }
+    if (tag == 0) {
+        tag = atomic_fetch_add(&lastClassTag, 1) + 1;
+        if (JVMTI_FUNC_PTR(tagEnv,SetTag)(tagEnv, clazz, tag) != JVMTI_ERROR_NONE) {
+            return 0;
+        }
+        /* Another thread may have tagged it meanwhile; the last tag wins */
+        if (JVMTI_FUNC_PTR(tagEnv,GetTag)(tagEnv, clazz, &tag) != JVMTI_ERROR_NONE) {
+            return 0;
+        }
+    }
+    return tag;
+}
+
+static jint
+hashSite(jlong classTag, jvmtiFrameInfo *frames, jint depth)
+{
+    jlong hash = classTag;
+    jint i;
+
+    for (i = 0; i < depth; i++) {
+        hash = hash * 31 + (jlong)(intptr_t)frames[i].method;
+        hash = hash * 31 + frames[i].location;
+    }
+    return (jint)(hash ^ (hash >> 29));
+}
+
+/* Must be called with siteLock held. */
+static AllocSite *
+findSite(jint hash, jlong classTag, jvmtiFrameInfo *frames, jint depth)
+{
+    AllocSite *site;
+
+    for (site = buckets[hash & (BUCKET_COUNT - 1)]; site != NULL;
+         site = site->next) {
+        jint i;
+
+        if (site->hash != hash || site->classTag != classTag ||
+            site->depth != depth) {
+            continue;
+        }
+        for (i = 0; i < depth; i++) {
+            if (site->frames[i].method != frames[i].method ||
+                site->frames[i].location != frames[i].location) {
+                break;
+            }
+        }
+        if (i == depth) {
+            return site;
+        }
+    }
+    return NULL;
+}
+
+/* Must be called with siteLock held. */
+static ClassRef *
+findClassRef(jlong tag)
+{
+    ClassRef *ref;
+
+    for (ref = classBuckets[(jint)(tag & (CLASS_BUCKETS - 1))]; ref != NULL;
+         ref = ref->next) {
+        if (ref->tag == tag) {
+            return ref;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * The table entry of a class, added if it is new and there is room.
+ * Returns NULL if the tables were taken out since epoch.
+ */
+static ClassRef *
+getClassRef(JNIEnv *env, jint epoch, jlong tag, jclass clazz)
+{
+    ClassRef *ref;
+    ClassRef *fresh;
+
+    lightLock_enter(&siteLock);
+    ref = (epoch == tableEpoch) ? findClassRef(tag) : NULL;
+    lightLock_exit(&siteLock);
+    if (ref != NULL) {
+        return ref;
+    }
+
+    /* Take the ref outside of the lock and look again */
+    fresh = jvmtiAllocate((jint)sizeof(ClassRef));
+    if (fresh == NULL) {
+        return NULL;
+    }
+    fresh->tag = tag;
+    fresh->clazz = NULL;
+    saveGlobalRef(env, clazz, &fresh->clazz);
+
+    lightLock_enter(&siteLock);
+    if (epoch == tableEpoch) {
+        ref = findClassRef(tag);
+        if (ref == NULL && fresh->clazz != NULL && classCount < MAX_CLASSES) {
+            jint index = (jint)(tag & (CLASS_BUCKETS - 1));
+
+            fresh->next = classBuckets[index];
+            classBuckets[index] = fresh;
+            classCount++;
+            ref = fresh;
+            fresh = NULL;
+        }
+    }
+    lightLock_exit(&siteLock);
+
+    if (fresh != NULL) {
+        if (fresh->clazz != NULL) {
+            tossGlobalRef(env, &fresh->clazz);
+        }
+        jvmtiDeallocate(fresh);
+    }
+    return ref;
+}
+
+/*
+ * A new site, not yet in the table. Returns NULL if the classes cannot
+ * be entered into the class table.
+ */
+static AllocSite *
+newSite(JNIEnv *env, jint epoch, jint hash, jlong classTag, jclass clazz,
+        jvmtiFrameInfo *frames, jint depth)
+{
+    AllocSite *site;
+    jint i;
+
+    site = jvmtiAllocate((jint)sizeof(AllocSite));
+    if (site == NULL) {
+        return NULL;
+    }
+    (void)memset(site, 0, sizeof(AllocSite));
+    site->hash = hash;
+    site->classTag = classTag;
+    site->depth = depth;
+    site->classRef = getClassRef(env, epoch, classTag, clazz);
+    if (site->classRef == NULL) {
+        jvmtiDeallocate(site);
+        return NULL;
+    }
+
+    for (i = 0; i < depth; i++) {
+        jclass frameClass;
+        jlong frameTag;
+
+        site->frames[i].method = frames[i].method;
+        site->frames[i].location = frames[i].location;
+        /* The frame is on this thread's stack, so its class is loaded */
+        if (methodClass(frames[i].method, &frameClass) != JVMTI_ERROR_NONE) {
+            jvmtiDeallocate(site);
+            return NULL;
+        }
+        frameTag = classKey(frameClass);
+        if (frameTag != 0) {
+            site->frames[i].classRef = getClassRef(env, epoch, frameTag,
+                                                   frameClass);
+        }
+        JNI_FUNC_PTR(env,DeleteLocalRef)(env, frameClass);
+        if (site->frames[i].classRef == NULL) {
+            jvmtiDeallocate(site);
+            return NULL;
+        }
+    }
+    return site;
+}
+
+/* Must be called with siteLock held. */
+static void
+countSample(AllocSite *site, jlong size)
+{
+    site->count++;
+    site->bytes += size;
+    sampleCount++;
+}
+
+/*
+ * Whether this allocation is to be sampled. Plain memory work, so that
+ * allocations which are not sampled cost next to nothing.
+ */
+jboolean
+allocProfile_isSampled(void)
+{
+    if (!atomic_load_explicit(&profileActive, memory_order_relaxed)) {
+        return JNI_FALSE;
+    }
+    return (atomic_fetch_add_explicit(&allocationCount, 1, memory_order_relaxed) %
+            atomic_load_explicit(&sampleInterval, memory_order_relaxed) == 0) ?
+           JNI_TRUE : JNI_FALSE;
+}
+
+/* Samples an allocation allocProfile_isSampled picked */
+void
+allocProfile_onAlloc(JNIEnv *env, jthread thread, jclass clazz, jlong size)
+{
+    jvmtiFrameInfo frames[MAX_DEPTH];
+    AllocSite *site;
+    AllocSite *fresh;
+    jlong classTag;
+    jint epoch;
+    jint depth;
+    jint hash;
+
+    /* Allocations of the agent's own threads are not sampled */
+    if (threadControl_isDebugThread(thread)) {
+        return;
+    }
+
+    depth = 0;
+    classTag = classKey(clazz);
+    if (classTag == 0 ||
+        JVMTI_FUNC_PTR(gdata->jvmti,GetStackTrace)
+                (gdata->jvmti, thread, 0,
+                 atomic_load_explicit(&sampleDepth, memory_order_relaxed),
+                 frames, &depth) != JVMTI_ERROR_NONE) {
+        lightLock_enter(&siteLock);
+        droppedCount++;
+        lightLock_exit(&siteLock);
+        return;
+    }
+    hash = hashSite(classTag, frames, depth);
+
+    lightLock_enter(&siteLock);
+    epoch = tableEpoch;
+    site = findSite(hash, classTag, frames, depth);
+    if (site != NULL) {
+        countSample(site, size);
+    }
+    lightLock_exit(&siteLock);
+    if (site != NULL) {
+        return;
+    }
+
+    /* A new site; get its classes outside of the lock and look again */
+    fresh = newSite(env, epoch, hash, classTag, clazz, frames, depth);
+
+    lightLock_enter(&siteLock);
+    if (epoch != tableEpoch) {
+        /* The tables were taken out meanwhile, with fresh's class refs */
+        lightLock_exit(&siteLock);
+        jvmtiDeallocate(fresh);
+        return;
+    }
+    site = findSite(hash, classTag, frames, depth);
+    if (site == NULL && fresh != NULL && siteCount < MAX_SITES) {
+        jint index = hash & (BUCKET_COUNT - 1);
+
+        fresh->next = buckets[index];
+        buckets[index] = fresh;
+        siteCount++;
+        site = fresh;
+        fresh = NULL;
+    }
+    if (site != NULL) {
+        countSample(site, size);
+    } else {
+        droppedCount++;
+    }
+    lightLock_exit(&siteLock);
+
+    jvmtiDeallocate(fresh);
+}
+
+jvmtiError
+allocProfile_start(jint interval, jint maxDepth)
+{
+    jvmtiCapabilities caps;
+    jvmtiError error;
+
+    if (interval <= 0 || maxDepth <= 0 || maxDepth > MAX_DEPTH) {
+        return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+    error = jvmtiGetCapabilities(&caps);
+    if (error != JVMTI_ERROR_NONE) {
+        return error;
+    }
+    if (!caps.can_generate_vm_object_alloc_events || tagEnv == NULL) {
+        return JVMTI_ERROR_MUST_POSSESS_CAPABILITY;
+    }
+
+    atomic_store(&sampleInterval, interval);
+    atomic_store(&sampleDepth, maxDepth);
+    if (!atomic_exchange(&profileActive, JNI_TRUE)) {
+        error = JVMTI_FUNC_PTR(gdata->jvmti,SetEventNotificationMode)
+                    (gdata->jvmti, JVMTI_ENABLE, JVMTI_EVENT_VM_OBJECT_ALLOC, NULL);
+        if (error != JVMTI_ERROR_NONE) {
+            atomic_store(&profileActive, JNI_FALSE);
+        }
+    }
+    return error;
+}
+
+void
+allocProfile_stop(void)
+{
+    if (atomic_exchange(&profileActive, JNI_FALSE)) {
+        (void)JVMTI_FUNC_PTR(gdata->jvmti,SetEventNotificationMode)
+                (gdata->jvmti, JVMTI_DISABLE, JVMTI_EVENT_VM_OBJECT_ALLOC, NULL);
+    }
+}
+
+static int
+compareSites(const void *p1, const void *p2)
+{
+    const SiteCounts *s1 = p1;
+    const SiteCounts *s2 = p2;
+
+    /* Most bytes first */
+    if (s1->bytes != s2->bytes) {
+        return (s1->bytes > s2->bytes) ? -1 : 1;
+    }
+    if (s1->count != s2->count) {
+        return (s1->count > s2->count) ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ * Take the sites and the class refs out of the tables. Must be called
+ * with siteLock held.
+ */
+static AllocSite *
+detachSites(ClassRef **classRefs)
+{
+    AllocSite *list;
+    jint i;
+
+    list = NULL;
+    for (i = 0; i < BUCKET_COUNT; i++) {
+        while (buckets[i] != NULL) {
+            AllocSite *site = buckets[i];
+            buckets[i] = site->next;
+            site->next = list;
+            list = site;
+        }
+    }
+    *classRefs = NULL;
+    for (i = 0; i < CLASS_BUCKETS; i++) {
+        while (classBuckets[i] != NULL) {
+            ClassRef *ref = classBuckets[i];
+            classBuckets[i] = ref->next;
+            ref->next = *classRefs;
+            *classRefs = ref;
+        }
+    }
+    classCount = 0;
+    tableEpoch++;
+    siteCount = 0;
+    sampleCount = 0;
+    droppedCount = 0;
+    return list;
+}
+
+static void
+freeSites(JNIEnv *env, AllocSite *list, ClassRef *classRefs)
+{
+    while (list != NULL) {
+        AllocSite *next = list->next;
+        jvmtiDeallocate(list);
+        list = next;
+    }
+    while (classRefs != NULL) {
+        ClassRef *next = classRefs->next;
+        tossGlobalRef(env, &classRefs->clazz);
+        jvmtiDeallocate(classRefs);
+        classRefs = next;
+    }
+}
+
+void
+allocProfile_writeSites(JNIEnv *env, PacketOutputStream *out,
+                        jint maxSites, jboolean clear)
+{
+    SiteCounts *counts;
+    AllocSite *detached;
+    ClassRef *detachedClasses;
+    jlong samples;
+    jlong dropped;
+    jint count;
+    jint i;
+
+    /* Sized before taking the lock; sites added meanwhile wait for the next call */
+    counts = jvmtiAllocate(MAX_SITES * (jint)sizeof(SiteCounts));
+    if (counts == NULL) {
+        outStream_setError(out, JDWP_ERROR(OUT_OF_MEMORY));
+        return;
+    }
+
+    count = 0;
+    lightLock_enter(&siteLock);
+    {
+        for (i = 0; i < BUCKET_COUNT; i++) {
+            AllocSite *site;
+            for (site = buckets[i]; site != NULL; site = site->next) {
+                counts[count].site = site;
+                counts[count].count = site->count;
+                counts[count].bytes = site->bytes;
+                count++;
+            }
+        }
+        samples = sampleCount;
+        dropped = droppedCount;
+        detached = NULL;
+        detachedClasses = NULL;
+        if (clear) {
+            detached = detachSites(&detachedClasses);
+        }
+    }
+    lightLock_exit(&siteLock);
+
+    if (count > 1) {
+        qsort(counts, count, sizeof(SiteCounts), compareSites);
+    }
+    if (maxSites >= 0 && maxSites < count) {
+        count = maxSites;
+    }
+
+    (void)outStream_writeInt(out, atomic_load(&sampleInterval));
+    (void)outStream_writeLong(out, atomic_load(&allocationCount));
+    (void)outStream_writeLong(out, samples);
+    (void)outStream_writeLong(out, dropped);
+    (void)outStream_writeInt(out, count);
+    for (i = 0; i < count; i++) {
+        AllocSite *site = counts[i].site;
+        jclass clazz = site->classRef->clazz;
+        jint j;
+
+        (void)outStream_writeByte(out, referenceTypeTag(clazz));
+        (void)outStream_writeObjectRef(env, out, clazz);
+        (void)outStream_writeLong(out, counts[i].count);
+        (void)outStream_writeLong(out, counts[i].bytes);
+        (void)outStream_writeInt(out, site->depth);
+        for (j = 0; j < site->depth; j++) {
+            writeCodeLocation(out, site->frames[j].classRef->clazz,
+                              site->frames[j].method,
+                              site->frames[j].location);
+        }
+    }
+
+    if (clear) {
+        atomic_store(&allocationCount, 0);
+        freeSites(env, detached, detachedClasses);
+    }
+    jvmtiDeallocate(counts);
+}
+
+void
+allocProfile_initialize(void)
+{
+    lightLock_init(&siteLock, "JDWP Allocation Site Lock");
+    tagEnv = getSpecialJvmti();
+}
+
+void
+allocProfile_reset(void)
+{
+    AllocSite *detached;
+    ClassRef *detachedClasses;
+
+    allocProfile_stop();
+    lightLock_enter(&siteLock);
+    detached = detachSites(&detachedClasses);
+    lightLock_exit(&siteLock);
+    atomic_store(&allocationCount, 0);
+    freeSites(getEnv(), detached, detachedClasses);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+#ifndef JDWP_ALLOCPROFILE_H
+#define JDWP_ALLOCPROFILE_H
+
+#include "outStream.h"
+
+/*
+ * Allocation profiling. While active, the agent enables VMObjectAlloc
+ * events for itself, samples every Nth allocation and aggregates the
+ * samples by allocated class and allocation site.
+ */
+
+void allocProfile_initialize(void);
+void allocProfile_reset(void);
+
+jvmtiError allocProfile_start(jint interval, jint maxDepth);
+void allocProfile_stop(void);
+jboolean allocProfile_isSampled(void);
+void allocProfile_onAlloc(JNIEnv *env, jthread thread, jclass clazz,
+                          jlong size);
+void allocProfile_writeSites(JNIEnv *env, PacketOutputStream *out,
+                             jint maxSites, jboolean clear);
+
+#endif
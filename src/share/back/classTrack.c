@@ -64,6 +64,16 @@
  * done before the event-handler system is setup or done while
  * holding the event handlerLock. The list of freed classes is
  * protected by the classTagLock.
+ *
+ * ANDROID-CHANGED: The tag counter doubles as a class-set generation
+ * number. Every prepared class is stamped with a new generation (its
+ * tag) and every batch of unloads processed bumps the generation once
+ * and is recorded in a bounded log. This lets a debugger that has seen
+ * the class set at some generation ask only for what changed since
+ * (see classTrack_changesSince and Vendor.ClassesChangedSince).
+ * Generations given out carry an epoch of this agent instance in their
+ * upper bits, so that a generation saved against another process is
+ * never taken for one of ours.
  */
 
 #include "util.h"
@@ -106,6 +116,91 @@ static jrawMonitorID deletedTagLock;
  */
 struct bag* deletedTagBag;
 
+/*
+ * ANDROID-CHANGED: A record of a class unloaded at some generation.
+ */
+typedef struct UnloadRecord {
+    jlong generation;        /* Generation at which the unload was processed */
+    char *signature;         /* class signature (a copy owned by the record) */
+} UnloadRecord;
+
+/*
+ * Upper bound on the number of unload records we keep. Once exceeded
+ * the log is dropped and unloadFloor raised, so that requests for changes
+ * since an older generation fall back to the full class set.
+ */
+#define MAX_UNLOAD_RECORDS 4096
+
+/*
+ * ANDROID-CHANGED: Unloads processed since generation unloadFloor. Protected by the
+ * handlerLock like the KlassNode list.
+ */
+static struct bag *unloadRecords;
+static jlong unloadFloor;
+
+/*
+ * ANDROID-CHANGED: Layout of a generation as given out: the epoch above
+ * GENERATION_BITS, the tag counter below. generationEpoch is already
+ * shifted into place; it is picked at startup and is never 0.
+ */
+#define GENERATION_BITS 39
+#define GENERATION_MASK ((((jlong)1) << GENERATION_BITS) - 1)
+#define EPOCH_MASK      ((jlong)0xffffff)
+
+static jlong generationEpoch;
+
+static jboolean
+freeUnloadRecord(void *item, void *arg)
+{
+    jvmtiDeallocate(((UnloadRecord *)item)->signature);
+    return JNI_TRUE;
+}
+
+static void
+clearUnloadRecords(void)
+{
+    (void)bagEnumerateOver(unloadRecords, freeUnloadRecord, NULL);
+    bagDeleteAll(unloadRecords);
+}
+
+/*
+ * Log the given unloaded signatures under a new generation.
+ */
+static jboolean
+recordUnload(void *item, void *arg)
+{
+    char *signature = *(char **)item;
+    UnloadRecord *record;
+
+    record = bagAdd(unloadRecords);
+    if (record == NULL) {
+        EXIT_ERROR(AGENT_ERROR_OUT_OF_MEMORY,"UnloadRecord");
+    }
+    record->generation = currentKlassTag;
+    record->signature = jvmtiAllocate((int)strlen(signature) + 1);
+    if (record->signature == NULL) {
+        EXIT_ERROR(AGENT_ERROR_OUT_OF_MEMORY,"UnloadRecord signature");
+    }
+    (void)strcpy(record->signature, signature);
+    return JNI_TRUE;
+}
+
+static void
+recordUnloads(struct bag *signatures)
+{
+    if (bagSize(signatures) == 0) {
+        return;
+    }
+    ++currentKlassTag;
+    if (bagSize(unloadRecords) + bagSize(signatures) > MAX_UNLOAD_RECORDS) {
+        /* Older generations can no longer be answered with a delta. */
+        clearUnloadRecords();
+        unloadFloor = currentKlassTag;
+        return;
+    }
+    (void)bagEnumerateOver(signatures, recordUnload, NULL);
+}
+
 /*
  * The callback for when classes are freed. Only classes are called because this is registered with
  * the trackingEnv which only tags classes.
@@ -192,6 +287,8 @@ classTrack_processUnloads(JNIEnv *env)
         bagDeleteAll(deletedTagBag);
     }
     debugMonitorExit(deletedTagLock);
+    /* ANDROID-CHANGED: Log the unloads for classTrack_changesSince */
+    recordUnloads(deleted);
     return deleted;
 }
 
@@ -239,6 +336,115 @@ classTrack_addPreparedClass(JNIEnv *env, jclass klass)
     list = node;
 }
 
+typedef struct UnloadQuery {
+    jlong generation;
+    struct bag *signatures;
+} UnloadQuery;
+
+static jboolean
+collectUnload(void *item, void *arg)
+{
+    UnloadRecord *record = item;
+    UnloadQuery *query = arg;
+    char **signature;
+
+    if (record->generation <= query->generation) {
+        return JNI_TRUE;
+    }
+    signature = bagAdd(query->signatures);
+    if (signature == NULL) {
+        EXIT_ERROR(AGENT_ERROR_OUT_OF_MEMORY,"unloaded signature");
+    }
+    *signature = jvmtiAllocate((int)strlen(record->signature) + 1);
+    if (*signature == NULL) {
+        EXIT_ERROR(AGENT_ERROR_OUT_OF_MEMORY,"unloaded signature");
+    }
+    (void)strcpy(*signature, record->signature);
+    return JNI_TRUE;
+}
+
+/*
+ * ANDROID-CHANGED: Collect the changes to the prepared class set since 'generation'.
+ *
+ * The tags of classes prepared after 'generation' are returned in addedTags (allocated
+ * with jvmtiAllocate) and copies of the signatures of classes unloaded after it are
+ * added to removedSignatures (char* items, to be freed by the caller). If 'generation'
+ * is 0, predates the unload log or is not a generation of this agent (its epoch
+ * differs), the tags of all prepared classes are returned instead and *isDelta is
+ * set to JNI_FALSE. Returns the current generation, or 0 if the counter no longer
+ * fits next to the epoch.
+ */
+jlong
+classTrack_changesSince(jlong generation, jint *addedCount, jlong **addedTags,
+                        struct bag *removedSignatures, jboolean *isDelta)
+{
+    KlassNode *node;
+    jint count;
+    jint i;
+
+    *isDelta = ((generation & ~GENERATION_MASK) == generationEpoch &&
+                currentKlassTag <= GENERATION_MASK);
+    generation &= GENERATION_MASK;
+    *isDelta = *isDelta && (generation > 0 && generation >= unloadFloor &&
+                            generation <= currentKlassTag);
+    if (!*isDelta) {
+        generation = 0;
+    }
+
+    /* Nodes are kept newest first, so stop at the first older one. */
+    count = 0;
+    for (node = list; node != NULL && node->klass_tag > generation; node = node->next) {
+        count++;
+    }
+    *addedTags = jvmtiAllocate((count + 1) * (jint)sizeof(jlong));
+    if (*addedTags == NULL) {
+        EXIT_ERROR(AGENT_ERROR_OUT_OF_MEMORY,"class tags");
+    }
+    for (i = 0, node = list; i < count; i++, node = node->next) {
+        (*addedTags)[i] = node->klass_tag;
+    }
+    *addedCount = count;
+
+    if (*isDelta) {
+        UnloadQuery query;
+        query.generation = generation;
+        query.signatures = removedSignatures;
+        (void)bagEnumerateOver(unloadRecords, collectUnload, &query);
+    }
+    if (currentKlassTag > GENERATION_MASK) {
+        return 0;
+    }
+    return generationEpoch | currentKlassTag;
+}
+
+/*
+ * ANDROID-CHANGED: Map class tags collected by classTrack_changesSince to local
+ * references. Classes freed since are left out. The returned array is allocated
+ * with jvmtiAllocate.
+ */
+jvmtiError
+classTrack_classesForTags(jint tagCount, jlong *tags, jint *classCount, jclass **classes)
+{
+    return JVMTI_FUNC_PTR(trackingEnv,GetObjectsWithTags)
+                (trackingEnv, tagCount, tags, classCount, (jobject **)classes, NULL);
+}
+
+/*
+ * ANDROID-CHANGED: The tag of a prepared class, or 0 if it is not tracked.
+ * Tags are not reused, so unlike a jclass or a jmethodID a tag tells a class
+ * apart from one loaded after it was unloaded. Needs no lock.
+ */
+jlong
+classTrack_getTag(jclass klass)
+{
+    jlong tag = 0;
+
+    if (JVMTI_FUNC_PTR(trackingEnv,GetTag)(trackingEnv, klass, &tag) != JVMTI_ERROR_NONE) {
+        return 0;
+    }
+    return tag;
+}
+
 static jboolean
 setupEvents()
 {
@@ -286,6 +492,15 @@ classTrack_initialize(JNIEnv *env)
     }
     currentKlassTag = 0l;
     list = NULL;
+    /* ANDROID-CHANGED: Setup the unload log */
+    unloadRecords = bagCreateBag(sizeof(UnloadRecord), 10);
+    unloadFloor = 0l;
+    /* ANDROID-CHANGED: Pick the epoch from the startup time */
+    {
+        jlong now = nanoTime();
+        jlong epoch = contentHash((const unsigned char *)&now, (jint)sizeof(now)) & EPOCH_MASK;
+        generationEpoch = ((epoch == 0) ? 1 : epoch) << GENERATION_BITS;
+    }
     WITH_LOCAL_REFS(env, 1) {
 
         jint classCount;
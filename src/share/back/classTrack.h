@@ -39,6 +39,27 @@ classTrack_processUnloads(JNIEnv *env);
 void
 classTrack_addPreparedClass(JNIEnv *env, jclass klass);
 
+/*
+ * ANDROID-CHANGED: Collect the tags of classes prepared and the signatures of
+ * classes unloaded since the given class-set generation. Returns the current
+ * generation.
+ */
+jlong
+classTrack_changesSince(jlong generation, jint *addedCount, jlong **addedTags,
+                        struct bag *removedSignatures, jboolean *isDelta);
+
+/*
+ * ANDROID-CHANGED: Get the classes still loaded for the given tags.
+ */
+jvmtiError
+classTrack_classesForTags(jint tagCount, jlong *tags, jint *classCount, jclass **classes);
+
+/*
+ * ANDROID-CHANGED: The unique tag of a prepared class, 0 if it is not tracked.
+ */
+jlong
+classTrack_getTag(jclass klass);
+
 /*
  * Initialize class tracking.
  */
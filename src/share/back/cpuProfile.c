@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+/*
+ * ANDROID-CHANGED: Sampling CPU profiler.
+ *
+ * Suspending threads to read their frames distorts what is being
+ * measured. Instead, while profiling is active an agent thread wakes
+ * up every sampling interval and takes the stacks of all threads with
+ * GetAllStackTraces, which does not change any suspend count the
+ * debugger can see. Stacks of runnable application threads which are
+ * not in native code or suspended are merged into a call tree keyed
+ * by method and location, each node counting the samples which had it
+ * on top of the stack. The tree is written out on demand as collapsed
+ * stacks, one entry per distinct stack with its sample count.
+ *
+ * Nodes come from fixed size chunks and point to the declaring class
+ * of their method in a class table, which holds one global ref per
+ * class (keyed by its classTrack tag), so the jmethodIDs stay valid
+ * for as long as the nodes exist. Global refs are a scarce resource
+ * of the VM, so the class table is bounded well below its limit, as
+ * is the number of nodes; samples which would need more are counted
+ * as dropped. Everything except the taking of stacks is done with
+ * profileLock held.
+ */
+
+#include "util.h"
+#include "threadControl.h"
+#include "classTrack.h"
+#include "cpuProfile.h"
+
+#define MAX_DEPTH       1024
+#define MAX_NODES       (64 * 1024)
+#define NODES_PER_CHUNK 1024
+#define MAX_CLASSES     2048
+#define CLASS_BUCKETS   256
+
+typedef struct ClassRef {
+    struct ClassRef *next;      /* hash chain */
+    jlong tag;                  /* see classTrack_getTag */
+    jclass clazz;               /* global ref */
+} ClassRef;
+
+typedef struct CallNode {
+    jmethodID method;
+    jlocation location;
+    ClassRef *classRef;         /* NULL for the root */
+    jlong selfCount;
+    struct CallNode *children;
+    struct CallNode *sibling;
+} CallNode;
+
+typedef struct NodeChunk {
+    struct NodeChunk *next;
+    jint used;
+    CallNode nodes[NODES_PER_CHUNK];
+} NodeChunk;
+
+static jrawMonitorID profileLock;
+
+/* Protected by profileLock */
+static jboolean samplerStarted;
+static jboolean profileActive;
+static jint sampleInterval;     /* milliseconds */
+static jint sampleDepth;
+static CallNode root;
+static NodeChunk *chunks;
+static jint nodeCount;
+static jlong sampleCount;
+static jlong droppedCount;
+static ClassRef *classBuckets[CLASS_BUCKETS];
+static jint classCount;
+
+/* Returns the entry of a class, adding it if there is room */
+static ClassRef *
+findClassRef(JNIEnv *env, jclass clazz)
+{
+    jlong tag = classTrack_getTag(clazz);
+    ClassRef **bucket;
+    ClassRef *ref;
+
+    if (tag == 0) {
+        return NULL;
+    }
+    bucket = &classBuckets[(jint)(tag & (CLASS_BUCKETS - 1))];
+    for (ref = *bucket; ref != NULL; ref = ref->next) {
+        if (ref->tag == tag) {
+            return ref;
+        }
+    }
+    if (classCount >= MAX_CLASSES) {
+        return NULL;
+    }
+    ref = jvmtiAllocate((jint)sizeof(ClassRef));
+    if (ref == NULL) {
+        return NULL;
+    }
+    ref->tag = tag;
+    ref->clazz = NULL;
+    saveGlobalRef(env, clazz, &ref->clazz);
+    if (ref->clazz == NULL) {
+        jvmtiDeallocate(ref);
+        return NULL;
+    }
+    ref->next = *bucket;
+    *bucket = ref;
+    classCount++;
+    return ref;
+}
+
+static CallNode *
+newNode(void)
+{
+    NodeChunk *chunk;
+
+    if (nodeCount >= MAX_NODES) {
+        return NULL;
+    }
+    chunk = chunks;
+    if (chunk == NULL || chunk->used == NODES_PER_CHUNK) {
+        chunk = jvmtiAllocate((jint)sizeof(NodeChunk));
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = chunks;
+        chunk->used = 0;
+        chunks = chunk;
+    }
+    nodeCount++;
+    return &chunk->nodes[chunk->used++];
+}
+
+/*
+ * Find the child of parent for the given frame, adding it if it is
+ * new. Found children are moved to the front, as the same few paths
+ * tend to be sampled over and over.
+ */
+static CallNode *
+findChild(JNIEnv *env, CallNode *parent, jvmtiFrameInfo *frame)
+{
+    CallNode *prev;
+    CallNode *node;
+    ClassRef *classRef;
+    jclass clazz;
+
+    prev = NULL;
+    for (node = parent->children; node != NULL; node = node->sibling) {
+        if (node->method == frame->method &&
+            node->location == frame->location) {
+            if (prev != NULL) {
+                prev->sibling = node->sibling;
+                node->sibling = parent->children;
+                parent->children = node;
+            }
+            return node;
+        }
+        prev = node;
+    }
+
+    /* The class may be unloaded by now, then the sample is dropped */
+    if (methodClass(frame->method, &clazz) != JVMTI_ERROR_NONE) {
+        return NULL;
+    }
+    classRef = findClassRef(env, clazz);
+    JNI_FUNC_PTR(env,DeleteLocalRef)(env, clazz);
+    if (classRef == NULL) {
+        return NULL;
+    }
+    node = newNode();
+    if (node != NULL) {
+        (void)memset(node, 0, sizeof(CallNode));
+        node->method = frame->method;
+        node->location = frame->location;
+        node->classRef = classRef;
+        node->sibling = parent->children;
+        parent->children = node;
+    }
+    return node;
+}
+
+static jboolean
+isSampled(jvmtiStackInfo *info)
+{
+    jint state = info->state;
+
+    if ((state & JVMTI_THREAD_STATE_RUNNABLE) == 0 ||
+        (state & (JVMTI_THREAD_STATE_SUSPENDED |
+                  JVMTI_THREAD_STATE_IN_NATIVE)) != 0 ||
+        info->frame_count == 0) {
+        return JNI_FALSE;
+    }
+    return !threadControl_isDebugThread(info->thread);
+}
+
+/* Must be called with profileLock held. */
+static void
+addStack(JNIEnv *env, jvmtiStackInfo *info)
+{
+    CallNode *node;
+    jint i;
+
+    node = &root;
+    for (i = info->frame_count - 1; i >= 0; i--) {
+        node = findChild(env, node, &info->frame_buffer[i]);
+        if (node == NULL) {
+            droppedCount++;
+            return;
+        }
+    }
+    node->selfCount++;
+    sampleCount++;
+}
+
+static void
+takeSample(JNIEnv *env, jint maxDepth)
+{
+    jvmtiStackInfo *stacks;
+    jint threadCount;
+    jvmtiError error;
+    jint i;
+
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetAllStackTraces)
+                (gdata->jvmti, maxDepth, &stacks, &threadCount);
+    if (error != JVMTI_ERROR_NONE) {
+        return;
+    }
+
+    debugMonitorEnter(profileLock);
+    for (i = 0; i < threadCount; i++) {
+        /* Profiling may have been stopped meanwhile */
+        if (profileActive && isSampled(&stacks[i])) {
+            addStack(env, &stacks[i]);
+        }
+        JNI_FUNC_PTR(env,DeleteLocalRef)(env, stacks[i].thread);
+    }
+    debugMonitorExit(profileLock);
+
+    jvmtiDeallocate(stacks);
+}
+
+static void JNICALL
+samplerThread(jvmtiEnv *jvmti_env, JNIEnv *env, void *arg)
+{
+    LOG_MISC(("Begin CPU sampler"));
+
+    debugMonitorEnter(profileLock);
+    while (!gdata->vmDead) {
+        jint depth;
+
+        if (!profileActive) {
+            debugMonitorWait(profileLock);
+            continue;
+        }
+        debugMonitorTimedWait(profileLock, sampleInterval);
+        if (!profileActive || gdata->vmDead) {
+            continue;
+        }
+        depth = sampleDepth;
+        debugMonitorExit(profileLock);
+
+        takeSample(env, depth);
+
+        debugMonitorEnter(profileLock);
+    }
+    debugMonitorExit(profileLock);
+
+    LOG_MISC(("End CPU sampler"));
+}
+
+jvmtiError
+cpuProfile_start(jint intervalMillis, jint maxDepth)
+{
+    jvmtiError error;
+    jboolean spawn;
+
+    if (intervalMillis <= 0 || maxDepth <= 0 || maxDepth > MAX_DEPTH) {
+        return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    debugMonitorEnter(profileLock);
+    {
+        spawn = !samplerStarted;
+        samplerStarted = JNI_TRUE;
+        sampleInterval = intervalMillis;
+        sampleDepth = maxDepth;
+        profileActive = JNI_TRUE;
+        debugMonitorNotifyAll(profileLock);
+    }
+    debugMonitorExit(profileLock);
+
+    /* The sampler thread is started once and idles while inactive */
+    error = JVMTI_ERROR_NONE;
+    if (spawn) {
+        error = spawnNewThread(samplerThread, NULL, "JDWP CPU Sampler");
+        if (error != JVMTI_ERROR_NONE) {
+            debugMonitorEnter(profileLock);
+            samplerStarted = JNI_FALSE;
+            profileActive = JNI_FALSE;
+            debugMonitorExit(profileLock);
+        }
+    }
+    return error;
+}
+
+void
+cpuProfile_stop(void)
+{
+    debugMonitorEnter(profileLock);
+    {
+        profileActive = JNI_FALSE;
+        debugMonitorNotifyAll(profileLock);
+    }
+    debugMonitorExit(profileLock);
+}
+
+/* Must be called with profileLock held. */
+static void
+clearLocked(JNIEnv *env)
+{
+    jint i;
+
+    while (chunks != NULL) {
+        NodeChunk *next = chunks->next;
+
+        jvmtiDeallocate(chunks);
+        chunks = next;
+    }
+    for (i = 0; i < CLASS_BUCKETS; i++) {
+        while (classBuckets[i] != NULL) {
+            ClassRef *ref = classBuckets[i];
+
+            classBuckets[i] = ref->next;
+            tossGlobalRef(env, &ref->clazz);
+            jvmtiDeallocate(ref);
+        }
+    }
+    classCount = 0;
+    (void)memset(&root, 0, sizeof(root));
+    nodeCount = 0;
+    sampleCount = 0;
+    droppedCount = 0;
+}
+
+static jint
+countStacks(CallNode *node)
+{
+    CallNode *child;
+    jint count;
+
+    count = (node->selfCount > 0) ? 1 : 0;
+    for (child = node->children; child != NULL; child = child->sibling) {
+        count += countStacks(child);
+    }
+    return count;
+}
+
+/* Write the stack ending in each node with samples, outermost frame first */
+static void
+writeStacks(PacketOutputStream *out, CallNode *node,
+            CallNode **path, jint depth)
+{
+    CallNode *child;
+    jint i;
+
+    if (node->selfCount > 0) {
+        (void)outStream_writeLong(out, node->selfCount);
+        (void)outStream_writeInt(out, depth);
+        for (i = 0; i < depth; i++) {
+            writeCodeLocation(out, path[i]->classRef->clazz,
+                              path[i]->method, path[i]->location);
+        }
+    }
+    for (child = node->children; child != NULL; child = child->sibling) {
+        path[depth] = child;
+        writeStacks(out, child, path, depth + 1);
+    }
+}
+
+void
+cpuProfile_writeStacks(JNIEnv *env, PacketOutputStream *out, jboolean clear)
+{
+    CallNode **path;
+
+    path = jvmtiAllocate(MAX_DEPTH * (jint)sizeof(CallNode *));
+    if (path == NULL) {
+        outStream_setError(out, JDWP_ERROR(OUT_OF_MEMORY));
+        return;
+    }
+
+    debugMonitorEnter(profileLock);
+    {
+        (void)outStream_writeLong(out, sampleCount);
+        (void)outStream_writeLong(out, droppedCount);
+        (void)outStream_writeInt(out, countStacks(&root));
+        writeStacks(out, &root, path, 0);
+        if (clear) {
+            clearLocked(env);
+        }
+    }
+    debugMonitorExit(profileLock);
+
+    jvmtiDeallocate(path);
+}
+
+void
+cpuProfile_initialize(void)
+{
+    profileLock = debugMonitorCreate("JDWP CPU Profile Lock");
+    chunks = NULL;
+    (void)memset(&root, 0, sizeof(root));
+}
+
+void
+cpuProfile_reset(void)
+{
+    debugMonitorEnter(profileLock);
+    {
+        profileActive = JNI_FALSE;
+        debugMonitorNotifyAll(profileLock);
+        clearLocked(getEnv());
+    }
+    debugMonitorExit(profileLock);
+}
@@ -43,6 +43,7 @@
 #include "EventRequestImpl.h"
 #include "StackFrameImpl.h"
 #include "DDMImpl.h"
+#include "VendorImpl.h"
 
 static void **l1Array;
 
@@ -98,6 +99,9 @@ debugDispatch_getHandler(int cmdSet, int cmd)
     // ANDROID-CHANGED: DDMS has cmdSet -57 (199u). Check for this one specifically.
     if (cmdSet == JDWP_COMMAND_SET(DDM)) {
         l2Array = (void **)DDM_Cmds;
+    // ANDROID-CHANGED: Agent specific extensions have cmdSet -56 (200u).
+    } else if (cmdSet == JDWP_COMMAND_SET(Vendor)) {
+        l2Array = (void **)Vendor_Cmds;
     } else if (cmdSet > JDWP_HIGHEST_COMMAND_SET || cmdSet < 0) {
         return NULL;
     } else {
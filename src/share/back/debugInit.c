@@ -42,6 +42,10 @@
 // ANDROID-CHANGED: Allow us to initialize VMDebug & ddms apis.
 #include "vmDebug.h"
 #include "DDMImpl.h"
+#include "monitorProfile.h"
+#include "cpuProfile.h"
+#include "allocProfile.h"
+#include "lineCoverage.h"
 
 /* How the options get to OnLoad: */
 #define XDEBUG "-Xdebug"
@@ -413,6 +417,9 @@ Agent_OnLoad(JavaVM *vm, char *options, void *reserved)
         = potential_capabilities.can_get_owned_monitor_stack_depth_info;
     needed_capabilities.can_get_constant_pool
                 = potential_capabilities.can_get_constant_pool;
+    /* ANDROID-CHANGED: Needed for allocation profiling */
+    needed_capabilities.can_generate_vm_object_alloc_events
+                = potential_capabilities.can_generate_vm_object_alloc_events;
     {
         needed_capabilities.can_get_source_debug_extension      = 1;
         needed_capabilities.can_get_source_file_name            = 1;
@@ -802,6 +809,18 @@ initialize(JNIEnv *env, jthread thread, EventIndex triggering_ei)
     // ANDROID-CHANGED: Set up DDM
     DDM_initialize();
 
+    // ANDROID-CHANGED: Set up monitor contention profiling
+    monitorProfile_initialize();
+
+    // ANDROID-CHANGED: Set up CPU sampling
+    cpuProfile_initialize();
+
+    // ANDROID-CHANGED: Set up allocation profiling
+    allocProfile_initialize();
+
+    // ANDROID-CHANGED: Set up line coverage collection
+    lineCoverage_initialize();
+
     // ANDROID-CHANGED: Take over relevant VMDebug APIs.
     vmDebug_initalize(env);
 
@@ -857,7 +876,7 @@ initialize(JNIEnv *env, jthread thread, EventIndex triggering_ei)
         initEventBag = eventHelper_createEventBag();
         (void)memset(&info,0,sizeof(info));
         info.ei = triggering_ei;
-        eventHelper_recordEvent(&info, 0, suspendPolicy, initEventBag);
+        eventHelper_recordEvent(&info, 0, suspendPolicy, 0, initEventBag);
         (void)eventHelper_reportEvents(currentSessionID, initEventBag);
         bagDestroyBag(initEventBag);
     }
@@ -882,6 +901,12 @@ debugInit_reset(JNIEnv *env)
     currentSessionID++;
     initComplete = JNI_FALSE;
 
+    // ANDROID-CHANGED: Stop profiling and coverage before the handlers
+    // are freed.
+    monitorProfile_reset();
+    cpuProfile_reset();
+    allocProfile_reset();
+    lineCoverage_reset();
     eventHandler_reset(currentSessionID);
     transport_reset();
     debugDispatch_reset();
@@ -971,6 +996,8 @@ printUsage(void)
  "onthrow=<exception name>         debug on throw                    none\n"
  "onuncaught=y|n                   debug on any uncaught?            n\n"
  "timeout=<timeout value>          for listen/attach in milliseconds n\n"
+ /* ANDROID-CHANGED: Added socketbuffer */
+ "socketbuffer=<bytes>             socket send/receive buffer size   system\n"
  "mutf8=y|n                        output modified utf-8             n\n"
  "quiet=y|n                        control over terminal messages    n\n"
  "\n"
@@ -1118,6 +1145,8 @@ parseOptions(char *options)
     logfile             = DEFAULT_LOGFILE;
     // ANDROID-CHANGED: By default we assume ddms is off initially.
     gdata->ddmInitiallyActive = JNI_FALSE;
+    /* ANDROID-CHANGED: Keep the system's socket buffer sizing */
+    gdata->transportBufferSize = 0;
 
     /* Options being NULL will end up being an error. */
     if (options == NULL) {
@@ -1208,6 +1237,18 @@ parseOptions(char *options)
             }
             currentTransport->timeout = atol(current);
             current += strlen(current) + 1;
+        } else if (strcmp(buf, "socketbuffer") == 0) {
+            /* ANDROID-CHANGED: Added socketbuffer */
+            /*LINTED*/
+            if (!get_tok(&str, current, (int)(end - current), ',')) {
+                goto syntax_error;
+            }
+            gdata->transportBufferSize = atoi(current);
+            if (gdata->transportBufferSize < 0) {
+                errmsg = "socketbuffer must not be negative";
+                goto bad_option_with_errmsg;
+            }
+            current += strlen(current) + 1;
         } else if (strcmp(buf, "launch") == 0) {
             /*LINTED*/
             if (!get_tok(&str, current, (int)(end - current), ',')) {
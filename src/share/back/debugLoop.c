@@ -40,6 +40,10 @@
 
 
 static void JNICALL reader(jvmtiEnv* jvmti_env, JNIEnv* jni_env, void* arg);
+static void JNICALL writer(jvmtiEnv* jvmti_env, JNIEnv* jni_env, void* arg);
+static void queueReply(PacketOutputStream *out);
+static void waitForReplies(void);
+static void stopWriter(void);
 static void enqueue(jdwpPacket *p);
 static jboolean dequeue(jdwpPacket *p);
 static void notifyTransportError(void);
@@ -50,10 +54,27 @@ struct PacketList {
 };
 
 static volatile struct PacketList *cmdQueue;
-static jrawMonitorID cmdQueueLock;
+/* ANDROID-CHANGED: Lightweight lock, see lightLock.c */
+static LightLock cmdQueueLock;
 static jrawMonitorID vmDeathLock;
 static jboolean transportError;
 
+/*
+ * ANDROID-CHANGED: Replies are transmitted by the "JDWP Reply Writer"
+ * thread, so neither the vmDeathLock nor the command loop wait for the
+ * transport. The command loop executes and encodes a command under the
+ * vmDeathLock, appends the encoded reply here and goes on with the next
+ * command while the writer drains the queue in order. The sequence
+ * numbers let debugLoop_sync wait for the replies queued so far.
+ */
+static struct PacketList *replyQueue;
+static struct PacketList *replyQueueTail;
+static LightLock replyQueueLock;
+static jlong repliesQueued;
+static jlong repliesSent;
+static jboolean writerStopping;
+static jboolean writerRunning;
+
 static jboolean
 lastCommand(jdwpCmdPacket *cmd)
 {
@@ -77,6 +98,14 @@ debugLoop_sync(void)
 {
     debugMonitorEnter(vmDeathLock);
     debugMonitorExit(vmDeathLock);
+
+    /*
+     * ANDROID-CHANGED: The command that held the vmDeathLock has only
+     * queued its reply; wait until the writer has handed it to the
+     * transport, and make the transport flush it.
+     */
+    waitForReplies();
+    transport_setBatching(JNI_FALSE);
 }
 
 /*
@@ -93,13 +122,27 @@ debugLoop_run(void)
     /* Initialize all statics */
     /* We may be starting a new connection after an error */
     cmdQueue = NULL;
-    cmdQueueLock = debugMonitorCreate("JDWP Command Queue Lock");
+    lightLock_init(&cmdQueueLock, "JDWP Command Queue Lock");
     transportError = JNI_FALSE;
 
+    /* ANDROID-CHANGED: Reply writer state */
+    replyQueue = NULL;
+    replyQueueTail = NULL;
+    lightLock_init(&replyQueueLock, "JDWP Reply Queue Lock");
+    repliesQueued = 0;
+    repliesSent = 0;
+    writerStopping = JNI_FALSE;
+    writerRunning = JNI_TRUE;
+
     shouldListen = JNI_TRUE;
 
     func = &reader;
     (void)spawnNewThread(func, NULL, "JDWP Command Reader");
+    // ANDROID-CHANGED: Replies are sent by their own thread.
+    func = &writer;
+    if (spawnNewThread(func, NULL, "JDWP Reply Writer") != JVMTI_ERROR_NONE) {
+        writerRunning = JNI_FALSE;
+    }
 
     standardHandlers_onConnect();
     threadControl_onConnect();
@@ -136,6 +179,8 @@ debugLoop_run(void)
              * that a command after VM_DEATH will be allowed to complete
              * before the thread posting the VM_DEATH continues VM
              * termination.
+             * ANDROID-CHANGED: "Replying" only queues the reply for the
+             * writer thread; debugLoop_sync also waits for it to be sent.
              */
             debugMonitorEnter(vmDeathLock);
 
@@ -182,7 +227,8 @@ debugLoop_run(void)
                 if (inStream_error(&in)) {
                     outStream_setError(&out, inStream_error(&in));
                 }
-                outStream_sendReply(&out);
+                // ANDROID-CHANGED: Sent by the writer thread.
+                queueReply(&out);
             }
 
             /*
@@ -196,6 +242,9 @@ debugLoop_run(void)
             shouldListen = !lastCommand(cmd);
         }
     }
+    // ANDROID-CHANGED: Let the writer send the remaining replies.
+    stopWriter();
+
     threadControl_onDisconnect();
     standardHandlers_onDisconnect();
 
@@ -205,7 +254,6 @@ debugLoop_run(void)
      * be trying to send.
      */
     transport_close();
-    debugMonitorDestroy(cmdQueueLock);
 
     // ANDROID-CHANGED: Tell vmDebug we have disconnected.
     vmDebug_onDisconnect();
@@ -268,6 +316,126 @@ reader(jvmtiEnv* jvmti_env, JNIEnv* jni_env, void* arg)
     LOG_MISC(("End reader thread"));
 }
 
+/*
+ * ANDROID-CHANGED: Reply writer. While more replies are queued the
+ * transport may hold a reply back so that a burst goes out together;
+ * the last reply of the burst flushes them. Commands still waiting to
+ * run do not count, a finished reply is never held for them, and
+ * batching is always off while the writer waits.
+ */
+static void JNICALL
+writer(jvmtiEnv* jvmti_env, JNIEnv* jni_env, void* arg)
+{
+    LOG_MISC(("Begin writer thread"));
+
+    lightLock_enter(&replyQueueLock);
+    for (;;) {
+        struct PacketList *node;
+        jboolean more;
+
+        while (replyQueue == NULL && !writerStopping) {
+            lightLock_wait(&replyQueueLock);
+        }
+        if (replyQueue == NULL) {
+            break;
+        }
+        node = replyQueue;
+        replyQueue = node->next;
+        if (replyQueue == NULL) {
+            replyQueueTail = NULL;
+        }
+        more = (replyQueue != NULL);
+        lightLock_exit(&replyQueueLock);
+
+        if (more) {
+            transport_setBatching(JNI_TRUE);
+        }
+        (void)transport_sendPacket(&node->packet);
+        if (!more) {
+            /*
+             * Never wait for the next reply with packets held back: a
+             * command may not reply at all (invokes reply from the
+             * invoking thread), and events would be stuck behind it.
+             */
+            transport_setBatching(JNI_FALSE);
+        }
+        jvmtiDeallocate(node->packet.type.cmd.data);
+        jvmtiDeallocate(node);
+
+        lightLock_enter(&replyQueueLock);
+        repliesSent++;
+        lightLock_notifyAll(&replyQueueLock);
+    }
+    writerRunning = JNI_FALSE;
+    lightLock_notifyAll(&replyQueueLock);
+    lightLock_exit(&replyQueueLock);
+
+    LOG_MISC(("End writer thread"));
+}
+
+/*
+ * ANDROID-CHANGED: Hand the reply in out to the writer thread. If it
+ * cannot be copied, or there is no writer, send it here once the queued
+ * replies are out, which keeps the replies in order.
+ */
+static void
+queueReply(PacketOutputStream *out)
+{
+    struct PacketList *node;
+
+    node = writerRunning ? jvmtiAllocate((jint)sizeof(struct PacketList)) : NULL;
+    if (node == NULL || outStream_prepareReply(out, &node->packet) != JDWP_ERROR(NONE)) {
+        jvmtiDeallocate(node);
+        waitForReplies();
+        transport_setBatching(JNI_FALSE);
+        outStream_sendReply(out);
+        return;
+    }
+    node->next = NULL;
+
+    lightLock_enter(&replyQueueLock);
+    if (replyQueueTail == NULL) {
+        replyQueue = node;
+    } else {
+        replyQueueTail->next = node;
+    }
+    replyQueueTail = node;
+    repliesQueued++;
+    lightLock_notifyAll(&replyQueueLock);
+    lightLock_exit(&replyQueueLock);
+}
+
+/*
+ * ANDROID-CHANGED: Wait until the replies queued so far have been sent.
+ */
+static void
+waitForReplies(void)
+{
+    jlong target;
+
+    lightLock_enter(&replyQueueLock);
+    target = repliesQueued;
+    while (writerRunning && repliesSent < target) {
+        lightLock_wait(&replyQueueLock);
+    }
+    lightLock_exit(&replyQueueLock);
+}
+
+/*
+ * ANDROID-CHANGED: Stop the writer once it has sent all queued replies.
+ */
+static void
+stopWriter(void)
+{
+    lightLock_enter(&replyQueueLock);
+    writerStopping = JNI_TRUE;
+    lightLock_notifyAll(&replyQueueLock);
+    while (writerRunning) {
+        lightLock_wait(&replyQueueLock);
+    }
+    lightLock_exit(&replyQueueLock);
+}
+
 /*
  * The current system for queueing packets is highly
  * inefficient, and should be rewritten! It'd be nice
@@ -288,11 +456,11 @@ enqueue(jdwpPacket *packet)
     pL->packet = *packet;
     pL->next = NULL;
 
-    debugMonitorEnter(cmdQueueLock);
+    lightLock_enter(&cmdQueueLock);
 
     if (cmdQueue == NULL) {
         cmdQueue = pL;
-        debugMonitorNotify(cmdQueueLock);
+        lightLock_notify(&cmdQueueLock);
     } else {
         walker = (struct PacketList *)cmdQueue;
         while (walker->next != NULL)
@@ -301,24 +469,24 @@ enqueue(jdwpPacket *packet)
         walker->next = pL;
     }
 
-    debugMonitorExit(cmdQueueLock);
+    lightLock_exit(&cmdQueueLock);
 }
 
 static jboolean
 dequeue(jdwpPacket *packet) {
     struct PacketList *node = NULL;
 
-    debugMonitorEnter(cmdQueueLock);
+    lightLock_enter(&cmdQueueLock);
 
     while (!transportError && (cmdQueue == NULL)) {
-        debugMonitorWait(cmdQueueLock);
+        lightLock_wait(&cmdQueueLock);
     }
 
     if (cmdQueue != NULL) {
         node = (struct PacketList *)cmdQueue;
         cmdQueue = node->next;
     }
-    debugMonitorExit(cmdQueueLock);
+    lightLock_exit(&cmdQueueLock);
 
     if (node != NULL) {
         *packet = node->packet;
@@ -329,8 +497,8 @@ dequeue(jdwpPacket *packet) {
 
 static void
 notifyTransportError(void) {
-    debugMonitorEnter(cmdQueueLock);
+    lightLock_enter(&cmdQueueLock);
     transportError = JNI_TRUE;
-    debugMonitorNotify(cmdQueueLock);
-    debugMonitorExit(cmdQueueLock);
+    lightLock_notify(&cmdQueueLock);
+    lightLock_exit(&cmdQueueLock);
 }
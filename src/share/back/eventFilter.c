@@ -32,12 +32,17 @@
  * module eventHandler.
  */
 
+#include <stdatomic.h>
+
 #include "util.h"
 #include "eventFilter.h"
 #include "eventFilterRestricted.h"
 #include "eventHandlerRestricted.h"
 #include "stepControl.h"
 #include "threadControl.h"
+#include "lineCoverage.h"
+#include "snapshotPoint.h"
+#include "classTrack.h"
 #include "SDE.h"
 #include "jvmti.h"
 
@@ -92,6 +97,24 @@ typedef struct SourceNameFilter {
     char *sourceNamePattern;
 } SourceNameFilter;
 
+/* ANDROID-CHANGED: Does not filter, see eventFilter_setPrefetchFilter */
+typedef struct PrefetchFilter {
+    jint frames;
+} PrefetchFilter;
+
+/* ANDROID-CHANGED: See eventFilter_setMethodOnlyFilter */
+typedef struct MethodFilter {
+    jclass clazz;
+    jmethodID method;
+    jlocation start;
+    jboolean narrowed;
+} MethodFilter;
+
+/* ANDROID-CHANGED: Does not filter, see eventFilter_setSnapshotFilter */
+typedef struct SnapshotFilter {
+    struct SnapshotRing *ring;
+} SnapshotFilter;
+
 typedef struct Filter_ {
     jbyte modifier;
     union {
@@ -107,6 +130,9 @@ typedef struct Filter_ {
         struct MatchFilter ClassMatch;
         struct MatchFilter ClassExclude;
         struct SourceNameFilter SourceNameOnly;
+        struct PrefetchFilter Prefetch;
+        struct MethodFilter MethodOnly;
+        struct SnapshotFilter Snapshot;
     } u;
 } Filter;
 
@@ -120,6 +146,14 @@ typedef struct Filter_ {
  */
 #define MAX_FILTERS 10000
 
+/* ANDROID-CHANGED: Number of agent-internal consumers (such as the
+ * monitor contention profiler) which need an event kind globally
+ * enabled without there being any HandlerNode for it. While this is
+ * non-zero, removing the last global handler must not disable the
+ * event. Protected by the event handler lock.
+ */
+static jint internalEventUsers[EI_max-EI_min+1];
+
 typedef struct EventFilters_ {
     jint filterCount;
     Filter filters[MAX_FILTERS];
@@ -213,6 +247,14 @@ clearFilters(HandlerNode *node)
             case JDWP_REQUEST_MODIFIER(ClassOnly):
                 tossGlobalRef(env, &(filter->u.ClassOnly.clazz));
                 break;
+            case JDWP_REQUEST_MODIFIER(MethodOnly):
+                tossGlobalRef(env, &(filter->u.MethodOnly.clazz));
+                break;
+            case JDWP_REQUEST_MODIFIER(Snapshot):
+                snapshotPoint_freeRing(env, filter->u.Snapshot.ring);
+                filter->u.Snapshot.ring = NULL;
+                node->snapshots = NULL;
+                break;
             case JDWP_REQUEST_MODIFIER(ClassMatch):
                 jvmtiDeallocate(filter->u.ClassMatch.classPattern);
                 break;
@@ -541,6 +583,27 @@ eventFilterRestricted_passesFilter(JNIEnv *env,
               break;
           }
 
+        case JDWP_REQUEST_MODIFIER(Prefetch):
+        case JDWP_REQUEST_MODIFIER(Snapshot):
+            break;
+
+        case JDWP_REQUEST_MODIFIER(MethodOnly): {
+            MethodFilter *mf = &(filter->u.MethodOnly);
+            if (evinfo->method != mf->method) {
+                return JNI_FALSE;
+            }
+            /* A narrowed request takes the events made up by its
+             * method watch, except for exits with a return value,
+             * which only the real MethodExit event has.
+             */
+            if (mf->narrowed &&
+                evinfo->synthetic == (NODE_EI(node) == EI_METHOD_EXIT &&
+                                      node->needReturnValue)) {
+                return JNI_FALSE;
+            }
+            break;
+        }
+
         default:
             EXIT_ERROR(AGENT_ERROR_ILLEGAL_ARGUMENT,"Invalid filter modifier");
             return JNI_FALSE;
@@ -963,6 +1026,109 @@ eventFilter_setSourceNameMatchFilter(HandlerNode *node,
 
 }
 
+/*
+ * ANDROID-CHANGED: The Prefetch modifier only asks eventHelper to send
+ * the state of the stopped thread along with the event, so it is
+ * recorded in the node rather than evaluated as a filter.
+ */
+jvmtiError
+eventFilter_setPrefetchFilter(HandlerNode *node, jint index, jint frames)
+{
+    PrefetchFilter *filter = &FILTER(node, index).u.Prefetch;
+    if (index >= FILTER_COUNT(node)) {
+        return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+    if (frames <= 0) {
+        return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+    switch (NODE_EI(node)) {
+        case EI_SINGLE_STEP:
+        case EI_BREAKPOINT:
+        case EI_EXCEPTION:
+        case EI_FIELD_ACCESS:
+        case EI_FIELD_MODIFICATION:
+        case EI_METHOD_ENTRY:
+        case EI_METHOD_EXIT:
+        case EI_MONITOR_CONTENDED_ENTER:
+        case EI_MONITOR_CONTENDED_ENTERED:
+        case EI_MONITOR_WAIT:
+        case EI_MONITOR_WAITED:
+            break;
+        default:
+            return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    FILTER(node, index).modifier = JDWP_REQUEST_MODIFIER(Prefetch);
+    filter->frames = frames;
+    node->prefetchFrames = frames;
+    return JVMTI_ERROR_NONE;
+}
+
+/*
+ * ANDROID-CHANGED: A Snapshot request records snapshots into a ring
+ * buffer rather than reporting events, see snapshotPoint.c. The
+ * recording thread carries on, so only breakpoint requests which do
+ * not suspend can have one.
+ */
+jvmtiError
+eventFilter_setSnapshotFilter(HandlerNode *node, jint index, jint frames,
+                              jint maxBytes, jint capacity)
+{
+    SnapshotFilter *filter = &FILTER(node, index).u.Snapshot;
+    jvmtiError error;
+
+    if (index >= FILTER_COUNT(node)) {
+        return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+    if (NODE_EI(node) != EI_BREAKPOINT ||
+        node->suspendPolicy != JDWP_SUSPEND_POLICY(NONE) ||
+        node->snapshots != NULL) {
+        return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+    error = snapshotPoint_createRing(&filter->ring, frames, maxBytes, capacity);
+    if (error != JVMTI_ERROR_NONE) {
+        return error;
+    }
+
+    FILTER(node, index).modifier = JDWP_REQUEST_MODIFIER(Snapshot);
+    node->snapshots = filter->ring;
+    return JVMTI_ERROR_NONE;
+}
+
+/*
+ * ANDROID-CHANGED: A MethodOnly request of a method with bytecodes is
+ * narrowed: rather than enabling MethodEntry or MethodExit for the
+ * thread(s), enableEvents adds a method watch for it, see eventHandler.c.
+ * Requests of native methods are filtered the usual way.
+ */
+jvmtiError
+eventFilter_setMethodOnlyFilter(HandlerNode *node, jint index,
+                                jclass clazz, jmethodID method)
+{
+    JNIEnv *env = getEnv();
+    MethodFilter *filter = &FILTER(node, index).u.MethodOnly;
+    jlocation start;
+    jlocation end;
+
+    if (index >= FILTER_COUNT(node)) {
+        return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+    if ((NODE_EI(node) != EI_METHOD_ENTRY) &&
+        (NODE_EI(node) != EI_METHOD_EXIT)) {
+        return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+
+    /* Create a class ref that will live beyond */
+    /* the end of this call */
+    saveGlobalRef(env, clazz, &(filter->clazz));
+    FILTER(node, index).modifier = JDWP_REQUEST_MODIFIER(MethodOnly);
+    filter->method = method;
+    filter->narrowed = (methodLocation(method, &start, &end) ==
+                            JVMTI_ERROR_NONE && start >= 0);
+    filter->start = filter->narrowed ? start : -1;
+    return JVMTI_ERROR_NONE;
+}
+
 /***** JVMTI event enabling / disabling *****/
 
 /**
@@ -984,6 +1150,21 @@ findFilter(HandlerNode *node, jint modifier)
     return NULL;
 }
 
+/**
+ * ANDROID-CHANGED: Return the MethodFilter of a narrowed MethodOnly
+ * request, NULL if this is not one.
+ */
+static MethodFilter *
+narrowedMethodFilter(HandlerNode *node)
+{
+    Filter *filter = findFilter(node, JDWP_REQUEST_MODIFIER(MethodOnly));
+
+    if (filter == NULL || !filter->u.MethodOnly.narrowed) {
+        return NULL;
+    }
+    return &(filter->u.MethodOnly);
+}
+
 /**
  * Determine if the specified breakpoint node is in the
  * same location as the LocationFilter passed in arg.
@@ -1032,8 +1213,12 @@ setBreakpoint(HandlerNode *node)
         /* if this is the first handler for this
          * location, set bp at JVMTI level
          */
+        /* ANDROID-CHANGED: The JVMTI breakpoint may already be set
+         * for line coverage.
+         */
         if (!eventHandlerRestricted_iterator(
-                EI_BREAKPOINT, matchBreakpoint, lf)) {
+                EI_BREAKPOINT, matchBreakpoint, lf) &&
+            !lineCoverage_hasBreakpoint(lf->method, lf->location)) {
             LOG_LOC(("SetBreakpoint at location: method=%p,location=%d",
                         lf->method, (int)lf->location));
             error = JVMTI_FUNC_PTR(gdata->jvmti,SetBreakpoint)
@@ -1062,8 +1247,12 @@ clearBreakpoint(HandlerNode *node)
         /* if this is the last handler for this
          * location, clear bp at JVMTI level
          */
+        /* ANDROID-CHANGED: Leave it set if line coverage still
+         * needs it.
+         */
         if (!eventHandlerRestricted_iterator(
-                EI_BREAKPOINT, matchBreakpoint, lf)) {
+                EI_BREAKPOINT, matchBreakpoint, lf) &&
+            !lineCoverage_hasBreakpoint(lf->method, lf->location)) {
             LOG_LOC(("ClearBreakpoint at location: method=%p,location=%d",
                         lf->method, (int)lf->location));
             error = JVMTI_FUNC_PTR(gdata->jvmti,ClearBreakpoint)
@@ -1073,6 +1262,16 @@ clearBreakpoint(HandlerNode *node)
     return error;
 }
 
+/**
+ * ANDROID-CHANGED: Match a class name against a class pattern the way
+ * ClassMatch and ClassExclude filters do.
+ */
+jboolean
+eventFilter_classNameMatches(char *classname, const char *pattern)
+{
+    return patternStringMatch(classname, pattern);
+}
+
 /**
  * Return true if a breakpoint is set at the specified location.
  */
@@ -1212,6 +1411,11 @@ matchThread(JNIEnv *env, HandlerNode *node, void *arg)
     jthread goalThread = (jthread)arg;
     jthread reqThread = requestThread(node);
 
+    /* ANDROID-CHANGED: Narrowed requests do not need the event enabled */
+    if (narrowedMethodFilter(node) != NULL) {
+        return JNI_FALSE;
+    }
+
     /* If the event's thread and the passed thread are the same
      * (or both are NULL), we have a match.
      */
@@ -1226,6 +1430,7 @@ static jvmtiError
 enableEvents(HandlerNode *node)
 {
     jvmtiError error = JVMTI_ERROR_NONE;
+    MethodFilter *mf;
 
     switch (NODE_EI(node)) {
         /* The stepping code directly enables/disables stepping as
@@ -1253,6 +1458,19 @@ enableEvents(HandlerNode *node)
             error = setBreakpoint(node);
             break;
 
+        /* ANDROID-CHANGED: Watch the method instead of enabling the
+         * event if the request is narrowed to a single method.
+         */
+        case EI_METHOD_ENTRY:
+        case EI_METHOD_EXIT:
+            mf = narrowedMethodFilter(node);
+            if (mf != NULL) {
+                return eventHandlerRestricted_addMethodWatch(NODE_EI(node),
+                            mf->clazz, mf->method, mf->start,
+                            node->needReturnValue);
+            }
+            break;
+
         default:
             break;
     }
@@ -1284,7 +1502,7 @@ disableEvents(HandlerNode *node)
     jvmtiError error = JVMTI_ERROR_NONE;
     jvmtiError error2 = JVMTI_ERROR_NONE;
     jthread thread;
-
+    MethodFilter *mf;
 
     switch (NODE_EI(node)) {
         /* The stepping code directly enables/disables stepping as
@@ -1312,6 +1530,16 @@ disableEvents(HandlerNode *node)
             error = clearBreakpoint(node);
             break;
 
+        /* ANDROID-CHANGED: See enableEvents */
+        case EI_METHOD_ENTRY:
+        case EI_METHOD_EXIT:
+            mf = narrowedMethodFilter(node);
+            if (mf != NULL) {
+                return eventHandlerRestricted_removeMethodWatch(NODE_EI(node),
+                            mf->method, node->needReturnValue);
+            }
+            break;
+
         default:
             break;
     }
@@ -1323,14 +1551,89 @@ disableEvents(HandlerNode *node)
      * events on this thread.
      *
      * Disable even if the above caused an error
+     *
+     * ANDROID-CHANGED: Leave the event globally enabled if an
+     * agent-internal user still needs it, and MethodExit enabled for
+     * a thread running a method watched for its return value.
      */
-    if (!eventHandlerRestricted_iterator(NODE_EI(node), matchThread, thread)) {
+    if (!eventHandlerRestricted_iterator(NODE_EI(node), matchThread, thread) &&
+        (thread != NULL || internalEventUsers[NODE_EI(node)-EI_min] == 0) &&
+        (thread == NULL || NODE_EI(node) != EI_METHOD_EXIT ||
+         !threadControl_hasReturnValueWatch(thread))) {
         error2 = threadControl_setEventMode(JVMTI_DISABLE,
                                             NODE_EI(node), thread);
     }
     return error != JVMTI_ERROR_NONE? error : error2;
 }
 
+/**
+ * ANDROID-CHANGED: Register an agent-internal user of an event kind.
+ * The event is globally enabled for as long as there is at least one
+ * such user, independent of the handler chains. Assumes the event
+ * handler lock is held.
+ */
+jvmtiError
+eventFilter_addInternalEventUser(EventIndex ei)
+{
+    jvmtiError error = JVMTI_ERROR_NONE;
+
+    if (internalEventUsers[ei-EI_min]++ == 0 &&
+        !eventHandlerRestricted_iterator(ei, matchThread, NULL)) {
+        error = threadControl_setEventMode(JVMTI_ENABLE, ei, NULL);
+        if (error != JVMTI_ERROR_NONE) {
+            internalEventUsers[ei-EI_min]--;
+        }
+    }
+    return error;
+}
+
+/**
+ * ANDROID-CHANGED: Remove an agent-internal user of an event kind,
+ * globally disabling the event if nothing else needs it. Assumes the
+ * event handler lock is held.
+ */
+jvmtiError
+eventFilter_removeInternalEventUser(EventIndex ei)
+{
+    jvmtiError error = JVMTI_ERROR_NONE;
+
+    JDI_ASSERT(internalEventUsers[ei-EI_min] > 0);
+    if (--internalEventUsers[ei-EI_min] == 0 &&
+        !eventHandlerRestricted_iterator(ei, matchThread, NULL)) {
+        error = threadControl_setEventMode(JVMTI_DISABLE, ei, NULL);
+    }
+    return error;
+}
+
+/**
+ * ANDROID-CHANGED: Enable an event kind on one thread for an
+ * agent-internal user, unless a request for that thread already did.
+ * Unlike the global users above these are counted by the caller.
+ * Assumes the event handler lock is held.
+ */
+jvmtiError
+eventFilter_enableThreadEvent(EventIndex ei, jthread thread)
+{
+    if (eventHandlerRestricted_iterator(ei, matchThread, thread)) {
+        return JVMTI_ERROR_NONE;
+    }
+    return threadControl_setEventMode(JVMTI_ENABLE, ei, thread);
+}
+
+/**
+ * ANDROID-CHANGED: Undo eventFilter_enableThreadEvent, leaving the
+ * event enabled if a request for the thread needs it. Assumes the
+ * event handler lock is held.
+ */
+jvmtiError
+eventFilter_disableThreadEvent(EventIndex ei, jthread thread)
+{
+    if (eventHandlerRestricted_iterator(ei, matchThread, thread)) {
+        return JVMTI_ERROR_NONE;
+    }
+    return threadControl_setEventMode(JVMTI_DISABLE, ei, thread);
+}
+
 
 /***** filter (and event) installation and deinstallation *****/
 
@@ -1359,3 +1662,314 @@ eventFilterRestricted_deinstall(HandlerNode *node)
 
     return error1 != JVMTI_ERROR_NONE? error1 : error2;
 }
+
+/***** exception match set *****/
+
+/*
+ * ANDROID-CHANGED: Apps which use exceptions for control flow can throw
+ * a very large number of them, and with any Exception request active
+ * every throw used to go through event_callback (handlerLock,
+ * getClassname and an IsInstanceOf per request) only to be filtered
+ * out. To avoid that, the ExceptionOnly filters of all Exception
+ * requests are summarized in an immutable ExceptionMatchSet which
+ * cbException consults before doing any other work. Whether a thrown
+ * class is assignable to any of the filtered classes is cached per
+ * class in a small open addressed table inside the set, so a throw
+ * that no request can match costs a hash probe. Classes are keyed by
+ * their classTrack tag, so the cache keeps no references to them and
+ * does not prevent them from being unloaded. Tags are never reused.
+ *
+ * The check is conservative: it only looks at the first ExceptionOnly
+ * filter of each request, and anything passing it is still run
+ * through the complete filtering in event_callback.
+ *
+ * A new set is built (with the handlerLock held) whenever the
+ * Exception handler chain changes and is published with an atomic
+ * store. Readers don't lock; they announce themselves in the
+ * exceptionMatchReaders counter of the current epoch while using a
+ * set. A replaced set is retired; the next rebuild starts a new epoch
+ * for it, and it is freed once the readers counted in the epoch before
+ * have left. So a steady stream of exceptions cannot keep retired sets
+ * from being freed, only delay that to a later rebuild.
+ */
+
+#define EXCEPTION_CACHE_SIZE   1024   /* must be a power of 2 */
+#define EXCEPTION_CACHE_PROBES 8
+
+#define MATCH_CAUGHT   0x1
+#define MATCH_UNCAUGHT 0x2
+
+#define SLOT_EMPTY 0
+#define SLOT_BUSY  1
+#define SLOT_READY 2
+
+typedef struct ExceptionClassSlot {
+    _Atomic(jint) state;
+    jlong classTag;             /* classTrack tag */
+    jint matches;               /* MATCH_* bits */
+} ExceptionClassSlot;
+
+typedef struct ExceptionMatchSet {
+    struct ExceptionMatchSet *nextRetired;
+    jint unconditional;         /* MATCH_* bits wanted for any class */
+    jint conditional;           /* MATCH_* bits wanted for some classes */
+    jint filterCount;
+    ExceptionFilter *filters;   /* class filters only, global refs */
+    ExceptionClassSlot slots[EXCEPTION_CACHE_SIZE];
+} ExceptionMatchSet;
+
+static _Atomic(ExceptionMatchSet *) exceptionMatchSet = ATOMIC_VAR_INIT(NULL);
+static _Atomic(jint) exceptionMatchEpoch = ATOMIC_VAR_INIT(0);
+static _Atomic(jint) exceptionMatchReaders[2];
+/* Protected by handlerLock */
+static ExceptionMatchSet *retiredMatchSets;  /* replaced in this epoch */
+static ExceptionMatchSet *waitingMatchSets;  /* replaced in the epoch before */
+
+static jint
+exceptionFilterBits(ExceptionFilter *filter)
+{
+    return (filter->caught ? MATCH_CAUGHT : 0) |
+           (filter->uncaught ? MATCH_UNCAUGHT : 0);
+}
+
+static ExceptionFilter *
+firstExceptionFilter(HandlerNode *node)
+{
+    Filter *filter = FILTERS_ARRAY(node);
+    int i;
+
+    for (i = 0; i < FILTER_COUNT(node); ++i, ++filter) {
+        if (filter->modifier == JDWP_REQUEST_MODIFIER(ExceptionOnly)) {
+            return &filter->u.ExceptionOnly;
+        }
+    }
+    return NULL;
+}
+
+static jboolean
+countExceptionClassFilters(JNIEnv *env, HandlerNode *node, void *arg)
+{
+    ExceptionFilter *filter = firstExceptionFilter(node);
+
+    if (filter != NULL && filter->exception != NULL) {
+        (*(jint *)arg)++;
+    }
+    return JNI_FALSE; /* visit all requests */
+}
+
+static jboolean
+summarizeExceptionRequest(JNIEnv *env, HandlerNode *node, void *arg)
+{
+    ExceptionMatchSet *set = arg;
+    ExceptionFilter *filter = firstExceptionFilter(node);
+
+    if (filter == NULL) {
+        set->unconditional |= MATCH_CAUGHT | MATCH_UNCAUGHT;
+    } else if (filter->exception == NULL) {
+        set->unconditional |= exceptionFilterBits(filter);
+    } else {
+        ExceptionFilter *copy = &set->filters[set->filterCount++];
+
+        copy->caught = filter->caught;
+        copy->uncaught = filter->uncaught;
+        saveGlobalRef(env, filter->exception, &copy->exception);
+        set->conditional |= exceptionFilterBits(filter);
+    }
+    return JNI_FALSE; /* visit all requests */
+}
+
+static void
+freeExceptionMatchSet(JNIEnv *env, ExceptionMatchSet *set)
+{
+    int i;
+
+    for (i = 0; i < set->filterCount; i++) {
+        tossGlobalRef(env, &set->filters[i].exception);
+    }
+    if (set->filters != NULL) {
+        jvmtiDeallocate(set->filters);
+    }
+    jvmtiDeallocate(set);
+}
+
+static void
+freeExceptionMatchSets(JNIEnv *env, ExceptionMatchSet *list)
+{
+    while (list != NULL) {
+        ExceptionMatchSet *next = list->nextRetired;
+        freeExceptionMatchSet(env, list);
+        list = next;
+    }
+}
+
+/*
+ * Free the sets of the epoch before once its readers have left, and
+ * start a new epoch for the sets retired since. A reader counted in the
+ * current epoch may still use a set retired in it, so those wait for
+ * the epoch after. Assumes the handlerLock is held.
+ */
+static void
+reclaimExceptionMatchSets(JNIEnv *env)
+{
+    jint previous;
+
+    previous = (atomic_load(&exceptionMatchEpoch) - 1) & 1;
+    if (waitingMatchSets != NULL &&
+            atomic_load(&exceptionMatchReaders[previous]) == 0) {
+        freeExceptionMatchSets(env, waitingMatchSets);
+        waitingMatchSets = NULL;
+    }
+    if (waitingMatchSets == NULL && retiredMatchSets != NULL) {
+        waitingMatchSets = retiredMatchSets;
+        retiredMatchSets = NULL;
+        previous = atomic_fetch_add(&exceptionMatchEpoch, 1) & 1;
+        /* Usually nobody is reading right now */
+        if (atomic_load(&exceptionMatchReaders[previous]) == 0) {
+            freeExceptionMatchSets(env, waitingMatchSets);
+            waitingMatchSets = NULL;
+        }
+    }
+}
+
+/**
+ * Rebuild the exception match set after the Exception handler chain
+ * changed. Assumes the handlerLock is held.
+ */
+void
+eventFilterRestricted_exceptionRequestsChanged(void)
+{
+    JNIEnv *env = getEnv();
+    ExceptionMatchSet *set;
+    ExceptionMatchSet *old;
+    jint count = 0;
+
+    /* No match set means every exception goes the slow way */
+    set = jvmtiAllocate((jint)sizeof(ExceptionMatchSet));
+    if (set != NULL) {
+        (void)memset(set, 0, sizeof(ExceptionMatchSet));
+        (void)eventHandlerRestricted_iterator(EI_EXCEPTION,
+                                              countExceptionClassFilters, &count);
+        if (count > 0) {
+            set->filters = jvmtiAllocate(count * (jint)sizeof(ExceptionFilter));
+            if (set->filters == NULL) {
+                jvmtiDeallocate(set);
+                set = NULL;
+            }
+        }
+    }
+    if (set != NULL) {
+        (void)eventHandlerRestricted_iterator(EI_EXCEPTION,
+                                              summarizeExceptionRequest, set);
+    }
+
+    old = atomic_exchange(&exceptionMatchSet, set);
+    if (old != NULL) {
+        old->nextRetired = retiredMatchSets;
+        retiredMatchSets = old;
+    }
+    reclaimExceptionMatchSets(env);
+}
+
+static jint
+computeExceptionMatches(JNIEnv *env, ExceptionMatchSet *set, jclass clazz)
+{
+    jint matches = 0;
+    int i;
+
+    for (i = 0; i < set->filterCount; i++) {
+        ExceptionFilter *filter = &set->filters[i];
+        jint bits = exceptionFilterBits(filter);
+
+        if ((bits & ~matches) != 0 &&
+            JNI_FUNC_PTR(env,IsAssignableFrom)(env, clazz, filter->exception)) {
+            matches |= bits;
+        }
+    }
+    return matches;
+}
+
+static jint
+exceptionClassMatches(JNIEnv *env, ExceptionMatchSet *set, jobject exception)
+{
+    jclass clazz;
+    jlong tag;
+    jint hash;
+    jint matches;
+    int i;
+
+    clazz = JNI_FUNC_PTR(env,GetObjectClass)(env, exception);
+    if (clazz == NULL) {
+        return MATCH_CAUGHT | MATCH_UNCAUGHT;
+    }
+    /* Tags are handed out in sequence, which spreads them well enough */
+    tag = classTrack_getTag(clazz);
+    hash = (jint)tag;
+
+    for (i = 0; tag != 0 && i < EXCEPTION_CACHE_PROBES; i++) {
+        ExceptionClassSlot *slot = &set->slots[(hash + i) & (EXCEPTION_CACHE_SIZE - 1)];
+        jint state = atomic_load_explicit(&slot->state, memory_order_acquire);
+
+        if (state == SLOT_EMPTY &&
+            atomic_compare_exchange_strong(&slot->state, &state, SLOT_BUSY)) {
+            matches = computeExceptionMatches(env, set, clazz);
+            slot->classTag = tag;
+            slot->matches = matches;
+            atomic_store_explicit(&slot->state, SLOT_READY, memory_order_release);
+            goto done;
+        }
+        if (state == SLOT_READY && slot->classTag == tag) {
+            matches = slot->matches;
+            goto done;
+        }
+    }
+
+    /* Class not tracked (yet) or probe sequence full; don't cache */
+    matches = computeExceptionMatches(env, set, clazz);
+
+done:
+    JNI_FUNC_PTR(env,DeleteLocalRef)(env, clazz);
+    return matches;
+}
+
+/**
+ * Quick check whether any Exception request could possibly want an
+ * exception of this kind. Does not take any locks.
+ */
+jboolean
+eventFilterRestricted_exceptionMayMatch(JNIEnv *env, jobject exception,
+                                        jboolean caught)
+{
+    ExceptionMatchSet *set;
+    jint wanted;
+    jint epoch;
+    jboolean result;
+
+    /* Don't make JNI calls with an exception pending; let the slow path deal with it */
+    if (JNI_FUNC_PTR(env,ExceptionCheck)(env)) {
+        return JNI_TRUE;
+    }
+
+    wanted = caught ? MATCH_CAUGHT : MATCH_UNCAUGHT;
+    /*
+     * Count ourselves in the current epoch. If a new epoch started
+     * meanwhile, the rebuild may not have seen us; count again.
+     */
+    for (;;) {
+        epoch = atomic_load(&exceptionMatchEpoch) & 1;
+        atomic_fetch_add(&exceptionMatchReaders[epoch], 1);
+        if ((atomic_load(&exceptionMatchEpoch) & 1) == epoch) {
+            break;
+        }
+        atomic_fetch_sub(&exceptionMatchReaders[epoch], 1);
+    }
+    set = atomic_load(&exceptionMatchSet);
+    if (set == NULL || (set->unconditional & wanted) != 0) {
+        result = JNI_TRUE;
+    } else if ((set->conditional & wanted) == 0) {
+        result = JNI_FALSE;
+    } else {
+        result = (exceptionClassMatches(env, set, exception) & wanted) != 0;
+    }
+    atomic_fetch_sub(&exceptionMatchReaders[epoch], 1);
+    return result;
+}
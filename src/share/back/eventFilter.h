@@ -69,10 +69,32 @@ jvmtiError eventFilter_setStepFilter(HandlerNode *node,
 jvmtiError eventFilter_setSourceNameMatchFilter(HandlerNode *node,
                                                 jint index,
                                                 char *sourceNamePattern);
+jvmtiError eventFilter_setPrefetchFilter(HandlerNode *node,
+                                         jint index,
+                                         jint frames);
+jvmtiError eventFilter_setSnapshotFilter(HandlerNode *node,
+                                         jint index,
+                                         jint frames,
+                                         jint maxBytes,
+                                         jint capacity);
+jvmtiError eventFilter_setMethodOnlyFilter(HandlerNode *node,
+                                           jint index,
+                                           jclass clazz,
+                                           jmethodID method);
 
 /***** misc *****/
 
 jboolean eventFilter_predictFiltering(HandlerNode *node, jclass clazz, char *classname);
 jboolean isBreakpointSet(jclass clazz, jmethodID method, jlocation location);
+/* ANDROID-CHANGED: Wildcard matching of ClassMatch filters */
+jboolean eventFilter_classNameMatches(char *classname, const char *pattern);
+
+/***** agent-internal event users *****/
+
+/* Must be called with the event handler lock held (eventHandler_lock). */
+jvmtiError eventFilter_addInternalEventUser(EventIndex ei);
+jvmtiError eventFilter_removeInternalEventUser(EventIndex ei);
+jvmtiError eventFilter_enableThreadEvent(EventIndex ei, jthread thread);
+jvmtiError eventFilter_disableThreadEvent(EventIndex ei, jthread thread);
 
 #endif /* _EVENT_FILTER_H */
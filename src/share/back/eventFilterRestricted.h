@@ -50,4 +50,10 @@ jboolean eventFilterRestricted_isBreakpointInClass(JNIEnv *env,
                                                    jclass clazz,
                                                    HandlerNode *node);
 
+/* ANDROID-CHANGED: lock-free pre-filtering of exception events */
+void eventFilterRestricted_exceptionRequestsChanged(void);
+jboolean eventFilterRestricted_exceptionMayMatch(JNIEnv *env,
+                                                 jobject exception,
+                                                 jboolean caught);
+
 #endif
@@ -56,6 +56,8 @@
  * Each event kind has a handler chain, which is a doublely linked
  * list of handlers for that kind of event.
  */
+#include <stdatomic.h>
+
 #include "util.h"
 #include "eventHandler.h"
 #include "eventHandlerRestricted.h"
@@ -67,6 +69,10 @@
 #include "classTrack.h"
 #include "commonRef.h"
 #include "debugLoop.h"
+#include "monitorProfile.h"
+#include "allocProfile.h"
+#include "lineCoverage.h"
+#include "snapshotPoint.h"
 
 static HandlerID requestIdCounter;
 static jbyte currentSessionID;
@@ -162,6 +168,12 @@ typedef struct HandlerChain_ {
 
 static HandlerChain __handlers[EI_max-EI_min+1];
 
+/*
+ * ANDROID-CHANGED: The number of handlers in each chain. Written with
+ * the handlerLock held, read without it by hasHandlers().
+ */
+static atomic_int handlerCounts[EI_max-EI_min+1];
+
 /* Given a HandlerNode, these access our private data.
  */
 #define PRIVATE_DATA(node) \
@@ -177,6 +189,43 @@ static jvmtiError freeHandler(HandlerNode *node);
 
 static jvmtiError freeHandlerChain(HandlerChain *chain);
 
+/*
+ * ANDROID-CHANGED: A method watch stands in for MethodEntry and MethodExit
+ * requests narrowed to one method by a MethodOnly modifier, so that those
+ * events need not be enabled for every method the VM runs. An internal
+ * breakpoint at the start of the method detects entries. A fresh frame
+ * never has a frame pop request yet, so NotifyFramePop failing with
+ * JVMTI_ERROR_DUPLICATE tells a branch back to the start apart from an
+ * entry. Otherwise the FramePop it requested marks the exit of the frame.
+ * As FramePop has no return value, requests which want one get the real
+ * MethodExit events instead, enabled only on the threads running a
+ * watched frame. MethodEntry and MethodExit events made up from the
+ * breakpoint and the frame pop are marked synthetic, see
+ * eventFilterRestricted_passesFilter. A class redefinition clears the
+ * breakpoint, which eventHandler_freeClassBreakpoints then sets again on
+ * the new code. Protected by handlerLock.
+ */
+typedef struct MethodWatch_ {
+    jmethodID method;
+    jint entryRequests;
+    jint exitRequests;          /* MethodExit without return value */
+    jint returnValueRequests;   /* MethodExit with return value */
+    HandlerNode *breakpoint;    /* NULL while cleared by a redefinition */
+    jboolean redefined;         /* breakpoint to be set on the new code */
+    struct MethodWatch_ *next;
+} MethodWatch;
+
+static MethodWatch *methodWatches;
+static HandlerNode *methodWatchFramePop;
+static jint returnValueWatchCount;
+/* Read without handlerLock by cbFramePop */
+static volatile jboolean methodWatchesActive = JNI_FALSE;
+
+static jboolean methodWatchFramePopped(jthread thread, jmethodID method);
+static void forgetMethodWatchBreakpoint(HandlerNode *node);
+static void rearmMethodWatches(jclass clazz);
+static void clearMethodWatches(void);
+
 static HandlerChain *
 getHandlerChain(EventIndex i)
 {
@@ -186,6 +235,20 @@ getHandlerChain(EventIndex i)
     return &(__handlers[i-EI_min]);
 }
 
+/*
+ * ANDROID-CHANGED: Check without the handlerLock whether any request
+ * exists for an event. Used to skip the handler machinery for events
+ * that are only enabled for agent internal use. A request being
+ * installed concurrently can miss the event, just as it would if the
+ * event had been posted a little earlier.
+ */
+static jboolean
+hasHandlers(EventIndex ei)
+{
+    (void)getHandlerChain(ei); /* checks the index */
+    return atomic_load(&handlerCounts[ei-EI_min]) > 0;
+}
+
 static void
 insert(HandlerChain *chain, HandlerNode *node)
 {
@@ -197,6 +260,7 @@ insert(HandlerChain *chain, HandlerNode *node)
         PREV(oldHead) = node;
     }
     chain->first = node;
+    atomic_fetch_add(&handlerCounts[chain - __handlers], 1);
 }
 
 static HandlerNode *
@@ -239,6 +303,7 @@ deinsert(HandlerNode *node)
         NEXT(PREV(node)) = NEXT(node);
     }
     CHAIN(node) = NULL;
+    atomic_fetch_sub(&handlerCounts[chain - __handlers], 1);
 }
 
 jboolean
@@ -536,36 +601,57 @@ synthesizeUnloadEvent(void *signatureVoid, void *envVoid)
 /* Garbage Collection Happened */
 static unsigned int garbageCollected = 0;
 
-/* The JVMTI generic event callback. Each event is passed to a sequence of
- * handlers in a chain until the chain ends or one handler
- * consumes the event.
+/* Pass the event to each handler of its chain that wants it.
+ * Assumes handlerLock held.
  */
 static void
-event_callback(JNIEnv *env, EventInfo *evinfo)
+processHandlerChain(JNIEnv *env, EventInfo *evinfo, struct bag *eventBag)
 {
-    struct bag *eventBag;
-    jbyte eventSessionID = currentSessionID; /* session could change */
-    jthrowable currentException;
-    jthread thread;
+    HandlerNode *node;
+    char        *classname;
 
-    LOG_MISC(("event_callback(): ei=%s", eventText(evinfo->ei)));
-    log_debugee_location("event_callback()", evinfo->thread, evinfo->method, evinfo->location);
+    node = getHandlerChain(evinfo->ei)->first;
+    classname = getClassname(evinfo->clazz);
 
-    /* We want to preserve any current exception that might get
-     * wiped out during event handling (e.g. JNI calls). We have
-     * to rely on space for the local reference on the current
-     * frame because doing a PushLocalFrame here might itself
-     * generate an exception.
-     */
-    currentException = JNI_FUNC_PTR(env,ExceptionOccurred)(env);
-    JNI_FUNC_PTR(env,ExceptionClear)(env);
+    while (node != NULL) {
+        /* save next so handlers can remove themselves */
+        HandlerNode *next = NEXT(node);
+        jboolean shouldDelete;
 
-    /* See if a garbage collection finish event happened earlier.
-     *
-     * Note: The "if" is an optimization to avoid entering the lock on every
-     *       event; garbageCollected may be zapped before we enter
-     *       the lock but then this just becomes one big no-op.
-     */
+        if (eventFilterRestricted_passesFilter(env, classname,
+                                               evinfo, node,
+                                               &shouldDelete)) {
+            HandlerFunction func;
+
+            func = HANDLER_FUNCTION(node);
+            if ( func == NULL ) {
+                EXIT_ERROR(AGENT_ERROR_INTERNAL,"handler function NULL");
+            }
+            (*func)(env, evinfo, node, eventBag);
+        }
+        if (shouldDelete) {
+            /* We can safely free the node now that we are done
+             * using it.
+             */
+            (void)freeHandler(node);
+        }
+        node = next;
+    }
+    jvmtiDeallocate(classname);
+}
+
+/*
+ * See if a garbage collection finish event happened earlier.
+ * ANDROID-CHANGED: Moved out of event_callback, so that commands which
+ * report unloaded classes can process pending unloads too.
+ *
+ * Note: The "if" is an optimization to avoid entering the lock on every
+ *       event; garbageCollected may be zapped before we enter
+ *       the lock but then this just becomes one big no-op.
+ */
+static void
+processGarbageCollections(JNIEnv *env)
+{
     if ( garbageCollected > 0 ) {
         struct bag *unloadedSignatures = NULL;
 
@@ -585,6 +671,11 @@ event_callback(JNIEnv *env, EventInfo *evinfo)
         /* Analyze which class unloads occurred */
         unloadedSignatures = classTrack_processUnloads(env);
 
+        /* ANDROID-CHANGED: Forget the coverage records of those classes */
+        if (unloadedSignatures != NULL && bagSize(unloadedSignatures) > 0) {
+            lineCoverage_processUnloads(env);
+        }
+
         debugMonitorExit(handlerLock);
 
         /* Generate the synthetic class unload events and/or just cleanup.  */
@@ -594,6 +685,45 @@ event_callback(JNIEnv *env, EventInfo *evinfo)
             bagDestroyBag(unloadedSignatures);
         }
     }
+}
+
+/*
+ * ANDROID-CHANGED: Processes class unloads which happened since the
+ * last event, including their ClassUnload events. Must not be called
+ * with the handlerLock held.
+ */
+void
+eventHandler_processUnloads(JNIEnv *env)
+{
+    processGarbageCollections(env);
+}
+
+/* The JVMTI generic event callback. Each event is passed to a sequence of
+ * handlers in a chain until the chain ends or one handler
+ * consumes the event.
+ */
+static void
+event_callback(JNIEnv *env, EventInfo *evinfo)
+{
+    struct bag *eventBag;
+    jbyte eventSessionID = currentSessionID; /* session could change */
+    jthrowable currentException;
+    jthread thread;
+
+    LOG_MISC(("event_callback(): ei=%s", eventText(evinfo->ei)));
+    log_debugee_location("event_callback()", evinfo->thread, evinfo->method, evinfo->location);
+
+    /* We want to preserve any current exception that might get
+     * wiped out during event handling (e.g. JNI calls). We have
+     * to rely on space for the local reference on the current
+     * frame because doing a PushLocalFrame here might itself
+     * generate an exception.
+     */
+    currentException = JNI_FUNC_PTR(env,ExceptionOccurred)(env);
+    JNI_FUNC_PTR(env,ExceptionClear)(env);
+
+    /* ANDROID-CHANGED: Moved to processGarbageCollections */
+    processGarbageCollections(env);
 
     thread = evinfo->thread;
     if (thread != NULL) {
@@ -637,45 +767,18 @@ event_callback(JNIEnv *env, EventInfo *evinfo)
 
     debugMonitorEnter(handlerLock);
     {
-        HandlerNode *node;
-        char        *classname;
-
         /* We must keep track of all classes prepared to know what's unloaded */
         if (evinfo->ei == EI_CLASS_PREPARE) {
             classTrack_addPreparedClass(env, evinfo->clazz);
         }
 
-        node = getHandlerChain(evinfo->ei)->first;
-        classname = getClassname(evinfo->clazz);
-
-        while (node != NULL) {
-            /* save next so handlers can remove themselves */
-            HandlerNode *next = NEXT(node);
-            jboolean shouldDelete;
-
-            if (eventFilterRestricted_passesFilter(env, classname,
-                                                   evinfo, node,
-                                                   &shouldDelete)) {
-                HandlerFunction func;
-
-                func = HANDLER_FUNCTION(node);
-                if ( func == NULL ) {
-                    EXIT_ERROR(AGENT_ERROR_INTERNAL,"handler function NULL");
-                }
-                (*func)(env, evinfo, node, eventBag);
-            }
-            if (shouldDelete) {
-                /* We can safely free the node now that we are done
-                 * using it.
-                 */
-                (void)freeHandler(node);
-            }
-            node = next;
-        }
-        jvmtiDeallocate(classname);
+        processHandlerChain(env, evinfo, eventBag);
     }
     debugMonitorExit(handlerLock);
 
+    /* ANDROID-CHANGED: Snapshot requests capture outside of the lock */
+    snapshotPoint_capturePending(env, evinfo);
+
     if (eventBag != NULL) {
         reportEvents(env, eventSessionID, thread, evinfo->ei,
                 evinfo->clazz, evinfo->method, evinfo->location, eventBag);
@@ -753,6 +856,21 @@ cbObjectFree(jvmtiEnv* jvmti_env, jlong tag)
   commonRef_handleFreedObject(tag);
 }
 
+/* ANDROID-CHANGED: Event callback for JVMTI_EVENT_VM_OBJECT_ALLOC. It is
+ * only enabled by the allocation profiler and has no jdwp event.
+ */
+static void JNICALL
+cbVMObjectAlloc(jvmtiEnv *jvmti_env, JNIEnv *env, jthread thread,
+                jobject object, jclass object_klass, jlong size)
+{
+    /* Allocations which are not sampled skip the callback lock */
+    if (!gdata->vmDead && allocProfile_isSampled()) {
+        BEGIN_CALLBACK() {
+            allocProfile_onAlloc(env, thread, object_klass, size);
+        } END_CALLBACK();
+    }
+}
+
 /* Event callback for JVMTI_EVENT_SINGLE_STEP */
 static void JNICALL
 cbSingleStep(jvmtiEnv *jvmti_env, JNIEnv *env,
@@ -785,13 +903,18 @@ cbBreakpoint(jvmtiEnv *jvmti_env, JNIEnv *env,
     LOG_CB(("cbBreakpoint: thread=%p", thread));
 
     BEGIN_CALLBACK() {
-        (void)memset(&info,0,sizeof(info));
-        info.ei         = EI_BREAKPOINT;
-        info.thread     = thread;
-        info.clazz      = getMethodClass(jvmti_env, method);
-        info.method     = method;
-        info.location   = location;
-        event_callback(env, &info);
+        /* ANDROID-CHANGED: A breakpoint set only for line coverage
+         * is not an event.
+         */
+        if (!lineCoverage_onBreakpoint(method, location)) {
+            (void)memset(&info,0,sizeof(info));
+            info.ei         = EI_BREAKPOINT;
+            info.thread     = thread;
+            info.clazz      = getMethodClass(jvmti_env, method);
+            info.method     = method;
+            info.location   = location;
+            event_callback(env, &info);
+        }
     } END_CALLBACK();
 
     LOG_MISC(("END cbBreakpoint"));
@@ -807,6 +930,14 @@ cbFramePop(jvmtiEnv *jvmti_env, JNIEnv *env,
 
     /* JDWP does not return these events when popped due to an exception. */
     if ( wasPoppedByException ) {
+        /* ANDROID-CHANGED: A method watch still has to see the frame go. */
+        if ( methodWatchesActive ) {
+            BEGIN_CALLBACK() {
+                debugMonitorEnter(handlerLock);
+                (void)methodWatchFramePopped(thread, method);
+                debugMonitorExit(handlerLock);
+            } END_CALLBACK();
+        }
         return;
     }
 
@@ -835,6 +966,14 @@ cbException(jvmtiEnv *jvmti_env, JNIEnv *env,
 
     LOG_CB(("cbException: thread=%p", thread));
 
+    /* ANDROID-CHANGED: Drop exceptions no request can want before
+     * taking any locks.
+     */
+    if (!eventFilterRestricted_exceptionMayMatch(env, exception,
+                                                 catch_method != NULL)) {
+        return;
+    }
+
     BEGIN_CALLBACK() {
         (void)memset(&info,0,sizeof(info));
         info.ei                         = EI_EXCEPTION;
@@ -879,6 +1018,9 @@ cbThreadEnd(jvmtiEnv *jvmti_env, JNIEnv *env, jthread thread)
     LOG_CB(("cbThreadEnd: thread=%p", thread));
 
     BEGIN_CALLBACK() {
+        /* ANDROID-CHANGED: Give back the thread's monitor profile buffer. */
+        monitorProfile_onThreadEnd(env, thread);
+
         (void)memset(&info,0,sizeof(info));
         info.ei         = EI_THREAD_END;
         info.thread     = thread;
@@ -1092,21 +1234,29 @@ cbMonitorContendedEnter(jvmtiEnv *jvmti_env, JNIEnv *env,
     LOG_CB(("cbMonitorContendedEnter: thread=%p", thread));
 
     BEGIN_CALLBACK() {
-        (void)memset(&info,0,sizeof(info));
-        info.ei         = EI_MONITOR_CONTENDED_ENTER;
-        info.thread     = thread;
-        info.object     = object;
-        /* get current location of contended monitor enter */
-        error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
-                (gdata->jvmti, thread, 0, &method, &location);
-        if (error == JVMTI_ERROR_NONE) {
-            info.location = location;
-            info.method   = method;
-            info.clazz    = getMethodClass(jvmti_env, method);
-        } else {
-            info.location = -1;
+        /* ANDROID-CHANGED: Feed the monitor contention profiler. */
+        jboolean profiled = JNI_FALSE;
+        if (monitorProfile_isActive() && !gdata->vmDead) {
+            monitorProfile_onContendedEnter(env, thread, object);
+            profiled = JNI_TRUE;
+        }
+        if (!profiled || hasHandlers(EI_MONITOR_CONTENDED_ENTER)) {
+            (void)memset(&info,0,sizeof(info));
+            info.ei         = EI_MONITOR_CONTENDED_ENTER;
+            info.thread     = thread;
+            info.object     = object;
+            /* get current location of contended monitor enter */
+            error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
+                    (gdata->jvmti, thread, 0, &method, &location);
+            if (error == JVMTI_ERROR_NONE) {
+                info.location = location;
+                info.method   = method;
+                info.clazz    = getMethodClass(jvmti_env, method);
+            } else {
+                info.location = -1;
+            }
+            event_callback(env, &info);
         }
-        event_callback(env, &info);
     } END_CALLBACK();
 
     LOG_MISC(("END cbMonitorContendedEnter"));
@@ -1125,21 +1275,29 @@ cbMonitorContendedEntered(jvmtiEnv *jvmti_env, JNIEnv *env,
     LOG_CB(("cbMonitorContendedEntered: thread=%p", thread));
 
     BEGIN_CALLBACK() {
-        (void)memset(&info,0,sizeof(info));
-        info.ei         = EI_MONITOR_CONTENDED_ENTERED;
-        info.thread     = thread;
-        info.object     = object;
-        /* get current location of contended monitor enter */
-        error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
-                (gdata->jvmti, thread, 0, &method, &location);
-        if (error == JVMTI_ERROR_NONE) {
-            info.location = location;
-            info.method   = method;
-            info.clazz    = getMethodClass(jvmti_env, method);
-        } else {
-            info.location = -1;
+        /* ANDROID-CHANGED: Feed the monitor contention profiler. */
+        jboolean profiled = JNI_FALSE;
+        if (monitorProfile_isActive() && !gdata->vmDead) {
+            monitorProfile_onContendedEntered(env, thread, object);
+            profiled = JNI_TRUE;
+        }
+        if (!profiled || hasHandlers(EI_MONITOR_CONTENDED_ENTERED)) {
+            (void)memset(&info,0,sizeof(info));
+            info.ei         = EI_MONITOR_CONTENDED_ENTERED;
+            info.thread     = thread;
+            info.object     = object;
+            /* get current location of contended monitor enter */
+            error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
+                    (gdata->jvmti, thread, 0, &method, &location);
+            if (error == JVMTI_ERROR_NONE) {
+                info.location = location;
+                info.method   = method;
+                info.clazz    = getMethodClass(jvmti_env, method);
+            } else {
+                info.location = -1;
+            }
+            event_callback(env, &info);
         }
-        event_callback(env, &info);
     } END_CALLBACK();
 
     LOG_MISC(("END cbMonitorContendedEntered"));
@@ -1159,29 +1317,37 @@ cbMonitorWait(jvmtiEnv *jvmti_env, JNIEnv *env,
     LOG_CB(("cbMonitorWait: thread=%p", thread));
 
     BEGIN_CALLBACK() {
-        (void)memset(&info,0,sizeof(info));
-        info.ei         = EI_MONITOR_WAIT;
-        info.thread     = thread;
-        info.object     = object;
-        /* The info.clazz is used for both class filtering and for location info.
-         * For monitor wait event the class filtering is done for class of monitor
-         * object. So here info.clazz is set to class of monitor object here and it
-         * is reset to class of method before writing location info.
-         * See writeMonitorEvent in eventHelper.c
-         */
-        info.clazz      = getObjectClass(object);
-        info.u.monitor.timeout = timeout;
-
-        /* get location of monitor wait() method. */
-        error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
-                (gdata->jvmti, thread, 0, &method, &location);
-        if (error == JVMTI_ERROR_NONE) {
-            info.location = location;
-            info.method   = method;
-        } else {
-            info.location = -1;
+        /* ANDROID-CHANGED: Feed the monitor contention profiler. */
+        jboolean profiled = JNI_FALSE;
+        if (monitorProfile_isActive() && !gdata->vmDead) {
+            monitorProfile_onWait(env, thread, object);
+            profiled = JNI_TRUE;
+        }
+        if (!profiled || hasHandlers(EI_MONITOR_WAIT)) {
+            (void)memset(&info,0,sizeof(info));
+            info.ei         = EI_MONITOR_WAIT;
+            info.thread     = thread;
+            info.object     = object;
+            /* The info.clazz is used for both class filtering and for location info.
+             * For monitor wait event the class filtering is done for class of monitor
+             * object. So here info.clazz is set to class of monitor object here and it
+             * is reset to class of method before writing location info.
+             * See writeMonitorEvent in eventHelper.c
+             */
+            info.clazz      = getObjectClass(object);
+            info.u.monitor.timeout = timeout;
+
+            /* get location of monitor wait() method. */
+            error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
+                    (gdata->jvmti, thread, 0, &method, &location);
+            if (error == JVMTI_ERROR_NONE) {
+                info.location = location;
+                info.method   = method;
+            } else {
+                info.location = -1;
+            }
+            event_callback(env, &info);
         }
-        event_callback(env, &info);
     } END_CALLBACK();
 
     LOG_MISC(("END cbMonitorWait"));
@@ -1201,29 +1367,37 @@ cbMonitorWaited(jvmtiEnv *jvmti_env, JNIEnv *env,
     LOG_CB(("cbMonitorWaited: thread=%p", thread));
 
     BEGIN_CALLBACK() {
-        (void)memset(&info,0,sizeof(info));
-        info.ei         = EI_MONITOR_WAITED;
-        info.thread     = thread;
-        info.object     = object;
-        /* The info.clazz is used for both class filtering and for location info.
-         * For monitor waited event the class filtering is done for class of monitor
-         * object. So here info.clazz is set to class of monitor object here and it
-         * is reset to class of method before writing location info.
-         * See writeMonitorEvent in eventHelper.c
-         */
-        info.clazz      = getObjectClass(object);
-        info.u.monitor.timed_out = timed_out;
-
-        /* get location of monitor wait() method */
-        error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
-                (gdata->jvmti, thread, 0, &method, &location);
-        if (error == JVMTI_ERROR_NONE) {
-            info.location = location;
-            info.method   = method;
-        } else {
-            info.location = -1;
+        /* ANDROID-CHANGED: Feed the monitor contention profiler. */
+        jboolean profiled = JNI_FALSE;
+        if (monitorProfile_isActive() && !gdata->vmDead) {
+            monitorProfile_onWaited(env, thread, object);
+            profiled = JNI_TRUE;
+        }
+        if (!profiled || hasHandlers(EI_MONITOR_WAITED)) {
+            (void)memset(&info,0,sizeof(info));
+            info.ei         = EI_MONITOR_WAITED;
+            info.thread     = thread;
+            info.object     = object;
+            /* The info.clazz is used for both class filtering and for location info.
+             * For monitor waited event the class filtering is done for class of monitor
+             * object. So here info.clazz is set to class of monitor object here and it
+             * is reset to class of method before writing location info.
+             * See writeMonitorEvent in eventHelper.c
+             */
+            info.clazz      = getObjectClass(object);
+            info.u.monitor.timed_out = timed_out;
+
+            /* get location of monitor wait() method */
+            error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
+                    (gdata->jvmti, thread, 0, &method, &location);
+            if (error == JVMTI_ERROR_NONE) {
+                info.location = location;
+                info.method   = method;
+            } else {
+                info.location = -1;
+            }
+            event_callback(env, &info);
         }
-        event_callback(env, &info);
     } END_CALLBACK();
 
     LOG_MISC(("END cbMonitorWaited"));
@@ -1338,6 +1512,10 @@ freeHandler(HandlerNode *node) {
     if (node != NULL && (!node->permanent)) {
         deinsert(node);
         error = eventFilterRestricted_deinstall(node);
+        // ANDROID-CHANGED: Keep the exception pre-filter in sync.
+        if (node->ei == EI_EXCEPTION) {
+            eventFilterRestricted_exceptionRequestsChanged();
+        }
         jvmtiDeallocate(node);
     }
 
@@ -1428,10 +1606,13 @@ eventHandler_freeClassBreakpoints(jclass clazz)
         HandlerNode *next = NEXT(node); /* allows node removal */
         if (eventFilterRestricted_isBreakpointInClass(env, clazz,
                                                       node)) {
+            forgetMethodWatchBreakpoint(node);
             (void)freeHandler(node);
         }
         node = next;
     }
+    /* ANDROID-CHANGED: Set the cleared method watches on the new code */
+    rearmMethodWatches(clazz);
     debugMonitorExit(handlerLock);
 }
 
@@ -1474,6 +1655,7 @@ eventHandler_initialize(jbyte sessionID)
 
     for (i = EI_min; i <= EI_max; ++i) {
         getHandlerChain(i)->first = NULL;
+        atomic_store(&handlerCounts[i-EI_min], 0);
     }
 
     /*
@@ -1519,6 +1701,8 @@ eventHandler_initialize(jbyte sessionID)
     (void)memset(&(gdata->callbacks),0,sizeof(gdata->callbacks));
     /* ANDROID-CHANGED: Event callback for common-ref tracking */
     gdata->callbacks.ObjectFree                 = &cbObjectFree;
+    /* ANDROID-CHANGED: Event callback for allocation profiling */
+    gdata->callbacks.VMObjectAlloc              = &cbVMObjectAlloc;
     /* Event callback for JVMTI_EVENT_SINGLE_STEP */
     gdata->callbacks.SingleStep                 = &cbSingleStep;
     /* Event callback for JVMTI_EVENT_BREAKPOINT */
@@ -1592,6 +1776,9 @@ eventHandler_reset(jbyte sessionID)
      */
     eventHelper_reset(sessionID);
 
+    /* ANDROID-CHANGED: The watches' handlers go with the chains below */
+    clearMethodWatches();
+
     /* delete all handlers */
     for (i = EI_min; i <= EI_max; i++) {
         (void)freeHandlerChain(getHandlerChain(i));
@@ -1662,6 +1849,10 @@ installHandler(HandlerNode *node,
     error = eventFilterRestricted_install(node);
     if (error == JVMTI_ERROR_NONE) {
         insert(getHandlerChain(node->ei), node);
+        // ANDROID-CHANGED: Keep the exception pre-filter in sync.
+        if (node->ei == EI_EXCEPTION) {
+            eventFilterRestricted_exceptionRequestsChanged();
+        }
     }
 
     debugMonitorExit(handlerLock);
@@ -1737,10 +1928,275 @@ eventHandler_createInternalBreakpoint(HandlerFunction func,
                           clazz, method, location, JNI_FALSE);
 }
 
+/***** ANDROID-CHANGED: method watches *****/
+
+static MethodWatch *
+findMethodWatch(jmethodID method)
+{
+    MethodWatch *watch;
+
+    for (watch = methodWatches; watch != NULL; watch = watch->next) {
+        if (watch->method == method) {
+            return watch;
+        }
+    }
+    return NULL;
+}
+
+/* Depth of the top frame, for telling watched frames apart. */
+static jint
+methodWatchDepth(jthread thread)
+{
+    jint count = 0;
+
+    (void)JVMTI_FUNC_PTR(gdata->jvmti,GetFrameCount)
+                (gdata->jvmti, thread, &count);
+    return count;
+}
+
+/* Internal breakpoint handler at the start of a watched method. */
+static void
+handleMethodWatchStart(JNIEnv *env, EventInfo *evinfo, HandlerNode *node,
+                       struct bag *eventBag)
+{
+    MethodWatch *watch = findMethodWatch(evinfo->method);
+    jboolean entry;
+    jvmtiError error;
+
+    if (watch == NULL) {
+        return;
+    }
+
+    error = JVMTI_FUNC_PTR(gdata->jvmti,NotifyFramePop)
+                (gdata->jvmti, evinfo->thread, 0);
+    if (error != JVMTI_ERROR_NONE) {
+        /* Branched back to the start, or not a frame we can watch */
+        return;
+    }
+    if (watch->returnValueRequests > 0 &&
+        threadControl_countReturnValueWatch(evinfo->thread,
+                                methodWatchDepth(evinfo->thread), JNI_TRUE)) {
+        (void)eventFilter_enableThreadEvent(EI_METHOD_EXIT, evinfo->thread);
+    }
+
+    /* A handler may free the watch, so it must not be used after this */
+    entry = (watch->entryRequests > 0);
+    if (entry) {
+        EventInfo info = *evinfo;
+
+        info.ei = EI_METHOD_ENTRY;
+        info.synthetic = JNI_TRUE;
+        processHandlerChain(env, &info, eventBag);
+    }
+}
+
+/*
+ * Account for a watched frame being popped. Returns whether MethodExit
+ * events are to be made up for it. Assumes handlerLock held.
+ */
+static jboolean
+methodWatchFramePopped(jthread thread, jmethodID method)
+{
+    MethodWatch *watch = findMethodWatch(method);
+
+    if (watch == NULL) {
+        return JNI_FALSE;
+    }
+    /* Only a frame counted on entry is uncounted, whichever watch it was */
+    if (returnValueWatchCount > 0 &&
+        threadControl_countReturnValueWatch(thread, methodWatchDepth(thread),
+                                            JNI_FALSE)) {
+        (void)eventFilter_disableThreadEvent(EI_METHOD_EXIT, thread);
+    }
+    return watch->exitRequests > 0;
+}
+
+/* Internal FramePop handler for the frames of watched methods. */
+static void
+handleMethodWatchFramePop(JNIEnv *env, EventInfo *evinfo, HandlerNode *node,
+                          struct bag *eventBag)
+{
+    if (methodWatchFramePopped(evinfo->thread, evinfo->method)) {
+        EventInfo info = *evinfo;
+
+        info.ei = EI_METHOD_EXIT;
+        info.synthetic = JNI_TRUE;
+        processHandlerChain(env, &info, eventBag);
+    }
+}
+
+jvmtiError
+eventHandlerRestricted_addMethodWatch(EventIndex ei, jclass clazz,
+                                      jmethodID method, jlocation start,
+                                      jboolean returnValue)
+{
+    MethodWatch *watch = findMethodWatch(method);
+
+    if (watch == NULL) {
+        if (methodWatchFramePop == NULL) {
+            methodWatchFramePop = createInternal(EI_FRAME_POP,
+                                        handleMethodWatchFramePop,
+                                        NULL, NULL, NULL, 0, JNI_FALSE);
+            if (methodWatchFramePop == NULL) {
+                return AGENT_ERROR_INTERNAL;
+            }
+        }
+        watch = jvmtiAllocate((jint)sizeof(MethodWatch));
+        if (watch != NULL) {
+            (void)memset(watch, 0, sizeof(MethodWatch));
+            watch->method = method;
+            watch->breakpoint = createInternal(EI_BREAKPOINT,
+                                            handleMethodWatchStart,
+                                            NULL, clazz, method, start,
+                                            JNI_FALSE);
+        }
+        if (watch == NULL || watch->breakpoint == NULL) {
+            jvmtiError error = (watch == NULL) ?
+                                   AGENT_ERROR_OUT_OF_MEMORY :
+                                   JVMTI_ERROR_INVALID_METHODID;
+
+            jvmtiDeallocate(watch);
+            if (methodWatches == NULL) {
+                (void)freeHandler(methodWatchFramePop);
+                methodWatchFramePop = NULL;
+            }
+            return error;
+        }
+        watch->next = methodWatches;
+        methodWatches = watch;
+        methodWatchesActive = JNI_TRUE;
+    }
+
+    if (ei == EI_METHOD_ENTRY) {
+        watch->entryRequests++;
+    } else if (returnValue) {
+        watch->returnValueRequests++;
+        returnValueWatchCount++;
+    } else {
+        watch->exitRequests++;
+    }
+    return JVMTI_ERROR_NONE;
+}
+
+jvmtiError
+eventHandlerRestricted_removeMethodWatch(EventIndex ei, jmethodID method,
+                                         jboolean returnValue)
+{
+    MethodWatch *watch = findMethodWatch(method);
+    MethodWatch **link;
+    HandlerNode *breakpoint;
+
+    if (watch == NULL) {
+        /* Already dropped by eventHandler_reset */
+        return JVMTI_ERROR_NONE;
+    }
+
+    if (ei == EI_METHOD_ENTRY) {
+        watch->entryRequests--;
+    } else if (returnValue) {
+        watch->returnValueRequests--;
+        if (--returnValueWatchCount == 0) {
+            threadControl_clearReturnValueWatches();
+        }
+    } else {
+        watch->exitRequests--;
+    }
+    if (watch->entryRequests > 0 || watch->exitRequests > 0 ||
+        watch->returnValueRequests > 0) {
+        return JVMTI_ERROR_NONE;
+    }
+
+    for (link = &methodWatches; *link != watch; link = &(*link)->next) {
+    }
+    *link = watch->next;
+    breakpoint = watch->breakpoint;
+    jvmtiDeallocate(watch);
+    if (methodWatches == NULL) {
+        HandlerNode *framePop = methodWatchFramePop;
+
+        methodWatchesActive = JNI_FALSE;
+        methodWatchFramePop = NULL;
+        (void)freeHandler(framePop);
+    }
+    return (breakpoint == NULL) ? JVMTI_ERROR_NONE : freeHandler(breakpoint);
+}
+
+/* The breakpoint of a watch is being cleared by a class redefinition. */
+static void
+forgetMethodWatchBreakpoint(HandlerNode *node)
+{
+    MethodWatch *watch;
+
+    for (watch = methodWatches; watch != NULL; watch = watch->next) {
+        if (watch->breakpoint == node) {
+            watch->breakpoint = NULL;
+            watch->redefined = JNI_TRUE;
+        }
+    }
+}
+
+/*
+ * Set the breakpoints of the watches cleared by a redefinition of clazz
+ * again. The method IDs survive the redefinition, but the start of the
+ * new code has to be looked up.
+ */
+static void
+rearmMethodWatches(jclass clazz)
+{
+    MethodWatch *watch;
+
+    for (watch = methodWatches; watch != NULL; watch = watch->next) {
+        jlocation start;
+        jlocation end;
+        jvmtiError error;
+
+        if (!watch->redefined) {
+            continue;
+        }
+        watch->redefined = JNI_FALSE;
+        error = methodLocation(watch->method, &start, &end);
+        if (error == JVMTI_ERROR_NONE) {
+            watch->breakpoint = createInternal(EI_BREAKPOINT,
+                                            handleMethodWatchStart,
+                                            NULL, clazz, watch->method,
+                                            start, JNI_FALSE);
+            if (watch->breakpoint == NULL) {
+                error = JVMTI_ERROR_INVALID_METHODID;
+            }
+        }
+        if (error != JVMTI_ERROR_NONE) {
+            ERROR_MESSAGE(("JDWP unable to watch redefined method, "
+                           "MethodEntry/MethodExit requests lost: %s(%d)",
+                           jvmtiErrorText(error), error));
+        }
+    }
+}
+
+/* Drop all watches, leaving their handlers to be freed with the chains. */
+static void
+clearMethodWatches(void)
+{
+    while (methodWatches != NULL) {
+        MethodWatch *next = methodWatches->next;
+
+        jvmtiDeallocate(methodWatches);
+        methodWatches = next;
+    }
+    if (returnValueWatchCount > 0) {
+        returnValueWatchCount = 0;
+        threadControl_clearReturnValueWatches();
+    }
+    methodWatchFramePop = NULL;
+    methodWatchesActive = JNI_FALSE;
+}
+
 jvmtiError
 eventHandler_installExternal(HandlerNode *node)
 {
+    /* ANDROID-CHANGED: Snapshot requests don't report events */
     return installHandler(node,
-                          standardHandlers_defaultHandler(node->ei),
+                          (node->snapshots != NULL) ?
+                              snapshotPoint_handleEvent :
+                              standardHandlers_defaultHandler(node->ei),
                           JNI_TRUE);
 }
@@ -30,6 +30,8 @@
 
 typedef jint HandlerID;
 
+struct SnapshotRing;
+
 /* structure is read-only for users */
 typedef struct HandlerNode_ {
     HandlerID handlerID;
@@ -37,6 +39,10 @@ typedef struct HandlerNode_ {
     jbyte suspendPolicy;
     jboolean permanent;
     int needReturnValue;
+    /* ANDROID-CHANGED: Frames in the prefetch bundle, 0 for none */
+    jint prefetchFrames;
+    /* ANDROID-CHANGED: Ring of a Snapshot request, NULL for others */
+    struct SnapshotRing *snapshots;
 } HandlerNode;
 
 typedef void (*HandlerFunction)(JNIEnv *env,
@@ -76,6 +82,9 @@ void eventHandler_reset(jbyte sessionID);
 void eventHandler_lock(void);
 void eventHandler_unlock(void);
 
+/* ANDROID-CHANGED: Catch up on class unloads not seen by an event yet */
+void eventHandler_processUnloads(JNIEnv *env);
+
 
 jclass getMethodClass(jvmtiEnv *jvmti_env, jmethodID method);
 
@@ -37,6 +37,13 @@ typedef jboolean (*IteratorFunction)(JNIEnv *env,
 jboolean eventHandlerRestricted_iterator(EventIndex ei,
                               IteratorFunction func, void *arg);
 
+/* ANDROID-CHANGED: Method watches for narrowed MethodOnly requests */
+jvmtiError eventHandlerRestricted_addMethodWatch(EventIndex ei,
+                              jclass clazz, jmethodID method,
+                              jlocation start, jboolean returnValue);
+jvmtiError eventHandlerRestricted_removeMethodWatch(EventIndex ei,
+                              jmethodID method, jboolean returnValue);
+
 /* HandlerNode data has three components:
  *    public info                (HandlerNode)  as declared in eventHandler.h
  *    eventHandler private data  (EventHandlerPrivate_Data) as declared below
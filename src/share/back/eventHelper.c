@@ -28,6 +28,8 @@
 #include "eventHandler.h"
 #include "threadControl.h"
 #include "invoker.h"
+#include "FrameID.h"
+#include "lineCoverage.h"
 
 /*
  * Event helper thread command commandKinds
@@ -36,6 +38,8 @@
 #define COMMAND_REPORT_INVOKE_DONE              2
 #define COMMAND_REPORT_VM_INIT                  3
 #define COMMAND_SUSPEND_THREAD                  4
+/* ANDROID-CHANGED: See lineCoverage_clearReachedBreakpoints */
+#define COMMAND_CLEAR_COVERAGE_BREAKPOINTS      5
 
 /*
  * Event helper thread command singleKinds
@@ -70,6 +74,7 @@ typedef struct FrameEventCommandSingle {
 
 typedef struct CommandSingle {
     jint singleKind;
+    jint prefetchFrames;    /* ANDROID-CHANGED: See writePrefetchBundle() */
     union {
         EventCommandSingle eventCommand;
         UnloadCommandSingle unloadCommand;
@@ -118,11 +123,20 @@ typedef struct {
 } CommandQueue;
 
 static CommandQueue commandQueue;
-static jrawMonitorID commandQueueLock;
+/* ANDROID-CHANGED: Lightweight lock, see lightLock.c */
+static LightLock commandQueueLock;
 static jrawMonitorID commandCompleteLock;
 static jrawMonitorID blockCommandLoopLock;
 static jint maxQueueSize = 50 * 1024; /* TO DO: Make this configurable */
 static jboolean holdEvents;
+/*
+ * ANDROID-CHANGED: Credit based flow control, see Vendor.EventCredits.
+ * While eventCredits is not negative, every event composite sent uses up
+ * one credit and none is sent while there are no credits left. Negative
+ * means unlimited, which is the state until the debugger grants credits
+ * for the first time.
+ */
+static jint eventCredits = -1;
 static jint currentQueueSize = 0;
 static jint currentSessionID;
 
@@ -165,9 +179,9 @@ enqueueCommand(HelperCommand *command,
     command->waiting = wait;
     command->next = NULL;
 
-    debugMonitorEnter(commandQueueLock);
+    lightLock_enter(&commandQueueLock);
     while (size + currentQueueSize > maxQueueSize) {
-        debugMonitorWait(commandQueueLock);
+        lightLock_wait(&commandQueueLock);
     }
     log_debugee_location("enqueueCommand(): HelperCommand being processed", NULL, NULL, 0);
     if (vmDeathReported) {
@@ -187,8 +201,8 @@ enqueueCommand(HelperCommand *command,
             vmDeathReported = JNI_TRUE;
         }
     }
-    debugMonitorNotifyAll(commandQueueLock);
-    debugMonitorExit(commandQueueLock);
+    lightLock_notifyAll(&commandQueueLock);
+    lightLock_exit(&commandQueueLock);
 
     if (wait) {
         debugMonitorEnter(commandCompleteLock);
@@ -222,11 +236,15 @@ dequeueCommand(void)
     CommandQueue *queue = &commandQueue;
     jint size;
 
-    debugMonitorEnter(commandQueueLock);
+    lightLock_enter(&commandQueueLock);
 
     while (command == NULL) {
-        while (holdEvents || (queue->head == NULL)) {
-            debugMonitorWait(commandQueueLock);
+        while (holdEvents || (queue->head == NULL) ||
+               (eventCredits == 0 &&
+                queue->head->commandKind == COMMAND_REPORT_EVENT_COMPOSITE &&
+                queue->head->sessionID == currentSessionID &&
+                !gdata->vmDead)) {
+            lightLock_wait(&commandQueueLock);
         }
 
         JDI_ASSERT(queue->head);
@@ -247,34 +265,57 @@ dequeueCommand(void)
             log_debugee_location("dequeueCommand(): command session removal", NULL, NULL, 0);
             completeCommand(command);
             command = NULL;
+        } else if (eventCredits > 0 &&
+                   command->commandKind == COMMAND_REPORT_EVENT_COMPOSITE) {
+            eventCredits--;
         }
 
         /*
          * There's room in the queue for more.
          */
         currentQueueSize -= size;
-        debugMonitorNotifyAll(commandQueueLock);
+        lightLock_notifyAll(&commandQueueLock);
     }
 
-    debugMonitorExit(commandQueueLock);
+    lightLock_exit(&commandQueueLock);
 
     return command;
 }
 
 void eventHelper_holdEvents(void)
 {
-    debugMonitorEnter(commandQueueLock);
+    lightLock_enter(&commandQueueLock);
     holdEvents = JNI_TRUE;
-    debugMonitorNotifyAll(commandQueueLock);
-    debugMonitorExit(commandQueueLock);
+    lightLock_notifyAll(&commandQueueLock);
+    lightLock_exit(&commandQueueLock);
 }
 
 void eventHelper_releaseEvents(void)
 {
-    debugMonitorEnter(commandQueueLock);
+    lightLock_enter(&commandQueueLock);
     holdEvents = JNI_FALSE;
-    debugMonitorNotifyAll(commandQueueLock);
-    debugMonitorExit(commandQueueLock);
+    lightLock_notifyAll(&commandQueueLock);
+    lightLock_exit(&commandQueueLock);
+}
+
+/*
+ * ANDROID-CHANGED: Adds to the number of event composites which may be
+ * sent. A negative number removes the limit.
+ */
+void eventHelper_grantEventCredits(jint credits)
+{
+    lightLock_enter(&commandQueueLock);
+    if (credits < 0) {
+        eventCredits = -1;
+    } else if (eventCredits < 0) {
+        eventCredits = credits;
+    } else if (credits > 0x7fffffff - eventCredits) {
+        eventCredits = 0x7fffffff;
+    } else {
+        eventCredits += credits;
+    }
+    lightLock_notifyAll(&commandQueueLock);
+    lightLock_exit(&commandQueueLock);
 }
 
 static void
@@ -494,6 +535,222 @@ suspendWithInvokeEnabled(jbyte policy, jthread thread)
     }
 }
 
+/*
+ * ANDROID-CHANGED: Writes the values of the local variables visible at
+ * the current location of the thread, for writePrefetchBundle(). Values
+ * that cannot be read, for example because the variable is not live at
+ * this point, are left out.
+ */
+static void
+writePrefetchLocals(JNIEnv *env, PacketOutputStream *out, jthread thread,
+                    jmethodID method, jlocation location)
+{
+    jvmtiLocalVariableEntry *table;
+    jvmtiError error;
+    jint count;
+    jint i;
+
+    table = NULL;
+    count = 0;
+    if (location >= 0) {
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalVariableTable)
+                    (gdata->jvmti, method, &count, &table);
+        if (error != JVMTI_ERROR_NONE) {
+            table = NULL;
+            count = 0;
+        }
+    }
+
+    WITH_LOCAL_REFS(env, count + 1) {
+
+        jbyte *typeKeys;
+        jvalue *values;
+        jint valueCount;
+
+        typeKeys = jvmtiAllocate(count * (int)sizeof(jbyte));
+        values = jvmtiAllocate(count * (int)sizeof(jvalue));
+        valueCount = 0;
+        for (i = 0; (i < count) && (typeKeys != NULL) && (values != NULL); i++) {
+            jvmtiLocalVariableEntry *entry = &table[i];
+            jbyte typeKey = entry->signature[0];
+            jvalue *value = &values[i];
+            jint intValue;
+
+            typeKeys[i] = 0;
+            if (location < entry->start_location ||
+                    location >= entry->start_location + entry->length) {
+                continue;
+            }
+            if (isObjectTag(typeKey)) {
+                error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalObject)
+                            (gdata->jvmti, thread, 0, entry->slot, &value->l);
+            } else {
+                switch (typeKey) {
+                    case JDWP_TAG(FLOAT):
+                        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalFloat)
+                            (gdata->jvmti, thread, 0, entry->slot, &value->f);
+                        break;
+                    case JDWP_TAG(DOUBLE):
+                        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalDouble)
+                            (gdata->jvmti, thread, 0, entry->slot, &value->d);
+                        break;
+                    case JDWP_TAG(LONG):
+                        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalLong)
+                            (gdata->jvmti, thread, 0, entry->slot, &value->j);
+                        break;
+                    default:
+                        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalInt)
+                            (gdata->jvmti, thread, 0, entry->slot, &intValue);
+                        switch (typeKey) {
+                            case JDWP_TAG(BYTE):
+                                value->b = (jbyte)intValue;
+                                break;
+                            case JDWP_TAG(CHAR):
+                                value->c = (jchar)intValue;
+                                break;
+                            case JDWP_TAG(SHORT):
+                                value->s = (jshort)intValue;
+                                break;
+                            case JDWP_TAG(BOOLEAN):
+                                value->z = (jboolean)intValue;
+                                break;
+                            default:
+                                value->i = intValue;
+                                break;
+                        }
+                        break;
+                }
+            }
+            if (error == JVMTI_ERROR_NONE) {
+                typeKeys[i] = typeKey;
+                valueCount++;
+            }
+        }
+
+        (void)outStream_writeInt(out, valueCount);
+        for (i = 0; (i < count) && (valueCount > 0); i++) {
+            if (typeKeys[i] != 0) {
+                (void)outStream_writeInt(out, table[i].slot);
+                (void)outStream_writeValue(env, out, typeKeys[i], values[i]);
+            }
+        }
+
+        if (typeKeys != NULL) {
+            jvmtiDeallocate(typeKeys);
+        }
+        if (values != NULL) {
+            jvmtiDeallocate(values);
+        }
+
+    } END_WITH_LOCAL_REFS(env);
+
+    for (i = 0; i < count; i++) {
+        jvmtiDeallocate(table[i].name);
+        jvmtiDeallocate(table[i].signature);
+        if (table[i].generic_signature != NULL) {
+            jvmtiDeallocate(table[i].generic_signature);
+        }
+    }
+    if (table != NULL) {
+        jvmtiDeallocate(table);
+    }
+}
+
+/*
+ * ANDROID-CHANGED: Writes the prefetch bundle asked for with the Prefetch
+ * event request modifier, see jdwp.spec. It saves the debugger the
+ * commands it would otherwise send to read the stack, 'this' and the
+ * locals of a thread that has just stopped. State that cannot be read
+ * shortens the bundle but never fails the event.
+ */
+static void
+writePrefetchBundle(JNIEnv *env, PacketOutputStream *out,
+                    jthread thread, jint maxFrames)
+{
+    jvmtiFrameInfo *frames;
+    jvmtiError error;
+    jint suspendCount;
+    jint frameCount;
+    jint count;
+
+    error = threadControl_suspendCount(thread, &suspendCount);
+    if (error != JVMTI_ERROR_NONE || suspendCount == 0) {
+        return;
+    }
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameCount)
+                (gdata->jvmti, thread, &frameCount);
+    if (error != JVMTI_ERROR_NONE) {
+        return;
+    }
+    frames = jvmtiAllocate(maxFrames * (int)sizeof(jvmtiFrameInfo));
+    if (frames == NULL) {
+        return;
+    }
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetStackTrace)
+                (gdata->jvmti, thread, 0, maxFrames, frames, &count);
+    if (error != JVMTI_ERROR_NONE) {
+        jvmtiDeallocate(frames);
+        return;
+    }
+
+    WITH_LOCAL_REFS(env, count + 2) {
+
+        jclass *classes;
+        jobject thisObject;
+        jint i;
+
+        classes = jvmtiAllocate(count * (int)sizeof(jclass));
+        if (classes == NULL) {
+            count = 0;
+        }
+        for (i = 0; i < count; i++) {
+            if (methodClass(frames[i].method, &classes[i]) != JVMTI_ERROR_NONE) {
+                count = i;
+            }
+        }
+
+        thisObject = NULL;
+        if (count > 0) {
+            jint modifiers;
+            error = methodModifiers(frames[0].method, &modifiers);
+            if (error == JVMTI_ERROR_NONE &&
+                    (modifiers & (MOD_STATIC | MOD_NATIVE)) == 0) {
+                /* As in StackFrameImpl.c, ART needs GetLocalInstance */
+                error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalInstance)
+                            (gdata->jvmti, thread, 0, &thisObject);
+                if (error != JVMTI_ERROR_NONE) {
+                    thisObject = NULL;
+                }
+            }
+        }
+
+        (void)outStream_writeObjectRef(env, out, thread);
+        (void)outStream_writeInt(out, frameCount);
+        (void)outStream_writeInt(out, count);
+        for (i = 0; i < count; i++) {
+            (void)outStream_writeFrameID(out, createFrameID(thread, i));
+            writeCodeLocation(out, classes[i], frames[i].method,
+                              frames[i].location);
+        }
+        (void)outStream_writeByte(out, specificTypeKey(env, thisObject));
+        (void)outStream_writeObjectRef(env, out, thisObject);
+
+        if (count > 0) {
+            writePrefetchLocals(env, out, thread, frames[0].method,
+                                frames[0].location);
+        } else {
+            (void)outStream_writeInt(out, 0);
+        }
+
+        if (classes != NULL) {
+            jvmtiDeallocate(classes);
+        }
+
+    } END_WITH_LOCAL_REFS(env);
+
+    jvmtiDeallocate(frames);
+}
+
 static void
 handleReportEventCompositeCommand(JNIEnv *env,
                                   ReportEventCompositeCommand *recc)
@@ -501,6 +758,8 @@ handleReportEventCompositeCommand(JNIEnv *env,
     PacketOutputStream out;
     jint count = recc->eventCount;
     jint i;
+    jthread prefetchThread = NULL;
+    jint prefetchFrames = 0;
 
     if (recc->suspendPolicy != JDWP_SUSPEND_POLICY(NONE)) {
         /* must determine thread to interrupt before writing */
@@ -525,6 +784,20 @@ handleReportEventCompositeCommand(JNIEnv *env,
             (void)threadControl_suspendAll();
         } else {
             suspendWithInvokeEnabled(recc->suspendPolicy, thread);
+
+            /*
+             * ANDROID-CHANGED: The events are all for the same thread,
+             * the bundle holds the most frames asked for by any of them.
+             * Writing the events releases their thread references.
+             */
+            for (i = 0; i < count; i++) {
+                if (recc->singleCommand[i].prefetchFrames > prefetchFrames) {
+                    prefetchFrames = recc->singleCommand[i].prefetchFrames;
+                }
+            }
+            if (prefetchFrames > 0) {
+                saveGlobalRef(env, thread, &prefetchThread);
+            }
         }
     }
 
@@ -552,6 +825,11 @@ handleReportEventCompositeCommand(JNIEnv *env,
         }
     }
 
+    if (prefetchThread != NULL) {
+        writePrefetchBundle(env, &out, prefetchThread, prefetchFrames);
+        tossGlobalRef(env, &prefetchThread);
+    }
+
     outStream_sendCommand(&out);
     outStream_destroy(&out);
 }
@@ -617,6 +895,10 @@ handleCommand(JNIEnv *env, HelperCommand *command)
         case COMMAND_SUSPEND_THREAD:
             handleSuspendThreadCommand(env, &command->u.suspendThread);
             break;
+        /* ANDROID-CHANGED: Batched coverage breakpoint clears */
+        case COMMAND_CLEAR_COVERAGE_BREAKPOINTS:
+            lineCoverage_clearReachedBreakpoints();
+            break;
         default:
             EXIT_ERROR(AGENT_ERROR_INVALID_EVENT_TYPE,"Event Helper Command");
             break;
@@ -719,10 +1001,11 @@ eventHelper_initialize(jbyte sessionID)
 
     currentSessionID = sessionID;
     holdEvents = JNI_FALSE;
+    eventCredits = -1;
     commandQueue.head = NULL;
     commandQueue.tail = NULL;
 
-    commandQueueLock = debugMonitorCreate("JDWP Event Helper Queue Monitor");
+    lightLock_init(&commandQueueLock, "JDWP Event Helper Queue Lock");
     commandCompleteLock = debugMonitorCreate("JDWP Event Helper Completion Monitor");
     blockCommandLoopLock = debugMonitorCreate("JDWP Event Block CommandLoop Monitor");
 
@@ -734,11 +1017,12 @@ eventHelper_initialize(jbyte sessionID)
 void
 eventHelper_reset(jbyte newSessionID)
 {
-    debugMonitorEnter(commandQueueLock);
+    lightLock_enter(&commandQueueLock);
     currentSessionID = newSessionID;
     holdEvents = JNI_FALSE;
-    debugMonitorNotifyAll(commandQueueLock);
-    debugMonitorExit(commandQueueLock);
+    eventCredits = -1;
+    lightLock_notifyAll(&commandQueueLock);
+    lightLock_exit(&commandQueueLock);
 }
 
 /*
@@ -748,7 +1032,7 @@ eventHelper_reset(jbyte newSessionID)
 void
 eventHelper_lock(void)
 {
-    debugMonitorEnter(commandQueueLock);
+    lightLock_enter(&commandQueueLock);
     debugMonitorEnter(commandCompleteLock);
 }
 
@@ -756,7 +1040,7 @@ void
 eventHelper_unlock(void)
 {
     debugMonitorExit(commandCompleteLock);
-    debugMonitorExit(commandQueueLock);
+    lightLock_exit(&commandQueueLock);
 }
 
 /* Change all references to global in the EventInfo struct */
@@ -994,7 +1278,7 @@ eventHelper_reportEvents(jbyte sessionID, struct bag *eventBag)
 
 void
 eventHelper_recordEvent(EventInfo *evinfo, jint id, jbyte suspendPolicy,
-                         struct bag *eventBag)
+                         jint prefetchFrames, struct bag *eventBag)
 {
     JNIEnv *env = getEnv();
     CommandSingle *command = bagAdd(eventBag);
@@ -1003,6 +1287,7 @@ eventHelper_recordEvent(EventInfo *evinfo, jint id, jbyte suspendPolicy,
     }
 
     command->singleKind = COMMAND_SINGLE_EVENT;
+    command->prefetchFrames = prefetchFrames;
     command->u.eventCommand.suspendPolicy = suspendPolicy;
     command->u.eventCommand.id = id;
 
@@ -1022,12 +1307,14 @@ eventHelper_recordClassUnload(jint id, char *signature, struct bag *eventBag)
         EXIT_ERROR(AGENT_ERROR_OUT_OF_MEMORY,"bagAdd(eventBag)");
     }
     command->singleKind = COMMAND_SINGLE_UNLOAD;
+    command->prefetchFrames = 0;
     command->u.unloadCommand.id = id;
     command->u.unloadCommand.classSignature = signature;
 }
 
 void
-eventHelper_recordFrameEvent(jint id, jbyte suspendPolicy, EventIndex ei,
+eventHelper_recordFrameEvent(jint id, jbyte suspendPolicy,
+                             jint prefetchFrames, EventIndex ei,
                              jthread thread, jclass clazz,
                              jmethodID method, jlocation location,
                              int needReturnValue,
@@ -1043,6 +1330,7 @@ eventHelper_recordFrameEvent(jint id, jbyte suspendPolicy, EventIndex ei,
     }
 
     command->singleKind = COMMAND_SINGLE_FRAME_EVENT;
+    command->prefetchFrames = prefetchFrames;
     frameCommand = &command->u.frameEventCommand;
     frameCommand->suspendPolicy = suspendPolicy;
     frameCommand->id = id;
@@ -1121,3 +1409,22 @@ eventHelper_suspendThread(jbyte sessionID, jthread thread)
     saveGlobalRef(env, thread, &(command->u.suspendThread.thread));
     enqueueCommand(command, JNI_TRUE, JNI_FALSE);
 }
+
+/*
+ * ANDROID-CHANGED: Have the helper thread clear the coverage breakpoints
+ * reached so far, so that the thread hitting one does not have to.
+ */
+void
+eventHelper_clearCoverageBreakpoints(void)
+{
+    HelperCommand *command = jvmtiAllocate(sizeof(*command));
+    if (command == NULL) {
+        EXIT_ERROR(AGENT_ERROR_OUT_OF_MEMORY,"HelperCommmand");
+    }
+    (void)memset(command, 0, sizeof(*command));
+    command->commandKind = COMMAND_CLEAR_COVERAGE_BREAKPOINTS;
+    lightLock_enter(&commandQueueLock);
+    command->sessionID = (jbyte)currentSessionID;
+    lightLock_exit(&commandQueueLock);
+    enqueueCommand(command, JNI_FALSE, JNI_FALSE);
+}
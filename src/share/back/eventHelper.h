@@ -34,9 +34,11 @@ void eventHelper_reset(jbyte sessionID);
 struct bag *eventHelper_createEventBag(void);
 
 void eventHelper_recordEvent(EventInfo *evinfo, jint id,
-                             jbyte suspendPolicy, struct bag *eventBag);
+                             jbyte suspendPolicy, jint prefetchFrames,
+                             struct bag *eventBag);
 void eventHelper_recordClassUnload(jint id, char *signature, struct bag *eventBag);
-void eventHelper_recordFrameEvent(jint id, jbyte suspendPolicy, EventIndex ei,
+void eventHelper_recordFrameEvent(jint id, jbyte suspendPolicy,
+                                  jint prefetchFrames, EventIndex ei,
                                   jthread thread, jclass clazz,
                                   jmethodID method, jlocation location,
                                   int needReturnValue,
@@ -47,9 +49,11 @@ jbyte eventHelper_reportEvents(jbyte sessionID, struct bag *eventBag);
 void eventHelper_reportInvokeDone(jbyte sessionID, jthread thread);
 void eventHelper_reportVMInit(JNIEnv *env, jbyte sessionID, jthread thread, jbyte suspendPolicy);
 void eventHelper_suspendThread(jbyte sessionID, jthread thread);
+void eventHelper_clearCoverageBreakpoints(void); /* ANDROID-CHANGED */
 
 void eventHelper_holdEvents(void);
 void eventHelper_releaseEvents(void);
+void eventHelper_grantEventCredits(jint credits); /* ANDROID-CHANGED */
 
 void eventHelper_lock(void);
 void eventHelper_unlock(void);
@@ -45,4 +45,8 @@ void *  dbgsysFindLibraryEntry(void *, const char *);
 /* Implemented in exec_md.c */
 int     dbgsysExec(char *cmdLine);
 
+/* ANDROID-CHANGED: Implemented in wait_md.c */
+void    dbgsysWaitOnAddress(int *address, int value);
+void    dbgsysWakeOnAddress(int *address, int count);
+
 #endif
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+/*
+ * ANDROID-CHANGED: Lightweight locks.
+ *
+ * Raw monitors cost a call into the VM for every enter and exit, and
+ * entering one may poll for interrupts and wait for suspension. Locks
+ * which are only held for short stretches, by agent threads or by
+ * application threads which cannot be suspended meanwhile (queues,
+ * the transport), don't need any of that.
+ *
+ * A LightLock is the three state futex mutex: 0 free, 1 held, 2 held
+ * and maybe contended. Entering a free lock is one compare-and-swap.
+ * Otherwise the thread spins for a while, since critical sections are
+ * short, and then marks the lock contended and sleeps on the word
+ * (dbgsysWaitOnAddress, a futex on Linux).
+ * Exiting wakes one sleeper if the lock was marked. Reentrancy is
+ * handled by the owner, which is identified by the address of a
+ * thread local. The condition is a sequence number which notify bumps
+ * and waiters sleep on; notify must be called with the lock held.
+ */
+
+#include <limits.h>
+
+#include "util.h"
+#include "sys.h"
+#include "lightLock.h"
+
+#define SPIN_LIMIT 100
+
+static __thread char threadMarker;
+
+static uintptr_t
+currentThread(void)
+{
+    return (uintptr_t)&threadMarker;
+}
+
+static void
+cpuRelax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause");
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* atomic_int has the size and representation of int */
+
+static void
+futexWait(atomic_int *address, int value)
+{
+    dbgsysWaitOnAddress((int *)address, value);
+}
+
+static void
+futexWake(atomic_int *address, int count)
+{
+    dbgsysWakeOnAddress((int *)address, count);
+}
+
+static jboolean
+tryAcquire(LightLock *lock)
+{
+    int expected = 0;
+
+    return atomic_compare_exchange_strong_explicit(&lock->state, &expected, 1,
+                memory_order_acquire, memory_order_relaxed) ? JNI_TRUE : JNI_FALSE;
+}
+
+static void
+acquireSlow(LightLock *lock)
+{
+    int spins;
+    int state;
+
+    for (spins = 0; spins < SPIN_LIMIT; spins++) {
+        cpuRelax();
+        if (atomic_load_explicit(&lock->state, memory_order_relaxed) == 0 &&
+            tryAcquire(lock)) {
+            return;
+        }
+    }
+    state = atomic_exchange_explicit(&lock->state, 2, memory_order_acquire);
+    while (state != 0) {
+        futexWait(&lock->state, 2);
+        state = atomic_exchange_explicit(&lock->state, 2, memory_order_acquire);
+    }
+}
+
+static void
+release(LightLock *lock)
+{
+    if (atomic_exchange_explicit(&lock->state, 0, memory_order_release) == 2) {
+        futexWake(&lock->state, 1);
+    }
+}
+
+/*
+ * Must not be called while the lock is in use. A lock may be set up
+ * again, for example for a new session.
+ */
+void
+lightLock_init(LightLock *lock, const char *name)
+{
+    atomic_init(&lock->state, 0);
+    atomic_init(&lock->notifySeq, 0);
+    atomic_init(&lock->owner, 0);
+    lock->recursions = 0;
+    lock->waiters = 0;
+    lock->name = name;
+}
+
+void
+lightLock_enter(LightLock *lock)
+{
+    uintptr_t self = currentThread();
+
+    if (atomic_load_explicit(&lock->owner, memory_order_relaxed) == self) {
+        lock->recursions++;
+        return;
+    }
+    if (!tryAcquire(lock)) {
+        acquireSlow(lock);
+    }
+    atomic_store_explicit(&lock->owner, self, memory_order_relaxed);
+}
+
+void
+lightLock_exit(LightLock *lock)
+{
+    JDI_ASSERT(atomic_load_explicit(&lock->owner, memory_order_relaxed) ==
+               currentThread());
+    if (lock->recursions > 0) {
+        lock->recursions--;
+        return;
+    }
+    atomic_store_explicit(&lock->owner, 0, memory_order_relaxed);
+    release(lock);
+}
+
+/*
+ * Like a raw monitor wait, releases the lock however often it was
+ * entered and may return spuriously.
+ */
+void
+lightLock_wait(LightLock *lock)
+{
+    uintptr_t self = currentThread();
+    jint recursions = lock->recursions;
+    int seq;
+
+    JDI_ASSERT(atomic_load_explicit(&lock->owner, memory_order_relaxed) == self);
+    seq = atomic_load_explicit(&lock->notifySeq, memory_order_relaxed);
+    lock->waiters++;
+    lock->recursions = 0;
+    atomic_store_explicit(&lock->owner, 0, memory_order_relaxed);
+    release(lock);
+
+    /* Returns at once if notified since seq was read */
+    futexWait(&lock->notifySeq, seq);
+
+    if (!tryAcquire(lock)) {
+        acquireSlow(lock);
+    }
+    atomic_store_explicit(&lock->owner, self, memory_order_relaxed);
+    lock->recursions = recursions;
+    lock->waiters--;
+}
+
+void
+lightLock_notify(LightLock *lock)
+{
+    if (lock->waiters > 0) {
+        atomic_fetch_add_explicit(&lock->notifySeq, 1, memory_order_relaxed);
+        futexWake(&lock->notifySeq, 1);
+    }
+}
+
+void
+lightLock_notifyAll(LightLock *lock)
+{
+    if (lock->waiters > 0) {
+        atomic_fetch_add_explicit(&lock->notifySeq, 1, memory_order_relaxed);
+        futexWake(&lock->notifySeq, INT_MAX);
+    }
+}
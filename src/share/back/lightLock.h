@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+#ifndef JDWP_LIGHTLOCK_H
+#define JDWP_LIGHTLOCK_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "jni.h"
+
+/*
+ * Lightweight replacement for the raw monitors of locks that never
+ * need to cooperate with thread suspension. A LightLock is reentrant
+ * and has a built-in condition, like a raw monitor, but is entered
+ * without calling into the VM: uncontended with a single atomic
+ * operation, contended by spinning briefly and then parking on a
+ * futex (or what the platform offers). Interrupts are neither polled
+ * nor consumed.
+ */
+
+typedef struct LightLock {
+    atomic_int state;           /* 0 free, 1 held, 2 held with sleepers */
+    atomic_int notifySeq;       /* bumped by every notify */
+    atomic_uintptr_t owner;
+    jint recursions;
+    jint waiters;
+    const char *name;
+} LightLock;
+
+void lightLock_init(LightLock *lock, const char *name);
+
+void lightLock_enter(LightLock *lock);
+void lightLock_exit(LightLock *lock);
+void lightLock_wait(LightLock *lock);
+void lightLock_notify(LightLock *lock);
+void lightLock_notifyAll(LightLock *lock);
+
+#endif
@@ -0,0 +1,969 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+/*
+ * ANDROID-CHANGED: Line coverage collection.
+ *
+ * A class selected for coverage gets a record with the distinct line
+ * numbers of its methods, a bitmap with one bit per line, and one
+ * coverage breakpoint per line table entry. When a coverage breakpoint
+ * is hit, the bit of its line is set and the breakpoint goes away, so
+ * code which has run once runs at full speed afterwards. Clearing a
+ * JVMTI breakpoint is not cheap, so it is not done on the thread which
+ * hit it: the breakpoint is queued and the event helper thread clears
+ * the queued ones in a batch. Until then, further hits are consumed
+ * without doing anything else.
+ * In lazy mode only the first breakpoint of each method is set up
+ * front; the rest of the method's breakpoints are set when it is first
+ * entered, so methods which never run cost nothing beyond their entry.
+ *
+ * A JVMTI breakpoint may be shared with breakpoint requests of the
+ * debugger (or of the agent itself). Whoever removes its interest
+ * last clears it at the JVMTI level: eventFilter asks
+ * lineCoverage_hasBreakpoint before setting or clearing one, and this
+ * module checks isBreakpointSet. A hit which is only for coverage is
+ * consumed before any event processing takes place.
+ *
+ * Breakpoints which are still set are found through a hash table
+ * keyed by method and location. Everything is protected by the event
+ * handler lock, except for a flag which lets breakpoint callbacks skip
+ * the lookup when no coverage breakpoint is set.
+ *
+ * A record does not keep its class alive: it holds the class's
+ * classTrack tag, and the class is looked up by tag when it is needed.
+ * The record of an unloaded class is dropped after the next garbage
+ * collection, before its jmethodIDs can be mistaken for those of a
+ * class loaded later.
+ */
+
+#include "util.h"
+#include "eventHandler.h"
+#include "eventFilter.h"
+#include "eventHelper.h"
+#include "classTrack.h"
+#include "lineCoverage.h"
+
+#define INITIAL_BUCKETS 1024
+
+struct ClassCoverage;
+
+typedef struct CoverageBreakpoint {
+    struct CoverageBreakpoint *next;    /* hash chain, while set */
+    struct ClassCoverage *owner;
+    jmethodID method;
+    jlocation location;
+    jint line;          /* index of the line in owner->lines */
+    jint following;     /* number of further breakpoints of the method
+                         * if this is its first one, else 0 */
+    jboolean set;
+    jboolean reached;   /* hit, waiting in the clear queue */
+    struct CoverageBreakpoint *nextReached;
+    struct CoverageBreakpoint *prevReached;
+} CoverageBreakpoint;
+
+typedef struct ClassCoverage {
+    struct ClassCoverage *next;
+    jlong tag;                          /* classTrack tag of the class */
+    jclass clazz;                       /* local ref, see lookupClasses */
+    jboolean lazy;
+    jboolean redefined;
+    jint lineCount;
+    jint *lines;                        /* ascending line numbers */
+    unsigned char *bitmap;              /* bit i is set if lines[i] ran */
+    jint breakpointCount;
+    CoverageBreakpoint *breakpoints;    /* grouped by method */
+} ClassCoverage;
+
+/* Protected by the event handler lock */
+static ClassCoverage *classes;
+static CoverageBreakpoint **buckets;
+static jint bucketCount;
+static jint setCount;
+static char **classPatterns;
+static jint classPatternCount;
+static jboolean lazyBreakpoints;
+static HandlerNode *prepareHandler;
+static CoverageBreakpoint *reachedBreakpoints;  /* the clear queue */
+static jboolean clearPending;   /* a clear command is with the helper */
+
+static volatile jboolean breakpointsSet = JNI_FALSE;
+
+static jint
+hashLocation(jmethodID method, jlocation location)
+{
+    jlong hash = (jlong)(intptr_t)method * 31 + location;
+
+    return (jint)((hash ^ (hash >> 17)) & (bucketCount - 1));
+}
+
+static jboolean
+growBuckets(void)
+{
+    CoverageBreakpoint **oldBuckets = buckets;
+    jint oldCount = bucketCount;
+    jint newCount = (bucketCount == 0) ? INITIAL_BUCKETS : bucketCount * 2;
+    CoverageBreakpoint **newBuckets;
+    jint i;
+
+    newBuckets = jvmtiAllocate(newCount * (jint)sizeof(CoverageBreakpoint *));
+    if (newBuckets == NULL) {
+        return JNI_FALSE;
+    }
+    (void)memset(newBuckets, 0, newCount * sizeof(CoverageBreakpoint *));
+    buckets = newBuckets;
+    bucketCount = newCount;
+
+    for (i = 0; i < oldCount; i++) {
+        CoverageBreakpoint *bp = oldBuckets[i];
+        while (bp != NULL) {
+            CoverageBreakpoint *next = bp->next;
+            jint index = hashLocation(bp->method, bp->location);
+            bp->next = buckets[index];
+            buckets[index] = bp;
+            bp = next;
+        }
+    }
+    jvmtiDeallocate(oldBuckets);
+    return JNI_TRUE;
+}
+
+static CoverageBreakpoint **
+findBreakpoint(jmethodID method, jlocation location)
+{
+    CoverageBreakpoint **link;
+
+    if (bucketCount == 0) {
+        return NULL;
+    }
+    link = &buckets[hashLocation(method, location)];
+    for (; *link != NULL; link = &(*link)->next) {
+        if ((*link)->method == method && (*link)->location == location) {
+            return link;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Whether a breakpoint request of the debugger or of the agent needs
+ * the JVMTI breakpoint at the location too.
+ */
+static jboolean
+isRequestedBreakpoint(jmethodID method, jlocation location)
+{
+    JNIEnv *env = getEnv();
+    jclass clazz;
+    jboolean isSet;
+
+    if (methodClass(method, &clazz) != JVMTI_ERROR_NONE) {
+        return JNI_FALSE;
+    }
+    isSet = isBreakpointSet(clazz, method, location);
+    JNI_FUNC_PTR(env,DeleteLocalRef)(env, clazz);
+    return isSet;
+}
+
+/*
+ * A breakpoint which cannot be set is left out of the coverage; its
+ * line stays unreached unless another breakpoint records it.
+ */
+static void
+setCoverageBreakpoint(CoverageBreakpoint *bp)
+{
+    jint index;
+
+    if (bp->set || findBreakpoint(bp->method, bp->location) != NULL) {
+        return;
+    }
+    if (setCount >= bucketCount * 2 && !growBuckets()) {
+        return;
+    }
+    if (!isRequestedBreakpoint(bp->method, bp->location)) {
+        jvmtiError error;
+
+        error = JVMTI_FUNC_PTR(gdata->jvmti,SetBreakpoint)
+                    (gdata->jvmti, bp->method, bp->location);
+        if (error != JVMTI_ERROR_NONE) {
+            return;
+        }
+    }
+    index = hashLocation(bp->method, bp->location);
+    bp->next = buckets[index];
+    buckets[index] = bp;
+    bp->set = JNI_TRUE;
+    setCount++;
+    breakpointsSet = JNI_TRUE;
+}
+
+static void
+queueReachedBreakpoint(CoverageBreakpoint *bp)
+{
+    bp->reached = JNI_TRUE;
+    bp->prevReached = NULL;
+    bp->nextReached = reachedBreakpoints;
+    if (reachedBreakpoints != NULL) {
+        reachedBreakpoints->prevReached = bp;
+    }
+    reachedBreakpoints = bp;
+}
+
+static void
+unqueueReachedBreakpoint(CoverageBreakpoint *bp)
+{
+    if (bp->prevReached != NULL) {
+        bp->prevReached->nextReached = bp->nextReached;
+    } else {
+        reachedBreakpoints = bp->nextReached;
+    }
+    if (bp->nextReached != NULL) {
+        bp->nextReached->prevReached = bp->prevReached;
+    }
+    bp->nextReached = NULL;
+    bp->prevReached = NULL;
+    bp->reached = JNI_FALSE;
+}
+
+/*
+ * The JVMTI breakpoint is left alone if a breakpoint request still
+ * needs it, or if clearJvmti is false because the VM already dropped
+ * it.
+ */
+static void
+clearCoverageBreakpoint(CoverageBreakpoint *bp, jboolean clearJvmti)
+{
+    CoverageBreakpoint **link;
+
+    if (!bp->set) {
+        return;
+    }
+    if (bp->reached) {
+        unqueueReachedBreakpoint(bp);
+    }
+    link = findBreakpoint(bp->method, bp->location);
+    if (link != NULL) {
+        *link = bp->next;
+    }
+    bp->next = NULL;
+    bp->set = JNI_FALSE;
+    if (--setCount == 0) {
+        breakpointsSet = JNI_FALSE;
+    }
+    if (clearJvmti &&
+        !isRequestedBreakpoint(bp->method, bp->location)) {
+        (void)JVMTI_FUNC_PTR(gdata->jvmti,ClearBreakpoint)
+                    (gdata->jvmti, bp->method, bp->location);
+    }
+}
+
+static jboolean
+lineReached(CoverageBreakpoint *bp)
+{
+    return (bp->owner->bitmap[bp->line / 8] & (1 << (bp->line % 8))) != 0;
+}
+
+/*
+ * Sets the breakpoints of a class which are needed before any more of
+ * its code runs: those of the lines not reached yet, or if lazy the
+ * first of each method which still has such lines.
+ */
+static void
+armClass(ClassCoverage *cls)
+{
+    jint i;
+    jint j;
+
+    for (i = 0; i < cls->breakpointCount; i++) {
+        CoverageBreakpoint *bp = &cls->breakpoints[i];
+
+        if (!cls->lazy) {
+            if (!lineReached(bp)) {
+                setCoverageBreakpoint(bp);
+            }
+            continue;
+        }
+        for (j = 0; j <= bp->following; j++) {
+            if (!lineReached(bp + j)) {
+                setCoverageBreakpoint(bp);
+                break;
+            }
+        }
+        i += bp->following;
+    }
+}
+
+static void
+disarmClass(ClassCoverage *cls, jboolean clearJvmti)
+{
+    jint i;
+
+    for (i = 0; i < cls->breakpointCount; i++) {
+        clearCoverageBreakpoint(&cls->breakpoints[i], clearJvmti);
+    }
+}
+
+/*
+ * clearJvmti must be false if the class has been unloaded, see
+ * clearCoverageBreakpoint.
+ */
+static void
+freeClass(ClassCoverage *cls, jboolean clearJvmti)
+{
+    disarmClass(cls, clearJvmti);
+    jvmtiDeallocate(cls->lines);
+    jvmtiDeallocate(cls->bitmap);
+    jvmtiDeallocate(cls->breakpoints);
+    jvmtiDeallocate(cls);
+}
+
+static ClassCoverage *
+findClass(JNIEnv *env, jclass clazz)
+{
+    ClassCoverage *cls;
+    jlong tag;
+
+    tag = classTrack_getTag(clazz);
+    if (tag == 0) {
+        return NULL;
+    }
+    for (cls = classes; cls != NULL; cls = cls->next) {
+        if (cls->tag == tag) {
+            return cls;
+        }
+    }
+    return NULL;
+}
+
+static jint
+classCount(void)
+{
+    ClassCoverage *cls;
+    jint count = 0;
+
+    for (cls = classes; cls != NULL; cls = cls->next) {
+        count++;
+    }
+    return count;
+}
+
+static int
+compareTags(const void *a, const void *b)
+{
+    jlong tagA = (*(ClassCoverage * const *)a)->tag;
+    jlong tagB = (*(ClassCoverage * const *)b)->tag;
+
+    return (tagA < tagB) ? -1 : ((tagA > tagB) ? 1 : 0);
+}
+
+/*
+ * Finds out which recorded classes are still loaded. Those get a local
+ * ref in clazz, for which the caller makes room with WITH_LOCAL_REFS
+ * and which it gives up with forgetClasses. The records of the others
+ * are freed: their breakpoints went away with the class, and their
+ * jmethodIDs must not be used any more. Nothing changes if it cannot
+ * be found out.
+ */
+static jvmtiError
+lookupClasses(JNIEnv *env)
+{
+    ClassCoverage **sorted;
+    ClassCoverage **link;
+    ClassCoverage *cls;
+    jlong *tags;
+    jclass *loaded = NULL;
+    jint loadedCount = 0;
+    jint count;
+    jint i;
+    jvmtiError error = JVMTI_ERROR_NONE;
+
+    count = classCount();
+    if (count == 0) {
+        return JVMTI_ERROR_NONE;
+    }
+    sorted = jvmtiAllocate(count * (jint)sizeof(ClassCoverage *));
+    tags = jvmtiAllocate(count * (jint)sizeof(jlong));
+    if (sorted == NULL || tags == NULL) {
+        error = AGENT_ERROR_OUT_OF_MEMORY;
+        goto done;
+    }
+    i = 0;
+    for (cls = classes; cls != NULL; cls = cls->next) {
+        cls->clazz = NULL;
+        sorted[i++] = cls;
+    }
+    qsort(sorted, count, sizeof(ClassCoverage *), compareTags);
+    for (i = 0; i < count; i++) {
+        tags[i] = sorted[i]->tag;
+    }
+    error = classTrack_classesForTags(count, tags, &loadedCount, &loaded);
+    if (error != JVMTI_ERROR_NONE) {
+        goto done;
+    }
+    for (i = 0; i < loadedCount; i++) {
+        ClassCoverage key;
+        ClassCoverage *keyPtr = &key;
+        ClassCoverage **found;
+
+        key.tag = classTrack_getTag(loaded[i]);
+        found = bsearch(&keyPtr, sorted, count, sizeof(ClassCoverage *),
+                        compareTags);
+        if (found != NULL && (*found)->clazz == NULL) {
+            (*found)->clazz = loaded[i];
+        } else {
+            JNI_FUNC_PTR(env,DeleteLocalRef)(env, loaded[i]);
+        }
+    }
+    link = &classes;
+    while (*link != NULL) {
+        cls = *link;
+        if (cls->clazz == NULL) {
+            *link = cls->next;
+            freeClass(cls, JNI_FALSE);
+        } else {
+            link = &cls->next;
+        }
+    }
+
+done:
+    jvmtiDeallocate(loaded);
+    jvmtiDeallocate(tags);
+    jvmtiDeallocate(sorted);
+    return error;
+}
+
+/* The local refs themselves go with the caller's frame */
+static void
+forgetClasses(void)
+{
+    ClassCoverage *cls;
+
+    for (cls = classes; cls != NULL; cls = cls->next) {
+        cls->clazz = NULL;
+    }
+}
+
+static int
+compareLines(const void *a, const void *b)
+{
+    jint lineA = *(const jint *)a;
+    jint lineB = *(const jint *)b;
+
+    return (lineA < lineB) ? -1 : ((lineA > lineB) ? 1 : 0);
+}
+
+static jint
+lineIndex(ClassCoverage *cls, jint line)
+{
+    jint low = 0;
+    jint high = cls->lineCount - 1;
+
+    while (low < high) {
+        jint mid = (low + high) / 2;
+        if (cls->lines[mid] < line) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/*
+ * Builds the coverage record of a class from the line tables of its
+ * methods and arms it. Classes without line numbers are skipped.
+ */
+static void
+addClass(JNIEnv *env, jclass clazz)
+{
+    jint methodCount = 0;
+    jmethodID *methods = NULL;
+    jvmtiLineNumberEntry **tables = NULL;
+    jint *entryCounts = NULL;
+    jint total = 0;
+    ClassCoverage *cls = NULL;
+    jvmtiError error;
+    jint i;
+    jint j;
+
+    cls = findClass(env, clazz);
+    if (cls != NULL) {
+        /* Recorded by an earlier start; the stop disarmed it */
+        if (!cls->redefined) {
+            cls->lazy = lazyBreakpoints;
+            armClass(cls);
+        }
+        return;
+    }
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetClassMethods)
+                (gdata->jvmti, clazz, &methodCount, &methods);
+    if (error != JVMTI_ERROR_NONE || methodCount == 0) {
+        jvmtiDeallocate(methods);
+        return;
+    }
+    tables = jvmtiAllocate(methodCount * (jint)sizeof(jvmtiLineNumberEntry *));
+    entryCounts = jvmtiAllocate(methodCount * (jint)sizeof(jint));
+    if (tables == NULL || entryCounts == NULL) {
+        goto done;
+    }
+    for (i = 0; i < methodCount; i++) {
+        tables[i] = NULL;
+        entryCounts[i] = 0;
+        /* Native and abstract methods have no line table */
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLineNumberTable)
+                    (gdata->jvmti, methods[i], &entryCounts[i], &tables[i]);
+        if (error != JVMTI_ERROR_NONE) {
+            tables[i] = NULL;
+            entryCounts[i] = 0;
+        }
+        total += entryCounts[i];
+    }
+    if (total == 0) {
+        goto done;
+    }
+
+    cls = jvmtiAllocate((jint)sizeof(ClassCoverage));
+    if (cls == NULL) {
+        goto done;
+    }
+    (void)memset(cls, 0, sizeof(ClassCoverage));
+    cls->lines = jvmtiAllocate(total * (jint)sizeof(jint));
+    cls->breakpoints = jvmtiAllocate(total * (jint)sizeof(CoverageBreakpoint));
+    if (cls->lines == NULL || cls->breakpoints == NULL) {
+        goto fail;
+    }
+
+    for (i = 0; i < methodCount; i++) {
+        for (j = 0; j < entryCounts[i]; j++) {
+            cls->lines[cls->lineCount++] = tables[i][j].line_number;
+        }
+    }
+    qsort(cls->lines, cls->lineCount, sizeof(jint), compareLines);
+    for (i = 1, j = 1; i < cls->lineCount; i++) {
+        if (cls->lines[i] != cls->lines[j - 1]) {
+            cls->lines[j++] = cls->lines[i];
+        }
+    }
+    cls->lineCount = j;
+    cls->bitmap = jvmtiAllocate((cls->lineCount + 7) / 8);
+    if (cls->bitmap == NULL) {
+        goto fail;
+    }
+    (void)memset(cls->bitmap, 0, (cls->lineCount + 7) / 8);
+
+    for (i = 0; i < methodCount; i++) {
+        CoverageBreakpoint *first = &cls->breakpoints[cls->breakpointCount];
+        jint start = 0;
+
+        if (entryCounts[i] == 0) {
+            continue;
+        }
+        /* The entry with the lowest location goes first; it is the
+         * one reached when the method is entered.
+         */
+        for (j = 1; j < entryCounts[i]; j++) {
+            if (tables[i][j].start_location < tables[i][start].start_location) {
+                start = j;
+            }
+        }
+        for (j = 0; j < entryCounts[i]; j++) {
+            jint k = (j == 0) ? start : ((j <= start) ? j - 1 : j);
+            CoverageBreakpoint *bp = &cls->breakpoints[cls->breakpointCount++];
+
+            (void)memset(bp, 0, sizeof(CoverageBreakpoint));
+            bp->owner = cls;
+            bp->method = methods[i];
+            bp->location = tables[i][k].start_location;
+            bp->line = lineIndex(cls, tables[i][k].line_number);
+        }
+        first->following = entryCounts[i] - 1;
+    }
+
+    /* Every prepared class is tracked, but be safe */
+    cls->tag = classTrack_getTag(clazz);
+    if (cls->tag == 0) {
+        goto fail;
+    }
+    cls->lazy = lazyBreakpoints;
+    cls->next = classes;
+    classes = cls;
+    armClass(cls);
+    goto done;
+
+fail:
+    jvmtiDeallocate(cls->lines);
+    jvmtiDeallocate(cls->bitmap);
+    jvmtiDeallocate(cls->breakpoints);
+    jvmtiDeallocate(cls);
+
+done:
+    if (tables != NULL) {
+        for (i = 0; i < methodCount; i++) {
+            jvmtiDeallocate(tables[i]);
+        }
+    }
+    jvmtiDeallocate(tables);
+    jvmtiDeallocate(entryCounts);
+    jvmtiDeallocate(methods);
+}
+
+static jboolean
+classMatches(jclass clazz)
+{
+    char *classname = getClassname(clazz);
+    jboolean matches = JNI_FALSE;
+    jint i;
+
+    for (i = 0; classname != NULL && i < classPatternCount; i++) {
+        if (eventFilter_classNameMatches(classname, classPatterns[i])) {
+            matches = JNI_TRUE;
+            break;
+        }
+    }
+    jvmtiDeallocate(classname);
+    return matches;
+}
+
+static void
+handleClassPrepare(JNIEnv *env, EventInfo *evinfo,
+                   HandlerNode *node, struct bag *eventBag)
+{
+    /* Handlers run with the event handler lock held */
+    if (prepareHandler != NULL && classMatches(evinfo->clazz)) {
+        addClass(env, evinfo->clazz);
+    }
+}
+
+static void
+freePatterns(void)
+{
+    jint i;
+
+    for (i = 0; i < classPatternCount; i++) {
+        jvmtiDeallocate(classPatterns[i]);
+    }
+    jvmtiDeallocate(classPatterns);
+    classPatterns = NULL;
+    classPatternCount = 0;
+}
+
+/*
+ * Drops the records of unloaded classes. Must be done before the
+ * breakpoints of the recorded classes are cleared at the JVMTI level.
+ * Assumes the event handler lock is held.
+ */
+static void
+dropUnloadedClasses(JNIEnv *env)
+{
+    WITH_LOCAL_REFS(env, classCount() + 1) {
+        (void)lookupClasses(env);
+        forgetClasses();
+    } END_WITH_LOCAL_REFS(env);
+}
+
+/* Assumes the event handler lock is held */
+static void
+stopCoverage(void)
+{
+    ClassCoverage *cls;
+
+    if (prepareHandler == NULL) {
+        return;
+    }
+    (void)eventHandler_free(prepareHandler);
+    prepareHandler = NULL;
+    dropUnloadedClasses(getEnv());
+    for (cls = classes; cls != NULL; cls = cls->next) {
+        disarmClass(cls, JNI_TRUE);
+    }
+    (void)eventFilter_removeInternalEventUser(EI_BREAKPOINT);
+    freePatterns();
+}
+
+/* Assumes the event handler lock is held */
+static void
+freeClasses(JNIEnv *env)
+{
+    dropUnloadedClasses(env);
+    while (classes != NULL) {
+        ClassCoverage *cls = classes;
+        classes = cls->next;
+        freeClass(cls, JNI_TRUE);
+    }
+}
+
+void
+lineCoverage_initialize(void)
+{
+    classes = NULL;
+    buckets = NULL;
+    bucketCount = 0;
+    setCount = 0;
+    classPatterns = NULL;
+    classPatternCount = 0;
+    prepareHandler = NULL;
+    reachedBreakpoints = NULL;
+    clearPending = JNI_FALSE;
+    breakpointsSet = JNI_FALSE;
+}
+
+void
+lineCoverage_reset(void)
+{
+    JNIEnv *env = getEnv();
+
+    eventHandler_lock();
+    stopCoverage();
+    freeClasses(env);
+    clearPending = JNI_FALSE;
+    jvmtiDeallocate(buckets);
+    buckets = NULL;
+    bucketCount = 0;
+    eventHandler_unlock();
+}
+
+/*
+ * Takes ownership of the patterns, which must have been allocated
+ * with jvmtiAllocate. Coverage collected so far is kept; classes
+ * which already have a record only get breakpoints for the lines
+ * they have not reached yet.
+ */
+jvmtiError
+lineCoverage_start(JNIEnv *env, char **patterns, jint patternCount,
+                   jboolean lazy)
+{
+    jvmtiError error;
+
+    eventHandler_lock();
+    stopCoverage();
+    classPatterns = patterns;
+    classPatternCount = patternCount;
+    lazyBreakpoints = lazy;
+
+    error = eventFilter_addInternalEventUser(EI_BREAKPOINT);
+    if (error != JVMTI_ERROR_NONE) {
+        freePatterns();
+        eventHandler_unlock();
+        return error;
+    }
+    prepareHandler = eventHandler_createInternalThreadOnly(EI_CLASS_PREPARE,
+                                                           handleClassPrepare,
+                                                           NULL);
+    if (prepareHandler == NULL) {
+        (void)eventFilter_removeInternalEventUser(EI_BREAKPOINT);
+        freePatterns();
+        eventHandler_unlock();
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+
+    WITH_LOCAL_REFS(env, 1) {
+
+        jint classCount;
+        jclass *loaded;
+        jint i;
+
+        error = allLoadedClasses(&loaded, &classCount);
+        if (error == JVMTI_ERROR_NONE) {
+            for (i = 0; i < classCount; i++) {
+                jclass clazz = loaded[i];
+                jint status = classStatus(clazz);
+
+                if ((status & JVMTI_CLASS_STATUS_PREPARED) != 0 &&
+                    (status & JVMTI_CLASS_STATUS_ARRAY) == 0 &&
+                    classMatches(clazz)) {
+                    addClass(env, clazz);
+                }
+            }
+            jvmtiDeallocate(loaded);
+        }
+
+    } END_WITH_LOCAL_REFS(env)
+
+    if (error != JVMTI_ERROR_NONE) {
+        stopCoverage();
+    }
+    eventHandler_unlock();
+    return error;
+}
+
+/*
+ * Removes all coverage breakpoints which are still set. The bitmaps
+ * are kept until they are cleared or the debugger disconnects.
+ */
+void
+lineCoverage_stop(void)
+{
+    eventHandler_lock();
+    stopCoverage();
+    eventHandler_unlock();
+}
+
+/*
+ * Clearing starts over: while coverage is active all lines of the
+ * recorded classes become unreached again and get their breakpoints
+ * back, otherwise the records are dropped.
+ */
+void
+lineCoverage_writeBitmaps(JNIEnv *env, PacketOutputStream *out,
+                          jboolean clear)
+{
+    ClassCoverage *cls;
+    jvmtiError error;
+    jint i;
+
+    eventHandler_lock();
+    WITH_LOCAL_REFS(env, classCount() + 1) {
+        /* The coverage of unloaded classes is dropped here at the latest */
+        error = lookupClasses(env);
+        if (error != JVMTI_ERROR_NONE) {
+            outStream_setError(out, map2jdwpError(error));
+        } else {
+            (void)outStream_writeInt(out, classCount());
+            for (cls = classes; cls != NULL; cls = cls->next) {
+                jint bytes = (cls->lineCount + 7) / 8;
+
+                (void)outStream_writeByte(out, referenceTypeTag(cls->clazz));
+                (void)outStream_writeObjectRef(env, out, cls->clazz);
+                (void)outStream_writeInt(out, cls->lineCount);
+                for (i = 0; i < cls->lineCount; i++) {
+                    (void)outStream_writeInt(out, cls->lines[i]);
+                }
+                (void)outStream_writeByteArray(out, bytes, (jbyte *)cls->bitmap);
+            }
+        }
+        forgetClasses();
+    } END_WITH_LOCAL_REFS(env);
+
+    if (clear && error == JVMTI_ERROR_NONE) {
+        if (prepareHandler == NULL) {
+            freeClasses(env);
+        } else {
+            for (cls = classes; cls != NULL; cls = cls->next) {
+                (void)memset(cls->bitmap, 0, (cls->lineCount + 7) / 8);
+                if (!cls->redefined) {
+                    /* Back to the state before any code ran */
+                    disarmClass(cls, JNI_TRUE);
+                    armClass(cls);
+                }
+            }
+        }
+    }
+    eventHandler_unlock();
+}
+
+jboolean
+lineCoverage_onBreakpoint(jmethodID method, jlocation location)
+{
+    CoverageBreakpoint **link;
+    jboolean consumed = JNI_FALSE;
+    jboolean requestClear = JNI_FALSE;
+
+    if (!breakpointsSet) {
+        return JNI_FALSE;
+    }
+
+    eventHandler_lock();
+    link = findBreakpoint(method, location);
+    if (link != NULL) {
+        CoverageBreakpoint *bp = *link;
+        ClassCoverage *cls = bp->owner;
+        jint i;
+
+        consumed = !isRequestedBreakpoint(method, location);
+        if (!bp->reached) {
+            cls->bitmap[bp->line / 8] |= (unsigned char)(1 << (bp->line % 8));
+            queueReachedBreakpoint(bp);
+            if (!clearPending) {
+                clearPending = JNI_TRUE;
+                requestClear = JNI_TRUE;
+            }
+            if (cls->lazy) {
+                for (i = 1; i <= bp->following; i++) {
+                    if (!lineReached(bp + i)) {
+                        setCoverageBreakpoint(bp + i);
+                    }
+                }
+            }
+        }
+    }
+    eventHandler_unlock();
+
+    /* Queued outside of the lock, as the helper queue may be full */
+    if (requestClear) {
+        eventHelper_clearCoverageBreakpoints();
+    }
+    return consumed;
+}
+
+/*
+ * Called on the event helper thread to clear the breakpoints which
+ * have been reached since the last call.
+ */
+void
+lineCoverage_clearReachedBreakpoints(void)
+{
+    eventHandler_lock();
+    clearPending = JNI_FALSE;
+    while (reachedBreakpoints != NULL) {
+        clearCoverageBreakpoint(reachedBreakpoints, JNI_TRUE);
+    }
+    eventHandler_unlock();
+}
+
+jboolean
+lineCoverage_hasBreakpoint(jmethodID method, jlocation location)
+{
+    return findBreakpoint(method, location) != NULL;
+}
+
+/*
+ * Called after a garbage collection which unloaded classes.
+ */
+void
+lineCoverage_processUnloads(JNIEnv *env)
+{
+    eventHandler_lock();
+    if (classes != NULL) {
+        dropUnloadedClasses(env);
+    }
+    eventHandler_unlock();
+}
+
+/*
+ * Redefinition clears all breakpoints in the class at the JVMTI level
+ * and makes the recorded locations meaningless, so lines which were
+ * not reached by then stay unreached.
+ */
+void
+lineCoverage_onRedefineClass(JNIEnv *env, jclass clazz)
+{
+    ClassCoverage *cls;
+
+    eventHandler_lock();
+    cls = findClass(env, clazz);
+    if (cls != NULL) {
+        disarmClass(cls, JNI_FALSE);
+        cls->redefined = JNI_TRUE;
+    }
+    eventHandler_unlock();
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+#ifndef JDWP_LINECOVERAGE_H
+#define JDWP_LINECOVERAGE_H
+
+#include "outStream.h"
+
+/*
+ * Line coverage collection. While active, every line of the selected
+ * classes has a breakpoint which records that the line was reached and
+ * then is removed by the event helper thread.
+ */
+
+void lineCoverage_initialize(void);
+void lineCoverage_reset(void);
+
+jvmtiError lineCoverage_start(JNIEnv *env, char **patterns, jint patternCount,
+                              jboolean lazy);
+void lineCoverage_stop(void);
+void lineCoverage_writeBitmaps(JNIEnv *env, PacketOutputStream *out,
+                               jboolean clear);
+
+/* Returns JNI_TRUE if the breakpoint was set for coverage alone */
+jboolean lineCoverage_onBreakpoint(jmethodID method, jlocation location);
+void lineCoverage_clearReachedBreakpoints(void);
+
+/* Must be called with the event handler lock held */
+jboolean lineCoverage_hasBreakpoint(jmethodID method, jlocation location);
+
+void lineCoverage_onRedefineClass(JNIEnv *env, jclass clazz);
+void lineCoverage_processUnloads(JNIEnv *env);
+
+#endif
@@ -0,0 +1,652 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+/*
+ * ANDROID-CHANGED: Monitor contention profiling mode.
+ *
+ * Reporting every monitor event to the debugger (with its suspend
+ * policy) is far too expensive to leave enabled in production. In this
+ * mode the agent instead enables the JVMTI monitor events for itself
+ * (see eventFilter_addInternalEventUser) and aggregates the time each
+ * thread spends blocked, keyed by monitor class and call site.
+ *
+ * Each thread records into its own ProfileBuffer which it finds through
+ * a thread-local pointer, so the event callbacks never take a lock once
+ * a thread owns a buffer. A buffer is only written by its owning thread;
+ * the owner fills in a site and then publishes it by storing siteCount
+ * with release semantics, and the counters of a published site are
+ * atomics so the histogram command can read them while the owner keeps
+ * recording.
+ *
+ * Buffers live on a global list protected by profileLock, a lightweight
+ * lock. The callbacks run on application threads, which the debugger
+ * may suspend at any JNI or JVMTI call, so profileLock is only ever held
+ * for plain memory work: claiming a buffer (first contention seen on a
+ * thread), giving it back when the thread ends, and the histogram
+ * command copying the sites out. A buffer given back by a finished
+ * thread keeps its sites and is handed to the next thread that needs
+ * a buffer.
+ *
+ * Clearing is done by bumping a generation count. Sites in a buffer
+ * whose generation is stale are ignored by the histogram. The owner of
+ * a stale buffer swaps it for a fresh one, and stale buffers nobody
+ * owns are unlinked by the clear itself. Unlinked buffers wait on the
+ * retired list until the command loop thread frees them, together with
+ * the global refs of their sites. As only that thread frees buffers,
+ * the histogram command can use the refs of the sites it copied after
+ * dropping profileLock.
+ */
+
+#include <stdatomic.h>
+
+#include "util.h"
+#include "eventFilter.h"
+#include "eventHandler.h"
+#include "monitorProfile.h"
+
+#define SITES_PER_BUFFER 64
+
+/* Site kinds, as sent in the MonitorContentionHistogram reply */
+#define KIND_CONTENDED_ENTER 1
+#define KIND_WAIT            2
+
+/* Frames to skip looking for a non-native caller of Object.wait */
+#define MAX_NATIVE_WAIT_FRAMES 3
+
+typedef struct ContentionSite {
+    jbyte kind;
+    jclass monitorClass;        /* global ref */
+    jclass methodClass;         /* global ref, NULL if location unknown */
+    jmethodID method;
+    jlocation location;
+    _Atomic(jlong) count;
+    _Atomic(jlong) totalNanos;
+    _Atomic(jlong) maxNanos;
+} ContentionSite;
+
+/* A site as merged and written out by the histogram command */
+typedef struct SiteTotals {
+    jbyte kind;
+    jclass monitorClass;        /* borrowed from the site */
+    jclass methodClass;
+    jmethodID method;
+    jlocation location;
+    jlong count;
+    jlong totalNanos;
+    jlong maxNanos;
+} SiteTotals;
+
+typedef struct ProfileBuffer {
+    struct ProfileBuffer *next;
+    jboolean owned;             /* protected by profileLock */
+    jint generation;            /* fixed while the buffer is linked */
+    _Atomic(jint) siteCount;
+    _Atomic(jlong) dropped;
+    ContentionSite sites[SITES_PER_BUFFER];
+} ProfileBuffer;
+
+static LightLock profileLock;
+/* Protected by profileLock */
+static ProfileBuffer *buffers;
+static ProfileBuffer *retired;
+
+static _Atomic(jboolean) profileActive = ATOMIC_VAR_INIT(JNI_FALSE);
+static _Atomic(jboolean) profileWaits = ATOMIC_VAR_INIT(JNI_FALSE);
+static _Atomic(jint) generation = ATOMIC_VAR_INIT(1);
+
+/* Only ever touched by the thread itself */
+static _Thread_local ProfileBuffer *threadBuffer;
+static _Thread_local jlong enterStartNanos;
+static _Thread_local jlong waitStartNanos;
+
+/*
+ * Move a buffer from the list to the retired list.
+ * Must be called with profileLock held.
+ */
+static void
+retireBuffer(ProfileBuffer *buffer)
+{
+    ProfileBuffer **link;
+
+    for (link = &buffers; *link != NULL; link = &(*link)->next) {
+        if (*link == buffer) {
+            *link = buffer->next;
+            break;
+        }
+    }
+    buffer->next = retired;
+    retired = buffer;
+}
+
+/*
+ * Free buffers taken off the retired list. Only called on the command
+ * loop thread, see above.
+ */
+static void
+freeBuffers(JNIEnv *env, ProfileBuffer *list)
+{
+    while (list != NULL) {
+        ProfileBuffer *next = list->next;
+        jint count;
+        jint i;
+
+        count = atomic_load(&list->siteCount);
+        for (i = 0; i < count; i++) {
+            ContentionSite *site = &list->sites[i];
+            tossGlobalRef(env, &site->monitorClass);
+            if (site->methodClass != NULL) {
+                tossGlobalRef(env, &site->methodClass);
+            }
+        }
+        jvmtiDeallocate(list);
+        list = next;
+    }
+}
+
+/*
+ * Get a buffer of the current generation for this thread, retiring its
+ * stale one (if any). The fresh buffer is allocated up front so that
+ * nothing but plain memory work is done under profileLock.
+ */
+static ProfileBuffer *
+claimBuffer(ProfileBuffer *stale)
+{
+    ProfileBuffer *fresh;
+    ProfileBuffer *buffer;
+    jint current;
+
+    fresh = jvmtiAllocate(sizeof(ProfileBuffer));
+    if (fresh != NULL) {
+        (void)memset(fresh, 0, sizeof(ProfileBuffer));
+    }
+
+    lightLock_enter(&profileLock);
+    current = atomic_load(&generation);
+    if (stale != NULL) {
+        retireBuffer(stale);
+    }
+    /* Prefer a buffer given back by a finished thread */
+    for (buffer = buffers; buffer != NULL; buffer = buffer->next) {
+        if (!buffer->owned && buffer->generation == current) {
+            break;
+        }
+    }
+    if (buffer == NULL && fresh != NULL) {
+        buffer = fresh;
+        fresh = NULL;
+        buffer->generation = current;
+        buffer->next = buffers;
+        buffers = buffer;
+    }
+    if (buffer != NULL) {
+        buffer->owned = JNI_TRUE;
+    }
+    lightLock_exit(&profileLock);
+
+    if (fresh != NULL) {
+        jvmtiDeallocate(fresh);
+    }
+    return buffer;
+}
+
+static void
+getCallSite(jthread thread, jboolean skipNative,
+            jmethodID *pmethod, jlocation *plocation)
+{
+    jvmtiError error;
+    jint depth;
+
+    for (depth = 0; depth <= MAX_NATIVE_WAIT_FRAMES; depth++) {
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetFrameLocation)
+                (gdata->jvmti, thread, depth, pmethod, plocation);
+        if (error != JVMTI_ERROR_NONE) {
+            break;
+        }
+        if (!skipNative || !isMethodNative(*pmethod)) {
+            return;
+        }
+    }
+    *pmethod = NULL;
+    *plocation = -1;
+}
+
+static void
+record(JNIEnv *env, jthread thread, jobject object, jbyte kind, jlong nanos)
+{
+    ProfileBuffer *buffer;
+    ContentionSite *site;
+    jmethodID method;
+    jlocation location;
+    jclass clazz;
+    jint count;
+    jint i;
+
+    buffer = threadBuffer;
+    if (buffer == NULL || buffer->generation != atomic_load(&generation)) {
+        buffer = claimBuffer(buffer);
+        threadBuffer = buffer;
+        if (buffer == NULL) {
+            return;
+        }
+    }
+
+    getCallSite(thread, (kind == KIND_WAIT), &method, &location);
+
+    site = NULL;
+    WITH_LOCAL_REFS(env, 2) {
+        clazz = JNI_FUNC_PTR(env,GetObjectClass)(env, object);
+        count = atomic_load_explicit(&buffer->siteCount, memory_order_relaxed);
+        for (i = 0; i < count; i++) {
+            ContentionSite *candidate = &buffer->sites[i];
+            if (candidate->kind == kind &&
+                candidate->method == method &&
+                candidate->location == location &&
+                isSameObject(env, candidate->monitorClass, clazz)) {
+                site = candidate;
+                break;
+            }
+        }
+        if (site == NULL && count < SITES_PER_BUFFER) {
+            site = &buffer->sites[count];
+            (void)memset(site, 0, sizeof(ContentionSite));
+            site->kind = kind;
+            site->method = method;
+            site->location = location;
+            saveGlobalRef(env, clazz, &site->monitorClass);
+            if (method != NULL) {
+                jclass methodClass = getMethodClass(gdata->jvmti, method);
+                if (methodClass != NULL) {
+                    saveGlobalRef(env, methodClass, &site->methodClass);
+                }
+            }
+            /* Publish the new site to the histogram command */
+            atomic_store_explicit(&buffer->siteCount, count + 1,
+                                  memory_order_release);
+        }
+    } END_WITH_LOCAL_REFS(env);
+
+    if (site == NULL) {
+        atomic_fetch_add_explicit(&buffer->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    /* Only the owning thread writes the counters */
+    atomic_store_explicit(&site->count,
+        atomic_load_explicit(&site->count, memory_order_relaxed) + 1,
+        memory_order_relaxed);
+    atomic_store_explicit(&site->totalNanos,
+        atomic_load_explicit(&site->totalNanos, memory_order_relaxed) + nanos,
+        memory_order_relaxed);
+    if (nanos > atomic_load_explicit(&site->maxNanos, memory_order_relaxed)) {
+        atomic_store_explicit(&site->maxNanos, nanos, memory_order_relaxed);
+    }
+}
+
+jboolean
+monitorProfile_isActive(void)
+{
+    return atomic_load_explicit(&profileActive, memory_order_relaxed);
+}
+
+void
+monitorProfile_onContendedEnter(JNIEnv *env, jthread thread, jobject object)
+{
+    enterStartNanos = nanoTime();
+}
+
+void
+monitorProfile_onContendedEntered(JNIEnv *env, jthread thread, jobject object)
+{
+    jlong start;
+
+    start = enterStartNanos;
+    enterStartNanos = 0;
+    /* Profiling may have been started while this thread was blocked */
+    if (start != 0) {
+        record(env, thread, object, KIND_CONTENDED_ENTER, nanoTime() - start);
+    }
+}
+
+void
+monitorProfile_onWait(JNIEnv *env, jthread thread, jobject object)
+{
+    if (atomic_load_explicit(&profileWaits, memory_order_relaxed)) {
+        waitStartNanos = nanoTime();
+    }
+}
+
+void
+monitorProfile_onWaited(JNIEnv *env, jthread thread, jobject object)
+{
+    jlong start;
+
+    start = waitStartNanos;
+    waitStartNanos = 0;
+    if (start != 0) {
+        record(env, thread, object, KIND_WAIT, nanoTime() - start);
+    }
+}
+
+void
+monitorProfile_onThreadEnd(JNIEnv *env, jthread thread)
+{
+    ProfileBuffer *buffer;
+
+    buffer = threadBuffer;
+    if (buffer != NULL) {
+        threadBuffer = NULL;
+        lightLock_enter(&profileLock);
+        buffer->owned = JNI_FALSE;
+        if (buffer->generation != atomic_load(&generation)) {
+            retireBuffer(buffer);
+        }
+        lightLock_exit(&profileLock);
+    }
+}
+
+static EventIndex profileEvents[] = {
+    EI_MONITOR_CONTENDED_ENTER,
+    EI_MONITOR_CONTENDED_ENTERED,
+    EI_MONITOR_WAIT,
+    EI_MONITOR_WAITED
+};
+
+static int
+profileEventCount(jboolean includeWaits)
+{
+    return includeWaits ? 4 : 2;
+}
+
+/* Must be called with the event handler lock held. */
+static void
+stopProfile(void)
+{
+    int count;
+    int i;
+
+    if (!atomic_load(&profileActive)) {
+        return;
+    }
+    atomic_store(&profileActive, JNI_FALSE);
+    count = profileEventCount(atomic_load(&profileWaits));
+    for (i = 0; i < count; i++) {
+        (void)eventFilter_removeInternalEventUser(profileEvents[i]);
+    }
+    atomic_store(&profileWaits, JNI_FALSE);
+}
+
+jvmtiError
+monitorProfile_start(jboolean includeWaits)
+{
+    jvmtiError error;
+    int count;
+    int i;
+
+    error = JVMTI_ERROR_NONE;
+    eventHandler_lock(); /* for proper lock order */
+    {
+        stopProfile();
+        count = profileEventCount(includeWaits);
+        for (i = 0; i < count; i++) {
+            error = eventFilter_addInternalEventUser(profileEvents[i]);
+            if (error != JVMTI_ERROR_NONE) {
+                break;
+            }
+        }
+        if (error == JVMTI_ERROR_NONE) {
+            atomic_store(&profileWaits, includeWaits);
+            atomic_store(&profileActive, JNI_TRUE);
+        } else {
+            while (--i >= 0) {
+                (void)eventFilter_removeInternalEventUser(profileEvents[i]);
+            }
+        }
+    }
+    eventHandler_unlock();
+    return error;
+}
+
+void
+monitorProfile_stop(void)
+{
+    eventHandler_lock();
+    {
+        stopProfile();
+    }
+    eventHandler_unlock();
+}
+
+/*
+ * Start a new generation: retire the buffers nobody owns, owned buffers
+ * are swapped by their owner. Returns the retired list for the caller
+ * to free once it no longer uses the refs of the sites. Must be called
+ * with profileLock held.
+ */
+static ProfileBuffer *
+clearLocked(void)
+{
+    ProfileBuffer *buffer;
+    ProfileBuffer *next;
+    ProfileBuffer *detached;
+
+    atomic_fetch_add(&generation, 1);
+    for (buffer = buffers; buffer != NULL; buffer = next) {
+        next = buffer->next;
+        if (!buffer->owned) {
+            retireBuffer(buffer);
+        }
+    }
+    detached = retired;
+    retired = NULL;
+    return detached;
+}
+
+static int
+compareSites(const void *p1, const void *p2)
+{
+    const SiteTotals *s1 = *(SiteTotals * const *)p1;
+    const SiteTotals *s2 = *(SiteTotals * const *)p2;
+
+    return (s1->totalNanos < s2->totalNanos) ? 1 :
+               ((s1->totalNanos > s2->totalNanos) ? -1 : 0);
+}
+
+/*
+ * Copy the published sites of the current generation into copies, at
+ * most max of them. Must be called with profileLock held.
+ */
+static jint
+copySites(SiteTotals *copies, jint max, jlong *pdropped)
+{
+    ProfileBuffer *buffer;
+    jint current;
+    jint count;
+    jint i;
+
+    current = atomic_load(&generation);
+    count = 0;
+    for (buffer = buffers; buffer != NULL; buffer = buffer->next) {
+        jint siteCount;
+
+        if (buffer->generation != current) {
+            continue;
+        }
+        *pdropped += atomic_load_explicit(&buffer->dropped, memory_order_relaxed);
+        siteCount = atomic_load_explicit(&buffer->siteCount, memory_order_acquire);
+        for (i = 0; i < siteCount; i++) {
+            ContentionSite *site = &buffer->sites[i];
+            SiteTotals *copy;
+
+            if (count == max) {
+                /* Published after the sizing pass */
+                (*pdropped)++;
+                continue;
+            }
+            copy = &copies[count++];
+            copy->kind = site->kind;
+            copy->monitorClass = site->monitorClass;
+            copy->methodClass = site->methodClass;
+            copy->method = site->method;
+            copy->location = site->location;
+            copy->count = atomic_load_explicit(&site->count, memory_order_relaxed);
+            copy->totalNanos = atomic_load_explicit(&site->totalNanos, memory_order_relaxed);
+            copy->maxNanos = atomic_load_explicit(&site->maxNanos, memory_order_relaxed);
+        }
+    }
+    return count;
+}
+
+void
+monitorProfile_writeHistogram(JNIEnv *env, PacketOutputStream *out,
+                              jint maxSites, jboolean clear)
+{
+    ProfileBuffer *buffer;
+    ProfileBuffer *detached;
+    SiteTotals *copies;
+    SiteTotals **ranked;
+    jint current;
+    jint total;
+    jint copied;
+    jint count;
+    jlong dropped;
+    jint i;
+    jint j;
+
+    lightLock_enter(&profileLock);
+    current = atomic_load(&generation);
+    total = 0;
+    for (buffer = buffers; buffer != NULL; buffer = buffer->next) {
+        if (buffer->generation == current) {
+            total += atomic_load_explicit(&buffer->siteCount, memory_order_acquire);
+        }
+    }
+    lightLock_exit(&profileLock);
+
+    copies = NULL;
+    ranked = NULL;
+    if (total > 0) {
+        copies = jvmtiAllocate(total * (jint)sizeof(SiteTotals));
+        ranked = jvmtiAllocate(total * (jint)sizeof(SiteTotals *));
+        if (copies == NULL || ranked == NULL) {
+            outStream_setError(out, JDWP_ERROR(OUT_OF_MEMORY));
+            jvmtiDeallocate(copies);
+            jvmtiDeallocate(ranked);
+            return;
+        }
+    }
+
+    dropped = 0;
+    lightLock_enter(&profileLock);
+    {
+        copied = copySites(copies, total, &dropped);
+        detached = NULL;
+        if (clear) {
+            detached = clearLocked();
+        }
+    }
+    lightLock_exit(&profileLock);
+
+    /*
+     * The same site is usually present in the buffers of several
+     * threads; fold them into one entry per (kind, class, location).
+     */
+    count = 0;
+    for (i = 0; i < copied; i++) {
+        SiteTotals *site = &copies[i];
+        SiteTotals *entry = NULL;
+
+        for (j = 0; j < count; j++) {
+            if (ranked[j]->kind == site->kind &&
+                ranked[j]->method == site->method &&
+                ranked[j]->location == site->location &&
+                isSameObject(env, ranked[j]->monitorClass, site->monitorClass)) {
+                entry = ranked[j];
+                break;
+            }
+        }
+        if (entry == NULL) {
+            ranked[count++] = site;
+            continue;
+        }
+        entry->count += site->count;
+        entry->totalNanos += site->totalNanos;
+        if (site->maxNanos > entry->maxNanos) {
+            entry->maxNanos = site->maxNanos;
+        }
+    }
+
+    if (count > 1) {
+        qsort(ranked, count, sizeof(SiteTotals *), compareSites);
+    }
+    if (maxSites >= 0 && maxSites < count) {
+        count = maxSites;
+    }
+
+    (void)outStream_writeLong(out, dropped);
+    (void)outStream_writeInt(out, count);
+    for (i = 0; i < count; i++) {
+        SiteTotals *entry = ranked[i];
+
+        (void)outStream_writeByte(out, entry->kind);
+        (void)outStream_writeByte(out, referenceTypeTag(entry->monitorClass));
+        (void)outStream_writeObjectRef(env, out, entry->monitorClass);
+        writeCodeLocation(out, entry->methodClass, entry->method, entry->location);
+        (void)outStream_writeLong(out, entry->count);
+        (void)outStream_writeLong(out, entry->totalNanos);
+        (void)outStream_writeLong(out, entry->maxNanos);
+    }
+
+    /* Only now are the borrowed refs no longer needed */
+    freeBuffers(env, detached);
+    if (copies != NULL) {
+        jvmtiDeallocate(copies);
+    }
+    if (ranked != NULL) {
+        jvmtiDeallocate(ranked);
+    }
+}
+
+void
+monitorProfile_initialize(void)
+{
+    lightLock_init(&profileLock, "JDWP Monitor Profile Lock");
+    buffers = NULL;
+    retired = NULL;
+}
+
+void
+monitorProfile_reset(void)
+{
+    ProfileBuffer *detached;
+
+    monitorProfile_stop();
+
+    lightLock_enter(&profileLock);
+    {
+        detached = clearLocked();
+    }
+    lightLock_exit(&profileLock);
+    freeBuffers(getEnv(), detached);
+}
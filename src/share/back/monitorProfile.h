@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+#ifndef JDWP_MONITORPROFILE_H
+#define JDWP_MONITORPROFILE_H
+
+#include "outStream.h"
+
+/*
+ * Monitor contention profiling. While active, contended monitor entry
+ * (and optionally Object.wait) durations are aggregated per
+ * (monitor class, call site) in per-thread buffers instead of being
+ * reported as JDWP events.
+ */
+
+void monitorProfile_initialize(void);
+void monitorProfile_reset(void);
+
+jboolean monitorProfile_isActive(void);
+void monitorProfile_onContendedEnter(JNIEnv *env, jthread thread, jobject object);
+void monitorProfile_onContendedEntered(JNIEnv *env, jthread thread, jobject object);
+void monitorProfile_onWait(JNIEnv *env, jthread thread, jobject object);
+void monitorProfile_onWaited(JNIEnv *env, jthread thread, jobject object);
+void monitorProfile_onThreadEnd(JNIEnv *env, jthread thread);
+
+jvmtiError monitorProfile_start(jboolean includeWaits);
+void monitorProfile_stop(void);
+void monitorProfile_writeHistogram(JNIEnv *env, PacketOutputStream *out,
+                                   jint maxSites, jboolean clear);
+
+#endif
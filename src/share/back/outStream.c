@@ -294,6 +294,16 @@ outStream_writeByteArray(PacketOutputStream*stream, jint length,
     return writeBytes(stream, bytes, length);
 }
 
+/*
+ * ANDROID-CHANGED: Writes bytes as they are, without a length. Used
+ * to send data previously encoded with outStream_copyData().
+ */
+jdwpError
+outStream_writeBytes(PacketOutputStream *stream, jint length, jbyte *bytes)
+{
+    return writeBytes(stream, bytes, length);
+}
+
 jdwpError
 outStream_writeString(PacketOutputStream *stream, char *string)
 {
@@ -401,13 +411,48 @@ outStream_setError(PacketOutputStream *stream, jdwpError error)
     }
 }
 
+/*
+ * ANDROID-CHANGED: Return a copy of the data written so far as one
+ * contiguous array, allocated with jvmtiAllocate. Lets the stream be used
+ * to encode data that is not sent as is (see ReferenceTypeImpl.c).
+ */
+jbyte *
+outStream_copyData(PacketOutputStream *stream, jint *length)
+{
+    jint len;
+    PacketData *segment;
+    jbyte *data, *posP;
+
+    len = 0;
+    segment = (PacketData *)&(stream->firstSegment);
+    do {
+        len += segment->length;
+        segment = segment->next;
+    } while (segment != NULL);
+
+    /* Never ask for 0 bytes, which may return NULL */
+    data = jvmtiAllocate(len + 1);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    posP = data;
+    segment = (PacketData *)&(stream->firstSegment);
+    while (segment != NULL) {
+        (void)memcpy(posP, segment->data, segment->length);
+        posP += segment->length;
+        segment = segment->next;
+    }
+    *length = len;
+    return data;
+}
+
 static jint
 outStream_send(PacketOutputStream *stream) {
 
     jint rc;
     jint len = 0;
-    PacketData *segment;
-    jbyte *data, *posP;
+    jbyte *data;
 
     /*
      * If there's only 1 segment then we just send the
@@ -423,26 +468,11 @@ outStream_send(PacketOutputStream *stream) {
     /*
      * Multiple segments
      */
-    len = 0;
-    segment = (PacketData *)&(stream->firstSegment);
-    do {
-        len += segment->length;
-        segment = segment->next;
-    } while (segment != NULL);
-
-    data = jvmtiAllocate(len);
+    data = outStream_copyData(stream, &len);
     if (data == NULL) {
         return JDWP_ERROR(OUT_OF_MEMORY);
     }
 
-    posP = data;
-    segment = (PacketData *)&(stream->firstSegment);
-    while (segment != NULL) {
-        (void)memcpy(posP, segment->data, segment->length);
-        posP += segment->length;
-        segment = segment->next;
-    }
-
     stream->packet.type.cmd.len = 11 + len;
     stream->packet.type.cmd.data = data;
     rc = transport_sendPacket(&stream->packet);
@@ -469,6 +499,33 @@ outStream_sendReply(PacketOutputStream *stream)
     }
 }
 
+/*
+ * ANDROID-CHANGED: Fill in packet as outStream_sendReply() would send it,
+ * with the data flattened into a jvmtiAllocate'd copy owned by the caller,
+ * so that the reply can be transmitted after the stream is destroyed.
+ * The stream is marked sent, so destroying it keeps the object IDs.
+ */
+jdwpError
+outStream_prepareReply(PacketOutputStream *stream, jdwpPacket *packet)
+{
+    jint len = 0;
+    jbyte *data;
+
+    if (stream->error) {
+        stream->packet.type.reply.len = 0;
+        stream->packet.type.reply.errorCode = (jshort)stream->error;
+    }
+    data = outStream_copyData(stream, &len);
+    if (data == NULL) {
+        return JDWP_ERROR(OUT_OF_MEMORY);
+    }
+    *packet = stream->packet;
+    packet->type.cmd.len = 11 + len;
+    packet->type.cmd.data = data;
+    stream->sent = JNI_TRUE;
+    return JDWP_ERROR(NONE);
+}
+
 void
 outStream_sendCommand(PacketOutputStream *stream)
 {
@@ -490,6 +547,42 @@ releaseID(void *elementPtr, void *arg)
     return JNI_TRUE;
 }
 
+static jboolean
+copyID(void *elementPtr, void *arg)
+{
+    jlong **cursor = arg;
+    *(*cursor)++ = *(jlong *)elementPtr;
+    return JNI_TRUE;
+}
+
+/*
+ * ANDROID-CHANGED: Takes over the object IDs written to a stream
+ * whose data is kept rather than sent (see outStream_copyData), so
+ * that outStream_destroy() does not release them. The caller must
+ * eventually release them with commonRef_release() or send them.
+ * Returns JNI_FALSE, leaving them with the stream, if out of memory.
+ */
+jboolean
+outStream_takeIDs(PacketOutputStream *stream, jlong **ids, jint *count)
+{
+    jlong *cursor;
+
+    *count = bagSize(stream->ids);
+    *ids = NULL;
+    if (*count == 0) {
+        return JNI_TRUE;
+    }
+    *ids = jvmtiAllocate(*count * (jint)sizeof(jlong));
+    if (*ids == NULL) {
+        *count = 0;
+        return JNI_FALSE;
+    }
+    cursor = *ids;
+    (void)bagEnumerateOver(stream->ids, copyID, &cursor);
+    bagDeleteAll(stream->ids);
+    return JNI_TRUE;
+}
+
 void
 outStream_destroy(PacketOutputStream *stream)
 {
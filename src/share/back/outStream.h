@@ -84,7 +84,16 @@ void outStream_setError(PacketOutputStream *stream, jdwpError error);
 
 void outStream_sendReply(PacketOutputStream *stream);
 void outStream_sendCommand(PacketOutputStream *stream);
+/* ANDROID-CHANGED: Encoded reply, for sending after the stream is gone */
+jdwpError outStream_prepareReply(PacketOutputStream *stream, jdwpPacket *packet);
 
 void outStream_destroy(PacketOutputStream *stream);
 
+/* ANDROID-CHANGED: Flattened copy of the data written to the stream */
+jbyte *outStream_copyData(PacketOutputStream *stream, jint *length);
+/* ANDROID-CHANGED: Data previously taken with outStream_copyData */
+jdwpError outStream_writeBytes(PacketOutputStream *stream, jint length, jbyte *bytes);
+/* ANDROID-CHANGED: Ownership of the object IDs written to the stream */
+jboolean outStream_takeIDs(PacketOutputStream *stream, jlong **ids, jint *count);
+
 #endif
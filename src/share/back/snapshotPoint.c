@@ -0,0 +1,648 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+/*
+ * ANDROID-CHANGED: Snapshot points.
+ *
+ * A breakpoint request with the Snapshot modifier does not report
+ * events. Instead, the thread hitting it records the locations of its
+ * top frames and the values of the local variables visible in them,
+ * serialized right away in the JDWP format of a Vendor.SnapshotDrain
+ * snapshot, and continues. Snapshots are kept in a ring buffer of the
+ * request, the oldest being dropped when it is full, until the
+ * debugger drains them.
+ *
+ * The thread is only held up for reading its stack and locals. The
+ * variable table of the breakpoint's method is looked up once per
+ * request; deeper frames need a lookup per snapshot, so the size
+ * budget is checked before their locals are read. Object IDs written
+ * into a snapshot are held (see commonRef) until the snapshot is
+ * drained, and released if it is dropped.
+ *
+ * Rings belong to the Snapshot filter of their request and, like the
+ * handler chains, are protected by the event handler lock. The
+ * capture itself runs without it: the handler only queues a capture
+ * for the event, which event_callback runs once it has let go of the
+ * lock, see snapshotPoint_capturePending. The snapshot is then added
+ * to the ring under the lock again. A ring whose request goes away
+ * while captures for it are running is freed by the last of them.
+ */
+
+#include "util.h"
+#include "eventHandler.h"
+#include "eventHandlerRestricted.h"
+#include "commonRef.h"
+#include "snapshotPoint.h"
+
+/* Upper bounds of the encoded sizes used for the size budget */
+#define HEADER_SIZE     20      /* thread ID, timestamp, frame count */
+#define FRAME_SIZE      29      /* location and local count */
+#define LOCAL_SIZE      13      /* slot and largest tagged value */
+
+typedef struct Snapshot {
+    jbyte *data;
+    jint length;
+    jlong *ids;                 /* object IDs in data */
+    jint idCount;
+} Snapshot;
+
+typedef struct FrameTable {
+    jvmtiLocalVariableEntry *table;
+    jint count;
+    jint visible;               /* entries visible at the frame location */
+    jboolean owned;             /* not the cached table */
+} FrameTable;
+
+struct SnapshotRing {
+    jint frames;
+    jint maxBytes;
+    jint capacity;
+    jint first;                 /* slot of the oldest snapshot */
+    jint count;
+    jlong dropped;
+    Snapshot *slots;
+    jboolean tableLoaded;
+    jmethodID tableMethod;
+    jint tableCount;
+    jvmtiLocalVariableEntry *table;
+    jint users;                 /* captures not added yet */
+    jboolean detached;          /* request gone, freed by the last user */
+};
+
+/*
+ * A capture queued by snapshotPoint_handleEvent. The ring settings are
+ * copied when it starts, as the capture does not hold the lock.
+ */
+typedef struct Capture {
+    struct Capture *next;
+    EventInfo *evinfo;          /* identifies the event being handled */
+    struct SnapshotRing *ring;
+    jboolean detached;          /* request already gone */
+    jint frames;
+    jint maxBytes;
+    jboolean tableLoaded;
+    jboolean tableFound;        /* table looked up here, for the ring */
+    jmethodID tableMethod;
+    jint tableCount;
+    jvmtiLocalVariableEntry *table;
+} Capture;
+
+typedef struct RequestLookup {
+    HandlerID requestID;
+    HandlerNode *node;
+} RequestLookup;
+
+/* Protected by the event handler lock */
+static Capture *pendingCaptures;
+/* Read without the lock, to skip events without a capture */
+static volatile jint pendingCount = 0;
+
+static void
+freeVariableTable(jvmtiLocalVariableEntry *table, jint count)
+{
+    jint i;
+
+    if (table == NULL) {
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        jvmtiDeallocate(table[i].name);
+        jvmtiDeallocate(table[i].signature);
+        jvmtiDeallocate(table[i].generic_signature);
+    }
+    jvmtiDeallocate(table);
+}
+
+static jboolean
+isVisible(jvmtiLocalVariableEntry *entry, jlocation location)
+{
+    return location >= entry->start_location &&
+           location < entry->start_location + entry->length;
+}
+
+static void
+releaseSnapshot(JNIEnv *env, Snapshot *snapshot)
+{
+    jint i;
+
+    for (i = 0; i < snapshot->idCount; i++) {
+        commonRef_release(env, snapshot->ids[i]);
+    }
+    jvmtiDeallocate(snapshot->ids);
+    jvmtiDeallocate(snapshot->data);
+}
+
+jvmtiError
+snapshotPoint_createRing(struct SnapshotRing **pring, jint frames,
+                         jint maxBytes, jint capacity)
+{
+    struct SnapshotRing *ring;
+
+    *pring = NULL;
+    if (frames <= 0 || maxBytes <= 0 || capacity <= 0) {
+        return AGENT_ERROR_ILLEGAL_ARGUMENT;
+    }
+    ring = jvmtiAllocate((jint)sizeof(struct SnapshotRing));
+    if (ring == NULL) {
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    (void)memset(ring, 0, sizeof(struct SnapshotRing));
+    ring->slots = jvmtiAllocate(capacity * (jint)sizeof(Snapshot));
+    if (ring->slots == NULL) {
+        jvmtiDeallocate(ring);
+        return AGENT_ERROR_OUT_OF_MEMORY;
+    }
+    ring->frames = frames;
+    ring->maxBytes = maxBytes;
+    ring->capacity = capacity;
+    *pring = ring;
+    return JVMTI_ERROR_NONE;
+}
+
+static void
+destroyRing(JNIEnv *env, struct SnapshotRing *ring)
+{
+    jint i;
+
+    for (i = 0; i < ring->count; i++) {
+        releaseSnapshot(env, &ring->slots[(ring->first + i) % ring->capacity]);
+    }
+    freeVariableTable(ring->table, ring->tableCount);
+    jvmtiDeallocate(ring->slots);
+    jvmtiDeallocate(ring);
+}
+
+/* Assumes the event handler lock is held */
+void
+snapshotPoint_freeRing(JNIEnv *env, struct SnapshotRing *ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+    if (ring->users > 0) {
+        ring->detached = JNI_TRUE;
+        return;
+    }
+    destroyRing(env, ring);
+}
+
+/*
+ * Looks up the variable table of a frame. The one of the top frame is
+ * always in the breakpoint's method and is cached in the ring.
+ */
+static void
+getFrameTable(Capture *capture, jint depth,
+              jvmtiFrameInfo *frame, FrameTable *ft)
+{
+    jvmtiError error;
+    jint i;
+
+    (void)memset(ft, 0, sizeof(FrameTable));
+    if (frame->location < 0) {
+        return;
+    }
+    if (depth == 0 && capture->tableLoaded &&
+        capture->tableMethod == frame->method) {
+        ft->table = capture->table;
+        ft->count = capture->tableCount;
+    } else {
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalVariableTable)
+                    (gdata->jvmti, frame->method, &ft->count, &ft->table);
+        if (error != JVMTI_ERROR_NONE) {
+            ft->table = NULL;
+            ft->count = 0;
+        }
+        if (depth == 0 && !capture->tableLoaded) {
+            capture->tableLoaded = JNI_TRUE;
+            capture->tableFound = JNI_TRUE;
+            capture->tableMethod = frame->method;
+            capture->table = ft->table;
+            capture->tableCount = ft->count;
+        } else {
+            ft->owned = JNI_TRUE;
+        }
+    }
+    for (i = 0; i < ft->count; i++) {
+        if (isVisible(&ft->table[i], frame->location)) {
+            ft->visible++;
+        }
+    }
+}
+
+static jvmtiError
+readLocal(jthread thread, jint depth, jint slot, jbyte typeKey,
+          jvalue *value)
+{
+    jvmtiError error;
+    jint intValue;
+
+    if (isObjectTag(typeKey)) {
+        return JVMTI_FUNC_PTR(gdata->jvmti,GetLocalObject)
+                    (gdata->jvmti, thread, depth, slot, &value->l);
+    }
+    switch (typeKey) {
+        case JDWP_TAG(FLOAT):
+            return JVMTI_FUNC_PTR(gdata->jvmti,GetLocalFloat)
+                    (gdata->jvmti, thread, depth, slot, &value->f);
+        case JDWP_TAG(DOUBLE):
+            return JVMTI_FUNC_PTR(gdata->jvmti,GetLocalDouble)
+                    (gdata->jvmti, thread, depth, slot, &value->d);
+        case JDWP_TAG(LONG):
+            return JVMTI_FUNC_PTR(gdata->jvmti,GetLocalLong)
+                    (gdata->jvmti, thread, depth, slot, &value->j);
+        default:
+            break;
+    }
+    error = JVMTI_FUNC_PTR(gdata->jvmti,GetLocalInt)
+                (gdata->jvmti, thread, depth, slot, &intValue);
+    switch (typeKey) {
+        case JDWP_TAG(BYTE):
+            value->b = (jbyte)intValue;
+            break;
+        case JDWP_TAG(CHAR):
+            value->c = (jchar)intValue;
+            break;
+        case JDWP_TAG(SHORT):
+            value->s = (jshort)intValue;
+            break;
+        case JDWP_TAG(BOOLEAN):
+            value->z = (jboolean)intValue;
+            break;
+        default:
+            value->i = intValue;
+            break;
+    }
+    return error;
+}
+
+/*
+ * Writes the visible locals of a frame whose values could be read.
+ * The caller provides room for local refs to all of them.
+ */
+static void
+writeLocals(JNIEnv *env, PacketOutputStream *out, jthread thread,
+            jint depth, jlocation location, FrameTable *ft,
+            jbyte *typeKeys, jvalue *values)
+{
+    jint valueCount = 0;
+    jint i;
+
+    for (i = 0; i < ft->count; i++) {
+        jvmtiLocalVariableEntry *entry = &ft->table[i];
+
+        typeKeys[i] = 0;
+        if (isVisible(entry, location) &&
+            readLocal(thread, depth, entry->slot, entry->signature[0],
+                      &values[i]) == JVMTI_ERROR_NONE) {
+            typeKeys[i] = entry->signature[0];
+            valueCount++;
+        }
+    }
+    (void)outStream_writeInt(out, valueCount);
+    for (i = 0; i < ft->count; i++) {
+        if (typeKeys[i] != 0) {
+            (void)outStream_writeInt(out, ft->table[i].slot);
+            (void)outStream_writeValue(env, out, typeKeys[i], values[i]);
+        }
+    }
+}
+
+/*
+ * Returns JNI_TRUE if the oldest snapshot had to make room; it is
+ * moved to evicted for the caller to release.
+ */
+static jboolean
+addSnapshot(struct SnapshotRing *ring, Snapshot *snapshot, Snapshot *evicted)
+{
+    jboolean full = (ring->count == ring->capacity);
+
+    if (full) {
+        *evicted = ring->slots[ring->first];
+        ring->first = (ring->first + 1) % ring->capacity;
+        ring->count--;
+        ring->dropped++;
+    }
+    ring->slots[(ring->first + ring->count) % ring->capacity] = *snapshot;
+    ring->count++;
+    return full;
+}
+
+/*
+ * Reads the stack and locals of the thread into a snapshot. Runs
+ * without the event handler lock. Returns JNI_FALSE if nothing could
+ * be captured.
+ */
+static jboolean
+captureSnapshot(JNIEnv *env, jthread thread, Capture *capture,
+                Snapshot *snapshot)
+{
+    jvmtiFrameInfo *frames;
+    FrameTable *tables;
+    jint maxTable = 0;
+    jint count = 0;
+    jint captured;
+    jint size = HEADER_SIZE;
+    jvmtiError error;
+    PacketOutputStream out;
+    jboolean ok = JNI_FALSE;
+    jint i;
+
+    frames = jvmtiAllocate(capture->frames * (jint)sizeof(jvmtiFrameInfo));
+    tables = jvmtiAllocate(capture->frames * (jint)sizeof(FrameTable));
+    error = AGENT_ERROR_OUT_OF_MEMORY;
+    if (frames != NULL && tables != NULL) {
+        error = JVMTI_FUNC_PTR(gdata->jvmti,GetStackTrace)
+                    (gdata->jvmti, thread, 0, capture->frames, frames, &count);
+    }
+    if (error != JVMTI_ERROR_NONE) {
+        jvmtiDeallocate(frames);
+        jvmtiDeallocate(tables);
+        return JNI_FALSE;
+    }
+
+    /* The top frame is always captured, deeper ones while they fit */
+    for (captured = 0; captured < count; captured++) {
+        FrameTable *ft = &tables[captured];
+        jint frameSize;
+
+        getFrameTable(capture, captured, &frames[captured], ft);
+        frameSize = FRAME_SIZE + ft->visible * LOCAL_SIZE;
+        if (captured > 0 && size + frameSize > capture->maxBytes) {
+            if (ft->owned) {
+                freeVariableTable(ft->table, ft->count);
+            }
+            break;
+        }
+        size += frameSize;
+        if (ft->count > maxTable) {
+            maxTable = ft->count;
+        }
+    }
+
+    (void)memset(snapshot, 0, sizeof(Snapshot));
+    outStream_initReply(&out, 0);
+
+    WITH_LOCAL_REFS(env, size / LOCAL_SIZE + captured + 1) {
+
+        jbyte *typeKeys = jvmtiAllocate(maxTable + 1);
+        jvalue *values = jvmtiAllocate((maxTable + 1) * (jint)sizeof(jvalue));
+
+        if (typeKeys == NULL || values == NULL) {
+            outStream_setError(&out, JDWP_ERROR(OUT_OF_MEMORY));
+        }
+        (void)outStream_writeObjectRef(env, &out, thread);
+        (void)outStream_writeLong(&out, nanoTime());
+        (void)outStream_writeInt(&out, captured);
+        for (i = 0; i < captured && outStream_error(&out) == JDWP_ERROR(NONE); i++) {
+            jclass clazz;
+
+            error = methodClass(frames[i].method, &clazz);
+            if (error != JVMTI_ERROR_NONE) {
+                outStream_setError(&out, map2jdwpError(error));
+                break;
+            }
+            writeCodeLocation(&out, clazz, frames[i].method, frames[i].location);
+            writeLocals(env, &out, thread, i, frames[i].location, &tables[i],
+                        typeKeys, values);
+        }
+        jvmtiDeallocate(typeKeys);
+        jvmtiDeallocate(values);
+
+    } END_WITH_LOCAL_REFS(env);
+
+    if (outStream_error(&out) == JDWP_ERROR(NONE)) {
+        snapshot->data = outStream_copyData(&out, &snapshot->length);
+        if (snapshot->data != NULL &&
+            outStream_takeIDs(&out, &snapshot->ids, &snapshot->idCount)) {
+            ok = JNI_TRUE;
+        } else {
+            jvmtiDeallocate(snapshot->data);
+            snapshot->data = NULL;
+        }
+    }
+    outStream_destroy(&out);
+
+    for (i = 0; i < captured; i++) {
+        if (tables[i].owned) {
+            freeVariableTable(tables[i].table, tables[i].count);
+        }
+    }
+    jvmtiDeallocate(tables);
+    jvmtiDeallocate(frames);
+    return ok;
+}
+
+/*
+ * Runs with the event handler lock held, on the thread which hit the
+ * breakpoint. Only queues the capture, see snapshotPoint_capturePending.
+ */
+void
+snapshotPoint_handleEvent(JNIEnv *env, EventInfo *evinfo,
+                          HandlerNode *node, struct bag *eventBag)
+{
+    struct SnapshotRing *ring = node->snapshots;
+    Capture *pending = jvmtiAllocate((jint)sizeof(Capture));
+
+    if (pending == NULL) {
+        ring->dropped++;
+        return;
+    }
+    (void)memset(pending, 0, sizeof(Capture));
+    pending->evinfo = evinfo;
+    pending->ring = ring;
+    pending->next = pendingCaptures;
+    pendingCaptures = pending;
+    pendingCount++;
+    ring->users++;
+}
+
+/*
+ * Runs the captures queued for an event. Called by event_callback on
+ * the thread which hit the breakpoint, after it released the event
+ * handler lock.
+ */
+void
+snapshotPoint_capturePending(JNIEnv *env, EventInfo *evinfo)
+{
+    Capture *captures = NULL;
+    Capture **link;
+
+    if (pendingCount == 0) {
+        return;
+    }
+
+    eventHandler_lock();
+    link = &pendingCaptures;
+    while (*link != NULL) {
+        Capture *pending = *link;
+
+        if (pending->evinfo != evinfo) {
+            link = &pending->next;
+            continue;
+        }
+        *link = pending->next;
+        pendingCount--;
+        pending->detached = pending->ring->detached;
+        pending->frames = pending->ring->frames;
+        pending->maxBytes = pending->ring->maxBytes;
+        pending->tableLoaded = pending->ring->tableLoaded;
+        pending->tableMethod = pending->ring->tableMethod;
+        pending->tableCount = pending->ring->tableCount;
+        pending->table = pending->ring->table;
+        pending->next = captures;
+        captures = pending;
+    }
+    eventHandler_unlock();
+
+    while (captures != NULL) {
+        Capture *pending = captures;
+        struct SnapshotRing *ring = pending->ring;
+        struct SnapshotRing *orphan = NULL;
+        jvmtiLocalVariableEntry *unusedTable = NULL;
+        Snapshot snapshot;
+        Snapshot evicted;
+        jboolean taken;
+        jboolean evict = JNI_FALSE;
+
+        captures = pending->next;
+        /* A cached table stays valid while the ring has users */
+        taken = !pending->detached &&
+                captureSnapshot(env, evinfo->thread, pending, &snapshot);
+
+        eventHandler_lock();
+        if (pending->tableFound) {
+            if (!ring->detached && !ring->tableLoaded) {
+                ring->tableLoaded = JNI_TRUE;
+                ring->tableMethod = pending->tableMethod;
+                ring->table = pending->table;
+                ring->tableCount = pending->tableCount;
+            } else {
+                unusedTable = pending->table;
+            }
+        }
+        if (ring->detached) {
+            if (--ring->users == 0) {
+                orphan = ring;
+            }
+        } else {
+            ring->users--;
+            if (taken) {
+                evict = addSnapshot(ring, &snapshot, &evicted);
+                taken = JNI_FALSE;
+            } else {
+                ring->dropped++;
+            }
+        }
+        eventHandler_unlock();
+
+        /* Object IDs are released without holding up the event handler */
+        if (taken) {
+            releaseSnapshot(env, &snapshot);
+        }
+        if (evict) {
+            releaseSnapshot(env, &evicted);
+        }
+        if (unusedTable != NULL) {
+            freeVariableTable(unusedTable, pending->tableCount);
+        }
+        if (orphan != NULL) {
+            destroyRing(env, orphan);
+        }
+        jvmtiDeallocate(pending);
+    }
+}
+
+static jboolean
+matchRequest(JNIEnv *env, HandlerNode *node, void *arg)
+{
+    RequestLookup *lookup = (RequestLookup *)arg;
+
+    if (node->handlerID == lookup->requestID) {
+        lookup->node = node;
+        return JNI_TRUE;
+    }
+    return JNI_FALSE;
+}
+
+/*
+ * Moves up to maxSnapshots of the oldest snapshots (all if it is not
+ * positive) out of the ring of a request and writes them. The object
+ * IDs they hold now belong to the debugger.
+ */
+jdwpError
+snapshotPoint_drain(JNIEnv *env, PacketOutputStream *out,
+                    HandlerID requestID, jint maxSnapshots)
+{
+    RequestLookup lookup;
+    Snapshot *taken = NULL;
+    jint takenCount = 0;
+    jlong dropped = 0;
+    jdwpError serror = JDWP_ERROR(NONE);
+    jint i;
+
+    lookup.requestID = requestID;
+    lookup.node = NULL;
+
+    eventHandler_lock();
+    (void)eventHandlerRestricted_iterator(EI_BREAKPOINT, matchRequest, &lookup);
+    if (lookup.node == NULL || lookup.node->snapshots == NULL) {
+        serror = JDWP_ERROR(ILLEGAL_ARGUMENT);
+    } else {
+        struct SnapshotRing *ring = lookup.node->snapshots;
+
+        takenCount = ring->count;
+        if (maxSnapshots > 0 && maxSnapshots < takenCount) {
+            takenCount = maxSnapshots;
+        }
+        taken = jvmtiAllocate((takenCount + 1) * (jint)sizeof(Snapshot));
+        if (taken == NULL) {
+            serror = JDWP_ERROR(OUT_OF_MEMORY);
+        } else {
+            for (i = 0; i < takenCount; i++) {
+                taken[i] = ring->slots[ring->first];
+                ring->first = (ring->first + 1) % ring->capacity;
+                ring->count--;
+            }
+            dropped = ring->dropped;
+            ring->dropped = 0;
+        }
+    }
+    eventHandler_unlock();
+
+    if (serror != JDWP_ERROR(NONE)) {
+        return serror;
+    }
+
+    /* Copying the snapshots out does not hold up snapshot points */
+    (void)outStream_writeLong(out, dropped);
+    (void)outStream_writeInt(out, takenCount);
+    for (i = 0; i < takenCount; i++) {
+        (void)outStream_writeBytes(out, taken[i].length, taken[i].data);
+        jvmtiDeallocate(taken[i].ids);
+        jvmtiDeallocate(taken[i].data);
+    }
+    jvmtiDeallocate(taken);
+    return JDWP_ERROR(NONE);
+}
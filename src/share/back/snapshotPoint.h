@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+#ifndef JDWP_SNAPSHOTPOINT_H
+#define JDWP_SNAPSHOTPOINT_H
+
+#include "eventHandler.h"
+#include "outStream.h"
+
+/*
+ * Snapshot points: breakpoint requests with the Snapshot modifier
+ * capture the stack and locals of the hitting thread into a ring
+ * buffer of the request instead of reporting an event.
+ */
+
+struct SnapshotRing;
+
+jvmtiError snapshotPoint_createRing(struct SnapshotRing **pring, jint frames,
+                                    jint maxBytes, jint capacity);
+void snapshotPoint_freeRing(JNIEnv *env, struct SnapshotRing *ring);
+
+/* The handler function of Snapshot requests */
+void snapshotPoint_handleEvent(JNIEnv *env, EventInfo *evinfo,
+                               HandlerNode *node, struct bag *eventBag);
+/* Called by event_callback once the event handler lock is released */
+void snapshotPoint_capturePending(JNIEnv *env, EventInfo *evinfo);
+
+jdwpError snapshotPoint_drain(JNIEnv *env, PacketOutputStream *out,
+                              HandlerID requestID, jint maxSnapshots);
+
+#endif
@@ -72,7 +72,8 @@ handleClassPrepare(JNIEnv *env, EventInfo *evinfo,
         }
     }
     eventHelper_recordEvent(evinfo, node->handlerID,
-                            node->suspendPolicy, eventBag);
+                            node->suspendPolicy, node->prefetchFrames,
+                            eventBag);
 }
 
 static void
@@ -112,6 +113,7 @@ handleFrameEvent(JNIEnv *env, EventInfo *evinfo,
 
     eventHelper_recordFrameEvent(node->handlerID,
                                  node->suspendPolicy,
+                                 node->prefetchFrames,
                                  evinfo->ei,
                                  evinfo->thread,
                                  evinfo->clazz,
@@ -128,7 +130,7 @@ genericHandler(JNIEnv *env, EventInfo *evinfo,
                struct bag *eventBag)
 {
     eventHelper_recordEvent(evinfo, node->handlerID, node->suspendPolicy,
-                            eventBag);
+                            node->prefetchFrames, eventBag);
 }
 
 HandlerFunction
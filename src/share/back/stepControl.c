@@ -29,8 +29,46 @@
 #include "eventHelper.h"
 #include "threadControl.h"
 #include "SDE.h"
+// ANDROID-CHANGED: Needed for classTrack_getTag
+#include "classTrack.h"
+
+/*
+ * ANDROID-CHANGED: Step requests of a stepping session follow each other
+ * closely: the debugger deletes the completed request and creates the next
+ * one for the same thread. So that each step does not reinstall its frame
+ * pop and exception catch handlers, with the handlerLock and event mode
+ * changes that takes, clearing a step leaves those handlers installed but
+ * dormant (their functions ignore events while no step is pending), and
+ * the next step on the thread picks them up again. Dormant handlers are
+ * released when they first see an event, which means the thread runs
+ * outside of a step, and when the thread or the session ends. They are
+ * kept on the dormantSteps list, protected by the handlerLock. The method
+ * entry handler of a step into is not kept, since while enabled it costs
+ * every method call of the thread.
+ *
+ * Line tables, converted through the SDE, are cached by method in
+ * lineTables so that stepping into a method again, or checking whether a
+ * method has lines, does not ask JVMTI each time. Entries also record the
+ * class tag (see classTrack_getTag), as a method ID may be reused for a
+ * method of a class loaded after its class was unloaded. The cache is
+ * protected by the stepLock and dropped on redefinition and reset.
+ */
+#define LINE_TABLE_BUCKETS 256
+#define LINE_TABLE_LIMIT 4096
+
+typedef struct LineTable {
+    jmethodID method;
+    jlong classTag;
+    jboolean hasLines;               /* before conversion */
+    jint count;
+    jvmtiLineNumberEntry *entries;   /* converted */
+    struct LineTable *next;
+} LineTable;
 
 static jrawMonitorID stepLock;
+static StepRequest *dormantSteps;
+static LineTable *lineTables[LINE_TABLE_BUCKETS];
+static jint lineTableCount;
 
 static jint
 getFrameCount(jthread thread)
@@ -126,6 +164,104 @@ getLineNumberTable(jmethodID method, jint *pcount,
     }
 }
 
+/*
+ * ANDROID-CHANGED: Line table cache.
+ */
+static jint
+hashMethod(jmethodID method)
+{
+    jlong hash = (jlong)(intptr_t)method;
+    return (jint)((hash ^ (hash >> 17)) & (LINE_TABLE_BUCKETS - 1));
+}
+
+static void
+flushLineTables(void)
+{
+    jint i;
+
+    for (i = 0; i < LINE_TABLE_BUCKETS; i++) {
+        LineTable *table = lineTables[i];
+        while (table != NULL) {
+            LineTable *next = table->next;
+            jvmtiDeallocate(table->entries);
+            jvmtiDeallocate(table);
+            table = next;
+        }
+        lineTables[i] = NULL;
+    }
+    lineTableCount = 0;
+}
+
+/*
+ * The converted line table of method. If it cannot be cached it is loaded
+ * into scratch, and the caller owns scratch->entries. Assumes stepLock held.
+ */
+static LineTable *
+findLineTable(JNIEnv *env, jclass clazz, jmethodID method, LineTable *scratch)
+{
+    LineTable *table;
+    jlong classTag;
+    jint index;
+
+    classTag = classTrack_getTag(clazz);
+    index = hashMethod(method);
+    if (classTag != 0) {
+        for (table = lineTables[index]; table != NULL; table = table->next) {
+            if (table->method == method && table->classTag == classTag) {
+                return table;
+            }
+        }
+        if (lineTableCount >= LINE_TABLE_LIMIT) {
+            flushLineTables();
+        }
+    }
+
+    table = (classTag != 0) ? jvmtiAllocate((jint)sizeof(LineTable)) : NULL;
+    if (table == NULL) {
+        table = scratch;
+    }
+    table->method = method;
+    table->classTag = classTag;
+    getLineNumberTable(method, &table->count, &table->entries);
+    table->hasLines = (table->count > 0);
+    if (table->count > 0) {
+        convertLineNumberTable(env, clazz, &table->count, &table->entries);
+    }
+    if (table != scratch) {
+        table->next = lineTables[index];
+        lineTables[index] = table;
+        lineTableCount++;
+    }
+    return table;
+}
+
+/*
+ * A copy of the converted line table of method, for the step request.
+ */
+static void
+copyLineTable(JNIEnv *env, jclass clazz, jmethodID method,
+              jint *pcount, jvmtiLineNumberEntry **ptable)
+{
+    LineTable scratch;
+    LineTable *table;
+
+    *pcount = 0;
+    *ptable = NULL;
+
+    table = findLineTable(env, clazz, method, &scratch);
+    if (table == &scratch) {
+        *pcount = scratch.count;
+        *ptable = scratch.entries;
+    } else if (table->count > 0) {
+        jint size = table->count * (jint)sizeof(jvmtiLineNumberEntry);
+        *ptable = jvmtiAllocate(size);
+        if (*ptable != NULL) {
+            (void)memcpy(*ptable, table->entries, size);
+            *pcount = table->count;
+        }
+    }
+}
+
 static jint
 findLineNumber(jthread thread, jlocation location,
                jvmtiLineNumberEntry *lines, jint count)
@@ -147,19 +283,66 @@ findLineNumber(jthread thread, jlocation location,
     return line;
 }
 
+/* ANDROID-CHANGED: Answered from the line table cache */
 static jboolean
-hasLineNumbers(jmethodID method)
+hasLineNumbers(JNIEnv *env, jclass clazz, jmethodID method)
 {
-    jint count;
-    jvmtiLineNumberEntry *table;
+    LineTable scratch;
+    LineTable *table;
 
-    getLineNumberTable(method, &count, &table);
-    if ( count == 0 ) {
-        return JNI_FALSE;
-    } else {
-        jvmtiDeallocate(table);
+    table = findLineTable(env, clazz, method, &scratch);
+    if (table == &scratch) {
+        jvmtiDeallocate(scratch.entries);
+    }
+    return table->hasLines;
+}
+
+/*
+ * ANDROID-CHANGED: Dormant step handlers, see the comment at the top.
+ * Assume handlerLock held.
+ */
+static void
+unlinkDormant(StepRequest *step)
+{
+    StepRequest **link;
+
+    if (!step->handlersDormant) {
+        return;
+    }
+    for (link = &dormantSteps; *link != NULL; link = &(*link)->nextDormant) {
+        if (*link == step) {
+            *link = step->nextDormant;
+            break;
+        }
+    }
+    step->nextDormant = NULL;
+    step->handlersDormant = JNI_FALSE;
+}
+
+static void
+makeDormant(StepRequest *step)
+{
+    if (step->handlersDormant ||
+        (step->catchHandlerNode == NULL && step->framePopHandlerNode == NULL)) {
+        return;
+    }
+    step->handlersDormant = JNI_TRUE;
+    step->nextDormant = dormantSteps;
+    dormantSteps = step;
+}
+
+static void
+releaseHandlers(StepRequest *step)
+{
+    unlinkDormant(step);
+    if ( step->catchHandlerNode != NULL ) {
+        (void)eventHandler_free(step->catchHandlerNode);
+        step->catchHandlerNode = NULL;
+    }
+    if ( step->framePopHandlerNode!= NULL ) {
+        (void)eventHandler_free(step->framePopHandlerNode);
+        step->framePopHandlerNode = NULL;
     }
-    return JNI_TRUE;
 }
 
 static jvmtiError
@@ -234,12 +417,9 @@ initState(JNIEnv *env, jthread thread, StepRequest *step)
                         step->lineEntries = NULL;
                     }
                     step->method = method;
-                    getLineNumberTable(step->method,
-                                 &step->lineEntryCount, &step->lineEntries);
-                    if (step->lineEntryCount > 0) {
-                        convertLineNumberTable(env, clazz,
-                                &step->lineEntryCount, &step->lineEntries);
-                    }
+                    // ANDROID-CHANGED: From the line table cache
+                    copyLineTable(env, clazz, step->method,
+                                  &step->lineEntryCount, &step->lineEntries);
                 }
                 step->fromLine = findLineNumber(thread, location,
                                      step->lineEntries, step->lineEntryCount);
@@ -355,6 +535,9 @@ handleFramePopEvent(JNIEnv *env, EventInfo *evinfo,
             step->methodEnterHandlerNode = NULL;
         }
         LOG_STEP(("handleFramePopEvent: finished"));
+    } else {
+        /* ANDROID-CHANGED: The thread runs outside of a step */
+        releaseHandlers(step);
     }
 
     stepControl_unlock();
@@ -422,6 +605,9 @@ handleExceptionCatchEvent(JNIEnv *env, EventInfo *evinfo,
             (void)eventHandler_free(step->methodEnterHandlerNode);
             step->methodEnterHandlerNode = NULL;
         }
+    } else {
+        /* ANDROID-CHANGED: The thread runs outside of a step */
+        releaseHandlers(step);
     }
 
     stepControl_unlock();
@@ -463,7 +649,7 @@ handleMethodEnterEvent(JNIEnv *env, EventInfo *evinfo,
         if (    (!eventFilter_predictFiltering(step->stepHandlerNode,
                                                clazz, classname))
              && (   step->granularity != JDWP_STEP_SIZE(LINE)
-                 || hasLineNumbers(method) ) ) {
+                 || hasLineNumbers(env, clazz, method) ) ) {
             /*
              * We've found a suitable method in which to stop. Step
              * until we reach the next safe location to complete the step->,
@@ -578,7 +764,7 @@ stepControl_handleStep(JNIEnv *env, jthread thread,
         if (   step->depth == JDWP_STEP_DEPTH(INTO)
             && (!eventFilter_predictFiltering(step->stepHandlerNode, clazz,
                                           (classname = getClassname(clazz))))
-            && hasLineNumbers(method) ) {
+            && hasLineNumbers(env, clazz, method) ) {
 
             /* Stepped into a method with lines, so we're done */
             completed = JNI_TRUE;
@@ -691,6 +877,33 @@ stepControl_initialize(void)
 void
 stepControl_reset(void)
 {
+    /*
+     * ANDROID-CHANGED: eventHandler_reset has freed all handlers,
+     * dormant step handlers included.
+     */
+    eventHandler_lock();
+    stepControl_lock();
+    while (dormantSteps != NULL) {
+        StepRequest *step = dormantSteps;
+        unlinkDormant(step);
+        step->catchHandlerNode = NULL;
+        step->framePopHandlerNode = NULL;
+    }
+    flushLineTables();
+    stepControl_unlock();
+    eventHandler_unlock();
+}
+
+/*
+ * ANDROID-CHANGED: Redefinition may change the lines of methods that
+ * keep their IDs.
+ */
+void
+stepControl_onRedefineClasses(void)
+{
+    stepControl_lock();
+    flushLineTables();
+    stepControl_unlock();
 }
 
 /*
@@ -734,15 +947,21 @@ initEvents(jthread thread, StepRequest *step)
         /*
          * TO DO: These might be able to applied more selectively to
          * boost performance.
+         * ANDROID-CHANGED: Reuse the handlers of the previous step.
          */
-        step->catchHandlerNode = eventHandler_createInternalThreadOnly(
-                                     EI_EXCEPTION_CATCH,
-                                     handleExceptionCatchEvent,
-                                     thread);
-        step->framePopHandlerNode = eventHandler_createInternalThreadOnly(
-                                        EI_FRAME_POP,
-                                        handleFramePopEvent,
-                                        thread);
+        unlinkDormant(step);
+        if (step->catchHandlerNode == NULL) {
+            step->catchHandlerNode = eventHandler_createInternalThreadOnly(
+                                         EI_EXCEPTION_CATCH,
+                                         handleExceptionCatchEvent,
+                                         thread);
+        }
+        if (step->framePopHandlerNode == NULL) {
+            step->framePopHandlerNode = eventHandler_createInternalThreadOnly(
+                                            EI_FRAME_POP,
+                                            handleFramePopEvent,
+                                            thread);
+        }
 
         if (step->catchHandlerNode == NULL ||
             step->framePopHandlerNode == NULL) {
@@ -750,6 +969,9 @@ initEvents(jthread thread, StepRequest *step)
                         "installing step event handlers");
         }
 
+    } else {
+        // ANDROID-CHANGED: Not needed by this step.
+        releaseHandlers(step);
     }
     /*
      * Initially enable stepping:
@@ -815,8 +1037,8 @@ stepControl_beginStep(JNIEnv *env, jthread thread, jint size, jint depth,
              */
             step->granularity = size;
             step->depth = depth;
-            step->catchHandlerNode = NULL;
-            step->framePopHandlerNode = NULL;
+            // ANDROID-CHANGED: The frame pop and exception catch handlers
+            // are kept, see initEvents.
             step->methodEnterHandlerNode = NULL;
             step->stepHandlerNode = node;
             error = initState(env, thread, step);
@@ -853,14 +1075,9 @@ clearStep(jthread thread, StepRequest *step)
     if (step->pending) {
 
         disableStepping(thread);
-        if ( step->catchHandlerNode != NULL ) {
-            (void)eventHandler_free(step->catchHandlerNode);
-            step->catchHandlerNode = NULL;
-        }
-        if ( step->framePopHandlerNode!= NULL ) {
-            (void)eventHandler_free(step->framePopHandlerNode);
-            step->framePopHandlerNode = NULL;
-        }
+        // ANDROID-CHANGED: Keep the frame pop and exception catch
+        // handlers for the next step.
+        makeDormant(step);
         if ( step->methodEnterHandlerNode != NULL ) {
             (void)eventHandler_free(step->methodEnterHandlerNode);
             step->methodEnterHandlerNode = NULL;
@@ -911,6 +1128,8 @@ stepControl_clearRequest(jthread thread, StepRequest *step)
 {
     LOG_STEP(("stepControl_clearRequest: thread=%p", thread));
     clearStep(thread, step);
+    // ANDROID-CHANGED: The thread or the session is going away.
+    releaseHandlers(step);
 }
 
 void
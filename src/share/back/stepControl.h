@@ -29,7 +29,7 @@
 #include "eventFilter.h"
 #include "eventHandler.h"
 
-typedef struct {
+typedef struct StepRequest {
     /* Parameters */
     jint granularity;
     jint depth;
@@ -48,6 +48,10 @@ typedef struct {
     HandlerNode *catchHandlerNode;
     HandlerNode *framePopHandlerNode;
     HandlerNode *methodEnterHandlerNode;
+
+    /* ANDROID-CHANGED: Frame pop and exception catch handlers kept between steps */
+    jboolean handlersDormant;
+    struct StepRequest *nextDormant;
 } StepRequest;
 
 
@@ -64,6 +68,9 @@ jvmtiError stepControl_endStep(jthread thread);
 void stepControl_clearRequest(jthread thread, StepRequest *step);
 void stepControl_resetRequest(jthread thread);
 
+/* ANDROID-CHANGED: Line tables of redefined methods may change */
+void stepControl_onRedefineClasses(void);
+
 void stepControl_lock(void);
 void stepControl_unlock(void);
 
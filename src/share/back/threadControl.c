@@ -25,12 +25,14 @@
 
 #include "util.h"
 #include "eventHandler.h"
+#include "eventFilter.h"
 #include "threadControl.h"
 #include "commonRef.h"
 #include "eventHelper.h"
 #include "stepControl.h"
 #include "invoker.h"
 #include "bag.h"
+#include "outStream.h"
 
 #define HANDLING_EVENT(node) ((node)->current_ei != 0)
 
@@ -84,10 +86,22 @@ typedef struct ThreadNode {
     struct ThreadNode *prev;
     jlong frameGeneration;
     struct ThreadList *list;  /* Tells us what list this thread is in */
+    /* ANDROID-CHANGED: Cached for threadControl_writeAllThreadInfo */
+    char *name;               /* name as of the last lookup */
+    jstring nameString;       /* Thread.name value the name came from */
+    jthreadGroup threadGroup;
+    /* ANDROID-CHANGED: Depths of the frames of methods watched for their
+     * return value, innermost last, see threadControl_countReturnValueWatch */
+    jint *returnValueFrames;
+    jint returnValueWatches;  /* number of returnValueFrames in use */
+    jint returnValueFramesSize;
 } ThreadNode;
 
 static jint suspendAllCount;
 
+/* ANDROID-CHANGED: java.lang.Thread.name, used to notice renamed threads */
+static jfieldID threadNameField;
+
 typedef struct ThreadList {
     ThreadNode *first;
 } ThreadList;
@@ -359,6 +373,65 @@ insertThread(JNIEnv *env, ThreadList *list, jthread thread)
     return node;
 }
 
+/*
+ * ANDROID-CHANGED: The name and group of a thread are cached in its
+ * ThreadNode so that AllThreadInfo does not need a GetThreadInfo for
+ * each thread. Thread groups don't change while a thread runs; a name
+ * change is noticed by comparing the current value of Thread.name with
+ * the String the cached name was taken from. Assumes the threadLock
+ * is held.
+ */
+static void
+clearThreadInfo(JNIEnv *env, ThreadNode *node)
+{
+    if (node->name != NULL) {
+        jvmtiDeallocate(node->name);
+        node->name = NULL;
+    }
+    if (node->nameString != NULL) {
+        tossGlobalRef(env, &(node->nameString));
+    }
+    if (node->threadGroup != NULL) {
+        tossGlobalRef(env, &(node->threadGroup));
+    }
+}
+
+static jvmtiError
+refreshThreadInfo(JNIEnv *env, ThreadNode *node)
+{
+    jvmtiError error;
+
+    error = JVMTI_ERROR_NONE;
+    WITH_LOCAL_REFS(env, 2) {
+        jstring nameString = NULL;
+
+        if (threadNameField != NULL) {
+            nameString = JNI_FUNC_PTR(env,GetObjectField)
+                                (env, node->thread, threadNameField);
+        }
+        if (node->name == NULL || nameString == NULL ||
+                !isSameObject(env, nameString, node->nameString)) {
+            jvmtiThreadInfo info;
+
+            (void)memset(&info, 0, sizeof(info));
+            error = JVMTI_FUNC_PTR(gdata->jvmti,GetThreadInfo)
+                                (gdata->jvmti, node->thread, &info);
+            if (error == JVMTI_ERROR_NONE) {
+                clearThreadInfo(env, node);
+                node->name = info.name;
+                if (nameString != NULL) {
+                    saveGlobalRef(env, nameString, &(node->nameString));
+                }
+                if (info.thread_group != NULL) {
+                    saveGlobalRef(env, info.thread_group, &(node->threadGroup));
+                }
+            }
+        }
+    } END_WITH_LOCAL_REFS(env);
+
+    return error;
+}
+
 static void
 clearThread(JNIEnv *env, ThreadNode *node)
 {
@@ -369,10 +442,13 @@ clearThread(JNIEnv *env, ThreadNode *node)
     if (node->isDebugThread) {
         (void)threadControl_removeDebugThread(node->thread);
     }
+    clearThreadInfo(env, node);
     /* Clear out TLS on this thread (just a cleanup action) */
     setThreadLocalStorage(node->thread, NULL);
     tossGlobalRef(env, &(node->thread));
     bagDestroyBag(node->eventBag);
+    /* ANDROID-CHANGED: See threadControl_countReturnValueWatch */
+    jvmtiDeallocate(node->returnValueFrames);
     jvmtiDeallocate(node);
 }
 
@@ -566,6 +642,7 @@ threadControl_initialize(void)
 {
     jlocation unused;
     jvmtiError error;
+    JNIEnv *env;
 
     suspendAllCount = 0;
     runningThreads.first = NULL;
@@ -583,6 +660,14 @@ threadControl_initialize(void)
     if (error != JVMTI_ERROR_NONE) {
         EXIT_ERROR(error, "getting method location");
     }
+    /* ANDROID-CHANGED: Without it thread names are simply always looked up */
+    env = getEnv();
+    threadNameField = JNI_FUNC_PTR(env,GetFieldID)
+                        (env, gdata->threadClass, "name", "Ljava/lang/String;");
+    if (JNI_FUNC_PTR(env,ExceptionCheck)(env)) {
+        JNI_FUNC_PTR(env,ExceptionClear)(env);
+        threadNameField = NULL;
+    }
 }
 
 static jthread
@@ -837,6 +922,7 @@ threadControl_onHook(void)
                  * the threads that already exist (e.g. the finalizer thread).
                  */
                 node->isStarted = JNI_TRUE;
+                (void)refreshThreadInfo(env, node);
             }
         }
 
@@ -2085,6 +2171,7 @@ threadControl_onEventHandlerEntry(jbyte sessionID, EventIndex ei, jthread thread
     if (ei == EI_THREAD_START) {
         node->isStarted = JNI_TRUE;
         processDeferredEventModes(env, thread, node);
+        (void)refreshThreadInfo(env, node);
     }
 
     node->current_ei = ei;
@@ -2215,6 +2302,56 @@ threadControl_applicationThreadStatus(jthread thread,
     return error;
 }
 
+/*
+ * ANDROID-CHANGED: Write the reply of Vendor.AllThreadInfo, the started
+ * application threads with their name, status, suspend count and group,
+ * using the information cached in the thread list.
+ */
+void
+threadControl_writeAllThreadInfo(PacketOutputStream *out)
+{
+    JNIEnv *env;
+    ThreadNode *node;
+    jint count;
+
+    env = getEnv();
+
+    debugMonitorEnter(threadLock);
+
+    count = 0;
+    for (node = runningThreads.first; node != NULL; node = node->next) {
+        if (node->isStarted && !node->isDebugThread) {
+            count++;
+        }
+    }
+
+    (void)outStream_writeInt(out, count);
+    for (node = runningThreads.first; node != NULL; node = node->next) {
+        jdwpThreadStatus threadStatus;
+        jint state;
+
+        if (!node->isStarted || node->isDebugThread) {
+            continue;
+        }
+        (void)refreshThreadInfo(env, node);
+        (void)threadState(node->thread, &state);
+        threadStatus = map2jdwpThreadStatus(state);
+        if (HANDLING_EVENT(node)) {
+            /* Same as threadControl_applicationThreadStatus */
+            threadStatus = JDWP_THREAD_STATUS(RUNNING);
+        }
+
+        (void)outStream_writeObjectRef(env, out, node->thread);
+        (void)outStream_writeString(out, node->name == NULL ? "" : node->name);
+        (void)outStream_writeInt(out, threadStatus);
+        (void)outStream_writeInt(out, map2jdwpSuspendStatus(state));
+        (void)outStream_writeInt(out, node->suspendCount);
+        (void)outStream_writeObjectRef(env, out, node->threadGroup);
+    }
+
+    debugMonitorExit(threadLock);
+}
+
 jvmtiError
 threadControl_interrupt(jthread thread)
 {
@@ -2501,3 +2638,103 @@ threadControl_getFrameGeneration(jthread thread)
 
     return frameGeneration;
 }
+
+/*
+ * ANDROID-CHANGED: Record a frame of a method watched for its return value
+ * being entered, or account for one being popped, on this thread. Frames
+ * are told apart by their depth, so that pops of frames the method watch
+ * did not arm (entered before the watch was added, or armed for a step or
+ * a FramePop request) are ignored. Returns JNI_TRUE if the thread went from
+ * having no such frames to having one or back, i.e. when the caller has to
+ * enable or disable MethodExit for it. Assumes the event handler lock is
+ * held.
+ */
+jboolean
+threadControl_countReturnValueWatch(jthread thread, jint depth, jboolean enter)
+{
+    jboolean changed = JNI_FALSE;
+
+    debugMonitorEnter(threadLock);
+    {
+        ThreadNode *node;
+
+        node = findThread(&runningThreads, thread);
+        if (node != NULL && enter) {
+            if (node->returnValueWatches == node->returnValueFramesSize) {
+                jint size = (node->returnValueFramesSize == 0) ?
+                                8 : node->returnValueFramesSize * 2;
+                jint *frames = jvmtiAllocate(size * (jint)sizeof(jint));
+
+                if (frames == NULL) {
+                    EXIT_ERROR(AGENT_ERROR_OUT_OF_MEMORY,
+                               "return value watch frames");
+                }
+                if (node->returnValueWatches > 0) {
+                    (void)memcpy(frames, node->returnValueFrames,
+                                 node->returnValueWatches * sizeof(jint));
+                }
+                jvmtiDeallocate(node->returnValueFrames);
+                node->returnValueFrames = frames;
+                node->returnValueFramesSize = size;
+            }
+            node->returnValueFrames[node->returnValueWatches++] = depth;
+            changed = (node->returnValueWatches == 1);
+        } else if (node != NULL && node->returnValueWatches > 0) {
+            jint count = node->returnValueWatches;
+
+            /* Deeper frames went without a pop, e.g. by PopFrames */
+            while (count > 0 && node->returnValueFrames[count - 1] > depth) {
+                count--;
+            }
+            if (count > 0 && node->returnValueFrames[count - 1] == depth) {
+                count--;
+            }
+            node->returnValueWatches = count;
+            changed = (count == 0);
+        }
+    }
+    debugMonitorExit(threadLock);
+
+    return changed;
+}
+
+jboolean
+threadControl_hasReturnValueWatch(jthread thread)
+{
+    jboolean watched = JNI_FALSE;
+
+    debugMonitorEnter(threadLock);
+    {
+        ThreadNode *node;
+
+        node = findThread(&runningThreads, thread);
+        watched = (node != NULL && node->returnValueWatches > 0);
+    }
+    debugMonitorExit(threadLock);
+
+    return watched;
+}
+
+/*
+ * ANDROID-CHANGED: Called when the last method watched for its return value
+ * goes away. Frames entered while it was watched are no longer tracked, so
+ * stop counting them and disable MethodExit where it was enabled for them.
+ * Assumes the event handler lock is held.
+ */
+void
+threadControl_clearReturnValueWatches(void)
+{
+    debugMonitorEnter(threadLock);
+    {
+        ThreadNode *node;
+
+        for (node = runningThreads.first; node != NULL; node = node->next) {
+            if (node->returnValueWatches > 0) {
+                node->returnValueWatches = 0;
+                (void)eventFilter_disableThreadEvent(EI_METHOD_EXIT,
+                                                     node->thread);
+            }
+        }
+    }
+    debugMonitorExit(threadLock);
+}
@@ -59,6 +59,7 @@ jboolean threadControl_isDebugThread(jthread thread);
 jvmtiError threadControl_addDebugThread(jthread thread);
 
 jvmtiError threadControl_applicationThreadStatus(jthread thread, jdwpThreadStatus *pstatus, jint *suspendStatus);
+void threadControl_writeAllThreadInfo(struct PacketOutputStream *out);
 jvmtiError threadControl_interrupt(jthread thread);
 jvmtiError threadControl_stop(jthread thread, jobject throwable);
 
@@ -75,4 +76,10 @@ void threadControl_saveCLEInfo(JNIEnv *env, jthread thread, EventIndex ei,
                                jlocation location);
 jlong threadControl_getFrameGeneration(jthread thread);
 
+/* ANDROID-CHANGED: See eventHandler.c method watches */
+jboolean threadControl_countReturnValueWatch(jthread thread, jint depth,
+                                            jboolean enter);
+jboolean threadControl_hasReturnValueWatch(jthread thread);
+void threadControl_clearReturnValueWatches(void);
+
 #endif
@@ -30,7 +30,18 @@
 
 static jdwpTransportEnv *transport;
 static jrawMonitorID listenerLock;
-static jrawMonitorID sendLock;
+/* ANDROID-CHANGED: Lightweight lock, see lightLock.c */
+static LightLock sendLock;
+
+/*
+ * ANDROID-CHANGED: Optional extension entry points of the most recently
+ * loaded transport library (see jdwpTransport.h), and the environment
+ * they belong to.
+ */
+static jdwpTransportEnv *extensionTransport;
+static jdwpTransport_SetBatching_t setBatchingFunc;
+static jdwpTransport_GetStats_t getStatsFunc;
+static jdwpTransport_SetBufferSize_t setBufferSizeFunc;
 
 /*
  * data structure used for passing transport info from thread to thread
@@ -218,6 +229,28 @@ loadTransport(const char *name, jdwpTransportEnv **transportPtr)
             return JDWP_ERROR(TRANSPORT_INIT);
         }
         *transportPtr = t;
+
+        /* ANDROID-CHANGED: Find the optional extensions */
+        extensionTransport = t;
+        setBatchingFunc = (jdwpTransport_SetBatching_t)
+                 dbgsysFindLibraryEntry(handle, "jdwpTransport_SetBatching");
+        getStatsFunc = (jdwpTransport_GetStats_t)
+                 dbgsysFindLibraryEntry(handle, "jdwpTransport_GetStats");
+        setBufferSizeFunc = (jdwpTransport_SetBufferSize_t)
+                 dbgsysFindLibraryEntry(handle, "jdwpTransport_SetBufferSize");
+        if (gdata->transportBufferSize > 0) {
+            if (setBufferSizeFunc == NULL) {
+                ERROR_MESSAGE(("transport %s ignores the socketbuffer option",
+                               name));
+            } else {
+                jdwpTransportError err;
+
+                err = (*setBufferSizeFunc)(t, gdata->transportBufferSize);
+                if (err != JDWPTRANSPORT_ERROR_NONE) {
+                    printLastError(t, err);
+                }
+            }
+        }
     } else {
         return JDWP_ERROR(TRANSPORT_LOAD);
     }
@@ -345,7 +378,7 @@ transport_initialize(void)
 {
     transport = NULL;
     listenerLock = debugMonitorCreate("JDWP Transport Listener Monitor");
-    sendLock = debugMonitorCreate("JDWP Transport Send Monitor");
+    lightLock_init(&sendLock, "JDWP Transport Send Lock");
 }
 
 void
@@ -573,9 +606,9 @@ transport_sendPacket(jdwpPacket *packet)
 
     if (transport != NULL) {
         if ( (*transport)->IsOpen(transport) ) {
-            debugMonitorEnter(sendLock);
+            lightLock_enter(&sendLock);
             err = (*transport)->WritePacket(transport, packet);
-            debugMonitorExit(sendLock);
+            lightLock_exit(&sendLock);
         }
         if (err != JDWPTRANSPORT_ERROR_NONE) {
             if ((*transport)->IsOpen(transport)) {
@@ -594,6 +627,42 @@ transport_sendPacket(jdwpPacket *packet)
     return rc;
 }
 
+/*
+ * ANDROID-CHANGED: Ask the transport to hold packets back (batching) or
+ * to send everything held back now. Transports without the extension
+ * always send right away.
+ */
+void
+transport_setBatching(jboolean batching)
+{
+    jdwpTransportError err;
+
+    if (transport == NULL || transport != extensionTransport ||
+            setBatchingFunc == NULL) {
+        return;
+    }
+    lightLock_enter(&sendLock);
+    err = (*setBatchingFunc)(transport, batching);
+    lightLock_exit(&sendLock);
+    if (err != JDWPTRANSPORT_ERROR_NONE && (*transport)->IsOpen(transport)) {
+        printLastError(transport, err);
+    }
+}
+
+/*
+ * ANDROID-CHANGED: Get the transport's traffic counters. Returns
+ * JNI_FALSE if the transport does not keep any.
+ */
+jboolean
+transport_getStats(jdwpTransportStats *stats)
+{
+    if (transport == NULL || transport != extensionTransport ||
+            getStatsFunc == NULL) {
+        return JNI_FALSE;
+    }
+    return (*getStatsFunc)(transport, stats) == JDWPTRANSPORT_ERROR_NONE;
+}
+
 jint
 transport_receivePacket(jdwpPacket *packet)
 {
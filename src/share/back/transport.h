@@ -37,5 +37,7 @@ jint transport_sendPacket(jdwpPacket *);
 jboolean transport_is_open(void);
 void transport_waitForConnection(void);
 void transport_close(void);
+void transport_setBatching(jboolean batching);
+jboolean transport_getStats(jdwpTransportStats *stats);
 
 #endif
@@ -42,6 +42,9 @@ BackendGlobalData *gdata = NULL;
 static jboolean isInterface(jclass clazz);
 static char * getPropertyUTF8(JNIEnv *env, char *propertyName);
 
+// ANDROID-CHANGED: Holds the type tags cache, see classTypeTags.
+static jvmtiEnv *typeTagEnv;
+
 static jvmtiError (JNICALL *ext_RawMonitorEnterNoSuspend) (jvmtiEnv* env, jrawMonitorID monitor);
 static jvmtiError (JNICALL *ext_RawMonitorExitNoSuspend) (jvmtiEnv* env, jrawMonitorID monitor);
 
@@ -56,6 +59,47 @@ milliTime(void)
   return ((jlong)now.tv_sec) * 1000LL + ((jlong)now.tv_nsec) / 1000000LL;
 }
 
+// ANDROID-CHANGED: Same as milliTime but with nanosecond resolution.
+jlong
+nanoTime(void)
+{
+  struct timespec now;
+  memset(&now, 0, sizeof(now));
+  (void)clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((jlong)now.tv_sec) * 1000000000LL + ((jlong)now.tv_nsec);
+}
+
+// ANDROID-CHANGED: 64-bit FNV-1a. Cheap enough to compute on every request, so that no
+// per-method or per-class state has to be kept in the agent.
+jlong
+contentHash(const unsigned char *bytes, jint length)
+{
+  jlong hash = (jlong)0xcbf29ce484222325ULL;
+  jint i;
+  for (i = 0; i < length; i++) {
+    hash ^= (jlong)bytes[i];
+    hash = (jlong)((unsigned long long)hash * 0x100000001b3ULL);
+  }
+  return hash;
+}
+
+// ANDROID-CHANGED: Shared by Vendor.BytecodeRange and Vendor.ConstantPoolRange.
+void
+writeContentRange(PacketOutputStream *out, const unsigned char *bytes, jint byteCount,
+                  jint offset, jint length)
+{
+  if (offset < 0 || offset > byteCount) {
+    outStream_setError(out, JDWP_ERROR(ILLEGAL_ARGUMENT));
+    return;
+  }
+  if (length < 0 || length > byteCount - offset) {
+    length = byteCount - offset;
+  }
+  (void)outStream_writeLong(out, contentHash(bytes, byteCount));
+  (void)outStream_writeInt(out, byteCount);
+  (void)outStream_writeByteArray(out, length, (jbyte *)(bytes + offset));
+}
+
 /* Save an object reference for use later (create a NewGlobalRef) */
 void
 saveGlobalRef(JNIEnv *env, jobject obj, jobject *pobj)
@@ -225,6 +269,9 @@ util_initialize(JNIEnv *env)
         saveGlobalRef(env, localStringClass,      &(gdata->stringClass));
         saveGlobalRef(env, localSystemClass,      &(gdata->systemClass));
 
+        // ANDROID-CHANGED: Environment for the type tags cache, see classTypeTags.
+        typeTagEnv = getSpecialJvmti();
+
         /* Find some standard methods */
 
         gdata->threadConstructor =
@@ -321,32 +368,73 @@ isObjectTag(jbyte tag) {
            (tag == JDWP_TAG(ARRAY));
 }
 
+/*
+ * ANDROID-CHANGED: The JDWP tags of a class are cached as its tag in a
+ * JVMTI environment of their own, so that writing an object value costs a
+ * GetObjectClass and a tag lookup instead of up to six JNI type checks.
+ * What kind of class a class is never changes, so the cached tags need no
+ * invalidation and go away with the class. A cached tag holds
+ * TYPE_TAGS_CACHED | referenceTypeTag << 8 | specificTypeKey of instances.
+ */
+#define TYPE_TAGS_CACHED ((jlong)1 << 16)
+
+static jlong
+classTypeTags(jclass clazz)
+{
+    JNIEnv *env;
+    jlong tags = 0;
+    jbyte typeTag;
+    jbyte typeKey;
+
+    if (typeTagEnv != NULL &&
+        JVMTI_FUNC_PTR(typeTagEnv,GetTag)(typeTagEnv, clazz, &tags) == JVMTI_ERROR_NONE &&
+        tags != 0) {
+        return tags;
+    }
+
+    env = getEnv();
+    if (isArrayClass(clazz)) {
+        typeTag = JDWP_TYPE_TAG(ARRAY);
+        typeKey = JDWP_TAG(ARRAY);
+    } else {
+        typeTag = isInterface(clazz) ? JDWP_TYPE_TAG(INTERFACE) : JDWP_TYPE_TAG(CLASS);
+        if (JNI_FUNC_PTR(env,IsAssignableFrom)(env, clazz, gdata->stringClass)) {
+            typeKey = JDWP_TAG(STRING);
+        } else if (JNI_FUNC_PTR(env,IsAssignableFrom)(env, clazz, gdata->threadClass)) {
+            typeKey = JDWP_TAG(THREAD);
+        } else if (JNI_FUNC_PTR(env,IsAssignableFrom)(env, clazz, gdata->threadGroupClass)) {
+            typeKey = JDWP_TAG(THREAD_GROUP);
+        } else if (JNI_FUNC_PTR(env,IsAssignableFrom)(env, clazz, gdata->classLoaderClass)) {
+            typeKey = JDWP_TAG(CLASS_LOADER);
+        } else if (JNI_FUNC_PTR(env,IsAssignableFrom)(env, clazz, gdata->classClass)) {
+            typeKey = JDWP_TAG(CLASS_OBJECT);
+        } else {
+            typeKey = JDWP_TAG(OBJECT);
+        }
+    }
+    tags = TYPE_TAGS_CACHED | ((jlong)(typeTag & 0xff) << 8) | (typeKey & 0xff);
+
+    /* Racing threads store the same value */
+    if (typeTagEnv != NULL) {
+        (void)JVMTI_FUNC_PTR(typeTagEnv,SetTag)(typeTagEnv, clazz, tags);
+    }
+    return tags;
+}
+
 jbyte
 specificTypeKey(JNIEnv *env, jobject object)
 {
+    jclass clazz;
+    jlong tags;
+
     if (object == NULL) {
         return JDWP_TAG(OBJECT);
-    } else if (JNI_FUNC_PTR(env,IsInstanceOf)(env, object, gdata->stringClass)) {
-        return JDWP_TAG(STRING);
-    } else if (JNI_FUNC_PTR(env,IsInstanceOf)(env, object, gdata->threadClass)) {
-        return JDWP_TAG(THREAD);
-    } else if (JNI_FUNC_PTR(env,IsInstanceOf)(env, object, gdata->threadGroupClass)) {
-        return JDWP_TAG(THREAD_GROUP);
-    } else if (JNI_FUNC_PTR(env,IsInstanceOf)(env, object, gdata->classLoaderClass)) {
-        return JDWP_TAG(CLASS_LOADER);
-    } else if (JNI_FUNC_PTR(env,IsInstanceOf)(env, object, gdata->classClass)) {
-        return JDWP_TAG(CLASS_OBJECT);
-    } else {
-        jboolean classIsArray;
-
-        WITH_LOCAL_REFS(env, 1) {
-            jclass clazz;
-            clazz = JNI_FUNC_PTR(env,GetObjectClass)(env, object);
-            classIsArray = isArrayClass(clazz);
-        } END_WITH_LOCAL_REFS(env);
-
-        return (classIsArray ? JDWP_TAG(ARRAY) : JDWP_TAG(OBJECT));
     }
+    // ANDROID-CHANGED: Classified by the object's class, see classTypeTags.
+    clazz = JNI_FUNC_PTR(env,GetObjectClass)(env, object);
+    tags = classTypeTags(clazz);
+    JNI_FUNC_PTR(env,DeleteLocalRef)(env, clazz);
+    return (jbyte)(tags & 0xff);
 }
 
 static void
@@ -678,17 +766,8 @@ filterDebugThreads(jthread *threads, int count)
 jbyte
 referenceTypeTag(jclass clazz)
 {
-    jbyte tag;
-
-    if (isInterface(clazz)) {
-        tag = JDWP_TYPE_TAG(INTERFACE);
-    } else if (isArrayClass(clazz)) {
-        tag = JDWP_TYPE_TAG(ARRAY);
-    } else {
-        tag = JDWP_TYPE_TAG(CLASS);
-    }
-
-    return tag;
+    // ANDROID-CHANGED: Cached, see classTypeTags.
+    return (jbyte)((classTypeTags(clazz) >> 8) & 0xff);
 }
 
 /**
@@ -2680,6 +2759,9 @@ classInstanceCounts(jint classCount, jclass *classes, jlong *counts)
     ClassCountData     data;
     jvmtiError         error;
     jvmtiEnv          *jvmti;
+    JNIEnv            *env;
+    jboolean           countClassObjects;
+    jint               heapFilter;
     int                i;
 
     /* Check interface assumptions */
@@ -2703,6 +2785,9 @@ classInstanceCounts(jint classCount, jclass *classes, jlong *counts)
     data.classCount   = classCount;
     data.counts       = counts;
 
+    env = getEnv();
+    countClassObjects = JNI_FALSE;
+
     error = JVMTI_ERROR_NONE;
     /* Set tags on classes, use index in classes[] as the tag value. */
     error             = JVMTI_ERROR_NONE;
@@ -2710,6 +2795,10 @@ classInstanceCounts(jint classCount, jclass *classes, jlong *counts)
         if (classes[i] != NULL) {
             jlong tag;
 
+            if (isSameObject(env, classes[i], gdata->classClass)) {
+                countClassObjects = JNI_TRUE;
+            }
+
             tag = INDEX2CLASSTAG(i);
             error = JVMTI_FUNC_PTR(jvmti,SetTag) (jvmti, classes[i], tag);
             if ( error != JVMTI_ERROR_NONE ) {
@@ -2741,12 +2830,24 @@ classInstanceCounts(jint classCount, jclass *classes, jlong *counts)
              */
             data.negObjTag = -INDEX2CLASSTAG(classCount);
 
+            /* ANDROID-CHANGED: As all counted objects are tagged, leave
+             *   tagged objects out of the callbacks, so that an object is
+             *   reported for its first reference only instead of for every
+             *   reference to it. Not when counting java.lang.Class
+             *   instances, since the supplied classes are tagged before
+             *   they are counted.
+             */
+            heapFilter = JVMTI_HEAP_FILTER_CLASS_UNTAGGED;
+            if (!countClassObjects) {
+                heapFilter |= JVMTI_HEAP_FILTER_TAGGED;
+            }
+
             /* Setup callbacks, only using object reference callback */
             heap_callbacks.heap_reference_callback = &cbObjectCounterFromRef;
 
             /* Follow references, no initiating object, tagged classes only */
             error = JVMTI_FUNC_PTR(jvmti,FollowReferences)
-                          (jvmti, JVMTI_HEAP_FILTER_CLASS_UNTAGGED,
+                          (jvmti, heapFilter,
                            NULL, NULL, &heap_callbacks, &data);
 
         } else {
@@ -2759,7 +2860,8 @@ classInstanceCounts(jint classCount, jclass *classes, jlong *counts)
 
             /* FIXUP: Need some kind of trigger here to avoid excessive GC's? */
             error = JVMTI_FUNC_PTR(jvmti,ForceGarbageCollection)(jvmti);
-            if ( error != JVMTI_ERROR_NONE ) {
+            /* ANDROID-CHANGED: Iterate when the GC worked, not when it failed. */
+            if ( error == JVMTI_ERROR_NONE ) {
 
                 /* Setup callbacks, just need object callback */
                 heap_callbacks.heap_iteration_callback = &cbObjectCounter;
@@ -52,6 +52,7 @@
 #include "util_md.h"
 #include "error_messages.h"
 #include "debugInit.h"
+#include "lightLock.h"
 
 /* Get access to Native Platform Toolkit functions */
 #include "npt.h"
@@ -160,6 +161,9 @@ typedef struct {
      /* ANDROID-CHANGED: Need to keep track of if ddm is initially active. */
      jboolean ddmInitiallyActive;
 
+     /* ANDROID-CHANGED: socketbuffer option, 0 for the transport's default */
+     jint transportBufferSize;
+
 } BackendGlobalData;
 
 extern BackendGlobalData * gdata;
@@ -235,6 +239,8 @@ typedef struct {
     jmethodID   method;
     jlocation   location;
     jobject     object; /* possibly an exception or user object */
+    /* ANDROID-CHANGED: Made up by a method watch, see eventHandler.c */
+    jboolean    synthetic;
 
     union {
 
@@ -343,6 +349,16 @@ jvmtiError objectReferrers(jobject obj, ObjectBatch *referrers, int maxObjects);
 
 // ANDROID-CHANGED: Helper function to get current time in milliseconds on CLOCK_MONOTONIC
 jlong milliTime(void);
+// ANDROID-CHANGED: Helper function to get current time in nanoseconds on CLOCK_MONOTONIC
+jlong nanoTime(void);
+
+// ANDROID-CHANGED: 64-bit FNV-1a hash of a byte array, used to identify bytecode and
+// constant pool contents. The JDI front-end computes the same function.
+jlong contentHash(const unsigned char *bytes, jint length);
+// ANDROID-CHANGED: Write the content hash and length of a byte array followed by the
+// requested range of it. A negative length means up to the end.
+void writeContentRange(struct PacketOutputStream *out, const unsigned char *bytes,
+                       jint byteCount, jint offset, jint length);
 
 /*
  * Command handling helpers shared among multiple command sets
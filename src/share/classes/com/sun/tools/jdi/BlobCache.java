@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+package com.sun.tools.jdi;
+
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+
+/*
+ * ANDROID-CHANGED: Fetches bytecodes and constant pools with the
+ * Vendor.BytecodeRange and Vendor.ConstantPoolRange commands, in chunks
+ * of at most CHUNK_SIZE bytes. When the "com.sun.tools.jdi.blobCache"
+ * property names a directory, blobs are also kept there under their
+ * content hash, so that later sessions against the same code only ask
+ * the target for the hash. Cached blobs are read by mapping their file.
+ */
+class BlobCache {
+    static final String DIRECTORY_PROPERTY = "com.sun.tools.jdi.blobCache";
+    static final int CHUNK_SIZE =
+        Integer.getInteger("com.sun.tools.jdi.blobChunkSize", 256 * 1024);
+
+    /*
+     * One reply of a range command.
+     */
+    static final class Range {
+        final int count;        // constant pool count, 0 for bytecodes
+        final long hash;
+        final int totalLength;
+        final byte[] bytes;
+
+        Range(int count, long hash, int totalLength, byte[] bytes) {
+            this.count = count;
+            this.hash = hash;
+            this.totalLength = totalLength;
+            this.bytes = bytes;
+        }
+    }
+
+    interface Source {
+        Range fetch(int offset, int length) throws JDWPException;
+    }
+
+    private final File directory;   // null if there is no persistent cache
+
+    BlobCache() {
+        String path = System.getProperty(DIRECTORY_PROPERTY);
+        File dir = (path == null) ? null : new File(path);
+        if (dir != null && !dir.isDirectory() && !dir.mkdirs()) {
+            dir = null;
+        }
+        directory = dir;
+    }
+
+    boolean isPersistent() {
+        return directory != null;
+    }
+
+    /*
+     * The 64-bit FNV-1a hash, as computed by the back-end's contentHash.
+     */
+    static long contentHash(ByteBuffer buffer) {
+        long hash = 0xcbf29ce484222325L;
+        int limit = buffer.limit();
+        for (int i = 0; i < limit; i++) {
+            hash ^= (buffer.get(i) & 0xff);
+            hash *= 0x100000001b3L;
+        }
+        return hash;
+    }
+
+    /*
+     * Returns the whole blob, or null if it changed on the target while
+     * it was being fetched in pieces.
+     */
+    Range fetch(Source source) throws JDWPException {
+        // Without a cache the first chunk usually is the whole blob.
+        Range head = source.fetch(0, (directory == null) ? CHUNK_SIZE : 0);
+        int total = head.totalLength;
+        if (head.bytes.length == total) {
+            return head;
+        }
+
+        ByteBuffer cached = map(head.hash, total);
+        if (cached != null) {
+            byte[] bytes = new byte[total];
+            cached.get(bytes);
+            return new Range(head.count, head.hash, total, bytes);
+        }
+
+        byte[] bytes = fetchRest(source, head);
+        return (bytes == null) ? null :
+                   new Range(head.count, head.hash, total, bytes);
+    }
+
+    /*
+     * Like fetch, for a blob whose hash and length are already known.
+     * A cached blob is returned as a read-only mapping of its file.
+     */
+    ByteBuffer fetchBuffer(Source source, long hash, int totalLength)
+                                                throws JDWPException {
+        ByteBuffer cached = map(hash, totalLength);
+        if (cached != null) {
+            return cached;
+        }
+        byte[] bytes = fetchRest(source,
+                                 new Range(0, hash, totalLength, new byte[0]));
+        return (bytes == null) ? null : ByteBuffer.wrap(bytes);
+    }
+
+    private byte[] fetchRest(Source source, Range head) throws JDWPException {
+        int total = head.totalLength;
+        byte[] bytes = new byte[total];
+        System.arraycopy(head.bytes, 0, bytes, 0, head.bytes.length);
+        int offset = head.bytes.length;
+        while (offset < total) {
+            Range range = source.fetch(offset, Math.min(CHUNK_SIZE, total - offset));
+            if (range.hash != head.hash || range.totalLength != total ||
+                range.bytes.length == 0) {
+                return null;
+            }
+            System.arraycopy(range.bytes, 0, bytes, offset, range.bytes.length);
+            offset += range.bytes.length;
+        }
+        if (contentHash(ByteBuffer.wrap(bytes)) != head.hash) {
+            return null;
+        }
+        store(head.hash, bytes);
+        return bytes;
+    }
+
+    private File file(long hash) {
+        return new File(directory, String.format("%016x.blob", hash));
+    }
+
+    /*
+     * Cache failures are never fatal; a blob that cannot be read or does
+     * not match its name is fetched from the target again.
+     */
+    private ByteBuffer map(long hash, int length) {
+        if (directory == null) {
+            return null;
+        }
+        File f = file(hash);
+        if (f.length() != length) {
+            return null;
+        }
+        try (RandomAccessFile in = new RandomAccessFile(f, "r")) {
+            // The mapping stays valid after the file is closed.
+            ByteBuffer buffer =
+                in.getChannel().map(FileChannel.MapMode.READ_ONLY, 0, length);
+            return (contentHash(buffer) == hash) ? buffer : null;
+        } catch (IOException exc) {
+            return null;
+        }
+    }
+
+    private void store(long hash, byte[] bytes) {
+        if (directory == null) {
+            return;
+        }
+        File tmp = null;
+        try {
+            // Write aside and rename so concurrent readers never see a
+            // partial blob.
+            tmp = File.createTempFile("blob", ".tmp", directory);
+            try (FileOutputStream out = new FileOutputStream(tmp)) {
+                out.write(bytes);
+            }
+            if (tmp.renameTo(file(hash))) {
+                tmp = null;
+            }
+        } catch (IOException exc) {
+            // Leave it uncached
+        } finally {
+            if (tmp != null) {
+                tmp.delete();
+            }
+        }
+    }
+}
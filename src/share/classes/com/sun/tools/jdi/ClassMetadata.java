@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 1999, 2017, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+package com.sun.tools.jdi;
+
+import com.sun.jdi.*;
+
+import java.nio.BufferUnderflowException;
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.List;
+
+/*
+ * ANDROID-CHANGED: The decoded class metadata blob of Vendor.ClassMetadata,
+ * paired with the session specific field and method IDs from
+ * Vendor.ClassMetadataKey. See the JDWP specification of those commands
+ * for the blob format.
+ */
+class ClassMetadata {
+    static final int VERSION = 1;
+
+    // Item states
+    static final byte ABSENT = 0;
+    static final byte PRESENT = 1;
+    static final byte ASK = 2;
+
+    static final class Member {
+        final String name;
+        final String signature;
+        final String genericSignature;
+        final int modifiers;
+
+        Member(ByteBuffer buffer) {
+            name = readString(buffer);
+            signature = readString(buffer);
+            genericSignature = readString(buffer);
+            modifiers = buffer.getInt();
+        }
+    }
+
+    static final class LineTable {
+        final long start;
+        final long end;
+        final long[] codeIndexes;
+        final int[] lineNumbers;
+
+        LineTable(ByteBuffer buffer) {
+            start = buffer.getLong();
+            end = buffer.getLong();
+            int count = readCount(buffer);
+            codeIndexes = new long[count];
+            lineNumbers = new int[count];
+            for (int i = 0; i < count; i++) {
+                codeIndexes[i] = buffer.getLong();
+                lineNumbers[i] = buffer.getInt();
+            }
+        }
+
+        LineTable(JDWP.Method.LineTable reply) {
+            start = reply.start;
+            end = reply.end;
+            int count = reply.lines.length;
+            codeIndexes = new long[count];
+            lineNumbers = new int[count];
+            for (int i = 0; i < count; i++) {
+                codeIndexes[i] = reply.lines[i].lineCodeIndex;
+                lineNumbers[i] = reply.lines[i].lineNumber;
+            }
+        }
+    }
+
+    static final class Variable {
+        final long codeIndex;
+        final String name;
+        final String signature;
+        final String genericSignature;
+        final int length;
+        final int slot;
+
+        Variable(ByteBuffer buffer) {
+            codeIndex = buffer.getLong();
+            name = readString(buffer);
+            signature = readString(buffer);
+            genericSignature = readString(buffer);
+            length = buffer.getInt();
+            slot = buffer.getInt();
+        }
+
+        Variable(JDWP.Method.VariableTableWithGeneric.SlotInfo si) {
+            codeIndex = si.codeIndex;
+            name = si.name;
+            signature = si.signature;
+            genericSignature = si.genericSignature;
+            length = si.length;
+            slot = si.slot;
+        }
+    }
+
+    static final class VariableTable {
+        final int argCnt;
+        final Variable[] slots;
+
+        VariableTable(ByteBuffer buffer) {
+            argCnt = buffer.getInt();
+            slots = new Variable[readCount(buffer)];
+            for (int i = 0; i < slots.length; i++) {
+                slots[i] = new Variable(buffer);
+            }
+        }
+
+        VariableTable(JDWP.Method.VariableTableWithGeneric reply) {
+            argCnt = reply.argCnt;
+            slots = new Variable[reply.slots.length];
+            for (int i = 0; i < slots.length; i++) {
+                slots[i] = new Variable(reply.slots[i]);
+            }
+        }
+    }
+
+    static final class MethodData {
+        final Member member;
+        final byte linesState;
+        final LineTable lines;
+        final byte variablesState;
+        final VariableTable variables;
+
+        MethodData(ByteBuffer buffer) {
+            member = new Member(buffer);
+            linesState = buffer.get();
+            lines = (linesState == PRESENT) ? new LineTable(buffer) : null;
+            variablesState = buffer.get();
+            variables = (variablesState == PRESENT) ?
+                            new VariableTable(buffer) : null;
+        }
+    }
+
+    final byte sourceFileState;
+    final String sourceFile;
+    final byte sourceDebugExtensionState;
+    final String sourceDebugExtension;
+    private final Member[] fields;
+    private final MethodData[] methods;
+    private final long[] fieldIDs;
+    private final long[] methodIDs;
+
+    private ClassMetadata(ByteBuffer buffer, long[] fieldIDs, long[] methodIDs) {
+        sourceFileState = buffer.get();
+        sourceFile = (sourceFileState == PRESENT) ? readString(buffer) : null;
+        sourceDebugExtensionState = buffer.get();
+        sourceDebugExtension = (sourceDebugExtensionState == PRESENT) ?
+                                   readString(buffer) : null;
+        fields = new Member[readCount(buffer)];
+        for (int i = 0; i < fields.length; i++) {
+            fields[i] = new Member(buffer);
+        }
+        methods = new MethodData[readCount(buffer)];
+        for (int i = 0; i < methods.length; i++) {
+            methods[i] = new MethodData(buffer);
+        }
+        this.fieldIDs = fieldIDs;
+        this.methodIDs = methodIDs;
+    }
+
+    /*
+     * Returns null if the blob is of another format version, is malformed
+     * or does not describe the given number of fields and methods.
+     */
+    static ClassMetadata parse(ByteBuffer buffer, long[] fieldIDs, long[] methodIDs) {
+        try {
+            if (buffer.getInt() != VERSION) {
+                return null;
+            }
+            ClassMetadata metadata = new ClassMetadata(buffer, fieldIDs, methodIDs);
+            if (buffer.hasRemaining() ||
+                metadata.fields.length != fieldIDs.length ||
+                metadata.methods.length != methodIDs.length) {
+                return null;
+            }
+            return metadata;
+        } catch (BufferUnderflowException | IllegalArgumentException exc) {
+            return null;
+        }
+    }
+
+    List<Field> fields(VirtualMachineImpl vm, ReferenceTypeImpl declaringType) {
+        List<Field> list = new ArrayList<Field>(fields.length);
+        for (int i = 0; i < fields.length; i++) {
+            Member fi = fields[i];
+            list.add(new FieldImpl(vm, declaringType, fieldIDs[i],
+                                   fi.name, fi.signature,
+                                   fi.genericSignature, fi.modifiers));
+        }
+        return list;
+    }
+
+    List<Method> methods(VirtualMachineImpl vm, ReferenceTypeImpl declaringType) {
+        List<Method> list = new ArrayList<Method>(methods.length);
+        for (int i = 0; i < methods.length; i++) {
+            Member mi = methods[i].member;
+            MethodImpl method = MethodImpl.createMethodImpl(vm, declaringType,
+                                                            methodIDs[i],
+                                                            mi.name, mi.signature,
+                                                            mi.genericSignature,
+                                                            mi.modifiers);
+            if (method instanceof ConcreteMethodImpl) {
+                ((ConcreteMethodImpl)method).setMetadata(methods[i]);
+            }
+            list.add(method);
+        }
+        return list;
+    }
+
+    private static int readCount(ByteBuffer buffer) {
+        int count = buffer.getInt();
+        if (count < 0 || count > buffer.remaining()) {
+            throw new IllegalArgumentException();
+        }
+        return count;
+    }
+
+    private static String readString(ByteBuffer buffer) {
+        byte[] bytes = new byte[readCount(buffer)];
+        buffer.get(bytes);
+        return new String(bytes, StandardCharsets.UTF_8);
+    }
+}
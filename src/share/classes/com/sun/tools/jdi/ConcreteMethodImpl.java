@@ -80,6 +80,8 @@ public class ConcreteMethodImpl extends MethodImpl {
     private long lastIndex = -1;
     private SoftReference<byte[]> bytecodesRef = null;
     private int argSlotCount = -1;
+    // ANDROID-CHANGED: Tables from the metadata cache, see ClassMetadata
+    private ClassMetadata.MethodData metadata = null;
 
     ConcreteMethodImpl(VirtualMachine vm, ReferenceTypeImpl declaringType,
                        long ref,
@@ -91,6 +93,11 @@ public class ConcreteMethodImpl extends MethodImpl {
               genericSignature, modifiers);
     }
 
+    // ANDROID-CHANGED: Called right after construction, see ClassMetadata
+    void setMetadata(ClassMetadata.MethodData metadata) {
+        this.metadata = metadata;
+    }
+
     public Location location() {
         if (location == null) {
             getBaseLocations();
@@ -250,8 +257,12 @@ public class ConcreteMethodImpl extends MethodImpl {
                                      bytecodesRef.get();
         if (bytecodes == null) {
             try {
-                bytecodes = JDWP.Method.Bytecodes.
-                                 process(vm, declaringType, ref).bytes;
+                // ANDROID-CHANGED: Prefer the hashed and chunked vendor command
+                bytecodes = fetchBytecodeRanges();
+                if (bytecodes == null) {
+                    bytecodes = JDWP.Method.Bytecodes.
+                                     process(vm, declaringType, ref).bytes;
+                }
             } catch (JDWPException exc) {
                 throw exc.toJDIException();
             }
@@ -265,6 +276,36 @@ public class ConcreteMethodImpl extends MethodImpl {
         return bytecodes.clone();
     }
 
+    /*
+     * ANDROID-CHANGED: Fetch the bytecodes through the BlobCache, or return
+     * null if the target does not support Vendor.BytecodeRange or the
+     * method was redefined while it was being fetched.
+     */
+    private byte[] fetchBytecodeRanges() throws JDWPException {
+        if (!vm.vendorContentRange) {
+            return null;
+        }
+        try {
+            BlobCache.Range range = vm.blobCache.fetch(new BlobCache.Source() {
+                public BlobCache.Range fetch(int offset, int length)
+                                                throws JDWPException {
+                    JDWP.Vendor.BytecodeRange reply =
+                        JDWP.Vendor.BytecodeRange.process(vm, declaringType, ref,
+                                                          offset, length);
+                    return new BlobCache.Range(0, reply.hash, reply.totalLength,
+                                               reply.bytes);
+                }
+            });
+            return (range == null) ? null : range.bytes;
+        } catch (JDWPException exc) {
+            if (exc.errorCode() == JDWP.Error.NOT_IMPLEMENTED) {
+                vm.vendorContentRange = false;
+                return null;
+            }
+            throw exc;
+        }
+    }
+
     int argSlotCount() throws AbsentInformationException {
         if (argSlotCount == -1) {
             getVariables();
@@ -353,26 +394,30 @@ public class ConcreteMethodImpl extends MethodImpl {
             return info;
         }
 
-        JDWP.Method.LineTable lntab = null;
-        try {
-            lntab = JDWP.Method.LineTable.process(vm, declaringType, ref);
-        } catch (JDWPException exc) {
-            /*
-             * Note: the absent info error shouldn't happen here
-             * because the first and last index are always available.
-             */
-            throw exc.toJDIException();
+        // ANDROID-CHANGED: Use the cached line table if there is one
+        ClassMetadata.LineTable lntab = (metadata == null) ? null : metadata.lines;
+        if (lntab == null) {
+            try {
+                lntab = new ClassMetadata.LineTable(
+                    JDWP.Method.LineTable.process(vm, declaringType, ref));
+            } catch (JDWPException exc) {
+                /*
+                 * Note: the absent info error shouldn't happen here
+                 * because the first and last index are always available.
+                 */
+                throw exc.toJDIException();
+            }
         }
 
-        int count  = lntab.lines.length;
+        int count  = lntab.codeIndexes.length;
 
         List<Location> lineLocations = new ArrayList<Location>(count);
         Map<Integer, List<Location>>lineMapper = new HashMap<Integer, List<Location>>();
         int lowestLine = -1;
         int highestLine = -1;
         for (int i = 0; i < count; i++) {
-            long bci = lntab.lines[i].lineCodeIndex;
-            int lineNumber = lntab.lines[i].lineNumber;
+            long bci = lntab.codeIndexes[i];
+            int lineNumber = lntab.lineNumbers[i];
 
             /*
              * Some compilers will point multiple consecutive
@@ -382,7 +427,7 @@ public class ConcreteMethodImpl extends MethodImpl {
              * to record only the last line entry at a particular
              * location.
              */
-            if ((i + 1 == count) || (bci != lntab.lines[i+1].lineCodeIndex)) {
+            if ((i + 1 == count) || (bci != lntab.codeIndexes[i+1])) {
                 // Remember the largest/smallest line number
                 if (lineNumber > highestLine) {
                     highestLine = lineNumber;
@@ -485,16 +530,27 @@ public class ConcreteMethodImpl extends MethodImpl {
             return getVariables1_4();
         }
 
-        JDWP.Method.VariableTableWithGeneric vartab = null;
-        try {
-            vartab = JDWP.Method.VariableTableWithGeneric.
-                                     process(vm, declaringType, ref);
-        } catch (JDWPException exc) {
-            if (exc.errorCode() == JDWP.Error.ABSENT_INFORMATION) {
+        // ANDROID-CHANGED: Use the cached variable table if there is one
+        ClassMetadata.VariableTable vartab = null;
+        if (metadata != null) {
+            if (metadata.variablesState == ClassMetadata.ABSENT) {
                 absentVariableInformation = true;
                 throw new AbsentInformationException();
-            } else {
-                throw exc.toJDIException();
+            }
+            vartab = metadata.variables;
+        }
+        if (vartab == null) {
+            try {
+                vartab = new ClassMetadata.VariableTable(
+                    JDWP.Method.VariableTableWithGeneric.
+                                     process(vm, declaringType, ref));
+            } catch (JDWPException exc) {
+                if (exc.errorCode() == JDWP.Error.ABSENT_INFORMATION) {
+                    absentVariableInformation = true;
+                    throw new AbsentInformationException();
+                } else {
+                    throw exc.toJDIException();
+                }
             }
         }
 
@@ -503,7 +559,7 @@ public class ConcreteMethodImpl extends MethodImpl {
         int count = vartab.slots.length;
         List<LocalVariable> variables = new ArrayList<LocalVariable>(count);
         for (int i=0; i<count; i++) {
-            JDWP.Method.VariableTableWithGeneric.SlotInfo si = vartab.slots[i];
+            ClassMetadata.Variable si = vartab.slots[i];
 
             /*
              * Skip "this*" entries because they are never real
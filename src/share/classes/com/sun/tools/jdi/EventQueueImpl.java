@@ -33,11 +33,41 @@ import java.util.*;
 
 public class EventQueueImpl extends MirrorImpl implements EventQueue {
 
+    /**
+     * ANDROID-CHANGED: Key of the event request property which selects
+     * what happens to the request's events when an event queue is full.
+     * With "drop" a new event set is discarded. With "coalesce" it
+     * replaces the one still queued for the same request, if any, and is
+     * otherwise discarded. Either way the oldest queued set which may
+     * be discarded makes room for sets which may not. Only event sets
+     * which suspend nothing are ever discarded.
+     *
+     * @see com.sun.jdi.request.EventRequest#putProperty
+     */
+    public static final String OVERFLOW_POLICY_PROPERTY =
+        "com.sun.tools.jdi.overflowPolicy";
+
+    static final int OVERFLOW_KEEP = 0;
+    static final int OVERFLOW_DROP = 1;
+    static final int OVERFLOW_COALESCE = 2;
+
+    /*
+     * ANDROID-CHANGED: Number of queued event sets above which the
+     * overflow policies apply. Sets which may not be discarded are still
+     * queued above it; those are bounded by the event flow control in
+     * TargetVM instead.
+     */
+    private static final int CAPACITY =
+        Integer.getInteger("com.sun.tools.jdi.eventQueueCapacity", 2000);
+
     /*
      * Note this is not a synchronized list. Iteration/update should be
      * protected through the 'this' monitor.
      */
-    LinkedList<EventSet> eventSets = new LinkedList<EventSet>();
+    ArrayDeque<EventSet> eventSets = new ArrayDeque<EventSet>();
+    // Number of the queued sets whose overflow policy is not OVERFLOW_KEEP
+    private int discardableCount = 0;
+    private long discardedCount = 0;
 
     TargetVM target;
     boolean closed = false;
@@ -59,15 +89,104 @@ public class EventQueueImpl extends MirrorImpl implements EventQueue {
         return System.identityHashCode(this);
     }
 
+    static int overflowPolicy(Object propertyValue) {
+        if ("drop".equals(propertyValue)) {
+            return OVERFLOW_DROP;
+        } else if ("coalesce".equals(propertyValue)) {
+            return OVERFLOW_COALESCE;
+        } else {
+            return OVERFLOW_KEEP;
+        }
+    }
+
     synchronized void enqueue(EventSet eventSet) {
+        EventSetImpl set = (EventSetImpl)eventSet;
+        if (!closed && (eventSets.size() >= CAPACITY) && !makeRoom(set)) {
+            discarded(set);
+            return;
+        }
         eventSets.add(eventSet);
+        if (set.overflowPolicy() != OVERFLOW_KEEP) {
+            discardableCount++;
+        }
         notifyAll();
     }
 
+    /*
+     * ANDROID-CHANGED: Called when the queue is full. Discards a queued
+     * set to make room for the given one, following the overflow
+     * policies. Returns false if the given set should be discarded
+     * instead.
+     */
+    private boolean makeRoom(EventSetImpl set) {
+        int policy = set.overflowPolicy();
+        if (policy == OVERFLOW_DROP) {
+            return false;
+        }
+        EventSetImpl victim = null;
+        for (EventSet queued : eventSets) {
+            EventSetImpl queuedSet = (EventSetImpl)queued;
+            if (queuedSet.overflowPolicy() == OVERFLOW_KEEP) {
+                continue;
+            }
+            if (policy == OVERFLOW_COALESCE &&
+                queuedSet.overflowPolicy() == OVERFLOW_COALESCE &&
+                queuedSet.coalesceRequestID() == set.coalesceRequestID()) {
+                victim = queuedSet;
+                break;
+            }
+            if (victim == null && policy == OVERFLOW_KEEP) {
+                // The oldest set that may be discarded
+                victim = queuedSet;
+            }
+        }
+        if (victim == null) {
+            return policy == OVERFLOW_KEEP;
+        }
+        // Compare identities: EventSetImpl.equals is List.equals
+        Iterator<EventSet> iter = eventSets.iterator();
+        while (iter.hasNext()) {
+            if (iter.next() == victim) {
+                iter.remove();
+                break;
+            }
+        }
+        discardableCount--;
+        discarded(victim);
+        return true;
+    }
+
+    private void discarded(EventSetImpl set) {
+        discardedCount++;
+        set.discardedByQueue();
+        if ((vm.traceFlags & VirtualMachine.TRACE_EVENTS) != 0) {
+            vm.printTrace("Event queue full, discarded event set " +
+                          discardedCount + ((set.overflowPolicy() ==
+                                             OVERFLOW_COALESCE) ?
+                                            " (coalesced)" : ""));
+        }
+    }
+
     synchronized int size() {
         return eventSets.size();
     }
 
+    /*
+     * ANDROID-CHANGED: The number of queued sets which may not be
+     * discarded. These are what event flow control has to limit.
+     */
+    synchronized int undiscardableSize() {
+        return eventSets.size() - discardableCount;
+    }
+
+    private EventSetImpl removeFirst() {
+        EventSetImpl eventSet = (EventSetImpl)eventSets.removeFirst();
+        if (eventSet.overflowPolicy() != OVERFLOW_KEEP) {
+            discardableCount--;
+        }
+        return eventSet;
+    }
+
     synchronized void close() {
         if (!closed) {
             closed = true; // OK for this the be first since synchronized
@@ -162,7 +281,7 @@ public class EventQueueImpl extends MirrorImpl implements EventQueue {
                  * If there's already something there, no need
                  * for anything elaborate.
                  */
-                eventSet = (EventSetImpl)eventSets.removeFirst();
+                eventSet = removeFirst();
             } else {
                 /*
                  * If a timeout was specified, create a thread to
@@ -199,7 +318,7 @@ public class EventQueueImpl extends MirrorImpl implements EventQueue {
                         throw new VMDisconnectedException();
                     }
                 } else {
-                    eventSet = (EventSetImpl)eventSets.removeFirst();
+                    eventSet = removeFirst();
                 }
             }
         }
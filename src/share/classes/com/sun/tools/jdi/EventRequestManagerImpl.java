@@ -30,6 +30,7 @@ import com.sun.jdi.request.*;
 import com.sun.tools.jdi.JDWP;
 
 import java.util.*;
+import java.util.concurrent.ConcurrentHashMap;
 
 /**
  * This interface is used to create and remove Breakpoints, Watchpoints,
@@ -46,6 +47,36 @@ class EventRequestManagerImpl extends MirrorImpl
     List<? extends EventRequest>[] requestLists;
     private static int methodExitEventCmd = 0;
 
+    // ANDROID-CHANGED: Overflow policies of the enabled requests which
+    // have one, by request ID. Read by the transport reader thread, which
+    // must not wait for request locks. See EventQueueImpl.
+    private final Map<Integer, Integer> overflowPolicies =
+        new ConcurrentHashMap<Integer, Integer>();
+
+    /*
+     * ANDROID-CHANGED: Request property giving the number of frames the
+     * target should send along with each event that suspends, so that
+     * the stack, 'this' and the locals of the top frame are known without
+     * further commands. See the Prefetch modifier in jdwp.spec. The system
+     * property of the same name sets the default for all requests of
+     * the event kinds that support it; 0, the default, turns it off.
+     */
+    static final String PREFETCH_FRAMES_PROPERTY =
+        "com.sun.tools.jdi.prefetchFrames";
+    private static final int DEFAULT_PREFETCH_FRAMES =
+        Integer.getInteger(PREFETCH_FRAMES_PROPERTY, 0);
+
+    /*
+     * ANDROID-CHANGED: Request property naming the one Method whose
+     * entries or exits a MethodEntryRequest or MethodExitRequest is for.
+     * The target then only has to watch that method instead of reporting
+     * every method entry or exit. See the MethodOnly modifier in jdwp.spec.
+     * A target without it is sent a ClassOnly modifier for the declaring
+     * type instead, and the events of the other methods of that type are
+     * dropped here.
+     */
+    static final String METHOD_ONLY_PROPERTY = "com.sun.tools.jdi.methodOnly";
+
     static int JDWPtoJDISuspendPolicy(byte jdwpPolicy) {
         switch(jdwpPolicy) {
             case JDWP.SuspendPolicy.ALL:
@@ -97,6 +128,11 @@ class EventRequestManagerImpl extends MirrorImpl
         boolean deleted = false;
         byte suspendPolicy = JDWP.SuspendPolicy.ALL;
         private Map<Object, Object> clientProperties = null;
+        // ANDROID-CHANGED: See EventQueueImpl.OVERFLOW_POLICY_PROPERTY
+        private int overflowPolicy = EventQueueImpl.OVERFLOW_KEEP;
+        // ANDROID-CHANGED: The method of METHOD_ONLY_PROPERTY if the
+        // target only filters by its declaring type. See setClassRequest.
+        private volatile MethodImpl classOnlyMethod = null;
 
         EventRequestImpl() {
             super(EventRequestManagerImpl.this.vm);
@@ -194,19 +230,133 @@ class EventRequestManagerImpl extends MirrorImpl
          * set (enable) the event request
          */
         synchronized void set() {
-            JDWP.EventRequest.Set.Modifier[] mods =
-                filters.toArray(
-                    new JDWP.EventRequest.Set.Modifier[filters.size()]);
+            int frames = vm.vendorPrefetch ? prefetchFrames() : 0;
+            MethodImpl method = methodOnly();
+            classOnlyMethod = null;
+            if (method != null && !vm.vendorMethodOnly) {
+                id = setClassRequest(frames, method);
+            } else {
+                id = setRequest(frames, method);
+            }
+            isEnabled = true;
+            if (overflowPolicy != EventQueueImpl.OVERFLOW_KEEP) {
+                overflowPolicies.put(id, overflowPolicy);
+            }
+        }
+
+        /*
+         * ANDROID-CHANGED: Sends the request, with a Prefetch modifier
+         * if frames is positive and a MethodOnly modifier if method is
+         * not null. A target that does not know these modifiers rejects
+         * them as an illegal argument.
+         */
+        private int setRequest(int frames, MethodImpl method) {
+            List<Object> mods = new ArrayList<Object>(filters);
+            if (frames > 0) {
+                mods.add(JDWP.EventRequest.Set.Modifier.Prefetch.create(frames));
+            }
+            if (method != null) {
+                mods.add(JDWP.EventRequest.Set.Modifier.MethodOnly.create(
+                             (ReferenceTypeImpl)method.declaringType(),
+                             method.ref()));
+            }
             try {
-                id = JDWP.EventRequest.Set.process(vm, (byte)eventCmd(),
-                                                   suspendPolicy, mods).requestID;
+                return JDWP.EventRequest.Set.process(vm, (byte)eventCmd(),
+                          suspendPolicy,
+                          mods.toArray(new JDWP.EventRequest.Set.Modifier[
+                                           mods.size()])).requestID;
             } catch (JDWPException exc) {
+                if ((frames > 0 || method != null) &&
+                    exc.errorCode() == JDWP.Error.ILLEGAL_ARGUMENT) {
+                    // Throws if another modifier was at fault
+                    int requestID = (method != null) ?
+                                        setClassRequest(0, method) :
+                                        setRequest(0, null);
+                    if (frames > 0) {
+                        vm.vendorPrefetch = false;
+                    }
+                    if (method != null) {
+                        vm.vendorMethodOnly = false;
+                    }
+                    return requestID;
+                }
                 throw exc.toJDIException();
             }
-            isEnabled = true;
+        }
+
+        /*
+         * ANDROID-CHANGED: The fallback for a MethodOnly modifier, a
+         * ClassOnly modifier for the declaring type of the method. The
+         * target then reports the other methods of that type too, which
+         * EventSetImpl drops by comparing them with classOnlyMethod().
+         */
+        private int setClassRequest(int frames, MethodImpl method) {
+            filters.add(JDWP.EventRequest.Set.Modifier.ClassOnly
+                            .create((ReferenceTypeImpl)method.declaringType()));
+            try {
+                int requestID = setRequest(frames, null);
+                classOnlyMethod = method;
+                return requestID;
+            } finally {
+                filters.remove(filters.size() - 1);
+            }
+        }
+
+        /*
+         * ANDROID-CHANGED: The method whose events are the only ones
+         * this request is for, if the target could not filter them
+         * itself, or null.
+         */
+        MethodImpl classOnlyMethod() {
+            return classOnlyMethod;
+        }
+
+        private MethodImpl methodOnly() {
+            switch (eventCmd()) {
+                case JDWP.EventKind.METHOD_ENTRY:
+                case JDWP.EventKind.METHOD_EXIT:
+                case JDWP.EventKind.METHOD_EXIT_WITH_RETURN_VALUE:
+                    break;
+                default:
+                    return null;
+            }
+            Object method = getProperty(METHOD_ONLY_PROPERTY);
+            if (!(method instanceof MethodImpl)) {
+                return null;
+            }
+            return (MethodImpl)method;
+        }
+
+        private int prefetchFrames() {
+            switch (eventCmd()) {
+                case JDWP.EventKind.SINGLE_STEP:
+                case JDWP.EventKind.BREAKPOINT:
+                case JDWP.EventKind.EXCEPTION:
+                case JDWP.EventKind.FIELD_ACCESS:
+                case JDWP.EventKind.FIELD_MODIFICATION:
+                case JDWP.EventKind.METHOD_ENTRY:
+                case JDWP.EventKind.METHOD_EXIT:
+                case JDWP.EventKind.METHOD_EXIT_WITH_RETURN_VALUE:
+                case JDWP.EventKind.MONITOR_CONTENDED_ENTER:
+                case JDWP.EventKind.MONITOR_CONTENDED_ENTERED:
+                case JDWP.EventKind.MONITOR_WAIT:
+                case JDWP.EventKind.MONITOR_WAITED:
+                    break;
+                default:
+                    return 0;
+            }
+            if (suspendPolicy == JDWP.SuspendPolicy.NONE) {
+                return 0;
+            }
+            Object frames = getProperty(PREFETCH_FRAMES_PROPERTY);
+            if (frames instanceof Number) {
+                return Math.max(((Number)frames).intValue(), 0);
+            }
+            return DEFAULT_PREFETCH_FRAMES;
         }
 
         synchronized void clear() {
+            overflowPolicies.remove(id);
             try {
                 JDWP.EventRequest.Clear.process(vm, (byte)eventCmd(), id);
             } catch (JDWPException exc) {
@@ -215,6 +365,17 @@ class EventRequestManagerImpl extends MirrorImpl
             isEnabled = false;
         }
 
+        private synchronized void setOverflowPolicy(int policy) {
+            overflowPolicy = policy;
+            if (isEnabled) {
+                if (policy == EventQueueImpl.OVERFLOW_KEEP) {
+                    overflowPolicies.remove(id);
+                } else {
+                    overflowPolicies.put(id, policy);
+                }
+            }
+        }
+
         /**
          * @return a small Map
          * @see #putProperty
@@ -254,6 +415,9 @@ class EventRequestManagerImpl extends MirrorImpl
             } else {
                 getProperties().remove(key);
             }
+            if (EventQueueImpl.OVERFLOW_POLICY_PROPERTY.equals(key)) {
+                setOverflowPolicy(EventQueueImpl.overflowPolicy(value));
+            }
         }
     }
 
@@ -947,6 +1111,19 @@ class EventRequestManagerImpl extends MirrorImpl
         return null;
     }
 
+    /*
+     * ANDROID-CHANGED: The overflow policy of an enabled request, for the
+     * transport reader thread.
+     */
+    int overflowPolicy(int requestId) {
+        Integer policy = overflowPolicies.get(requestId);
+        return (policy == null) ? EventQueueImpl.OVERFLOW_KEEP : policy;
+    }
+
+    boolean hasOverflowPolicies() {
+        return !overflowPolicies.isEmpty();
+    }
+
     List<? extends EventRequest>  requestList(int eventCmd) {
         return requestLists[eventCmd];
     }
@@ -30,6 +30,8 @@ import com.sun.jdi.event.*;
 import com.sun.jdi.request.*;
 
 import java.util.*;
+import java.lang.ref.PhantomReference;
+import java.lang.ref.ReferenceQueue;
 enum EventDestination {UNKNOWN_EVENT, INTERNAL_EVENT, CLIENT_EVENT};
 
 /*
@@ -42,6 +44,8 @@ enum EventDestination {UNKNOWN_EVENT, INTERNAL_EVENT, CLIENT_EVENT};
  * The EventSet is then added to each EventQueue. When an EventSet is
  * removed from an EventQueue, the EventSetImpl.build() method is called.
  * This method reads the packet bytes and creates the actual EventImpl objects.
+ * (ANDROID-CHANGED: The EventImpls only record where their fields are in the
+ * packet. Fields and mirrors are read when an accessor first needs them.)
  * build() also filters out events for our internal handler and puts them in
  * their own EventSet.  This means that the EventImpls that are in the EventSet
  * that is on the queues are all for client requests.
@@ -50,8 +54,25 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
     private static final long serialVersionUID = -4857338819787924570L;
     private VirtualMachineImpl vm; // we implement Mirror
     private Packet pkt;
+    // ANDROID-CHANGED: Read position used by EventImpl.decode(). It is
+    // kept after build() since events are decoded on first use.
+    private PacketStream cursor;
     private byte suspendPolicy;
     private EventSetImpl internalEventSet;
+    // ANDROID-CHANGED: What a full EventQueueImpl may do with this set,
+    // and the request whose events it coalesces. Set by the constructor
+    // on the transport reader thread, see scanOverflowPolicy().
+    private int overflowPolicy = EventQueueImpl.OVERFLOW_KEEP;
+    private int coalesceRequestID;
+    // ANDROID-CHANGED: VMState.settledResumeGeneration() when the packet
+    // arrived, for the prefetch bundle. See readPrefetchBundle().
+    private int prefetchGeneration = -1;
+    // ANDROID-CHANGED: Releases the object IDs this set never reads into
+    // mirrors once it is unreachable. See UnreadIDs.
+    private UnreadIDs unreadIDs;
+    // ANDROID-CHANGED: Event queues holding this set, only used on the
+    // transport reader thread. See discardedByQueue().
+    private int queueCount;
 
     public String toString() {
         String string = "event set, policy:" + suspendPolicy +
@@ -74,15 +95,20 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         private final int requestID;
         // This is set only for client requests, not internal requests.
         private final EventRequest request;
+        // ANDROID-CHANGED: Position of the event's fields in the packet.
+        // The fields, and the mirrors they refer to, are only read from
+        // the packet when one of them is first needed. See decode().
+        private final int dataPosition;
+        private boolean decoded;
 
         /**
          * Constructor for events.
          */
-        protected EventImpl(JDWP.Event.Composite.Events.EventsCommon evt,
-                            int requestID) {
+        protected EventImpl(byte eventCmd, int requestID, int dataPosition) {
             super(EventSetImpl.this.vm);
-            this.eventCmd = evt.eventKind();
+            this.eventCmd = eventCmd;
             this.requestID = requestID;
+            this.dataPosition = dataPosition;
             EventRequestManagerImpl ermi = EventSetImpl.this.
                 vm.eventRequestManagerImpl();
             this.request =  ermi.request(eventCmd, requestID);
@@ -107,8 +133,43 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
             this.eventCmd = eventCmd;
             this.requestID = 0;
             this.request = null;
+            this.dataPosition = -1;
+            this.decoded = true;
         }
 
+        /*
+         * ANDROID-CHANGED: Reads the fields of this event from the packet
+         * unless that has already been done. Every accessor of a field
+         * calls this first. The cursor is shared by all events of the
+         * set, hence the lock.
+         */
+        final void decode() {
+            synchronized (EventSetImpl.this) {
+                if (!decoded) {
+                    PacketStream ps = cursorAt(dataPosition);
+                    List<Long> ids = new ArrayList<Long>();
+                    ps.recordReadObjectIDs(ids);
+                    try {
+                        decodeFields(ps);
+                    } finally {
+                        ps.recordReadObjectIDs(null);
+                    }
+                    decoded = true;
+                    if (unreadIDs != null &&
+                            unreadIDs.decoded(dataPosition)) {
+                        // Released before, don't release again
+                        vm.forgetObjectIDs(ids);
+                    }
+                }
+            }
+        }
+
+        /**
+         * Reads the event specific fields, which start at the
+         * current position of the stream.
+         */
+        abstract void decodeFields(PacketStream ps);
+
         public EventRequest request() {
             return request;
         }
@@ -168,35 +229,41 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
     }
 
     abstract class ThreadedEventImpl extends EventImpl {
-        private ThreadReference thread;
+        ThreadReference thread;
+
+        ThreadedEventImpl(byte eventCmd, int requestID, int dataPosition) {
+            super(eventCmd, requestID, dataPosition);
+        }
 
-        ThreadedEventImpl(JDWP.Event.Composite.Events.EventsCommon evt,
-                          int requestID, ThreadReference thread) {
-            super(evt, requestID);
-            this.thread = thread;
+        void decodeFields(PacketStream ps) {
+            thread = ps.readThreadReference();
         }
 
         public ThreadReference thread() {
+            decode();
             return thread;
         }
 
         public String toString() {
-            return eventName() + " in thread " + thread.name();
+            return eventName() + " in thread " + thread().name();
         }
     }
 
     abstract class LocatableEventImpl extends ThreadedEventImpl
                                             implements Locatable {
-        private Location location;
+        Location location;
+
+        LocatableEventImpl(byte eventCmd, int requestID, int dataPosition) {
+            super(eventCmd, requestID, dataPosition);
+        }
 
-        LocatableEventImpl(JDWP.Event.Composite.Events.EventsCommon evt,
-                           int requestID,
-                           ThreadReference thread, Location location) {
-            super(evt, requestID, thread);
-            this.location = location;
+        void decodeFields(PacketStream ps) {
+            thread = ps.readThreadReference();
+            location = ps.readLocation();
         }
 
         public Location location() {
+            decode();
             return location;
         }
 
@@ -204,7 +271,25 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
          * For MethodEntry and MethodExit
          */
         public Method method() {
-            return location.method();
+            return location().method();
+        }
+
+        /*
+         * ANDROID-CHANGED: A request that fell back to a ClassOnly
+         * modifier also gets the events of the other methods of the
+         * type. See EventRequestImpl.classOnlyMethod().
+         */
+        EventDestination destination() {
+            EventDestination destination = super.destination();
+            if (destination == EventDestination.CLIENT_EVENT &&
+                    request() != null) {
+                MethodImpl method = ((EventRequestManagerImpl.EventRequestImpl)
+                                         request()).classOnlyMethod();
+                if (method != null && !method.equals(method())) {
+                    return EventDestination.UNKNOWN_EVENT;
+                }
+            }
+            return destination;
         }
 
         public String toString() {
@@ -216,8 +301,8 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
 
     class BreakpointEventImpl extends LocatableEventImpl
                             implements BreakpointEvent {
-        BreakpointEventImpl(JDWP.Event.Composite.Events.Breakpoint evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
+        BreakpointEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.BREAKPOINT, requestID, dataPosition);
         }
 
         String eventName() {
@@ -226,8 +311,8 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
     }
 
     class StepEventImpl extends LocatableEventImpl implements StepEvent {
-        StepEventImpl(JDWP.Event.Composite.Events.SingleStep evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
+        StepEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.SINGLE_STEP, requestID, dataPosition);
         }
 
         String eventName() {
@@ -237,8 +322,8 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
 
     class MethodEntryEventImpl extends LocatableEventImpl
                             implements MethodEntryEvent {
-        MethodEntryEventImpl(JDWP.Event.Composite.Events.MethodEntry evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
+        MethodEntryEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.METHOD_ENTRY, requestID, dataPosition);
         }
 
         String eventName() {
@@ -248,15 +333,20 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
 
     class MethodExitEventImpl extends LocatableEventImpl
                             implements MethodExitEvent {
+        private final boolean hasReturnValue;
         private Value returnVal = null;
 
-        MethodExitEventImpl(JDWP.Event.Composite.Events.MethodExit evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
+        MethodExitEventImpl(byte eventCmd, int requestID, int dataPosition) {
+            super(eventCmd, requestID, dataPosition);
+            hasReturnValue =
+                (eventCmd == JDWP.EventKind.METHOD_EXIT_WITH_RETURN_VALUE);
         }
 
-        MethodExitEventImpl(JDWP.Event.Composite.Events.MethodExitWithReturnValue evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
-            returnVal = evt.value;
+        void decodeFields(PacketStream ps) {
+            super.decodeFields(ps);
+            if (hasReturnValue) {
+                returnVal = ps.readValue();
+            }
         }
 
         String eventName() {
@@ -268,6 +358,7 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
                 throw new UnsupportedOperationException(
                 "target does not support return values in MethodExit events");
             }
+            decode();
             return returnVal;
         }
 
@@ -277,9 +368,15 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
                             implements MonitorContendedEnterEvent {
         private ObjectReference monitor = null;
 
-        MonitorContendedEnterEventImpl(JDWP.Event.Composite.Events.MonitorContendedEnter evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
-            this.monitor = evt.object;
+        MonitorContendedEnterEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.MONITOR_CONTENDED_ENTER, requestID,
+                  dataPosition);
+        }
+
+        void decodeFields(PacketStream ps) {
+            thread = ps.readThreadReference();
+            monitor = ps.readTaggedObjectReference();
+            location = ps.readLocation();
         }
 
         String eventName() {
@@ -287,6 +384,7 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         }
 
         public ObjectReference  monitor() {
+            decode();
             return monitor;
         };
 
@@ -296,9 +394,15 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
                             implements MonitorContendedEnteredEvent {
         private ObjectReference monitor = null;
 
-        MonitorContendedEnteredEventImpl(JDWP.Event.Composite.Events.MonitorContendedEntered evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
-            this.monitor = evt.object;
+        MonitorContendedEnteredEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.MONITOR_CONTENDED_ENTERED, requestID,
+                  dataPosition);
+        }
+
+        void decodeFields(PacketStream ps) {
+            thread = ps.readThreadReference();
+            monitor = ps.readTaggedObjectReference();
+            location = ps.readLocation();
         }
 
         String eventName() {
@@ -306,6 +410,7 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         }
 
         public ObjectReference  monitor() {
+            decode();
             return monitor;
         };
 
@@ -316,10 +421,15 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         private ObjectReference monitor = null;
         private long timeout;
 
-        MonitorWaitEventImpl(JDWP.Event.Composite.Events.MonitorWait evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
-            this.monitor = evt.object;
-            this.timeout = evt.timeout;
+        MonitorWaitEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.MONITOR_WAIT, requestID, dataPosition);
+        }
+
+        void decodeFields(PacketStream ps) {
+            thread = ps.readThreadReference();
+            monitor = ps.readTaggedObjectReference();
+            location = ps.readLocation();
+            timeout = ps.readLong();
         }
 
         String eventName() {
@@ -327,10 +437,12 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         }
 
         public ObjectReference  monitor() {
+            decode();
             return monitor;
         };
 
         public long timeout() {
+            decode();
             return timeout;
         }
     }
@@ -340,10 +452,15 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         private ObjectReference monitor = null;
         private boolean timed_out;
 
-        MonitorWaitedEventImpl(JDWP.Event.Composite.Events.MonitorWaited evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
-            this.monitor = evt.object;
-            this.timed_out = evt.timed_out;
+        MonitorWaitedEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.MONITOR_WAITED, requestID, dataPosition);
+        }
+
+        void decodeFields(PacketStream ps) {
+            thread = ps.readThreadReference();
+            monitor = ps.readTaggedObjectReference();
+            location = ps.readLocation();
+            timed_out = ps.readBoolean();
         }
 
         String eventName() {
@@ -351,10 +468,12 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         }
 
         public ObjectReference  monitor() {
+            decode();
             return monitor;
         };
 
         public boolean timedout() {
+            decode();
             return timed_out;
         }
     }
@@ -363,11 +482,22 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
                             implements ClassPrepareEvent {
         private ReferenceType referenceType;
 
-        ClassPrepareEventImpl(JDWP.Event.Composite.Events.ClassPrepare evt) {
-            super(evt, evt.requestID, evt.thread);
-            referenceType = this.vm.referenceType(evt.typeID, evt.refTypeTag,
-                                                  evt.signature);
-            ((ReferenceTypeImpl)referenceType).setStatus(evt.status);
+        ClassPrepareEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.CLASS_PREPARE, requestID, dataPosition);
+            // The prepared type is entered into the type cache right away,
+            // whether or not anyone looks at this event.
+            decode();
+        }
+
+        void decodeFields(PacketStream ps) {
+            thread = ps.readThreadReference();
+            byte refTypeTag = ps.readByte();
+            long typeID = ps.readClassRef();
+            String signature = ps.readString();
+            int status = ps.readInt();
+            referenceType = this.vm.referenceType(typeID, refTypeTag,
+                                                  signature);
+            ((ReferenceTypeImpl)referenceType).setStatus(status);
         }
 
         public ReferenceType referenceType() {
@@ -382,17 +512,22 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
     class ClassUnloadEventImpl extends EventImpl implements ClassUnloadEvent {
         private String classSignature;
 
-        ClassUnloadEventImpl(JDWP.Event.Composite.Events.ClassUnload evt) {
-            super(evt, evt.requestID);
-            this.classSignature = evt.signature;
+        ClassUnloadEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.CLASS_UNLOAD, requestID, dataPosition);
+        }
+
+        void decodeFields(PacketStream ps) {
+            classSignature = ps.readString();
         }
 
         public String className() {
+            String classSignature = classSignature();
             return classSignature.substring(1, classSignature.length()-1)
                 .replace('/', '.');
         }
 
         public String classSignature() {
+            decode();
             return classSignature;
         }
 
@@ -406,17 +541,23 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         private ObjectReference exception;
         private Location catchLocation;
 
-        ExceptionEventImpl(JDWP.Event.Composite.Events.Exception evt) {
-            super(evt, evt.requestID, evt.thread, evt.location);
-            this.exception = evt.exception;
-            this.catchLocation = evt.catchLocation;
+        ExceptionEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.EXCEPTION, requestID, dataPosition);
+        }
+
+        void decodeFields(PacketStream ps) {
+            super.decodeFields(ps);
+            exception = ps.readTaggedObjectReference();
+            catchLocation = ps.readLocation();
         }
 
         public ObjectReference exception() {
+            decode();
             return exception;
         }
 
         public Location catchLocation() {
+            decode();
             return catchLocation;
         }
 
@@ -427,8 +568,8 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
 
     class ThreadDeathEventImpl extends ThreadedEventImpl
                                         implements ThreadDeathEvent {
-        ThreadDeathEventImpl(JDWP.Event.Composite.Events.ThreadDeath evt) {
-            super(evt, evt.requestID, evt.thread);
+        ThreadDeathEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.THREAD_DEATH, requestID, dataPosition);
         }
 
         String eventName() {
@@ -438,8 +579,8 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
 
     class ThreadStartEventImpl extends ThreadedEventImpl
                                         implements ThreadStartEvent {
-        ThreadStartEventImpl(JDWP.Event.Composite.Events.ThreadStart evt) {
-            super(evt, evt.requestID, evt.thread);
+        ThreadStartEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.THREAD_START, requestID, dataPosition);
         }
 
         String eventName() {
@@ -449,8 +590,8 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
 
     class VMStartEventImpl extends ThreadedEventImpl
                                         implements VMStartEvent {
-        VMStartEventImpl(JDWP.Event.Composite.Events.VMStart evt) {
-            super(evt, evt.requestID, evt.thread);
+        VMStartEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.VM_START, requestID, dataPosition);
         }
 
         String eventName() {
@@ -460,8 +601,11 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
 
     class VMDeathEventImpl extends EventImpl implements VMDeathEvent {
 
-        VMDeathEventImpl(JDWP.Event.Composite.Events.VMDeath evt) {
-            super(evt, evt.requestID);
+        VMDeathEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.VM_DEATH, requestID, dataPosition);
+        }
+
+        void decodeFields(PacketStream ps) {
         }
 
         String eventName() {
@@ -476,6 +620,9 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
             super((byte)JDWP.EventKind.VM_DISCONNECTED);
         }
 
+        void decodeFields(PacketStream ps) {
+        }
+
         String eventName() {
             return "VMDisconnectEvent";
         }
@@ -483,23 +630,26 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
 
     abstract class WatchpointEventImpl extends LocatableEventImpl
                                             implements WatchpointEvent {
-        private final ReferenceTypeImpl refType;
-        private final long fieldID;
-        private final ObjectReference object;
+        private ReferenceTypeImpl refType;
+        private long fieldID;
+        private ObjectReference object;
         private Field field = null;
 
-        WatchpointEventImpl(JDWP.Event.Composite.Events.EventsCommon evt,
-                            int requestID,
-                            ThreadReference thread, Location location,
-                            byte refTypeTag, long typeID, long fieldID,
-                            ObjectReference object) {
-            super(evt, requestID, thread, location);
+        WatchpointEventImpl(byte eventCmd, int requestID, int dataPosition) {
+            super(eventCmd, requestID, dataPosition);
+        }
+
+        void decodeFields(PacketStream ps) {
+            super.decodeFields(ps);
+            byte refTypeTag = ps.readByte();
+            long typeID = ps.readClassRef();
             this.refType = this.vm.referenceType(typeID, refTypeTag);
-            this.fieldID = fieldID;
-            this.object = object;
+            this.fieldID = ps.readFieldRef();
+            this.object = ps.readTaggedObjectReference();
         }
 
         public Field field() {
+            decode();
             if (field == null) {
                 field = refType.getFieldMirror(fieldID);
             }
@@ -507,11 +657,12 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         }
 
         public ObjectReference object() {
+            decode();
             return object;
         }
 
         public Value valueCurrent() {
-            if (object == null) {
+            if (object() == null) {
                 return refType.getValue(field());
             } else {
                 return object.getValue(field());
@@ -522,9 +673,8 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
     class AccessWatchpointEventImpl extends WatchpointEventImpl
                                             implements AccessWatchpointEvent {
 
-        AccessWatchpointEventImpl(JDWP.Event.Composite.Events.FieldAccess evt) {
-            super(evt, evt.requestID, evt.thread, evt.location,
-                  evt.refTypeTag, evt.typeID, evt.fieldID, evt.object);
+        AccessWatchpointEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.FIELD_ACCESS, requestID, dataPosition);
         }
 
         String eventName() {
@@ -536,14 +686,18 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
                            implements ModificationWatchpointEvent {
         Value newValue;
 
-        ModificationWatchpointEventImpl(
-                        JDWP.Event.Composite.Events.FieldModification evt) {
-            super(evt, evt.requestID, evt.thread, evt.location,
-                  evt.refTypeTag, evt.typeID, evt.fieldID, evt.object);
-            this.newValue = evt.valueToBe;
+        ModificationWatchpointEventImpl(int requestID, int dataPosition) {
+            super((byte)JDWP.EventKind.FIELD_MODIFICATION, requestID,
+                  dataPosition);
+        }
+
+        void decodeFields(PacketStream ps) {
+            super.decodeFields(ps);
+            this.newValue = ps.readValue();
         }
 
         public Value valueToBe() {
+            decode();
             return newValue;
         }
 
@@ -570,6 +724,11 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         vm = (VirtualMachineImpl)aVm;
 
         this.pkt = pkt;
+        if (pkt != null) {
+            prefetchGeneration = vm.state().settledResumeGeneration();
+            scanOverflowPolicy();
+            unreadIDs = new UnreadIDs(this, vm, pkt);
+        }
     }
 
     /**
@@ -588,6 +747,52 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         }
     }
 
+    /*
+     * ANDROID-CHANGED: Works out the overflow policy of the set from the
+     * packet, without creating mirrors. A set may only be dropped if it
+     * suspends nothing and every event in it comes from a request with
+     * a policy. Only a set holding a single event can be coalesced.
+     */
+    private void scanOverflowPolicy() {
+        EventRequestManagerImpl ermi = vm.eventRequestManagerImpl();
+        if (ermi == null || !ermi.hasOverflowPolicies()) {
+            // Also true until the VM is initialized, when the ID sizes
+            // needed to scan the packet are not yet known.
+            return;
+        }
+        PacketStream ps = new PacketStream(vm, pkt);
+        if (ps.readByte() != JDWP.SuspendPolicy.NONE) {
+            return;
+        }
+        int eventCount = ps.readInt();
+        int policy = (eventCount == 1) ? EventQueueImpl.OVERFLOW_COALESCE
+                                       : EventQueueImpl.OVERFLOW_DROP;
+        for (int i = 0; i < eventCount; i++) {
+            byte eventKind = ps.readByte();
+            int requestID = ps.readInt();
+            int requestPolicy = ermi.overflowPolicy(requestID);
+            if (requestPolicy == EventQueueImpl.OVERFLOW_KEEP) {
+                return;
+            }
+            if (requestPolicy == EventQueueImpl.OVERFLOW_DROP) {
+                policy = EventQueueImpl.OVERFLOW_DROP;
+            }
+            coalesceRequestID = requestID;
+            if ((i + 1 < eventCount) && !skipEventFields(eventKind, ps)) {
+                return;
+            }
+        }
+        overflowPolicy = policy;
+    }
+
+    int overflowPolicy() {
+        return overflowPolicy;
+    }
+
+    int coalesceRequestID() {
+        return coalesceRequestID;
+    }
+
     private void addEvent(EventImpl evt) {
         // Note that this class has a public add method that throws
         // an exception so that clients can't modify the EventSet
@@ -604,9 +809,15 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         if (pkt == null) {
             return;
         }
+        /*
+         * ANDROID-CHANGED: Only the kind and request ID of each event are
+         * read here, which is all that is needed to route it. The rest
+         * is skipped and read by the event itself when it is first used.
+         */
         PacketStream ps = new PacketStream(vm, pkt);
-        JDWP.Event.Composite compEvt = new JDWP.Event.Composite(vm, ps);
-        suspendPolicy = compEvt.suspendPolicy;
+        cursor = new PacketStream(vm, pkt);
+        suspendPolicy = ps.readByte();
+        int eventCount = ps.readInt();
         if ((vm.traceFlags & VirtualMachine.TRACE_EVENTS) != 0) {
             switch(suspendPolicy) {
                 case JDWP.SuspendPolicy.ALL:
@@ -624,8 +835,20 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         }
 
         ThreadReference fix6485605 = null;
-        for (int i = 0; i < compEvt.events.length; i++) {
-            EventImpl evt = createEvent(compEvt.events[i]);
+        boolean complete = true;
+        for (int i = 0; i < eventCount; i++) {
+            byte eventKind = ps.readByte();
+            int requestID = ps.readInt();
+            // Before the event exists, since it may decode itself right away
+            unreadIDs.created(eventKind, ps.position());
+            EventImpl evt = createEvent(eventKind, requestID, ps.position());
+            if (evt == null) {
+                // The length of an unknown event is unknown, so nothing
+                // after it can be read.
+                complete = false;
+                break;
+            }
+            skipEventFields(eventKind, ps);
             if ((vm.traceFlags & VirtualMachine.TRACE_EVENTS) != 0) {
                 try {
                     vm.printTrace("Event: " + evt);
@@ -644,11 +867,14 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
                         suspendPolicy == JDWP.SuspendPolicy.EVENT_THREAD) {
                         fix6485605 = ((ThreadedEventImpl)evt).thread();
                     }
+                    // ANDROID-CHANGED: Nobody will see it
+                    unreadIDs.release(evt.dataPosition);
                     continue;
                 case CLIENT_EVENT:
                     addEvent(evt);
                     break;
                 case INTERNAL_EVENT:
+                    unreadIDs.internal();
                     if (internalEventSet == null) {
                         internalEventSet = new EventSetImpl(this.vm, null);
                     }
@@ -658,7 +884,11 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
                     throw new InternalException("Invalid event destination");
             }
         }
-        pkt = null; // No longer needed - free it up
+        if (complete && !ps.atEnd()) {
+            readPrefetchBundle(ps);
+        }
+        unreadIDs.built();
+        pkt = null; // Built. The cursor keeps the data for decode()
 
         // Avoid hangs described in 6296125, 6293795
         if (super.size() == 0) {
@@ -680,6 +910,279 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
 
     }
 
+    /**
+     * ANDROID-CHANGED: Reads the prefetch bundle which follows the events
+     * when a request asked for one with the Prefetch modifier, see
+     * jdwp.spec, and seeds the caches of the event thread with it. The
+     * bundle is dropped if a resume was pending when the packet arrived,
+     * since that resume may already have undone the stop it describes.
+     * The object IDs of a dropped bundle are released right away.
+     */
+    private void readPrefetchBundle(PacketStream ps) {
+        if (prefetchGeneration < 0) {
+            List<Long> ids = new ArrayList<Long>();
+            ps.recordSkippedObjectIDs(ids);
+            skipPrefetchBundle(ps);
+            ps.recordSkippedObjectIDs(null);
+            vm.disposeUnreadObjectIDs(ids);
+            return;
+        }
+        ThreadReferenceImpl thread = ps.readThreadReference();
+        int frameCount = ps.readInt();
+        int count = ps.readInt();
+        long[] frameIDs = new long[count];
+        Location[] locations = new Location[count];
+        boolean valid = true;
+        for (int i = 0; i < count; i++) {
+            frameIDs[i] = ps.readFrameRef();
+            locations[i] = ps.readLocation();
+            if (locations[i] == null) {
+                // Read on anyway, so that every ID is counted by a mirror
+                valid = false;
+            }
+        }
+        ObjectReference thisObject = ps.readTaggedObjectReference();
+        int valueCount = ps.readInt();
+        Map<Integer, Value> slotValues = new HashMap<Integer, Value>(valueCount);
+        for (int i = 0; i < valueCount; i++) {
+            int slot = ps.readInt();
+            slotValues.put(slot, ps.readValue());
+        }
+        if (thread != null && valid) {
+            thread.seedPrefetch(prefetchGeneration, frameCount, frameIDs,
+                                locations, thisObject, slotValues);
+        }
+    }
+
+    /*
+     * ANDROID-CHANGED: Moves past a prefetch bundle without reading it.
+     * Must agree with readPrefetchBundle().
+     */
+    private static void skipPrefetchBundle(PacketStream ps) {
+        ps.skipObjectRef();
+        ps.skipBytes(4);
+        int count = ps.readInt();
+        for (int i = 0; i < count; i++) {
+            ps.skipBytes(ps.vm.sizeofFrameRef);
+            ps.skipLocation();
+        }
+        ps.skipTaggedObjectReference();
+        int valueCount = ps.readInt();
+        for (int i = 0; i < valueCount; i++) {
+            ps.skipBytes(4);
+            ps.skipValue();
+        }
+    }
+
+    /*
+     * ANDROID-CHANGED: The back-end counts every object ID it sends, and
+     * JDI gives the count back with DisposeObjects when the mirror the ID
+     * was read into is collected. An ID that is never read into a mirror
+     * would keep its object alive in the target for good. This tracks
+     * which parts of the packet were not read, and releases the object
+     * IDs found in them:
+     * - right after build() for events of disabled or deleted requests,
+     *   which nobody can see,
+     * - when the set is consumed, that is resumed by the client, for its
+     *   client events that were never decoded,
+     * - when every event queue discarded the set, for the whole packet.
+     * Events that go to JDI's internal handlers are left alone, since
+     * that thread may still decode them. Whatever remains is released
+     * by VirtualMachineImpl once the set is unreachable; the phantom
+     * reference is only the backstop. A prefetch bundle is handled by
+     * build() itself.
+     *
+     * An event whose IDs were released may still be decoded later. Its
+     * mirrors then give back the counts just read (see decode()), so
+     * that no ID is released twice; the objects may be gone by then, as
+     * with any object that has collection enabled.
+     */
+    static final class UnreadIDs extends PhantomReference<EventSetImpl> {
+        private final VirtualMachineImpl vm;
+        private final Packet pkt;
+        private boolean built;
+        private boolean releasedAll;
+        // Kind and position of the events created by build(), in packet
+        // order, whether they were decoded or released, and whether they
+        // are for an internal request
+        private byte[] kinds = new byte[1];
+        private int[] positions = new int[1];
+        private boolean[] decoded = new boolean[1];
+        private boolean[] released = new boolean[1];
+        private boolean[] internal = new boolean[1];
+        private int count;
+
+        UnreadIDs(EventSetImpl set, VirtualMachineImpl vm, Packet pkt) {
+            super(set, vm.eventSetQueue);
+            this.vm = vm;
+            this.pkt = pkt;
+            vm.trackUnreadIDs(this);
+        }
+
+        // The methods below are called with the set locked.
+
+        void created(byte kind, int position) {
+            if (count == kinds.length) {
+                kinds = Arrays.copyOf(kinds, count * 2);
+                positions = Arrays.copyOf(positions, count * 2);
+                decoded = Arrays.copyOf(decoded, count * 2);
+                released = Arrays.copyOf(released, count * 2);
+                internal = Arrays.copyOf(internal, count * 2);
+            }
+            kinds[count] = kind;
+            positions[count] = position;
+            count++;
+        }
+
+        /*
+         * The last event created is for an internal request.
+         */
+        void internal() {
+            internal[count - 1] = true;
+        }
+
+        /*
+         * Returns true if the IDs of the event were released already.
+         */
+        boolean decoded(int position) {
+            int index = Arrays.binarySearch(positions, 0, count, position);
+            if (index < 0) {
+                return false;
+            }
+            decoded[index] = true;
+            return released[index];
+        }
+
+        void built() {
+            built = true;
+        }
+
+        /*
+         * Releases the IDs of the given event, unless already done.
+         */
+        void release(int position) {
+            int index = Arrays.binarySearch(positions, 0, count, position);
+            if (index >= 0) {
+                List<Long> ids = new ArrayList<Long>();
+                PacketStream ps = new PacketStream(vm, pkt);
+                ps.recordSkippedObjectIDs(ids);
+                releaseEvent(index, ps);
+                vm.disposeUnreadObjectIDs(ids);
+            }
+        }
+
+        /*
+         * Releases the IDs of all events but the internal ones, or of
+         * the whole packet if the set was never built.
+         */
+        void release() {
+            if (releasedAll) {
+                return;
+            }
+            List<Long> ids;
+            if (built) {
+                ids = new ArrayList<Long>();
+                PacketStream ps = new PacketStream(vm, pkt);
+                ps.recordSkippedObjectIDs(ids);
+                for (int i = 0; i < count; i++) {
+                    if (!internal[i]) {
+                        releaseEvent(i, ps);
+                    }
+                }
+            } else {
+                ids = collect();
+                releasedAll = true;
+            }
+            vm.disposeUnreadObjectIDs(ids);
+            if (releasedAll || nothingUnread()) {
+                // Nothing left for the backstop
+                vm.untrackUnreadIDs(this);
+                clear();
+            }
+        }
+
+        private void releaseEvent(int index, PacketStream ps) {
+            if (!decoded[index] && !released[index]) {
+                ps.position(positions[index]);
+                skipEventFields(kinds[index], ps);
+                released[index] = true;
+            }
+        }
+
+        private boolean nothingUnread() {
+            for (int i = 0; i < count; i++) {
+                if (!decoded[i] && !released[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /*
+         * Called by VirtualMachineImpl once the set is unreachable, and
+         * by release() for a set that was never built.
+         */
+        List<Long> collect() {
+            List<Long> ids = new ArrayList<Long>();
+            if (releasedAll) {
+                return ids;
+            }
+            PacketStream ps = new PacketStream(vm, pkt);
+            ps.recordSkippedObjectIDs(ids);
+            if (built) {
+                for (int i = 0; i < count; i++) {
+                    releaseEvent(i, ps);
+                }
+                return ids;
+            }
+            ps.readByte();
+            int eventCount = ps.readInt();
+            for (int i = 0; i < eventCount; i++) {
+                byte eventKind = ps.readByte();
+                ps.readInt();
+                if (!skipEventFields(eventKind, ps)) {
+                    return ids;
+                }
+            }
+            if (!ps.atEnd()) {
+                skipPrefetchBundle(ps);
+            }
+            return ids;
+        }
+    }
+
+    /*
+     * ANDROID-CHANGED: The client is done with this set; release the
+     * object IDs of the events it did not look at.
+     */
+    private void consumed() {
+        synchronized (this) {
+            if (unreadIDs != null) {
+                unreadIDs.release();
+            }
+        }
+    }
+
+    /*
+     * ANDROID-CHANGED: Called on the transport reader thread by each
+     * event queue the set was put in, see TargetVM.queueEventSet().
+     * Once every queue has discarded the set nobody can see it, so the
+     * whole packet is released. Such a set was never built.
+     */
+    void setQueueCount(int count) {
+        queueCount = count;
+    }
+
+    void discardedByQueue() {
+        if (--queueCount == 0) {
+            synchronized (this) {
+                if (unreadIDs != null) {
+                    unreadIDs.release();
+                }
+            }
+        }
+    }
+
     /**
      * Filter out internal events
      */
@@ -694,89 +1197,172 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
         return this.internalEventSet;
     }
 
-    EventImpl createEvent(JDWP.Event.Composite.Events evt) {
-        JDWP.Event.Composite.Events.EventsCommon comm = evt.aEventsCommon;
-        switch (evt.eventKind) {
+    EventImpl createEvent(byte eventKind, int requestID, int position) {
+        switch (eventKind) {
             case JDWP.EventKind.THREAD_START:
-                return new ThreadStartEventImpl(
-                      (JDWP.Event.Composite.Events.ThreadStart)comm);
+                return new ThreadStartEventImpl(requestID, position);
 
             case JDWP.EventKind.THREAD_END:
-                return new ThreadDeathEventImpl(
-                      (JDWP.Event.Composite.Events.ThreadDeath)comm);
+                return new ThreadDeathEventImpl(requestID, position);
 
             case JDWP.EventKind.EXCEPTION:
-                return new ExceptionEventImpl(
-                      (JDWP.Event.Composite.Events.Exception)comm);
+                return new ExceptionEventImpl(requestID, position);
 
             case JDWP.EventKind.BREAKPOINT:
-                return new BreakpointEventImpl(
-                      (JDWP.Event.Composite.Events.Breakpoint)comm);
+                return new BreakpointEventImpl(requestID, position);
 
             case JDWP.EventKind.METHOD_ENTRY:
-                return new MethodEntryEventImpl(
-                      (JDWP.Event.Composite.Events.MethodEntry)comm);
+                return new MethodEntryEventImpl(requestID, position);
 
             case JDWP.EventKind.METHOD_EXIT:
-                return new MethodExitEventImpl(
-                      (JDWP.Event.Composite.Events.MethodExit)comm);
-
             case JDWP.EventKind.METHOD_EXIT_WITH_RETURN_VALUE:
-                return new MethodExitEventImpl(
-                      (JDWP.Event.Composite.Events.MethodExitWithReturnValue)comm);
+                return new MethodExitEventImpl(eventKind, requestID, position);
 
             case JDWP.EventKind.FIELD_ACCESS:
-                return new AccessWatchpointEventImpl(
-                      (JDWP.Event.Composite.Events.FieldAccess)comm);
+                return new AccessWatchpointEventImpl(requestID, position);
 
             case JDWP.EventKind.FIELD_MODIFICATION:
-                return new ModificationWatchpointEventImpl(
-                      (JDWP.Event.Composite.Events.FieldModification)comm);
+                return new ModificationWatchpointEventImpl(requestID, position);
 
             case JDWP.EventKind.SINGLE_STEP:
-                return new StepEventImpl(
-                      (JDWP.Event.Composite.Events.SingleStep)comm);
+                return new StepEventImpl(requestID, position);
 
             case JDWP.EventKind.CLASS_PREPARE:
-                return new ClassPrepareEventImpl(
-                      (JDWP.Event.Composite.Events.ClassPrepare)comm);
+                return new ClassPrepareEventImpl(requestID, position);
 
             case JDWP.EventKind.CLASS_UNLOAD:
-                return new ClassUnloadEventImpl(
-                      (JDWP.Event.Composite.Events.ClassUnload)comm);
+                return new ClassUnloadEventImpl(requestID, position);
 
             case JDWP.EventKind.MONITOR_CONTENDED_ENTER:
-                return new MonitorContendedEnterEventImpl(
-                      (JDWP.Event.Composite.Events.MonitorContendedEnter)comm);
+                return new MonitorContendedEnterEventImpl(requestID, position);
 
             case JDWP.EventKind.MONITOR_CONTENDED_ENTERED:
-                return new MonitorContendedEnteredEventImpl(
-                      (JDWP.Event.Composite.Events.MonitorContendedEntered)comm);
+                return new MonitorContendedEnteredEventImpl(requestID, position);
 
             case JDWP.EventKind.MONITOR_WAIT:
-                return new MonitorWaitEventImpl(
-                      (JDWP.Event.Composite.Events.MonitorWait)comm);
+                return new MonitorWaitEventImpl(requestID, position);
 
             case JDWP.EventKind.MONITOR_WAITED:
-                return new MonitorWaitedEventImpl(
-                      (JDWP.Event.Composite.Events.MonitorWaited)comm);
+                return new MonitorWaitedEventImpl(requestID, position);
 
             case JDWP.EventKind.VM_START:
-                return new VMStartEventImpl(
-                      (JDWP.Event.Composite.Events.VMStart)comm);
+                return new VMStartEventImpl(requestID, position);
 
             case JDWP.EventKind.VM_DEATH:
-                return new VMDeathEventImpl(
-                      (JDWP.Event.Composite.Events.VMDeath)comm);
+                return new VMDeathEventImpl(requestID, position);
 
             default:
                 // Ignore unknown event types
                 System.err.println("Ignoring event cmd " +
-                                   evt.eventKind + " from the VM");
+                                   eventKind + " from the VM");
                 return null;
         }
     }
 
+    /*
+     * ANDROID-CHANGED: Moves past the fields of an event without reading
+     * them. Must agree with the decodeFields() methods above. Returns
+     * false for an unknown kind of event, whose length is unknown.
+     */
+    private static boolean skipEventFields(byte eventKind, PacketStream ps) {
+        switch (eventKind) {
+            case JDWP.EventKind.VM_DEATH:
+                break;
+
+            case JDWP.EventKind.CLASS_UNLOAD:
+                ps.skipString();
+                break;
+
+            case JDWP.EventKind.VM_START:
+            case JDWP.EventKind.THREAD_START:
+            case JDWP.EventKind.THREAD_END:
+                ps.skipObjectRef();
+                break;
+
+            case JDWP.EventKind.CLASS_PREPARE:
+                ps.skipObjectRef();
+                ps.skipBytes(1);
+                ps.skipClassRef();
+                ps.skipString();
+                ps.skipBytes(4);
+                break;
+
+            case JDWP.EventKind.SINGLE_STEP:
+            case JDWP.EventKind.BREAKPOINT:
+            case JDWP.EventKind.METHOD_ENTRY:
+            case JDWP.EventKind.METHOD_EXIT:
+                ps.skipObjectRef();
+                ps.skipLocation();
+                break;
+
+            case JDWP.EventKind.METHOD_EXIT_WITH_RETURN_VALUE:
+                ps.skipObjectRef();
+                ps.skipLocation();
+                ps.skipValue();
+                break;
+
+            case JDWP.EventKind.MONITOR_CONTENDED_ENTER:
+            case JDWP.EventKind.MONITOR_CONTENDED_ENTERED:
+                ps.skipObjectRef();
+                ps.skipTaggedObjectReference();
+                ps.skipLocation();
+                break;
+
+            case JDWP.EventKind.MONITOR_WAIT:
+                ps.skipObjectRef();
+                ps.skipTaggedObjectReference();
+                ps.skipLocation();
+                ps.skipBytes(8);
+                break;
+
+            case JDWP.EventKind.MONITOR_WAITED:
+                ps.skipObjectRef();
+                ps.skipTaggedObjectReference();
+                ps.skipLocation();
+                ps.skipBytes(1);
+                break;
+
+            case JDWP.EventKind.EXCEPTION:
+                ps.skipObjectRef();
+                ps.skipLocation();
+                ps.skipTaggedObjectReference();
+                ps.skipLocation();
+                break;
+
+            case JDWP.EventKind.FIELD_ACCESS:
+                ps.skipObjectRef();
+                ps.skipLocation();
+                ps.skipBytes(1);
+                ps.skipClassRef();
+                ps.skipFieldRef();
+                ps.skipTaggedObjectReference();
+                break;
+
+            case JDWP.EventKind.FIELD_MODIFICATION:
+                ps.skipObjectRef();
+                ps.skipLocation();
+                ps.skipBytes(1);
+                ps.skipClassRef();
+                ps.skipFieldRef();
+                ps.skipTaggedObjectReference();
+                ps.skipValue();
+                break;
+
+            default:
+                return false;
+        }
+        return true;
+    }
+
+    /*
+     * ANDROID-CHANGED: Returns the shared cursor positioned at the given
+     * event's fields. Called with this set locked.
+     */
+    private PacketStream cursorAt(int position) {
+        cursor.position(position);
+        return cursor;
+    }
+
     public VirtualMachine virtualMachine() {
         return vm;
     }
@@ -812,6 +1398,7 @@ public class EventSetImpl extends ArrayList<Event> implements EventSet {
             default:
                 throw new InternalException("Invalid suspend policy");
         }
+        consumed();
     }
 
     public Iterator<Event> iterator() {
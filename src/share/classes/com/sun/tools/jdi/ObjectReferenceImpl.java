@@ -41,6 +41,10 @@ public class ObjectReferenceImpl extends ValueImpl
     // This is cached only while the VM is suspended
     protected static class Cache {
         JDWP.ObjectReference.MonitorInfo monitorInfo = null;
+        // ANDROID-CHANGED: Instance field values read while suspended,
+        // and the resume generation they were read in.
+        Map<Field, Value> fieldValues = null;
+        int fieldValuesGeneration = -1;
     }
 
     private static final Cache noInitCache = new Cache();
@@ -82,6 +86,21 @@ public class ObjectReferenceImpl extends ValueImpl
         }
     }
 
+    /*
+     * ANDROID-CHANGED: Returns the cache, making sure that this object
+     * listens for the VM being resumed so that the cache is cleared
+     * then. Returns null if the VM is not suspended.
+     * Must be called synchronized on vm.state().
+     */
+    private Cache listeningCache() {
+        Cache local = getCache();
+        if (local != null && !vm.state().hasListener(this)) {
+            vm.state().addListener(this);
+            addedListener = true;
+        }
+        return local;
+    }
+
     // Return the ClassTypeImpl upon which to invoke a method.
     // By default it is our very own referenceType() but subclasses
     // can override.
@@ -197,7 +216,42 @@ public class ObjectReferenceImpl extends ValueImpl
             map = new HashMap<Field, Value>(size);
         }
 
+        // ANDROID-CHANGED: Instance field values read since the VM was
+        // suspended are reused. A single thread resumed or running a
+        // method invocation can change any object without the whole VM
+        // being resumed, so the values are stamped with the resume
+        // generation and dropped when it has moved on. Nothing is cached
+        // while a resuming command is still pending.
+        Cache local;
+        int generation;
+        synchronized (vm.state()) {
+            local = listeningCache();
+            generation = vm.state().settledResumeGeneration();
+            if (local != null && generation == -1) {
+                local = null;
+            }
+            if (local != null) {
+                if (local.fieldValues == null ||
+                    local.fieldValuesGeneration != generation) {
+                    local.fieldValues = new HashMap<Field, Value>();
+                    local.fieldValuesGeneration = generation;
+                } else {
+                    Iterator<Field> iter = instanceFields.iterator();
+                    while (iter.hasNext()) {
+                        Field field = iter.next();
+                        if (local.fieldValues.containsKey(field)) {
+                            map.put(field, local.fieldValues.get(field));
+                            iter.remove();
+                        }
+                    }
+                }
+            }
+        }
+
         size = instanceFields.size();
+        if (size == 0) {
+            return map;
+        }
 
         JDWP.ObjectReference.GetValues.Field[] queryFields =
                          new JDWP.ObjectReference.GetValues.Field[size];
@@ -223,6 +277,24 @@ public class ObjectReferenceImpl extends ValueImpl
             map.put(field, values[i]);
         }
 
+        if (local != null) {
+            synchronized (vm.state()) {
+                if (local.fieldValuesGeneration != generation ||
+                    vm.state().settledResumeGeneration() != generation) {
+                    // Something was resumed while the values were read
+                    return map;
+                }
+                for (int i=0; i<size; i++) {
+                    Field field = instanceFields.get(i);
+                    local.fieldValues.put(field, map.get(field));
+                }
+                if ((vm.traceFlags & VirtualMachine.TRACE_OBJREFS) != 0) {
+                    vm.printTrace(description() +
+                                  " temporarily caching field values");
+                }
+            }
+        }
+
         return map;
     }
 
@@ -258,6 +330,13 @@ public class ObjectReferenceImpl extends ValueImpl
                 JDWP.ObjectReference.SetValues.process(vm, this, fvals);
             } catch (JDWPException exc) {
                 throw exc.toJDIException();
+            } finally {
+                // ANDROID-CHANGED: Forget the value read before.
+                synchronized (vm.state()) {
+                    if (cache != null && cache.fieldValues != null) {
+                        cache.fieldValues.remove(field);
+                    }
+                }
             }
         } catch (ClassNotLoadedException e) {
             /*
@@ -45,13 +45,19 @@ public class Packet extends Object {
     short cmd;
     short errorCode;
     byte[] data;
+    // ANDROID-CHANGED: Index of the first data byte in "data". Received
+    // packets keep the array read from the connection, header included,
+    // instead of copying the data out of it.
+    int dataOffset;
     volatile boolean replied = false;
+    // ANDROID-CHANGED: Thread parked in TargetVM.waitForReply, if any
+    volatile Thread waiter;
 
     /**
      * Return byte representation of the packet
      */
     public byte[] toByteArray() {
-        int len = data.length + 11;
+        int len = dataLength() + 11;
         byte b[] = new byte[len];
         b[0] = (byte)((len >>> 24) & 0xff);
         b[1] = (byte)((len >>> 16) & 0xff);
@@ -69,12 +75,19 @@ public class Packet extends Object {
             b[9] = (byte)((errorCode >>>  8) & 0xff);
             b[10] = (byte)((errorCode >>>  0) & 0xff);
         }
-        if (data.length > 0) {
-            System.arraycopy(data, 0, b, 11, data.length);
+        if (dataLength() > 0) {
+            System.arraycopy(data, dataOffset, b, 11, dataLength());
         }
         return b;
     }
 
+    /**
+     * Return the number of data bytes in the packet
+     */
+    int dataLength() {
+        return data.length - dataOffset;
+    }
+
     /**
      * Create a packet from its byte array representation
      */
@@ -111,8 +124,8 @@ public class Packet extends Object {
             p.errorCode = (short)((b9 << 8) + (b10 << 0));
         }
 
-        p.data = new byte[b.length - 11];
-        System.arraycopy(b, 11, p.data, 0, p.data.length);
+        p.data = b;
+        p.dataOffset = 11;
         return p;
     }
 
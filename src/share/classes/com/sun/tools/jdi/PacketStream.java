@@ -35,6 +35,12 @@ class PacketStream {
     final Packet pkt;
     private ByteArrayOutputStream dataStream = new ByteArrayOutputStream();
     private boolean isCommitted = false;
+    // ANDROID-CHANGED: If not null, the object IDs passed over by the
+    // skip methods are added to it. See EventSetImpl.UnreadIDs.
+    private List<Long> skippedObjectIDs;
+    // ANDROID-CHANGED: If not null, the object IDs read by readObjectRef,
+    // and so into mirrors, are added to it. See EventSetImpl.decode().
+    private List<Long> readObjectIDs;
 
     PacketStream(VirtualMachineImpl vm, int cmdSet, int cmd) {
         this.vm = vm;
@@ -47,6 +53,7 @@ class PacketStream {
         this.vm = vm;
         this.pkt = pkt;
         this.isCommitted = true; /* read only stream */
+        this.inCursor = pkt.dataOffset;
     }
 
     int id() {
@@ -415,7 +422,11 @@ class PacketStream {
      * Read object represented as vm specific byte sequence.
      */
     long readObjectRef() {
-        return readID(vm.sizeofObjectRef);
+        long id = readID(vm.sizeofObjectRef);
+        if (readObjectIDs != null && id != 0) {
+            readObjectIDs.add(id);
+        }
+        return id;
     }
 
     long readClassRef() {
@@ -612,6 +623,96 @@ class PacketStream {
         return n;
     }
 
+    /*
+     * ANDROID-CHANGED: Cursor positioning and skipping of encoded values,
+     * so that a packet can be scanned without creating mirrors and read
+     * again from a saved position later. See EventSetImpl.
+     */
+    int position() {
+        return inCursor;
+    }
+
+    void position(int position) {
+        inCursor = position;
+    }
+
+    boolean atEnd() {
+        return inCursor >= pkt.data.length;
+    }
+
+    void recordSkippedObjectIDs(List<Long> ids) {
+        skippedObjectIDs = ids;
+    }
+
+    void recordReadObjectIDs(List<Long> ids) {
+        readObjectIDs = ids;
+    }
+
+    void skipObjectRef() {
+        if (skippedObjectIDs != null) {
+            long id = readID(vm.sizeofObjectRef);
+            if (id != 0) {
+                skippedObjectIDs.add(id);
+            }
+            return;
+        }
+        inCursor += vm.sizeofObjectRef;
+    }
+
+    void skipClassRef() {
+        inCursor += vm.sizeofClassRef;
+    }
+
+    void skipFieldRef() {
+        inCursor += vm.sizeofFieldRef;
+    }
+
+    void skipTaggedObjectReference() {
+        inCursor += 1;
+        skipObjectRef();
+    }
+
+    void skipLocation() {
+        inCursor += 1 + vm.sizeofObjectRef + vm.sizeofMethodRef + 8;
+    }
+
+    void skipString() {
+        int len = readInt();
+        inCursor += len;
+    }
+
+    void skipValue() {
+        byte typeKey = readByte();
+        if (isObjectTag(typeKey)) {
+            skipObjectRef();
+            return;
+        }
+        switch (typeKey) {
+            case JDWP.Tag.BYTE:
+            case JDWP.Tag.BOOLEAN:
+                inCursor += 1;
+                break;
+
+            case JDWP.Tag.CHAR:
+            case JDWP.Tag.SHORT:
+                inCursor += 2;
+                break;
+
+            case JDWP.Tag.INT:
+            case JDWP.Tag.FLOAT:
+                inCursor += 4;
+                break;
+
+            case JDWP.Tag.LONG:
+            case JDWP.Tag.DOUBLE:
+                inCursor += 8;
+                break;
+
+            case JDWP.Tag.VOID:
+                break;
+        }
+    }
+
     byte command() {
         return (byte)pkt.cmd;
     }
@@ -29,6 +29,7 @@ import com.sun.jdi.*;
 
 import java.util.*;
 import java.lang.ref.SoftReference;
+import java.nio.ByteBuffer;
 
 public abstract class ReferenceTypeImpl extends TypeImpl
 implements ReferenceType {
@@ -61,6 +62,10 @@ implements ReferenceType {
     private byte[] constantPoolBytes;
     private SoftReference<byte[]> constantPoolBytesRef = null;
 
+    // ANDROID-CHANGED: Metadata from the persistent cache, see metadata()
+    private SoftReference<ClassMetadata> metadataRef = null;
+    private boolean metadataFailed = false;
+
     /* to mark a SourceFile request that returned a genuine JDWP.Error.ABSENT_INFORMATION */
     private static final String ABSENT_BASE_SOURCE_NAME = "**ABSENT_BASE_SOURCE_NAME**";
 
@@ -89,6 +94,8 @@ implements ReferenceType {
         sdeRef = null;
         versionNumberGotten = false;
         constantPoolInfoGotten = false;
+        metadataRef = null;
+        metadataFailed = false;
     }
 
     Method getMethodMirror(long ref) {
@@ -305,7 +312,11 @@ implements ReferenceType {
     public List<Field> fields() {
         List<Field> fields = (fieldsRef == null) ? null : fieldsRef.get();
         if (fields == null) {
-            if (vm.canGet1_5LanguageFeatures()) {
+            // ANDROID-CHANGED: Serve from the metadata cache if possible
+            ClassMetadata metadata = metadata();
+            if (metadata != null) {
+                fields = metadata.fields(vm, this);
+            } else if (vm.canGet1_5LanguageFeatures()) {
                 JDWP.ReferenceType.FieldsWithGeneric.FieldInfo[] jdwpFields;
                 try {
                     jdwpFields = JDWP.ReferenceType.FieldsWithGeneric.process(vm, this).declared;
@@ -450,7 +461,11 @@ implements ReferenceType {
     public List<Method> methods() {
         List<Method> methods = (methodsRef == null) ? null : methodsRef.get();
         if (methods == null) {
-            if (!vm.canGet1_5LanguageFeatures()) {
+            // ANDROID-CHANGED: Serve from the metadata cache if possible
+            ClassMetadata metadata = metadata();
+            if (metadata != null) {
+                methods = metadata.methods(vm, this);
+            } else if (!vm.canGet1_5LanguageFeatures()) {
                 methods = methods1_4();
             } else {
                 JDWP.ReferenceType.MethodsWithGeneric.MethodInfo[] declared;
@@ -721,14 +736,21 @@ implements ReferenceType {
         if (bsn == null) {
             // Does not need synchronization, since worst-case
             // static info is fetched twice
-            try {
-                bsn = JDWP.ReferenceType.SourceFile.
-                    process(vm, this).sourceFile;
-            } catch (JDWPException exc) {
-                if (exc.errorCode() == JDWP.Error.ABSENT_INFORMATION) {
-                    bsn = ABSENT_BASE_SOURCE_NAME;
-                } else {
-                    throw exc.toJDIException();
+            // ANDROID-CHANGED: Serve from the metadata cache if possible
+            ClassMetadata metadata = metadata();
+            if (metadata != null && metadata.sourceFileState != ClassMetadata.ASK) {
+                bsn = (metadata.sourceFileState == ClassMetadata.PRESENT) ?
+                          metadata.sourceFile : ABSENT_BASE_SOURCE_NAME;
+            } else {
+                try {
+                    bsn = JDWP.ReferenceType.SourceFile.
+                        process(vm, this).sourceFile;
+                } catch (JDWPException exc) {
+                    if (exc.errorCode() == JDWP.Error.ABSENT_INFORMATION) {
+                        bsn = ABSENT_BASE_SOURCE_NAME;
+                    } else {
+                        throw exc.toJDIException();
+                    }
                 }
             }
             baseSourceName = bsn;
@@ -784,13 +806,20 @@ implements ReferenceType {
         SDE sde = (sdeRef == null) ?  null : sdeRef.get();
         if (sde == null) {
             String extension = null;
-            try {
-                extension = JDWP.ReferenceType.SourceDebugExtension.
-                    process(vm, this).extension;
-            } catch (JDWPException exc) {
-                if (exc.errorCode() != JDWP.Error.ABSENT_INFORMATION) {
-                    sdeRef = new SoftReference<SDE>(NO_SDE_INFO_MARK);
-                    throw exc.toJDIException();
+            // ANDROID-CHANGED: Serve from the metadata cache if possible
+            ClassMetadata metadata = metadata();
+            if (metadata != null &&
+                metadata.sourceDebugExtensionState != ClassMetadata.ASK) {
+                extension = metadata.sourceDebugExtension;
+            } else {
+                try {
+                    extension = JDWP.ReferenceType.SourceDebugExtension.
+                        process(vm, this).extension;
+                } catch (JDWPException exc) {
+                    if (exc.errorCode() != JDWP.Error.ABSENT_INFORMATION) {
+                        sdeRef = new SoftReference<SDE>(NO_SDE_INFO_MARK);
+                        throw exc.toJDIException();
+                    }
                 }
             }
             if (extension == null) {
@@ -879,9 +908,18 @@ implements ReferenceType {
         boolean someAbsent = false;
         // A method that should have info, did
         boolean somePresent = false;
-        List<Method> methods = methods();
         SDE.Stratum stratum = stratum(stratumID);
 
+        // ANDROID-CHANGED: Let the back-end search the line tables rather
+        // than fetching the LineTable of every method.
+        if (stratum.isJava()) {
+            List<Location> list = baseLocationsOfLine(sourceName, lineNumber);
+            if (list != null) {
+                return list;
+            }
+        }
+
+        List<Method> methods = methods();
         List<Location> list = new ArrayList<Location>();
 
         Iterator<Method> iter = methods.iterator();
@@ -908,6 +946,45 @@ implements ReferenceType {
         return list;
     }
 
+    /*
+     * ANDROID-CHANGED: Resolves a line in the Java stratum with
+     * Vendor.LocationsOfLine. Returns null if the target does not
+     * support the command.
+     */
+    private List<Location> baseLocationsOfLine(String sourceName,
+                                               int lineNumber)
+                           throws AbsentInformationException {
+        if (!vm.vendorLocationsOfLine) {
+            return null;
+        }
+        JDWP.Vendor.LocationsOfLine reply;
+        try {
+            reply = JDWP.Vendor.LocationsOfLine.process(vm, this, lineNumber);
+        } catch (JDWPException exc) {
+            if (exc.errorCode() == JDWP.Error.NOT_IMPLEMENTED) {
+                vm.vendorLocationsOfLine = false;
+                return null;
+            }
+            throw exc.toJDIException();
+        }
+        if (reply.absentInformation) {
+            throw new AbsentInformationException();
+        }
+        List<Location> list = new ArrayList<Location>(reply.locations.length);
+        if ((sourceName != null) && (reply.locations.length > 0) &&
+            !sourceName.equals(baseSourceName())) {
+            return list;
+        }
+        for (JDWP.Vendor.LocationsOfLine.LineLocation ll : reply.locations) {
+            LocationImpl loc = new LocationImpl(vm,
+                                                getMethodMirror(ll.methodID),
+                                                ll.lineCodeIndex);
+            loc.addBaseLineInfo(new BaseLineInfo(lineNumber, this));
+            list.add(loc);
+        }
+        return list;
+    }
+
     public List<ObjectReference> instances(long maxInstances) {
         if (!vm.canGetInstanceInfo()) {
             throw new UnsupportedOperationException(
@@ -990,8 +1067,19 @@ implements ReferenceType {
             }
         }
 
+        int count;
+        byte[] cpbytes;
         try {
-            jdwpCPool = JDWP.ReferenceType.ConstantPool.process(vm, this);
+            // ANDROID-CHANGED: Prefer the hashed and chunked vendor command
+            BlobCache.Range range = fetchConstantPoolRanges();
+            if (range != null) {
+                count = range.count;
+                cpbytes = range.bytes;
+            } else {
+                jdwpCPool = JDWP.ReferenceType.ConstantPool.process(vm, this);
+                count = jdwpCPool.count;
+                cpbytes = jdwpCPool.bytes;
+            }
         } catch (JDWPException exc) {
             if (exc.errorCode() == JDWP.Error.ABSENT_INFORMATION) {
                 constanPoolCount = 0;
@@ -1002,14 +1090,90 @@ implements ReferenceType {
                 throw exc.toJDIException();
             }
         }
-        byte[] cpbytes;
-        constanPoolCount = jdwpCPool.count;
-        cpbytes = jdwpCPool.bytes;
+        constanPoolCount = count;
         constantPoolBytesRef = new SoftReference<byte[]>(cpbytes);
         constantPoolInfoGotten = true;
         return cpbytes;
     }
 
+    /*
+     * ANDROID-CHANGED: Fetch the constant pool through the BlobCache, or
+     * return null if the target does not support Vendor.ConstantPoolRange or
+     * the class was redefined while it was being fetched.
+     */
+    private BlobCache.Range fetchConstantPoolRanges() throws JDWPException {
+        if (!vm.vendorContentRange) {
+            return null;
+        }
+        try {
+            return vm.blobCache.fetch(new BlobCache.Source() {
+                public BlobCache.Range fetch(int offset, int length)
+                                                throws JDWPException {
+                    JDWP.Vendor.ConstantPoolRange reply =
+                        JDWP.Vendor.ConstantPoolRange.process(
+                            vm, ReferenceTypeImpl.this, offset, length);
+                    return new BlobCache.Range(reply.count, reply.hash,
+                                               reply.totalLength, reply.bytes);
+                }
+            });
+        } catch (JDWPException exc) {
+            if (exc.errorCode() == JDWP.Error.NOT_IMPLEMENTED) {
+                vm.vendorContentRange = false;
+                return null;
+            }
+            throw exc;
+        }
+    }
+
+    /*
+     * ANDROID-CHANGED: The metadata of this class from the persistent
+     * metadata cache (see BlobCache), or null if there is no such cache or
+     * the target does not support Vendor.ClassMetadataKey. The target is
+     * asked for the hash of the metadata and the field and method IDs;
+     * the metadata itself is only transferred when it is not cached yet.
+     * Does not need synchronization, since worst-case it is fetched twice.
+     */
+    private ClassMetadata metadata() {
+        if (metadataFailed || !vm.vendorClassMetadata ||
+            !vm.blobCache.isPersistent()) {
+            return null;
+        }
+        ClassMetadata metadata = (metadataRef == null) ? null : metadataRef.get();
+        if (metadata != null) {
+            return metadata;
+        }
+        try {
+            JDWP.Vendor.ClassMetadataKey key =
+                JDWP.Vendor.ClassMetadataKey.process(vm, this);
+            ByteBuffer buffer = vm.blobCache.fetchBuffer(new BlobCache.Source() {
+                public BlobCache.Range fetch(int offset, int length)
+                                                throws JDWPException {
+                    JDWP.Vendor.ClassMetadata reply =
+                        JDWP.Vendor.ClassMetadata.process(
+                            vm, ReferenceTypeImpl.this, offset, length);
+                    return new BlobCache.Range(0, reply.hash,
+                                               reply.totalLength, reply.bytes);
+                }
+            }, key.hash, key.totalLength);
+            if (buffer != null) {
+                metadata = ClassMetadata.parse(buffer, key.fields, key.methods);
+            }
+        } catch (JDWPException exc) {
+            if (exc.errorCode() == JDWP.Error.NOT_IMPLEMENTED) {
+                vm.vendorClassMetadata = false;
+            }
+            // Otherwise the regular commands will report the error
+            return null;
+        }
+        if (metadata == null) {
+            // Do not try again for every query
+            metadataFailed = true;
+            return null;
+        }
+        metadataRef = new SoftReference<ClassMetadata>(metadata);
+        return metadata;
+    }
+
     public int constantPoolCount() {
         try {
             getConstantPoolInfo();
@@ -48,6 +48,15 @@ public class StackFrameImpl extends MirrorImpl
     private final Location location;
     private Map<String, LocalVariable> visibleVariables =  null;
     private ObjectReference thisObject = null;
+    // ANDROID-CHANGED: Values of local variables read from this frame.
+    // The frame is discarded when its thread resumes, and setValue
+    // keeps this up to date, so the values cannot go stale.
+    // Synchronized on this map.
+    private final Map<LocalVariable, Value> localValues =
+                                  new HashMap<LocalVariable, Value>();
+    // ANDROID-CHANGED: Values by slot from an event's prefetch bundle,
+    // see seedPrefetch(). Synchronized on localValues.
+    private Map<Integer, Value> prefetchedSlots = null;
 
     StackFrameImpl(VirtualMachine vm, ThreadReferenceImpl thread,
                    long id, Location location) {
@@ -75,6 +84,21 @@ public class StackFrameImpl extends MirrorImpl
         }
     }
 
+    /**
+     * ANDROID-CHANGED: Takes 'this' and the values of the visible
+     * locals from the prefetch bundle of an event, before the frame is
+     * handed out. See ThreadReferenceImpl.seedPrefetch().
+     */
+    void seedPrefetch(ObjectReference thisObject,
+                      Map<Integer, Value> slotValues) {
+        if (thisObject != null) {
+            this.thisObject = thisObject;
+        }
+        synchronized (localValues) {
+            prefetchedSlots = slotValues;
+        }
+    }
+
     void validateStackFrame() {
         if (!isValid) {
             throw new InvalidStackFrameException("Thread has been resumed");
@@ -206,15 +230,42 @@ public class StackFrameImpl extends MirrorImpl
         validateMirrors(variables);
 
         int count = variables.size();
-        JDWP.StackFrame.GetValues.SlotInfo[] slots =
-                           new JDWP.StackFrame.GetValues.SlotInfo[count];
-
         for (int i=0; i<count; ++i) {
             LocalVariableImpl variable = (LocalVariableImpl)variables.get(i);
             if (!variable.isVisible(this)) {
                 throw new IllegalArgumentException(variable.name() +
                                  " is not valid at this frame location");
             }
+        }
+
+        // ANDROID-CHANGED: Only query the variables not read before.
+        Map<LocalVariable, Value> map = new HashMap<LocalVariable, Value>(count);
+        List<LocalVariableImpl> queried = new ArrayList<LocalVariableImpl>(count);
+        synchronized (localValues) {
+            for (int i=0; i<count; ++i) {
+                LocalVariableImpl variable = (LocalVariableImpl)variables.get(i);
+                if (localValues.containsKey(variable)) {
+                    map.put(variable, localValues.get(variable));
+                } else if (prefetchedSlots != null &&
+                           prefetchedSlots.containsKey(variable.slot())) {
+                    Value value = prefetchedSlots.get(variable.slot());
+                    localValues.put(variable, value);
+                    map.put(variable, value);
+                } else if (!map.containsKey(variable)) {
+                    queried.add(variable);
+                    map.put(variable, null);
+                }
+            }
+        }
+        count = queried.size();
+        if (count == 0) {
+            return map;
+        }
+
+        JDWP.StackFrame.GetValues.SlotInfo[] slots =
+                           new JDWP.StackFrame.GetValues.SlotInfo[count];
+        for (int i=0; i<count; ++i) {
+            LocalVariableImpl variable = queried.get(i);
             slots[i] = new JDWP.StackFrame.GetValues.SlotInfo(variable.slot(),
                                       (byte)variable.signature().charAt(0));
         }
@@ -246,10 +297,12 @@ public class StackFrameImpl extends MirrorImpl
             throw new InternalException(
                       "Wrong number of values returned from target VM");
         }
-        Map<LocalVariable, Value> map = new HashMap<LocalVariable, Value>(count);
-        for (int i=0; i<count; ++i) {
-            LocalVariableImpl variable = (LocalVariableImpl)variables.get(i);
-            map.put(variable, values[i]);
+        synchronized (localValues) {
+            for (int i=0; i<count; ++i) {
+                LocalVariableImpl variable = queried.get(i);
+                map.put(variable, values[i]);
+                localValues.put(variable, values[i]);
+            }
         }
         return map;
     }
@@ -299,6 +352,14 @@ public class StackFrameImpl extends MirrorImpl
                 default:
                     throw exc.toJDIException();
                 }
+            } finally {
+                // ANDROID-CHANGED: Forget the value read before.
+                synchronized (localValues) {
+                    localValues.remove(variable);
+                    if (prefetchedSlots != null) {
+                        prefetchedSlots.remove(variable.slot());
+                    }
+                }
             }
         } catch (ClassNotLoadedException e) {
             /*
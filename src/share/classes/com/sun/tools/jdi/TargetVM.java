@@ -31,11 +31,16 @@ import com.sun.jdi.connect.spi.Connection;
 import com.sun.jdi.event.EventSet;
 
 import java.util.*;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.locks.LockSupport;
 import java.io.IOException;
 
 public class TargetVM implements Runnable {
-    private Map<String, Packet> waitingQueue = new HashMap<String, Packet>(32,0.75f);
-    private boolean shouldListen = true;
+    // ANDROID-CHANGED: Concurrent and keyed by packet id, so that neither
+    // senders nor the reader thread serialize on it.
+    private Map<Integer, Packet> waitingQueue =
+        new ConcurrentHashMap<Integer, Packet>(32, 0.75f);
+    private volatile boolean shouldListen = true;
     private List<EventQueue> eventQueues = Collections.synchronizedList(new ArrayList<EventQueue>(2));
     private VirtualMachineImpl vm;
     private Connection connection;
@@ -50,6 +55,20 @@ public class TargetVM implements Runnable {
     static private final int OVERLOADED_QUEUE = 2000;
     static private final int UNDERLOADED_QUEUE = 100;
 
+    /*
+     * ANDROID-CHANGED: Credit based event flow control. Targets which
+     * support Vendor.EventCredits may only send as many event sets as
+     * they have been granted credits for. Credits are granted to keep
+     * the undiscardable event sets queued plus those in flight at about
+     * EVENT_WINDOW, in batches of at least EVENT_CREDIT_BATCH to save
+     * round trips. Other targets get the HoldEvents/ReleaseEvents
+     * hysteresis above. Guarded by "this".
+     */
+    static private final int EVENT_WINDOW = OVERLOADED_QUEUE;
+    static private final int EVENT_CREDIT_BATCH = EVENT_WINDOW / 4;
+    private boolean useEventCredits = true;
+    private int eventCreditsOutstanding = 0;
+
     TargetVM(VirtualMachineImpl vm, Connection connection) {
         this.vm = vm;
         this.connection = connection;
@@ -66,7 +85,7 @@ public class TargetVM implements Runnable {
         String direction = sending ? "Sending" : "Receiving";
         if (sending) {
             vm.printTrace(direction + " Command. id=" + packet.id +
-                          ", length=" + packet.data.length +
+                          ", length=" + packet.dataLength() +
                           ", commandSet=" + packet.cmdSet +
                           ", command=" + packet.cmd +
                           ", flags=" + packet.flags);
@@ -74,13 +93,13 @@ public class TargetVM implements Runnable {
             String type = (packet.flags & Packet.Reply) != 0 ?
                           "Reply" : "Event";
             vm.printTrace(direction + " " + type + ". id=" + packet.id +
-                          ", length=" + packet.data.length +
+                          ", length=" + packet.dataLength() +
                           ", errorCode=" + packet.errorCode +
                           ", flags=" + packet.flags);
         }
         StringBuffer line = new StringBuffer(80);
         line.append("0000: ");
-        for (int i = 0; i < packet.data.length; i++) {
+        for (int i = 0; i < packet.dataLength(); i++) {
             if ((i > 0) && (i % 16 == 0)) {
                 vm.printTrace(line.toString());
                 line.setLength(0);
@@ -91,7 +110,7 @@ public class TargetVM implements Runnable {
                     line.insert(0, '0');
                 }
             }
-            int val = 0xff & packet.data[i];
+            int val = 0xff & packet.data[packet.dataOffset + i];
             String str = Integer.toHexString(val);
             if (str.length() == 1) {
                 line.append('0');
@@ -109,7 +128,6 @@ public class TargetVM implements Runnable {
             vm.printTrace("Target VM interface thread running");
         }
         Packet p=null,p2;
-        String idString;
 
         while(shouldListen) {
 
@@ -145,14 +163,7 @@ public class TargetVM implements Runnable {
                 }*/
 
                 vm.state().notifyCommandComplete(p.id);
-                idString = String.valueOf(p.id);
-
-                synchronized(waitingQueue) {
-                    p2 = waitingQueue.get(idString);
-
-                    if (p2 != null)
-                        waitingQueue.remove(idString);
-                }
+                p2 = waitingQueue.remove(p.id);
 
                 if(p2 == null) {
                     // Whoa! a reply without a sender. Problem.
@@ -163,11 +174,9 @@ public class TargetVM implements Runnable {
                 }
                 p2.errorCode = p.errorCode;
                 p2.data = p.data;
+                p2.dataOffset = p.dataOffset;
                 p2.replied = true;
-
-                synchronized(p2) {
-                    p2.notify();
-                }
+                wakeWaiter(p2);
             }
         }
 
@@ -190,15 +199,10 @@ public class TargetVM implements Runnable {
 
         // indirectly throw VMDisconnectedException to
         // command requesters.
-        synchronized(waitingQueue) {
-            Iterator<Packet> iter = waitingQueue.values().iterator();
-            while (iter.hasNext()) {
-                Packet packet = iter.next();
-                synchronized(packet) {
-                    packet.notify();
-                }
-            }
-            waitingQueue.clear();
+        Iterator<Packet> iter = waitingQueue.values().iterator();
+        while (iter.hasNext()) {
+            wakeWaiter(iter.next());
+            iter.remove();
         }
 
         if ((vm.traceFlags & VirtualMachine.TRACE_SENDS) != 0) {
@@ -244,6 +248,14 @@ public class TargetVM implements Runnable {
     }
 
     private synchronized void controlEventFlow(int maxQueueSize) {
+        if (useEventCredits) {
+            int credits = EVENT_WINDOW - maxQueueSize - eventCreditsOutstanding;
+            if (credits >= EVENT_CREDIT_BATCH) {
+                eventCreditsOutstanding += credits;
+                eventController().grantCredits(credits);
+            }
+            return;
+        }
         if (!eventsHeld && (maxQueueSize > OVERLOADED_QUEUE)) {
             eventController().hold();
             eventsHeld = true;
@@ -259,21 +271,42 @@ public class TargetVM implements Runnable {
             Iterator<EventQueue> iter = eventQueues.iterator();
             while (iter.hasNext()) {
                 EventQueueImpl queue = (EventQueueImpl)iter.next();
-                maxQueueSize = Math.max(maxQueueSize, queue.size());
+                maxQueueSize = Math.max(maxQueueSize,
+                                        queue.undiscardableSize());
             }
         }
         controlEventFlow(maxQueueSize);
     }
 
+    private synchronized void eventSetReceived() {
+        if (eventCreditsOutstanding > 0) {
+            eventCreditsOutstanding--;
+        }
+    }
+
+    /*
+     * ANDROID-CHANGED: Called by the event controller when the target
+     * does not understand Vendor.EventCredits.
+     */
+    private synchronized void disableEventCredits() {
+        useEventCredits = false;
+        eventCreditsOutstanding = 0;
+    }
+
     private void queueEventSet(EventSet eventSet) {
         int maxQueueSize = 0;
 
+        eventSetReceived();
+
         synchronized(eventQueues) {
+            // ANDROID-CHANGED: See EventSetImpl.discardedByQueue()
+            ((EventSetImpl)eventSet).setQueueCount(eventQueues.size());
             Iterator<EventQueue> iter = eventQueues.iterator();
             while (iter.hasNext()) {
                 EventQueueImpl queue = (EventQueueImpl)iter.next();
                 queue.enqueue(eventSet);
-                maxQueueSize = Math.max(maxQueueSize, queue.size());
+                maxQueueSize = Math.max(maxQueueSize,
+                                        queue.undiscardableSize());
             }
         }
 
@@ -281,11 +314,7 @@ public class TargetVM implements Runnable {
     }
 
     void send(Packet packet) {
-        String id = String.valueOf(packet.id);
-
-        synchronized(waitingQueue) {
-            waitingQueue.put(id, packet);
-        }
+        waitingQueue.put(packet.id, packet);
 
         if ((vm.traceFlags & VirtualMachineImpl.TRACE_RAW_SENDS) != 0) {
             dumpPacket(packet, true);
@@ -298,15 +327,30 @@ public class TargetVM implements Runnable {
         }
     }
 
+    /*
+     * ANDROID-CHANGED: Waiters park instead of waiting on the packet's
+     * monitor. The waiter is published before "replied" is checked and
+     * the reader thread sets "replied" before it looks for the waiter, so
+     * one of them always sees the other.
+     */
     void waitForReply(Packet packet) {
-        synchronized(packet) {
-            while ((!packet.replied) && shouldListen) {
-                try { packet.wait(); } catch (InterruptedException e) {;}
-            }
+        packet.waiter = Thread.currentThread();
+        while ((!packet.replied) && shouldListen) {
+            LockSupport.park(packet);
+            // Interrupts are ignored, as they were with Object.wait
+            Thread.interrupted();
+        }
+        packet.waiter = null;
 
-            if (!packet.replied) {
-                throw new VMDisconnectedException();
-            }
+        if (!packet.replied) {
+            throw new VMDisconnectedException();
+        }
+    }
+
+    private static void wakeWaiter(Packet packet) {
+        Thread waiter = packet.waiter;
+        if (waiter != null) {
+            LockSupport.unpark(waiter);
         }
     }
 
@@ -329,6 +373,8 @@ public class TargetVM implements Runnable {
 
     private class EventController extends Thread {
         int controlRequest = 0;
+        // ANDROID-CHANGED: Event credits still to be sent to the target
+        int creditGrant = 0;
 
         EventController(VirtualMachineImpl vm) {
             super(vm.threadGroupForJDI(), "JDI Event Control Thread");
@@ -347,16 +393,38 @@ public class TargetVM implements Runnable {
             notifyAll();
         }
 
+        synchronized void grantCredits(int credits) {
+            creditGrant += credits;
+            notifyAll();
+        }
+
         public void run() {
             while(true) {
                 int currentRequest;
+                int currentGrant;
                 synchronized(this) {
-                    while (controlRequest == 0) {
+                    while (controlRequest == 0 && creditGrant == 0) {
                         try {wait();} catch (InterruptedException e) {}
                         if (!shouldListen) return;
                     }
                     currentRequest = controlRequest;
                     controlRequest = 0;
+                    currentGrant = creditGrant;
+                    creditGrant = 0;
+                }
+                if (currentGrant > 0) {
+                    try {
+                        JDWP.Vendor.EventCredits.process(vm, currentGrant);
+                    } catch (JDWPException e) {
+                        if (e.errorCode() == JDWP.Error.NOT_IMPLEMENTED) {
+                            disableEventCredits();
+                        } else {
+                            e.toJDIException().printStackTrace(System.err);
+                        }
+                    }
+                }
+                if (currentRequest == 0) {
+                    continue;
                 }
                 try {
                     if (currentRequest > 0) {
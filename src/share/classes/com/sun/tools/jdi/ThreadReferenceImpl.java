@@ -65,6 +65,9 @@ public class ThreadReferenceImpl extends ObjectReferenceImpl
     // create a new initialized one.
     private static class LocalCache {
         JDWP.ThreadReference.Status status = null;
+        // ANDROID-CHANGED: Set when filled by Vendor.ThreadSnapshot,
+        // which also provides the status.
+        JDWP.Vendor.ThreadSnapshot threadSnapshot = null;
         List<StackFrame> frames = null;
         int framesStart = -1;
         int framesLength = 0;
@@ -112,6 +115,10 @@ public class ThreadReferenceImpl extends ObjectReferenceImpl
         return new Cache();
     }
 
+    // ANDROID-CHANGED: Number of frames fetched with Vendor.ThreadSnapshot.
+    private static final int SNAPSHOT_FRAMES =
+        Integer.getInteger("com.sun.tools.jdi.snapshotFrames", 64);
+
     // Listeners - synchronized on vm.state()
     private List<WeakReference<ThreadListener>> listeners = new ArrayList<WeakReference<ThreadListener>>();
 
@@ -185,7 +192,9 @@ public class ThreadReferenceImpl extends ObjectReferenceImpl
         synchronized (vm.state()) {
             processThreadAction(new ThreadAction(this,
                                         ThreadAction.THREAD_RESUMABLE));
-            return sender.send();
+            PacketStream stream = sender.send();
+            vm.state().noteResumeCommand(stream.id());
+            return stream;
         }
     }
 
@@ -214,6 +223,7 @@ public class ThreadReferenceImpl extends ObjectReferenceImpl
             processThreadAction(new ThreadAction(this,
                                       ThreadAction.THREAD_RESUMABLE));
             stream = JDWP.ThreadReference.Resume.enqueueCommand(vm, this);
+            vm.state().noteResumeCommand(stream.id());
         }
         try {
             JDWP.ThreadReference.Resume.waitForReply(vm, stream);
@@ -281,12 +291,22 @@ public class ThreadReferenceImpl extends ObjectReferenceImpl
     }
 
     public int status() {
+        JDWP.Vendor.ThreadSnapshot threadSnapshot = localCache.threadSnapshot;
+        if (threadSnapshot != null) {
+            return threadSnapshot.threadStatus;
+        }
         return jdwpStatus().threadStatus;
     }
 
     public boolean isSuspended() {
-        return ((suspendedZombieCount > 0) ||
-                ((jdwpStatus().suspendStatus & SUSPEND_STATUS_SUSPENDED) != 0));
+        if (suspendedZombieCount > 0) {
+            return true;
+        }
+        JDWP.Vendor.ThreadSnapshot threadSnapshot = localCache.threadSnapshot;
+        if (threadSnapshot != null) {
+            return (threadSnapshot.suspendStatus & SUSPEND_STATUS_SUSPENDED) != 0;
+        }
+        return (jdwpStatus().suspendStatus & SUSPEND_STATUS_SUSPENDED) != 0;
     }
 
     public boolean isAtBreakpoint() {
@@ -331,7 +351,7 @@ public class ThreadReferenceImpl extends ObjectReferenceImpl
     public int frameCount() throws IncompatibleThreadStateException  {
         LocalCache snapshot = localCache;
         try {
-            if (snapshot.frameCount == -1) {
+            if (snapshot.frameCount == -1 && !fetchSnapshot(snapshot)) {
                 snapshot.frameCount = JDWP.ThreadReference.FrameCount
                                           .process(vm, this).frameCount;
             }
@@ -388,6 +408,87 @@ public class ThreadReferenceImpl extends ObjectReferenceImpl
         return privateFrames(start, length);
     }
 
+    /**
+     * ANDROID-CHANGED: Fills the status, frame count and topmost frames
+     * of the given cache with one Vendor.ThreadSnapshot command, instead
+     * of the separate commands each would otherwise take when the
+     * debugger first looks at the stack of a thread that has stopped.
+     * Returns false, leaving the cache untouched, if the target does
+     * not support the command.
+     */
+    synchronized private boolean fetchSnapshot(LocalCache snapshot)
+                                               throws JDWPException {
+        if (!vm.vendorThreadSnapshot) {
+            return false;
+        }
+        if (snapshot.threadSnapshot != null) {
+            return true;
+        }
+        JDWP.Vendor.ThreadSnapshot reply;
+        try {
+            reply = JDWP.Vendor.ThreadSnapshot.process(vm, this,
+                                                       SNAPSHOT_FRAMES);
+        } catch (JDWPException exc) {
+            if (exc.errorCode() == JDWP.Error.NOT_IMPLEMENTED) {
+                vm.vendorThreadSnapshot = false;
+                return false;
+            }
+            throw exc;
+        }
+        int count = reply.frames.length;
+        List<StackFrame> frames = new ArrayList<StackFrame>(count);
+        for (int i = 0; i < count; i++) {
+            if (reply.frames[i].location == null) {
+                throw new InternalException("Invalid frame location");
+            }
+            frames.add(new StackFrameImpl(vm, this,
+                                          reply.frames[i].frameID,
+                                          reply.frames[i].location));
+        }
+        snapshot.threadSnapshot = reply;
+        snapshot.frameCount = reply.frameCount;
+        if (snapshot.frames == null) {
+            snapshot.frames = frames;
+            snapshot.framesStart = 0;
+            snapshot.framesLength = (count == reply.frameCount) ? -1 : count;
+        }
+        return true;
+    }
+
+    /**
+     * ANDROID-CHANGED: Fills the cache from the prefetch bundle sent
+     * with an event, see EventSetImpl. Nothing is done if the thread
+     * may have been resumed since the event arrived, which is the case
+     * when the resume generation has moved on, or if the cache already
+     * holds frames.
+     */
+    synchronized void seedPrefetch(int resumeGeneration, int frameCount,
+                                   long[] frameIDs, Location[] locations,
+                                   ObjectReference thisObject,
+                                   Map<Integer, Value> slotValues) {
+        // The cache is read before the generation, a resume bumps the
+        // generation before it resets the cache.
+        LocalCache snapshot = localCache;
+        if (vm.state().resumeGeneration() != resumeGeneration ||
+            snapshot.frames != null || snapshot.frameCount != -1) {
+            return;
+        }
+        int count = frameIDs.length;
+        List<StackFrame> frames = new ArrayList<StackFrame>(count);
+        for (int i = 0; i < count; i++) {
+            StackFrameImpl frame = new StackFrameImpl(vm, this, frameIDs[i],
+                                                      locations[i]);
+            if (i == 0) {
+                frame.seedPrefetch(thisObject, slotValues);
+            }
+            frames.add(frame);
+        }
+        snapshot.frameCount = frameCount;
+        snapshot.frames = frames;
+        snapshot.framesStart = 0;
+        snapshot.framesLength = (count == frameCount) ? -1 : count;
+    }
+
     /**
      * Private version of frames() allows "-1" to specify all
      * remaining frames.
@@ -399,6 +500,9 @@ public class ThreadReferenceImpl extends ObjectReferenceImpl
         // do this at the same time, one won't clobber the subset created by the other.
         LocalCache snapshot = localCache;
         try {
+            if (snapshot.frames == null && snapshot.frameCount == -1) {
+                fetchSnapshot(snapshot);
+            }
             if (snapshot.frames == null || !isSubrange(snapshot, start, length)) {
                 JDWP.ThreadReference.Frames.Frame[] jdwpFrames
                     = JDWP.ThreadReference.Frames.
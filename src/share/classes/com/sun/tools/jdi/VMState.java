@@ -43,9 +43,21 @@ class VMState {
      * are used to track whether there are pending resumes. (There
      * is an assumption that JDWP command ids are increasing over time.)
      */
-    private int lastCompletedCommandId = 0;   // synchronized (this)
+    // ANDROID-CHANGED: Updated without the lock by the transport reader
+    // thread, see notifyCommandComplete().
+    private volatile int lastCompletedCommandId = 0;
     private int lastResumeCommandId = 0;      // synchronized (this)
 
+    /*
+     * ANDROID-CHANGED: Bumped whenever the VM or any single thread is
+     * resumed, and the id of the last command that resumed anything.
+     * Read without the lock by the transport reader thread, so that an
+     * event set can later tell whether its event thread may have been
+     * resumed since the event arrived. See settledResumeGeneration().
+     */
+    private volatile int resumeGeneration = 0;      // written synchronized (this)
+    private volatile int lastAnyResumeCommandId = 0; // written synchronized (this)
+
     // This is cached only while the VM is suspended
     private static class Cache {
         List<ThreadGroupReference> groups = null;  // cached Top Level ThreadGroups
@@ -92,7 +104,10 @@ class VMState {
      * A JDWP command has been completed (reply has been received).
      * Update data that tracks pending resume commands.
      */
-    synchronized void notifyCommandComplete(int id) {
+    void notifyCommandComplete(int id) {
+        // ANDROID-CHANGED: Not synchronized, so that the transport reader
+        // thread never waits for threads holding the VMState lock. Only
+        // the reader thread writes the field.
         lastCompletedCommandId = id;
     }
 
@@ -111,10 +126,42 @@ class VMState {
     synchronized PacketStream thawCommand(CommandSender sender) {
         PacketStream stream = sender.send();
         lastResumeCommandId = stream.id();
+        noteResumeCommand(stream.id());
         thaw();
         return stream;
     }
 
+    /**
+     * ANDROID-CHANGED: Records a command that resumes the VM or a
+     * thread, after it has been sent.
+     */
+    synchronized void noteResumeCommand(int id) {
+        if (id > lastAnyResumeCommandId) {
+            lastAnyResumeCommandId = id;
+        }
+        resumeGeneration++;
+    }
+
+    /**
+     * ANDROID-CHANGED: The current resume generation, or -1 if a command
+     * that resumes the VM or a thread has been sent but not yet
+     * completed, so that the state of a thread that has stopped may be
+     * undone by it. The generation is read before the pending command,
+     * and both are written in the opposite order, so a resume that is
+     * missed here changes the generation later.
+     */
+    int settledResumeGeneration() {
+        int generation = resumeGeneration;
+        if (lastCompletedCommandId < lastAnyResumeCommandId) {
+            return -1;
+        }
+        return generation;
+    }
+
+    int resumeGeneration() {
+        return resumeGeneration;
+    }
+
     /**
      * All threads are resuming
      */
@@ -128,6 +175,8 @@ class VMState {
      * resumed.
      */
     synchronized void thaw(ThreadReference resumingThread) {
+        // ANDROID-CHANGED: Before any listener discards its state
+        resumeGeneration++;
         if (cache != null) {
             if ((vm.traceFlags & VirtualMachine.TRACE_OBJREFS) != 0) {
                 vm.printTrace("Clearing VM suspended cache");
@@ -73,8 +73,33 @@ class VirtualMachineImpl extends MirrorImpl
     // be set synchronously
     private Map<Long, ReferenceType> typesByID;
     private TreeSet<ReferenceType> typesBySignature;
+    // ANDROID-CHANGED: Index of the types in typesBySignature keyed by
+    // signature. typesBySignature is ordered by name and ref, which does
+    // not allow a lookup by signature, so without this index
+    // classesByName and ClassUnload handling scan every known type.
+    private Map<String, List<ReferenceType>> typeListsBySignature;
     private boolean retrievedAllTypes = false;
 
+    // ANDROID-CHANGED: Cleared when the target does not understand
+    // Vendor.LocationsOfLine, see ReferenceTypeImpl.locationsOfLine.
+    // Only ever goes from true to false, so needs no synchronization.
+    volatile boolean vendorLocationsOfLine = true;
+    // ANDROID-CHANGED: Likewise for Vendor.ThreadSnapshot, see
+    // ThreadReferenceImpl.fetchSnapshot.
+    volatile boolean vendorThreadSnapshot = true;
+    // ANDROID-CHANGED: Likewise for the Prefetch event request modifier,
+    // see EventRequestManagerImpl.EventRequestImpl.set.
+    volatile boolean vendorPrefetch = true;
+    // ANDROID-CHANGED: Likewise for the MethodOnly event request modifier.
+    volatile boolean vendorMethodOnly = true;
+    // ANDROID-CHANGED: Likewise for Vendor.BytecodeRange and
+    // Vendor.ConstantPoolRange, see BlobCache.
+    volatile boolean vendorContentRange = true;
+    final BlobCache blobCache = new BlobCache();
+    // ANDROID-CHANGED: Likewise for Vendor.ClassMetadataKey, see
+    // ReferenceTypeImpl.metadata.
+    volatile boolean vendorClassMetadata = true;
+
     // For other languages support
     private String defaultStratum = null;
 
@@ -85,6 +110,12 @@ class VirtualMachineImpl extends MirrorImpl
     static private final int DISPOSE_THRESHOLD = 50;
     private final List<SoftObjectReference> batchedDisposeRequests =
             Collections.synchronizedList(new ArrayList<SoftObjectReference>(DISPOSE_THRESHOLD + 10));
+    // ANDROID-CHANGED: Trackers of the object IDs event sets did not
+    // read, see EventSetImpl.UnreadIDs. They are created on the transport
+    // reader thread, which must not wait for "synchronized(this)".
+    private final Set<EventSetImpl.UnreadIDs> unreadIDs =
+            Collections.synchronizedSet(new HashSet<EventSetImpl.UnreadIDs>());
+    final ReferenceQueue<EventSetImpl> eventSetQueue = new ReferenceQueue<EventSetImpl>();
 
     // These are cached once for the life of the VM
     private JDWP.VirtualMachine.Version versionInfo;
@@ -783,6 +814,14 @@ class VirtualMachineImpl extends MirrorImpl
 
         typesByID.put(new Long(id), type);
         typesBySignature.add(type);
+        // ANDROID-CHANGED: Keep the signature index in step.
+        String sig = type.signature();
+        List<ReferenceType> sameSignature = typeListsBySignature.get(sig);
+        if (sameSignature == null) {
+            sameSignature = new ArrayList<ReferenceType>(1);
+            typeListsBySignature.put(sig, sameSignature);
+        }
+        sameSignature.add(type);
 
         if ((vm.traceFlags & VirtualMachine.TRACE_REFTYPES) != 0) {
            vm.printTrace("Caching new ReferenceType, sig=" + signature +
@@ -801,22 +840,20 @@ class VirtualMachineImpl extends MirrorImpl
          * we can't differentiate here, we first remove all
          * matching classes from our cache...
          */
-        Iterator<ReferenceType> iter = typesBySignature.iterator();
-        int matches = 0;
-        while (iter.hasNext()) {
-            ReferenceTypeImpl type = (ReferenceTypeImpl)iter.next();
-            int comp = signature.compareTo(type.signature());
-            if (comp == 0) {
-                matches++;
-                iter.remove();
-                typesByID.remove(new Long(type.ref()));
-                if ((vm.traceFlags & VirtualMachine.TRACE_REFTYPES) != 0) {
-                   vm.printTrace("Uncaching ReferenceType, sig=" + signature +
-                                 ", id=" + type.ref());
-                }
-/* fix for 4359077 , don't break out. list is no longer sorted
-        in the order we think
- */
+        // ANDROID-CHANGED: Use the signature index instead of scanning
+        // typesBySignature.
+        List<ReferenceType> sameSignature = typeListsBySignature.remove(signature);
+        if (sameSignature == null) {
+            return;
+        }
+        int matches = sameSignature.size();
+        for (ReferenceType rt : sameSignature) {
+            ReferenceTypeImpl type = (ReferenceTypeImpl)rt;
+            typesBySignature.remove(type);
+            typesByID.remove(new Long(type.ref()));
+            if ((vm.traceFlags & VirtualMachine.TRACE_REFTYPES) != 0) {
+               vm.printTrace("Uncaching ReferenceType, sig=" + signature +
+                             ", id=" + type.ref());
             }
         }
 
@@ -833,24 +870,19 @@ class VirtualMachineImpl extends MirrorImpl
         if (typesByID == null) {
             return new ArrayList<ReferenceType>(0);
         }
-        Iterator<ReferenceType> iter = typesBySignature.iterator();
-        List<ReferenceType> list = new ArrayList<ReferenceType>();
-        while (iter.hasNext()) {
-            ReferenceTypeImpl type = (ReferenceTypeImpl)iter.next();
-            int comp = signature.compareTo(type.signature());
-            if (comp == 0) {
-                list.add(type);
-/* fix for 4359077 , don't break out. list is no longer sorted
-        in the order we think
- */
-            }
+        // ANDROID-CHANGED: Use the signature index instead of scanning
+        // typesBySignature.
+        List<ReferenceType> sameSignature = typeListsBySignature.get(signature);
+        if (sameSignature == null) {
+            return new ArrayList<ReferenceType>(0);
         }
-        return list;
+        return new ArrayList<ReferenceType>(sameSignature);
     }
 
     private void initReferenceTypes() {
         typesByID = new HashMap<Long, ReferenceType>(300);
         typesBySignature = new TreeSet<ReferenceType>();
+        typeListsBySignature = new HashMap<String, List<ReferenceType>>(300);
     }
 
     ReferenceTypeImpl referenceType(long ref, byte tag) {
@@ -1218,6 +1250,10 @@ class VirtualMachineImpl extends MirrorImpl
     }
 
     private void batchForDispose(SoftObjectReference ref) {
+        // ANDROID-CHANGED: Nothing to give back, see forgetObjectIDs()
+        if (ref.count() == 0) {
+            return;
+        }
         if ((traceFlags & TRACE_OBJREFS) != 0) {
             printTrace("Batching object " + ref.key().longValue() +
                        " for dispose (ref count = " + ref.count() + ")");
@@ -1235,6 +1271,45 @@ class VirtualMachineImpl extends MirrorImpl
             removeObjectMirror(softRef);
             batchForDispose(softRef);
         }
+        // ANDROID-CHANGED: Release what unreachable event sets did not read
+        while ((ref = eventSetQueue.poll()) != null) {
+            EventSetImpl.UnreadIDs ids = (EventSetImpl.UnreadIDs)ref;
+            unreadIDs.remove(ids);
+            disposeUnreadObjectIDs(ids.collect());
+        }
+    }
+
+    void trackUnreadIDs(EventSetImpl.UnreadIDs ids) {
+        unreadIDs.add(ids);
+    }
+
+    void untrackUnreadIDs(EventSetImpl.UnreadIDs ids) {
+        unreadIDs.remove(ids);
+    }
+
+    /*
+     * ANDROID-CHANGED: The given IDs were read into mirrors after they
+     * had been released already, see EventSetImpl.UnreadIDs. Takes back
+     * the counts the mirrors took, once for every time an ID is listed.
+     */
+    synchronized void forgetObjectIDs(List<Long> ids) {
+        for (Long id : ids) {
+            SoftObjectReference ref = objectsByID.get(id);
+            if (ref != null) {
+                ref.decrementCount();
+            }
+        }
+    }
+
+    /*
+     * ANDROID-CHANGED: Batches the release of object IDs which were
+     * received but never read into a mirror. Each ID is released once
+     * for every time it is listed.
+     */
+    void disposeUnreadObjectIDs(List<Long> ids) {
+        for (Long id : ids) {
+            batchForDispose(new SoftObjectReference(id, null, null));
+        }
     }
 
     synchronized ObjectReferenceImpl objectMirror(long id, int tag) {
@@ -1430,6 +1505,13 @@ class VirtualMachineImpl extends MirrorImpl
            count++;
        }
 
+       // ANDROID-CHANGED: See forgetObjectIDs()
+       void decrementCount() {
+           if (count > 0) {
+               count--;
+           }
+       }
+
        Long key() {
            return key;
        }
@@ -142,6 +142,40 @@ typedef jint (JNICALL *jdwpTransport_OnLoad_t)(JavaVM *jvm,
                                                jint version,
                                                jdwpTransportEnv** env);
 
+/*
+ * ANDROID-CHANGED: Optional entry points a transport library may export
+ * next to jdwpTransport_OnLoad. The back-end looks them up by name
+ * ("jdwpTransport_SetBatching", "jdwpTransport_GetStats",
+ * "jdwpTransport_SetBufferSize") and copes with their absence.
+ *
+ * While batching is on, WritePacket may hold packets back in order to
+ * send several of them with one system call; turning batching off
+ * sends anything held back. Both are called with writes serialized.
+ *
+ * SetBufferSize asks for socket send and receive buffers of the given
+ * size on connections made afterwards; 0 leaves the system's defaults.
+ * The buffer sizes in the stats are those in effect on the current
+ * connection, or -1 if unknown.
+ */
+typedef struct jdwpTransportStats {
+    jlong bytesSent;
+    jlong bytesReceived;
+    jlong packetsSent;
+    jlong packetsReceived;
+    jlong sendCalls;            /* send system calls */
+    jlong recvCalls;            /* recv system calls */
+    jlong flushes;              /* batches written */
+    jlong sendBufferSize;       /* bytes */
+    jlong receiveBufferSize;    /* bytes */
+} jdwpTransportStats;
+
+typedef jdwpTransportError (JNICALL *jdwpTransport_SetBatching_t)(jdwpTransportEnv* env,
+                                                                 jboolean batching);
+typedef jdwpTransportError (JNICALL *jdwpTransport_GetStats_t)(jdwpTransportEnv* env,
+                                                              jdwpTransportStats* stats);
+typedef jdwpTransportError (JNICALL *jdwpTransport_SetBufferSize_t)(jdwpTransportEnv* env,
+                                                                   jint size);
+
 
 
 /* Function Interface */
@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stdatomic.h>
 
 #include "jdwpTransport.h"
 #include "sysSocket.h"
@@ -68,6 +69,36 @@ static jdwpTransportEnv single_env = (jdwpTransportEnv)&interface;
 static jint recv_fully(int, char *, int);
 static jint send_fully(int, char *, int);
 
+/*
+ * ANDROID-CHANGED: Output batching. While the back-end has batching
+ * turned on (see jdwpTransport_SetBatching) packets are collected in
+ * outputBuffer and written with a single send when batching is turned
+ * off again or the buffer is full. Protected by the back-end's send
+ * lock, like all of WritePacket.
+ */
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+static char *outputBuffer;
+static int outputLength;
+static jboolean batching;
+
+/*
+ * ANDROID-CHANGED: Socket buffer size set with jdwpTransport_SetBufferSize,
+ * or 0 to leave the kernel's defaults and auto-tuning alone. setOptions
+ * applies it before listen or connect, so that the TCP window scale is
+ * negotiated for it, and accepted connections inherit it.
+ */
+static jint bufferSize;
+
+/* ANDROID-CHANGED: Counters reported by jdwpTransport_GetStats */
+static _Atomic(jlong) bytesSent;
+static _Atomic(jlong) bytesReceived;
+static _Atomic(jlong) packetsSent;
+static _Atomic(jlong) packetsReceived;
+static _Atomic(jlong) sendCalls;
+static _Atomic(jlong) recvCalls;
+static _Atomic(jlong) flushes;
+
 /*
  * Record the last error for this thread.
  */
@@ -132,6 +163,21 @@ setOptions(int fd)
         RETURN_IO_ERROR("setsockopt TCPNODELAY failed");
     }
 
+    /* ANDROID-CHANGED: Requested buffer sizes */
+    if (bufferSize > 0) {
+        jvalue size;
+
+        size.i = bufferSize;
+        err = dbgsysSetSocketOption(fd, SO_SNDBUF, JNI_TRUE, size);
+        if (err < 0) {
+            RETURN_IO_ERROR("setsockopt SO_SNDBUF failed");
+        }
+        err = dbgsysSetSocketOption(fd, SO_RCVBUF, JNI_TRUE, size);
+        if (err < 0) {
+            RETURN_IO_ERROR("setsockopt SO_RCVBUF failed");
+        }
+    }
+
     return JDWPTRANSPORT_ERROR_NONE;
 }
 
@@ -321,22 +367,18 @@ socketTransport_startListening(jdwpTransportEnv* env, const char* address,
     return JDWPTRANSPORT_ERROR_NONE;
 }
 
-static jdwpTransportError JNICALL
-socketTransport_accept(jdwpTransportEnv* env, jlong acceptTimeout, jlong handshakeTimeout)
+/*
+ * Accept connections one at a time, handshaking with each before the
+ * next one is accepted.
+ */
+static jdwpTransportError
+acceptSequentially(jlong acceptTimeout, jlong handshakeTimeout)
 {
     socklen_t socketLen;
     int err;
     struct sockaddr_in socket;
     jlong startTime = (jlong)0;
 
-    /*
-     * Use a default handshake timeout if not specified - this avoids an indefinite
-     * hang in cases where something other than a debugger connects to our port.
-     */
-    if (handshakeTimeout == 0) {
-        handshakeTimeout = 2000;
-    }
-
     do {
         /*
          * If there is an accept timeout then we put the socket in non-blocking
@@ -413,6 +455,226 @@ socketTransport_accept(jdwpTransportEnv* env, jlong acceptTimeout, jlong handsha
     return JDWPTRANSPORT_ERROR_NONE;
 }
 
+/*
+ * ANDROID-CHANGED: Port scanners and health checkers connecting to the
+ * debug port used to stall the accept for the whole handshake timeout
+ * each. Instead the listening socket and up to MAX_PENDING_HANDSHAKES
+ * accepted connections are watched together, every connection gets
+ * its own handshake deadline and is dropped as soon as it sends a byte
+ * which does not match the handshake. The first connection to complete
+ * the handshake wins.
+ */
+
+#define MAX_PENDING_HANDSHAKES 16
+
+typedef struct PendingConnection {
+    int fd;                     /* -1 if the slot is free */
+    long deadline;
+    int received;
+} PendingConnection;
+
+static void
+dropPendingConnection(int pollSet, PendingConnection *conn, const char *reason)
+{
+    fprintf(stderr, "Debugger failed to attach: %s\n", reason);
+    (void)dbgsysPollSetRemove(pollSet, conn->fd);
+    dbgsysSocketClose(conn->fd);
+    conn->fd = -1;
+}
+
+/*
+ * Read whatever part of the handshake is available. Returns 1 once the
+ * complete handshake has been received, 0 if more is expected and -1
+ * (with the connection dropped) if it is not a debugger.
+ */
+static int
+readPendingHandshake(int pollSet, PendingConnection *conn)
+{
+    const char *hello = "JDWP-Handshake";
+    int helloLen = (int)strlen(hello);
+    char b[16];
+    int n;
+
+    n = dbgsysRecv(conn->fd, b, helloLen - conn->received, 0);
+    atomic_fetch_add_explicit(&recvCalls, 1, memory_order_relaxed);
+    if (n > 0) {
+        atomic_fetch_add_explicit(&bytesReceived, n, memory_order_relaxed);
+    }
+    if (n == 0) {
+        dropPendingConnection(pollSet, conn,
+            "handshake failed - connection prematurally closed");
+        return -1;
+    }
+    if (n < 0) {
+        dropPendingConnection(pollSet, conn, "recv failed during handshake");
+        return -1;
+    }
+    if (strncmp(b, hello + conn->received, n) != 0) {
+        dropPendingConnection(pollSet, conn, "handshake failed - unexpected data");
+        return -1;
+    }
+    conn->received += n;
+    return (conn->received == helloLen) ? 1 : 0;
+}
+
+static jdwpTransportError
+acceptMultiplexed(int pollSet, jlong acceptTimeout, jlong handshakeTimeout)
+{
+    const char *hello = "JDWP-Handshake";
+    PendingConnection pending[MAX_PENDING_HANDSHAKES];
+    int ready[MAX_PENDING_HANDSHAKES + 1];
+    long acceptDeadline = 0;
+    int i;
+
+    for (i = 0; i < MAX_PENDING_HANDSHAKES; i++) {
+        pending[i].fd = -1;
+    }
+    if (acceptTimeout > 0) {
+        acceptDeadline = dbgsysCurrentTimeMillis() + (long)acceptTimeout;
+    }
+
+    dbgsysConfigureBlocking(serverSocketFD, JNI_FALSE);
+    if (dbgsysPollSetAdd(pollSet, serverSocketFD) < 0) {
+        setLastError(JDWPTRANSPORT_ERROR_IO_ERROR, "poll failed");
+        dbgsysConfigureBlocking(serverSocketFD, JNI_TRUE);
+        return JDWPTRANSPORT_ERROR_IO_ERROR;
+    }
+
+    while (socketFD < 0) {
+        long now = dbgsysCurrentTimeMillis();
+        long timeout = -1;
+        int count;
+
+        /* Drop connections whose handshake took too long */
+        for (i = 0; i < MAX_PENDING_HANDSHAKES; i++) {
+            if (pending[i].fd >= 0) {
+                if (pending[i].deadline <= now) {
+                    dropPendingConnection(pollSet, &pending[i],
+                                          "timeout during handshake");
+                } else if (timeout < 0 || pending[i].deadline - now < timeout) {
+                    timeout = pending[i].deadline - now;
+                }
+            }
+        }
+        if (acceptTimeout > 0) {
+            if (acceptDeadline <= now) {
+                setLastError(JDWPTRANSPORT_ERROR_TIMEOUT,
+                             "timed out waiting for connection");
+                break;
+            }
+            if (timeout < 0 || acceptDeadline - now < timeout) {
+                timeout = acceptDeadline - now;
+            }
+        }
+
+        count = dbgsysPollSetWait(pollSet, ready, MAX_PENDING_HANDSHAKES + 1, timeout);
+        if (count < 0) {
+            setLastError(JDWPTRANSPORT_ERROR_IO_ERROR, "poll failed");
+            break;
+        }
+
+        for (i = 0; i < count && socketFD < 0; i++) {
+            int j;
+
+            if (ready[i] == serverSocketFD) {
+                struct sockaddr_in socket;
+                socklen_t socketLen = sizeof(socket);
+                int fd;
+
+                memset((void *)&socket,0,sizeof(struct sockaddr_in));
+                fd = dbgsysAccept(serverSocketFD, (struct sockaddr *)&socket, &socketLen);
+                if (fd == DBG_EWOULDBLOCK) {
+                    continue;
+                }
+                if (fd < 0) {
+                    setLastError(JDWPTRANSPORT_ERROR_IO_ERROR, "accept failed");
+                    goto done;
+                }
+                for (j = 0; j < MAX_PENDING_HANDSHAKES; j++) {
+                    if (pending[j].fd < 0) {
+                        break;
+                    }
+                }
+                if (j == MAX_PENDING_HANDSHAKES ||
+                        dbgsysConfigureBlocking(fd, JNI_FALSE) < 0 ||
+                        dbgsysPollSetAdd(pollSet, fd) < 0) {
+                    /* Too many half open connections, refuse this one */
+                    dbgsysSocketClose(fd);
+                    continue;
+                }
+                pending[j].fd = fd;
+                pending[j].received = 0;
+                pending[j].deadline = dbgsysCurrentTimeMillis() + (long)handshakeTimeout;
+                continue;
+            }
+
+            for (j = 0; j < MAX_PENDING_HANDSHAKES; j++) {
+                if (pending[j].fd == ready[i]) {
+                    break;
+                }
+            }
+            if (j == MAX_PENDING_HANDSHAKES ||
+                    readPendingHandshake(pollSet, &pending[j]) <= 0) {
+                continue;
+            }
+
+            /* A debugger, reply and hand the connection over */
+            (void)dbgsysPollSetRemove(pollSet, pending[j].fd);
+            dbgsysConfigureBlocking(pending[j].fd, JNI_TRUE);
+            if (send_fully(pending[j].fd, (char *)hello, (int)strlen(hello)) !=
+                    (int)strlen(hello)) {
+                fprintf(stderr, "Debugger failed to attach: %s\n",
+                        "send failed during handshake");
+                dbgsysSocketClose(pending[j].fd);
+            } else {
+                socketFD = pending[j].fd;
+            }
+            pending[j].fd = -1;
+        }
+    }
+
+done:
+    for (i = 0; i < MAX_PENDING_HANDSHAKES; i++) {
+        if (pending[i].fd >= 0) {
+            (void)dbgsysPollSetRemove(pollSet, pending[i].fd);
+            dbgsysSocketClose(pending[i].fd);
+        }
+    }
+    (void)dbgsysPollSetRemove(pollSet, serverSocketFD);
+    dbgsysConfigureBlocking(serverSocketFD, JNI_TRUE);
+
+    if (socketFD < 0) {
+        if (acceptTimeout > 0 && dbgsysCurrentTimeMillis() >= acceptDeadline) {
+            return JDWPTRANSPORT_ERROR_TIMEOUT;
+        }
+        return JDWPTRANSPORT_ERROR_IO_ERROR;
+    }
+    return JDWPTRANSPORT_ERROR_NONE;
+}
+
+static jdwpTransportError JNICALL
+socketTransport_accept(jdwpTransportEnv* env, jlong acceptTimeout, jlong handshakeTimeout)
+{
+    jdwpTransportError err;
+    int pollSet;
+
+    /*
+     * Use a default handshake timeout if not specified - this avoids an indefinite
+     * hang in cases where something other than a debugger connects to our port.
+     */
+    if (handshakeTimeout == 0) {
+        handshakeTimeout = 2000;
+    }
+
+    pollSet = dbgsysPollSetCreate();
+    if (pollSet < 0) {
+        return acceptSequentially(acceptTimeout, handshakeTimeout);
+    }
+    err = acceptMultiplexed(pollSet, acceptTimeout, handshakeTimeout);
+    dbgsysPollSetClose(pollSet);
+    return err;
+}
+
 static jdwpTransportError JNICALL
 socketTransport_stopListening(jdwpTransportEnv *env)
 {
@@ -503,6 +765,9 @@ socketTransport_close(jdwpTransportEnv* env)
 {
     int fd = socketFD;
     socketFD = -1;
+    /* ANDROID-CHANGED: Anything still batched is for the closed connection */
+    outputLength = 0;
+    batching = JNI_FALSE;
     if (fd < 0) {
         return JDWPTRANSPORT_ERROR_NONE;
     }
@@ -529,6 +794,25 @@ socketTransport_close(jdwpTransportEnv* env)
     return JDWPTRANSPORT_ERROR_NONE;
 }
 
+/*
+ * ANDROID-CHANGED: Write out the batched packets.
+ */
+static jdwpTransportError
+flushOutput(void)
+{
+    int len = outputLength;
+
+    if (len == 0) {
+        return JDWPTRANSPORT_ERROR_NONE;
+    }
+    outputLength = 0;
+    atomic_fetch_add_explicit(&flushes, 1, memory_order_relaxed);
+    if (send_fully(socketFD, outputBuffer, len) != len) {
+        RETURN_IO_ERROR("send failed");
+    }
+    return JDWPTRANSPORT_ERROR_NONE;
+}
+
 static jdwpTransportError JNICALL
 socketTransport_writePacket(jdwpTransportEnv* env, const jdwpPacket *packet)
 {
@@ -538,6 +822,7 @@ socketTransport_writePacket(jdwpTransportEnv* env, const jdwpPacket *packet)
      */
     char header[HEADER_SIZE + MAX_DATA_SIZE];
     jbyte *data;
+    jdwpTransportError err;
 
     /* packet can't be null */
     if (packet == NULL) {
@@ -569,6 +854,22 @@ socketTransport_writePacket(jdwpTransportEnv* env, const jdwpPacket *packet)
     }
 
     data = packet->type.cmd.data;
+    atomic_fetch_add_explicit(&packetsSent, 1, memory_order_relaxed);
+
+    /* ANDROID-CHANGED: Collect the packet if batching, or flush what was */
+    if (outputLength + HEADER_SIZE + data_len > OUTPUT_BUFFER_SIZE || !batching) {
+        err = flushOutput();
+        if (err != JDWPTRANSPORT_ERROR_NONE) {
+            return err;
+        }
+    }
+    if (batching && HEADER_SIZE + data_len <= OUTPUT_BUFFER_SIZE) {
+        memcpy(outputBuffer + outputLength, header, HEADER_SIZE);
+        memcpy(outputBuffer + outputLength + HEADER_SIZE, data, data_len);
+        outputLength += HEADER_SIZE + data_len;
+        return JDWPTRANSPORT_ERROR_NONE;
+    }
+
     /* Do one send for short packets, two for longer ones */
     if (data_len <= MAX_DATA_SIZE) {
         memcpy(header + HEADER_SIZE, data, data_len);
@@ -598,6 +899,7 @@ recv_fully(int f, char *buf, int len)
     int nbytes = 0;
     while (nbytes < len) {
         int res = dbgsysRecv(f, buf + nbytes, len - nbytes, 0);
+        atomic_fetch_add_explicit(&recvCalls, 1, memory_order_relaxed);
         if (res < 0) {
             return res;
         } else if (res == 0) {
@@ -605,6 +907,7 @@ recv_fully(int f, char *buf, int len)
         }
         nbytes += res;
     }
+    atomic_fetch_add_explicit(&bytesReceived, nbytes, memory_order_relaxed);
     return nbytes;
 }
 
@@ -614,6 +917,7 @@ send_fully(int f, char *buf, int len)
     int nbytes = 0;
     while (nbytes < len) {
         int res = dbgsysSend(f, buf + nbytes, len - nbytes, 0);
+        atomic_fetch_add_explicit(&sendCalls, 1, memory_order_relaxed);
         if (res < 0) {
             return res;
         } else if (res == 0) {
@@ -621,6 +925,7 @@ send_fully(int f, char *buf, int len)
         }
         nbytes += res;
     }
+    atomic_fetch_add_explicit(&bytesSent, nbytes, memory_order_relaxed);
     return nbytes;
 }
 
@@ -628,59 +933,50 @@ static jdwpTransportError JNICALL
 socketTransport_readPacket(jdwpTransportEnv* env, jdwpPacket* packet) {
     jint length, data_len;
     jint n;
+    char header[HEADER_SIZE];
 
     /* packet can't be null */
     if (packet == NULL) {
         RETURN_ERROR(JDWPTRANSPORT_ERROR_ILLEGAL_ARGUMENT, "packet is null");
     }
 
-    /* read the length field */
-    n = recv_fully(socketFD, (char *)&length, sizeof(jint));
+    /*
+     * ANDROID-CHANGED: Read the whole header with one recv_fully. Command
+     * and reply headers are both HEADER_SIZE bytes long.
+     */
+    n = recv_fully(socketFD, header, HEADER_SIZE);
 
     /* check for EOF */
     if (n == 0) {
         packet->type.cmd.len = 0;
         return JDWPTRANSPORT_ERROR_NONE;
     }
-    if (n != sizeof(jint)) {
+    if (n != HEADER_SIZE) {
         RETURN_RECV_ERROR(n);
     }
+    atomic_fetch_add_explicit(&packetsReceived, 1, memory_order_relaxed);
 
+    memcpy(&length, header + 0, sizeof(jint));
     length = (jint)dbgsysNetworkToHostLong(length);
     packet->type.cmd.len = length;
 
-
-    n = recv_fully(socketFD,(char *)&(packet->type.cmd.id),sizeof(jint));
-    if (n < (int)sizeof(jint)) {
-        RETURN_RECV_ERROR(n);
-    }
-
+    memcpy(&(packet->type.cmd.id), header + 4, sizeof(jint));
     packet->type.cmd.id = (jint)dbgsysNetworkToHostLong(packet->type.cmd.id);
 
-    n = recv_fully(socketFD,(char *)&(packet->type.cmd.flags),sizeof(jbyte));
-    if (n < (int)sizeof(jbyte)) {
-        RETURN_RECV_ERROR(n);
-    }
+    packet->type.cmd.flags = header[8];
 
     if (packet->type.cmd.flags & JDWPTRANSPORT_FLAGS_REPLY) {
-        n = recv_fully(socketFD,(char *)&(packet->type.reply.errorCode),sizeof(jbyte));
-        if (n < (int)sizeof(jshort)) {
-            RETURN_RECV_ERROR(n);
-        }
-
-        /* FIXME - should the error be converted to host order?? */
-
+        jshort errorCode;
 
+        /*
+         * ANDROID-CHANGED: The error code is big endian on the wire,
+         * like every other field, and writePacket converts it.
+         */
+        memcpy(&errorCode, header + 9, sizeof(jshort));
+        packet->type.reply.errorCode = dbgsysNetworkToHostShort(errorCode);
     } else {
-        n = recv_fully(socketFD,(char *)&(packet->type.cmd.cmdSet),sizeof(jbyte));
-        if (n < (int)sizeof(jbyte)) {
-            RETURN_RECV_ERROR(n);
-        }
-
-        n = recv_fully(socketFD,(char *)&(packet->type.cmd.cmd),sizeof(jbyte));
-        if (n < (int)sizeof(jbyte)) {
-            RETURN_RECV_ERROR(n);
-        }
+        packet->type.cmd.cmdSet = header[9];
+        packet->type.cmd.cmd = header[10];
     }
 
     data_len = length - ((sizeof(jint) * 2) + (sizeof(jbyte) * 3));
@@ -721,6 +1017,63 @@ socketTransport_getLastError(jdwpTransportEnv* env, char** msgP) {
     return JDWPTRANSPORT_ERROR_NONE;
 }
 
+/*
+ * ANDROID-CHANGED: Optional transport extensions, see jdwpTransport.h
+ */
+JNIEXPORT jdwpTransportError JNICALL
+jdwpTransport_SetBatching(jdwpTransportEnv* env, jboolean on)
+{
+    if (on && outputBuffer == NULL) {
+        outputBuffer = (*callback->alloc)(OUTPUT_BUFFER_SIZE);
+        if (outputBuffer == NULL) {
+            RETURN_ERROR(JDWPTRANSPORT_ERROR_OUT_OF_MEMORY, "out of memory");
+        }
+    }
+    batching = on;
+    if (!on) {
+        return flushOutput();
+    }
+    return JDWPTRANSPORT_ERROR_NONE;
+}
+
+JNIEXPORT jdwpTransportError JNICALL
+jdwpTransport_GetStats(jdwpTransportEnv* env, jdwpTransportStats* stats)
+{
+    if (stats == NULL) {
+        RETURN_ERROR(JDWPTRANSPORT_ERROR_ILLEGAL_ARGUMENT, "stats is NULL");
+    }
+    stats->bytesSent = atomic_load(&bytesSent);
+    stats->bytesReceived = atomic_load(&bytesReceived);
+    stats->packetsSent = atomic_load(&packetsSent);
+    stats->packetsReceived = atomic_load(&packetsReceived);
+    stats->sendCalls = atomic_load(&sendCalls);
+    stats->recvCalls = atomic_load(&recvCalls);
+    stats->flushes = atomic_load(&flushes);
+    stats->sendBufferSize = -1;
+    stats->receiveBufferSize = -1;
+    if (socketFD >= 0) {
+        jint size;
+
+        if (dbgsysGetSocketBufferSize(socketFD, SO_SNDBUF, &size) == 0) {
+            stats->sendBufferSize = size;
+        }
+        if (dbgsysGetSocketBufferSize(socketFD, SO_RCVBUF, &size) == 0) {
+            stats->receiveBufferSize = size;
+        }
+    }
+    return JDWPTRANSPORT_ERROR_NONE;
+}
+
+JNIEXPORT jdwpTransportError JNICALL
+jdwpTransport_SetBufferSize(jdwpTransportEnv* env, jint size)
+{
+    if (size < 0) {
+        RETURN_ERROR(JDWPTRANSPORT_ERROR_ILLEGAL_ARGUMENT, "negative buffer size");
+    }
+    bufferSize = size;
+    return JDWPTRANSPORT_ERROR_NONE;
+}
+
 JNIEXPORT jint JNICALL
 jdwpTransport_OnLoad(JavaVM *vm, jdwpTransportCallback* cbTablePtr,
                      jint version, jdwpTransportEnv** result)
@@ -34,6 +34,7 @@
 
 #define DBG_EINPROGRESS         -150
 #define DBG_ETIMEOUT            -200
+#define DBG_EWOULDBLOCK         -250
 #ifdef WIN32
 typedef int socklen_t;
 #endif
@@ -51,6 +52,8 @@ struct hostent *dbgsysGetHostByName(char *hostname);
 int dbgsysSocket(int domain, int type, int protocol);
 int dbgsysBind(int fd, struct sockaddr *name, socklen_t namelen);
 int dbgsysSetSocketOption(int fd, jint cmd, jboolean on, jvalue value);
+/* ANDROID-CHANGED: Effective SO_SNDBUF or SO_RCVBUF size */
+int dbgsysGetSocketBufferSize(int fd, jint cmd, jint *size);
 uint32_t dbgsysInetAddr(const char* cp);
 uint32_t dbgsysHostToNetworkLong(uint32_t hostlong);
 unsigned short dbgsysHostToNetworkShort(unsigned short hostshort);
@@ -60,6 +63,19 @@ int dbgsysGetSocketName(int fd, struct sockaddr *him, socklen_t *len);
 int dbgsysConfigureBlocking(int fd, jboolean blocking);
 int dbgsysPoll(int fd, jboolean rd, jboolean wr, long timeout);
 int dbgsysGetLastIOError(char *buf, jint size);
+
+/*
+ * ANDROID-CHANGED: Readiness notification for a set of descriptors.
+ * dbgsysPollSetCreate returns -1 if this is not supported, in which
+ * case callers fall back to dbgsysPoll on a single descriptor.
+ * dbgsysPollSetWait stores up to maxFds ready descriptors in fds and
+ * returns their count, 0 on timeout (or interruption) and -1 on error.
+ */
+int dbgsysPollSetCreate();
+int dbgsysPollSetAdd(int set, int fd);
+int dbgsysPollSetRemove(int set, int fd);
+int dbgsysPollSetWait(int set, int *fds, int maxFds, long timeout);
+int dbgsysPollSetClose(int set);
 long dbgsysCurrentTimeMillis();
 
 /*
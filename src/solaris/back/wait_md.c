@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 1998, 2013, Oracle and/or its affiliates. All rights reserved.
+ * DO NOT ALTER OR REMOVE COPYRIGHT NOTICES OR THIS FILE HEADER.
+ *
+ * This code is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 only, as
+ * published by the Free Software Foundation.  Oracle designates this
+ * particular file as subject to the "Classpath" exception as provided
+ * by Oracle in the LICENSE file that accompanied this code.
+ *
+ * This code is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * version 2 for more details (a copy is included in the LICENSE file that
+ * accompanied this code).
+ *
+ * You should have received a copy of the GNU General Public License version
+ * 2 along with this work; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Please contact Oracle, 500 Oracle Parkway, Redwood Shores, CA 94065 USA
+ * or visit www.oracle.com if you need additional information or have any
+ * questions.
+ */
+
+/*
+ * ANDROID-CHANGED: Sleeping on a word of memory, for lightLock.c.
+ * dbgsysWaitOnAddress sleeps while the int at the address still
+ * holds the given value, and may return spuriously. The caller
+ * changes the word before it calls dbgsysWakeOnAddress, which wakes
+ * at most count sleepers. Linux has futexes for this; elsewhere all
+ * sleepers share one condition, which is only slower.
+ */
+
+#include "sys.h"
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+void
+dbgsysWaitOnAddress(int *address, int value)
+{
+    (void)syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, value,
+                  NULL, NULL, 0);
+}
+
+void
+dbgsysWakeOnAddress(int *address, int count)
+{
+    (void)syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count,
+                  NULL, NULL, 0);
+}
+
+#else
+
+#include <pthread.h>
+
+static pthread_mutex_t waitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t waitCondition = PTHREAD_COND_INITIALIZER;
+
+void
+dbgsysWaitOnAddress(int *address, int value)
+{
+    (void)pthread_mutex_lock(&waitMutex);
+    if (__atomic_load_n(address, __ATOMIC_SEQ_CST) == value) {
+        (void)pthread_cond_wait(&waitCondition, &waitMutex);
+    }
+    (void)pthread_mutex_unlock(&waitMutex);
+}
+
+void
+dbgsysWakeOnAddress(int *address, int count)
+{
+    /* Sleepers on other addresses just return spuriously */
+    (void)pthread_mutex_lock(&waitMutex);
+    (void)pthread_cond_broadcast(&waitCondition);
+    (void)pthread_mutex_unlock(&waitMutex);
+}
+
+#endif
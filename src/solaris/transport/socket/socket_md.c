@@ -39,6 +39,9 @@
 #include <pthread.h>
 #include <sys/poll.h>
 #endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 #include "socket_md.h"
 #include "sysSocket.h"
@@ -78,6 +81,10 @@ dbgsysAccept(int fd, struct sockaddr *name, socklen_t *namelen) {
         if (rv >= 0) {
             return rv;
         }
+        /* ANDROID-CHANGED: the pending connection went away (non-blocking fd) */
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return DBG_EWOULDBLOCK;
+        }
         if (errno != ECONNABORTED && errno != EINTR) {
             return rv;
         }
@@ -215,6 +222,13 @@ dbgsysSetSocketOption(int fd, jint cmd, jboolean on, jvalue value)
                        (char *)&buflen, sizeof(buflen)) < 0) {
             return SYS_ERR;
         }
+    } else if (cmd == SO_RCVBUF) {
+        /* ANDROID-CHANGED: for the socketbuffer option */
+        jint buflen = value.i;
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF,
+                       (char *)&buflen, sizeof(buflen)) < 0) {
+            return SYS_ERR;
+        }
     } else if (cmd == SO_REUSEADDR) {
         int oni = (int)on;
         if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
@@ -228,6 +242,26 @@ dbgsysSetSocketOption(int fd, jint cmd, jboolean on, jvalue value)
     return SYS_OK;
 }
 
+/*
+ * ANDROID-CHANGED: The size the kernel uses for SO_SNDBUF or SO_RCVBUF,
+ * which may differ from the size set.
+ */
+int
+dbgsysGetSocketBufferSize(int fd, jint cmd, jint *size)
+{
+    int buflen;
+    socklen_t len = sizeof(buflen);
+
+    if (cmd != SO_SNDBUF && cmd != SO_RCVBUF) {
+        return SYS_ERR;
+    }
+    if (getsockopt(fd, SOL_SOCKET, cmd, (char *)&buflen, &len) < 0) {
+        return SYS_ERR;
+    }
+    *size = (jint)buflen;
+    return SYS_OK;
+}
+
 int
 dbgsysConfigureBlocking(int fd, jboolean blocking) {
     int flags = fcntl(fd, F_GETFL);
@@ -269,6 +303,88 @@ dbgsysPoll(int fd, jboolean rd, jboolean wr, long timeout) {
     return rv;
 }
 
+#ifdef __linux__
+
+#define MAX_POLLSET_EVENTS 32
+
+int
+dbgsysPollSetCreate() {
+    return epoll_create1(EPOLL_CLOEXEC);
+}
+
+int
+dbgsysPollSetAdd(int set, int fd) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    return epoll_ctl(set, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int
+dbgsysPollSetRemove(int set, int fd) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    return epoll_ctl(set, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int
+dbgsysPollSetWait(int set, int *fds, int maxFds, long timeout) {
+    struct epoll_event events[MAX_POLLSET_EVENTS];
+    int rv;
+    int i;
+
+    if (maxFds > MAX_POLLSET_EVENTS) {
+        maxFds = MAX_POLLSET_EVENTS;
+    }
+    rv = epoll_wait(set, events, maxFds, (int)timeout);
+    if (rv < 0) {
+        /* Let the caller recompute its timeout */
+        return (errno == EINTR) ? 0 : rv;
+    }
+    for (i = 0; i < rv; i++) {
+        /* Errors and hangups are reported as readable; recv will tell */
+        fds[i] = events[i].data.fd;
+    }
+    return rv;
+}
+
+int
+dbgsysPollSetClose(int set) {
+    return dbgsysSocketClose(set);
+}
+
+#else
+
+int
+dbgsysPollSetCreate() {
+    return -1;
+}
+
+int
+dbgsysPollSetAdd(int set, int fd) {
+    return -1;
+}
+
+int
+dbgsysPollSetRemove(int set, int fd) {
+    return -1;
+}
+
+int
+dbgsysPollSetWait(int set, int *fds, int maxFds, long timeout) {
+    return -1;
+}
+
+int
+dbgsysPollSetClose(int set) {
+    return -1;
+}
+
+#endif
+
 int
 dbgsysGetLastIOError(char *buf, jint size) {
     char *msg = strerror(errno);